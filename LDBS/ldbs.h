@@ -56,9 +56,7 @@
 /* All blocks in the block store are referenced by a 32-bit LDBLOCKID. For a 
  * file that's persisted on disk, this is an offset in the backing file.
  * A temporary store may be implemented in terms of malloc() and free(),
- * in which case its LDBLOCKIDs may be typecast pointers (on a 16- or 32-bit
- * system) or mapped to pointers using a lookup table
- * (on a system with larger pointers).
+ * in which case its LDBLOCKIDs are indices into a table of pointers.
  *
  * If long is larger than 32 bits that's fine, as long as the value it
  * contains never exceeds 2^31 .
@@ -91,6 +89,8 @@ typedef unsigned char dsk_gap_t;        /* Gap length */
 # define DSK_ERR_NOTME    (-5)   /* File is not in correct format */
 # define DSK_ERR_SYSERR   (-6)   /* System error, use errno */
 # define DSK_ERR_NOMEM    (-7)   /* Null return from malloc */
+# define DSK_ERR_NOTIMPL  (-8)   /* Function not implemented */
+# define DSK_ERR_RDONLY   (-11)  /* Read-only disc */
 # define DSK_ERR_NOADDR   (-15)  /* Missing address mark */
 # define DSK_ERR_OVERRUN  (-21)	 /* Overrun */
 # define DSK_ERR_CORRUPT  (-32)	 /* Disk image is corrupt */
@@ -416,6 +416,40 @@ dsk_err_t ldbs_getblock(PLDBS self, LDBLOCKID blockid, char type[4],
 dsk_err_t ldbs_getblock_a(PLDBS self, LDBLOCKID blockid, char *type,
 				void **data, size_t *len);
 
+/* ldbs_getblock_p: Get a pointer to a block in the store, without copying
+ *                  it. This can be done if the blockstore is held in 
+ *                  memory, or is a file opened read-only on a system 
+ *                  where LDBS can map it into memory. 
+ *
+ * Enter with: self    is the handle to the blockstore
+ *             blockid is the block to retrieve
+ *	       type    buffer to be populated with the block type, can be
+ *	       	       NULL if you don't care.
+ *             data    the address of a pointer, which will be set to point
+ *                     at the block data
+ *             *len    the address of a size_t that will be set to block length
+ *
+ * On success:
+ * 		Returns DSK_ERR_OK
+ * 		Populates *data with a pointer to the data. This belongs to
+ * 			  the blockstore and must not be written to or freed.
+ * 			  It remains valid until the block is changed or 
+ * 			  deleted, or the blockstore is closed.
+ * 		Populates *len with actual block length
+ * 		Populates type with the block type
+ *
+ * Other errors:
+ * 		DSK_ERR_NOTIMPL	The block can't be accessed directly; use 
+ * 				ldbs_getblock() or ldbs_getblock_a() instead.
+ * 		DSK_ERR_BADPTR	'self', 'data' or 'len' pointer is NULL
+ * 		DSK_ERR_BADPARM	blockid is LDBLOCKID_NULL
+ *		DSK_ERR_CORRUPT file is corrupt (block header not where it
+ *				should be, or block runs past the end of file)
+ * 		DSK_ERR_SYSERR  I/O error
+ */
+dsk_err_t ldbs_getblock_p(PLDBS self, LDBLOCKID blockid, char *type,
+				const void **data, size_t *len);
+
 /* ldbs_putblock: Write a block to the store. This covers:
  *   - Adding a new block
  *   - Updating an existing block
@@ -673,6 +707,19 @@ LDBS_TRACKHEAD *ldbs_trackhead_alloc(unsigned entries);
 /* Resize a track header structure */
 LDBS_TRACKHEAD *ldbs_trackhead_realloc(LDBS_TRACKHEAD *p, unsigned short entries);
 
+/* ldbs_trackhead_reuse: As ldbs_trackhead_alloc(), but reuses the track 
+ * header most recently passed to ldbs_trackhead_release() if it has room 
+ * for enough entries. 
+ *
+ * ldbs_trackhead_release: Finish with a track header, letting the 
+ * blockstore keep it for reuse. Any header that can be freed with 
+ * ldbs_free() can be passed in, including those returned by 
+ * ldbs_get_trackhead(). Headers it does not keep are freed; the one it
+ * keeps is freed by ldbs_close().
+ */
+LDBS_TRACKHEAD *ldbs_trackhead_reuse(PLDBS self, unsigned entries);
+void ldbs_trackhead_release(PLDBS self, LDBS_TRACKHEAD *trkh);
+
 /* ldbs_trackdir_add: Add / update an entry in the specified track directory
  * 		      structure. 
  *
@@ -824,7 +871,9 @@ dsk_err_t ldbs_put_dpb(PLDBS self, const LDBS_DPB *dpb);
  * 		DSK_ERR_OK	Success
  * 		                If the requested track header is present in
  *                              the blockstore, trkh now points to it. Free
- *                              trkh with ldbs_free() when it is not required.
+ *                              trkh with ldbs_free() or 
+ *                              ldbs_trackhead_release() when it is not 
+ *                              required.
  * 				If it is not present in the file, trkh will
  *                              be NULL.
  * 		DSK_ERR_NOTME   File does not contain a track directory
@@ -976,6 +1025,10 @@ dsk_err_t ldbs_all_sectors(PLDBS self, LDBS_SECTOR_CALLBACK cbk,
  *                image is -- for example, can it be represented by a 
  *                'flat' format with no metadata?
  *
+ *                The figures come from a summary of each track that is
+ *                kept in memory and updated by ldbs_put_trackhead(), so 
+ *                each track header is only read the first time.
+ *
  * Enter with: self    is the handle to the blockstore
  *             stats   is the structure to populate
  *
@@ -1042,6 +1095,44 @@ dsk_err_t ldbs_clone(PLDBS source, PLDBS target);
 /* LDBS 0.2: Write back any memory buffers associated with this blockstore */
 dsk_err_t ldbs_sync(PLDBS self);
 
+/* Rewrite a blockstore file so that it has no free space, with the blocks
+ * of a disc image laid out in track order (as ldbs_clone() does). The 
+ * compacted copy is built in a new file, with the original's permissions,
+ * which then replaces it; 'self' remains open on it. An in-memory
+ * blockstore is left as it is. If the file cannot be reopened once it has
+ * been replaced, every other call on 'self' will fail with DSK_ERR_SYSERR,
+ * and it should be passed to ldbs_close().
+ *
+ * Results:
+ * 		DSK_ERR_OK	Success
+ * 		DSK_ERR_BADPTR	'self' is NULL
+ * 		DSK_ERR_RDONLY	The blockstore file cannot be written
+ * 		DSK_ERR_NOMEM   Cannot allocate memory
+ * 		DSK_ERR_SYSERR  I/O error
+ */
+dsk_err_t ldbs_compact(PLDBS self);
+
+/* Sector deduplication. When this is on, ldbs_putblock() checks each new 
+ * sector block (one whose type begins with 'S') against the sector blocks
+ * already in the store, and if the contents are identical it returns the
+ * ID of the existing block rather than adding another. 
+ *
+ * Once a block is shared, the file's type becomes LDBS_DSK_TYPE_SHARED, 
+ * so that LDBS implementations that don't expect shared blocks will not
+ * open it (and overwrite a shared block as if only one sector used it).
+ *
+ * In a file of that type, whether deduplication is on or not, sector 
+ * blocks are reference-counted: ldbs_delblock() on a sector block that 
+ * other sectors are using just drops the reference, and ldbs_putblock() 
+ * on such a block leaves it alone and allocates a new one (so *blockid 
+ * will change). ldbs_clone() preserves the sharing. In any other file, 
+ * each sector block is taken to have one user.
+ *
+ * The setting is not saved in the file, and defaults to off.
+ */
+dsk_err_t ldbs_set_dedup(PLDBS self, int enable);
+int ldbs_get_dedup(PLDBS self);
+
 
 
 /* Magic numbers */
@@ -1051,6 +1142,9 @@ dsk_err_t ldbs_sync(PLDBS self);
 /* File types */
 #define LDBS_DSK_TYPE        "DSK\2"
 #define LDBS_DSK_TYPE_V1     "DSK\1"
+/* As LDBS_DSK_TYPE, but some sector blocks are used by more than one 
+ * sector. Files only get this type once a block is actually shared. */
+#define LDBS_DSK_TYPE_SHARED "DSK\3"
 
 /* Block types */
 #define LDBS_DIR_TYPE        "DIR\1"
@@ -1061,8 +1155,8 @@ dsk_err_t ldbs_sync(PLDBS self);
 
 /* Helper functions to store / retrieve 16- and 32-bit little-endian values */
 void ldbs_poke4(unsigned char *dest, unsigned long val);
-unsigned long ldbs_peek4(unsigned char *src);
+unsigned long ldbs_peek4(const unsigned char *src);
 
 void ldbs_poke2(unsigned char *dest, unsigned short val);
-unsigned short ldbs_peek2(unsigned char *src);
+unsigned short ldbs_peek2(const unsigned char *src);
 
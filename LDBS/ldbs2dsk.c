@@ -259,7 +259,8 @@ int convert_file(const char *filename)
 
 	if (verbose) printf("%s opened.\n", filename);
 
-	if (memcmp(type, LDBS_DSK_TYPE, 4))
+	if (memcmp(type, LDBS_DSK_TYPE, 4) && 
+	    memcmp(type, LDBS_DSK_TYPE_SHARED, 4))
 	{
 		ldbs_close(&infile);
 		return DSK_ERR_NOTME;
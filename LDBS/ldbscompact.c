@@ -0,0 +1,97 @@
+/* LDBS: LibDsk Block Store access functions
+ *
+ *  Copyright (c) 2016-17 John Elliott <seasip.webmaster@gmail.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR 
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR 
+ * OTHER DEALINGS IN THE SOFTWARE. */
+
+/* LDBS example software: 
+ * Test wrapper for the ldbs_compact() function, which rewrites an LDBS 
+ * blockstore without its free space and with its tracks in order.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ldbs.h"
+
+void diewith(const char *s, dsk_err_t err)
+{
+	switch (err)
+	{
+		case DSK_ERR_OK:
+			break;
+		case DSK_ERR_NOTME: 
+			fprintf(stderr, "%s: File is not in LDBS disk format\n", s); 
+			break;
+		case DSK_ERR_RDONLY: 
+			fprintf(stderr, "%s: File is read-only\n", s); 
+			break;
+		case DSK_ERR_SYSERR:
+			perror(s);
+			break;
+		case DSK_ERR_NOMEM:
+			fprintf(stderr, "Out of memory\n");
+			break;
+		default:
+			fprintf(stderr, "%s: LibDsk error %d\n", 
+				s, err);
+			break;
+	}
+	exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+	int ro, n;
+	dsk_err_t err;
+	PLDBS store;
+	char type[4];
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "%s: Syntax is %s file file ...\n",
+				argv[0], argv[0]);
+		exit(1);
+	}
+	for (n = 1; n < argc; n++)
+	{
+		ro = 0;
+		err = ldbs_open(&store, argv[n], type, &ro);
+		if (err) diewith(argv[n], err);
+
+		if (memcmp(type, LDBS_DSK_TYPE, 4) &&
+		    memcmp(type, LDBS_DSK_TYPE_V1, 4) &&
+		    memcmp(type, LDBS_DSK_TYPE_SHARED, 4))
+		{
+			ldbs_close(&store);
+			diewith(argv[n], DSK_ERR_NOTME);
+		}
+		err = ldbs_compact(store);
+		if (err)
+		{
+			ldbs_close(&store);
+			diewith(argv[n], err);
+		}
+		err = ldbs_close(&store);
+		if (err) diewith(argv[n], err);
+	}
+	return 0;
+}
@@ -309,7 +309,8 @@ void dump_file(const char *filename)
 
 	if (raw == 0 && peek4(header + 16) &&
 		(!memcmp(header + 4, "DSK\1", 4) ||
-		 !memcmp(header + 4, "DSK\2", 4)))
+		 !memcmp(header + 4, "DSK\2", 4) ||
+		 !memcmp(header + 4, "DSK\3", 4)))
 	{
 		dump_disk(fp, peek4(header + 16), header[7]);
 	}
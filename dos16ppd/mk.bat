@@ -41,6 +41,7 @@ if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/drvmyz80.c
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/drvgotek.c
+%CC% %CFLAGS% -c ../lib/drvovly.c
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/drvjv3.c
 if errorlevel 1 goto abort
@@ -71,6 +72,10 @@ if errorlevel 1 goto abort
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/dskcopy.c
 if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskdiff.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskhash.c
+if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/dskdirty.c
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/dskerror.c
@@ -81,6 +86,20 @@ if errorlevel 1 goto abort
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/dskiconv.c
 if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskgcach.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskpool.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskfbuf.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskperf.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dsktrace.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskfill.c
+if errorlevel 1 goto abort
+%CC% %CFLAGS% -c ../lib/dskrun.c
+if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/dsklphys.c
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../lib/dskopen.c
@@ -166,6 +185,7 @@ if errorlevel 1 goto abort
 libr r libdsk.lib drvjv3.obj
 if errorlevel 1 goto abort
 libr r libdsk.lib drvgotek.obj
+libr r libdsk.lib drvovly.obj
 if errorlevel 1 goto abort
 libr r libdsk.lib drvlogi.obj
 if errorlevel 1 goto abort
@@ -193,6 +213,10 @@ libr r libdsk.lib dskcmt.obj
 if errorlevel 1 goto abort
 libr r libdsk.lib dskcopy.obj
 if errorlevel 1 goto abort
+libr r libdsk.lib dskdiff.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dskhash.obj
+if errorlevel 1 goto abort
 libr r libdsk.lib dskdirty.obj
 if errorlevel 1 goto abort
 libr r libdsk.lib dskerror.obj
@@ -203,6 +227,20 @@ libr r libdsk.lib dskgeom.obj
 if errorlevel 1 goto abort
 libr r libdsk.lib dskiconv.obj
 if errorlevel 1 goto abort
+libr r libdsk.lib dskgcach.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dskpool.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dskfbuf.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dskperf.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dsktrace.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dskfill.obj
+if errorlevel 1 goto abort
+libr r libdsk.lib dskrun.obj
+if errorlevel 1 goto abort
 libr r libdsk.lib dsklphys.obj
 if errorlevel 1 goto abort
 libr r libdsk.lib dskopen.obj
@@ -267,6 +305,8 @@ if errorlevel 1 goto abort
 if errorlevel 1 goto abort
 %CC% %CFLAGS% ../tools/dskconv.c utilopts.obj formname.obj libdsk.lib
 if errorlevel 1 goto abort
+%CC% %CFLAGS% ../tools/dskdiff.c utilopts.obj formname.obj libdsk.lib
+if errorlevel 1 goto abort
 %CC% %CFLAGS% ../tools/dskform.c bootsec.obj utilopts.obj formname.obj libdsk.lib
 if errorlevel 1 goto abort
 %CC% %CFLAGS% -c ../tools/dsktrans.c 
@@ -256,6 +256,11 @@ LDPUBLIC32 char * LDPUBLIC16 dsk_strerror(/* in */ dsk_err_t err);
 LDPUBLIC32 dsk_err_t  LDPUBLIC16 dg_stdformat(DSK_GEOMETRY *self, dsk_format_t formatid,
 			dsk_cchar_t *name, dsk_cchar_t *desc);
 
+/* Find a standard or custom format by its short name (case-insensitive).
+ * Returns DSK_ERR_BADFMT if there is no format of that name. */
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dg_namedformat(dsk_cchar_t name, 
+			dsk_format_t *formatid);
+
 /* Convert sector size to a physical sector shift as used by the controller.
  * To go the other way, size = 128 << psh  */
 LDPUBLIC32 unsigned char LDPUBLIC16 dsk_get_psh(size_t sector_size);
@@ -412,6 +417,16 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_alform(DSK_PDRIVER self, DSK_GEOMETRY *geom
 /* Probe the geometry of a disc. This will use the boot sector and any
  * information the driver can give. */
 LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_getgeom(DSK_PDRIVER self, DSK_GEOMETRY *geom);
+/* The results of probing disc image files are cached, so that reopening
+ * an unchanged image need not probe it again. By default the cache lasts
+ * for the life of the program (or is kept in the file named by the 
+ * LIBDSK_GEOMCACHE environment variable, if set). dsk_geomcache_file() 
+ * selects a different file to keep it in; pass NULL to keep it in memory 
+ * only. */
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_geomcache_file(const char *filename);
+/* Forget the cached geometry for the named image file, or for all image
+ * files if filename is NULL. */
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_geomcache_invalidate(const char *filename);
 /* Convert various types of boot sector to DSK_GEOMETRY 
  * Return DSK_ERR_OK if successful, else DSK_ERR_BADFMT */
 LDPUBLIC32 dsk_err_t  LDPUBLIC16 dg_dosgeom(DSK_GEOMETRY *self, const unsigned char *bootsect);
@@ -490,10 +505,97 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_option_enum(DSK_PDRIVER self, int idx, char
 LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_set_comment(DSK_PDRIVER self, const char *comment);
 LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_get_comment(DSK_PDRIVER self, char **comment);
 
+/* Get the length of a closed image file, and how much space it actually 
+ * takes up on the host disc. These differ if the file has holes in it
+ * (see the RAW:SPARSE option). */
+LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_get_filesize(const char *filename, 
+		unsigned long *logical, unsigned long *allocated);
+
 /* Set / get the retry count. */
 LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_set_retry(DSK_PDRIVER self, unsigned int count);
 LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_get_retry(DSK_PDRIVER self, unsigned int *count);
 
+/* Per-handle operation statistics. Each call through the dsk_* wrappers
+ * that reaches the driver is counted and timed, along with the RPC packets
+ * sent by remote drivers. Times are in microseconds; ds_hist[n] counts
+ * calls that took from 2^n up to 2^(n+1) microseconds (calls under 1us
+ * go in ds_hist[0], and the last bucket also holds anything slower).
+ * The counters simply wrap if they overflow. */
+#define DSK_OP_READ	 0	/* dsk_pread / dsk_lread */
+#define DSK_OP_WRITE	 1	/* dsk_pwrite / dsk_lwrite */
+#define DSK_OP_FORMAT	 2	/* dsk_pformat / dsk_lformat */
+#define DSK_OP_GETGEOM	 3	/* dsk_getgeom */
+#define DSK_OP_SECID	 4	/* dsk_psecid / dsk_lsecid */
+#define DSK_OP_SEEK	 5	/* dsk_pseek / dsk_lseek */
+#define DSK_OP_STATUS	 6	/* dsk_drive_status */
+#define DSK_OP_XREAD	 7	/* dsk_xread */
+#define DSK_OP_XWRITE	 8	/* dsk_xwrite */
+#define DSK_OP_TREAD	 9	/* dsk_ptread / dsk_ltread */
+#define DSK_OP_XTREAD	10	/* dsk_xtread */
+#define DSK_OP_TRACKIDS	11	/* dsk_ptrackids / dsk_ltrackids */
+#define DSK_OP_RTREAD	12	/* dsk_rtread */
+#define DSK_OP_OPEN	13	/* dsk_open / dsk_creat */
+#define DSK_OP_RPC	14	/* RPC packets sent by a remote driver */
+#define DSK_OP_DECOMP	15	/* Unpacking a compressed image (tracing only) */
+#define DSK_OP_COMP	16	/* Packing a compressed image (tracing only) */
+#define DSK_OP_MAX	17
+
+#define DSK_STATS_BUCKETS 24
+
+typedef struct dsk_opstats
+{
+	unsigned long ds_calls;		/* Number of calls */
+	unsigned long ds_errors;	/* Calls that returned an error */
+	unsigned long ds_retries;	/* Extra attempts made on error */
+	unsigned long ds_bytes;		/* Bytes transferred by good calls */
+	unsigned long ds_total_us;	/* Total time taken */
+	unsigned long ds_max_us;	/* Slowest single call */
+	unsigned long ds_hist[DSK_STATS_BUCKETS];
+} DSK_OPSTATS;
+
+typedef struct dsk_stats
+{
+	DSK_OPSTATS st_op[DSK_OP_MAX];
+} DSK_STATS;
+
+/* Get or clear the statistics for a drive. */
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_get_stats(DSK_PDRIVER self, DSK_STATS *stats);
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_reset_stats(DSK_PDRIVER self);
+/* Name of an operation, eg "read"; NULL if op is out of range */
+LDPUBLIC32 const char * LDPUBLIC16 dsk_op_name(int op);
+
+/* Tracing. If a trace function is registered, it is called at the start
+ * and end of each operation counted above, and around compression and
+ * decompression of image files. Spans nest: a BEGIN is always followed
+ * by a matching END, with any inner spans between them. */
+#define DSK_TRACE_BEGIN	0
+#define DSK_TRACE_END	1
+
+typedef struct dsk_trace_event
+{
+	int te_phase;		/* DSK_TRACE_BEGIN or DSK_TRACE_END */
+	int te_op;		/* DSK_OP_* */
+	DSK_PDRIVER te_drive;	/* Drive, or NULL for compression */
+	const char *te_name;	/* Driver or compression name */
+	long te_cylinder;	/* Location, or -1 if not relevant. */
+	long te_head;		/* Set on both BEGIN and END events */
+	long te_sector;
+	unsigned long te_bytes;	/* Bytes transferred (END only) */
+	dsk_err_t te_err;	/* Result (END only) */
+	unsigned long te_sec;	/* Timestamp. Only differences between */
+	unsigned long te_nsec;	/* timestamps mean anything. */
+} DSK_TRACE_EVENT;
+
+typedef void (*DSK_TRACEFUNC)(const DSK_TRACE_EVENT *event, void *param);
+
+LDPUBLIC32 void LDPUBLIC16 dsk_tracefunc_set(DSK_TRACEFUNC func, void *param);
+LDPUBLIC32 void LDPUBLIC16 dsk_tracefunc_get(DSK_TRACEFUNC *func, void **param);
+
+/* Built-in trace function which writes events to a file in the JSON
+ * format read by Chrome's about:tracing and Perfetto. Pass NULL to
+ * finish the file and stop tracing. */
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_trace_chrome(const char *filename);
+
 /* Get the driver name and description */
 LDPUBLIC32 const char * LDPUBLIC16 dsk_drvname(DSK_PDRIVER self);
 LDPUBLIC32 const char * LDPUBLIC16 dsk_drvdesc(DSK_PDRIVER self);
@@ -521,7 +623,8 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_map_delete(unsigned int index);
 
 /* Copy one entire disk image to another. Currently this can only be done if 
  * both of them are based internally on LDBS; DSK_ERR_NOTIMPL will be returned 
- * otherwise. 
+ * otherwise. Where both drivers support it, the copy is streamed a track at 
+ * a time rather than going through a temporary LDBS store.
  * 
  * geom can be null. If it is not null, it will be used when converting 
  * from file formats that don't specify their own geometry (such as raw)
@@ -529,6 +632,70 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_map_delete(unsigned int index);
 LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_copy(DSK_GEOMETRY *geom, 
 				DSK_PDRIVER source, DSK_PDRIVER dest);
 
+/* Open a copy-on-write overlay on an open drive. Reads come from 'base'
+ * until a track is written to or formatted; from then on that track is 
+ * held in 'deltafile', an LDBS file, and 'base' is left untouched. If
+ * 'deltafile' exists it is reopened, so that earlier changes can be 
+ * picked up again. If it is NULL, the changes are held in a temporary 
+ * file and discarded when the overlay is closed.
+ *
+ * On success, the overlay owns 'base' and closing the overlay closes it.
+ * An overlay can also be opened with dsk_open() or dsk_creat(), on a 
+ * filename of the form "overlay:base,delta".
+ */
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_overlay(DSK_PDRIVER *self,
+				DSK_PDRIVER base, const char *deltafile);
+
+/* Write all the changes held in an overlay back to its base, and empty 
+ * the delta. Tracks whose sector layout has changed are reformatted on 
+ * the base; DSK_ERR_BADFMT is returned if a track with no sectors can't
+ * be written to it. Returns DSK_ERR_NOTIMPL if 'self' is not an overlay. */
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_overlay_commit(DSK_PDRIVER self,
+				const DSK_GEOMETRY *geom);
+
+/* Compare two drives, a track at a time, over the cylinders and heads in 
+ * 'geom'. If 'deltafile' is not NULL, every track of 'second' that differs
+ * from 'first' is saved in it, as an LDBS file; the delta can be applied
+ * to 'first' with dsk_diff_apply(), or opened as an overlay on it. If 
+ * 'func' is not NULL it is called for each track that differs, with the
+ * number of sectors on it that do. 'stats' can be NULL. The delta records
+ * the fingerprint (see dsk_hash()) of 'first', and dsk_diff_apply() returns
+ * DSK_ERR_MISMATCH, changing nothing, if 'self' does not match it. */
+typedef struct dsk_diff_stats
+{
+	unsigned long dd_tracks;	/* Tracks compared */
+	unsigned long dd_tracks_differ;	/* Tracks that differ */
+	unsigned long dd_sectors;	/* Sectors compared */
+	unsigned long dd_sectors_differ;/* Sectors that differ, or are
+					 * only present on one drive */
+} DSK_DIFF_STATS;
+
+typedef void (*DSK_DIFFFUNC)(dsk_pcyl_t cylinder, dsk_phead_t head,
+				dsk_psect_t differ, void *param);
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_diff(DSK_PDRIVER first, 
+				DSK_PDRIVER second, const DSK_GEOMETRY *geom,
+				const char *deltafile, DSK_DIFF_STATS *stats,
+				DSK_DIFFFUNC func, void *param);
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_diff_apply(DSK_PDRIVER self,
+				const DSK_GEOMETRY *geom, 
+				const char *deltafile);
+
+/* Fingerprint the contents of a drive, over the cylinders and heads in
+ * 'geom'. The result is a SHA-256 hash, which depends only on the sector
+ * IDs, data and status read from the drive, not on the image format.
+ * If 'func' is not NULL it is called with the hash of each sector's data
+ * ('sector' points to its ID) and then of each track ('sector' is NULL). */
+#define DSK_HASH_LEN 32
+
+typedef void (*DSK_HASHFUNC)(dsk_pcyl_t cylinder, dsk_phead_t head,
+				const DSK_FORMAT *sector, 
+				const unsigned char *hash, void *param);
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_hash(DSK_PDRIVER self, 
+				const DSK_GEOMETRY *geom, unsigned char *hash,
+				DSK_HASHFUNC func, void *param);
+
 /* Define this to print on the console a trace of all mallocs */
 #undef TRACE_MALLOCS 
 #ifdef TRACE_MALLOCS
@@ -27,9 +27,15 @@
  * 1.3  24 Aug 2013     - Return unused input from blast()
  *                      - Fix test code to correctly report unused input
  *                      - Enable the provision of initial input to blast()
+ *
+ * LibDsk changes:
+ *                      - Decode codes with a table lookup, rather than
+ *                        a bit at a time
+ *                      - Copy matches that don't overlap with memcpy()
  */
 
 #include <stddef.h>             /* for NULL */
+#include <string.h>             /* for memcpy() */
 #include <setjmp.h>             /* for setjmp(), longjmp(), and jmp_buf */
 #include "blast.h"              /* prototype for blast() */
 
@@ -44,7 +50,7 @@ struct state {
     void *inhow;                /* opaque information passed to infun() */
     unsigned char *in;          /* next input location */
     unsigned left;              /* available input at in */
-    int bitbuf;                 /* bit buffer */
+    unsigned long bitbuf;       /* bit buffer */
     int bitcnt;                 /* number of bits in bit buffer */
 
     /* input limit error return state for bits() and decode() */
@@ -59,8 +65,8 @@ struct state {
 };
 
 /*
- * Return need bits from the input stream.  This always leaves less than
- * eight bits in the buffer.  bits() works properly for need == 0.
+ * Return need bits from the input stream.  bits() works properly for
+ * need == 0.
  *
  * Format notes:
  *
@@ -71,7 +77,7 @@ struct state {
  */
 local int bits(struct state *s, int need)
 {
-    int val;            /* bit accumulator */
+    unsigned long val;  /* bit accumulator */
 
     /* load at least need bits into val */
     val = s->bitbuf;
@@ -80,17 +86,44 @@ local int bits(struct state *s, int need)
             s->left = s->infun(s->inhow, &(s->in));
             if (s->left == 0) longjmp(s->env, 1);       /* out of input */
         }
-        val |= (int)(*(s->in)++) << s->bitcnt;          /* load eight bits */
+        val |= (unsigned long)(*(s->in)++) << s->bitcnt; /* load eight bits */
         s->left--;
         s->bitcnt += 8;
     }
 
-    /* drop need bits and update buffer, always zero to seven bits left */
+    /* drop need bits and update buffer */
     s->bitbuf = val >> need;
     s->bitcnt -= need;
 
     /* return need bits, zeroing the bits above that */
-    return val & ((1 << need) - 1);
+    return (int)(val & ((1UL << need) - 1));
+}
+
+/*
+ * Try to have at least need bits in the buffer, so that the next code can be
+ * looked up in a table.  Unlike bits(), running out of input isn't an error
+ * here, since the code may turn out to be shorter than need bits.  No more
+ * input is asked for once there is a whole byte in the buffer, so that any
+ * whole bytes left there at the end came from the current input buffer, and
+ * can be given back.
+ */
+local void peek(struct state *s, int need)
+{
+    unsigned char *next;        /* new input */
+    unsigned len;               /* amount of new input */
+
+    while (s->bitcnt < need) {
+        if (s->left == 0) {
+            if (s->bitcnt >= 8) return;
+            len = s->infun(s->inhow, &next);
+            if (len == 0) return;
+            s->in = next;
+            s->left = len;
+        }
+        s->bitbuf |= (unsigned long)(*(s->in)++) << s->bitcnt;
+        s->left--;
+        s->bitcnt += 8;
+    }
 }
 
 /*
@@ -103,6 +136,8 @@ local int bits(struct state *s, int need)
 struct huffman {
     short *count;       /* number of symbols of each length */
     short *symbol;      /* canonically ordered symbols */
+    short *look;        /* symbol + 256 * length for each possible prefix */
+    int bits;           /* length of those prefixes */
 };
 
 /*
@@ -125,6 +160,10 @@ struct huffman {
  *   code, the last code of the longest length will be all zeros.  To support
  *   this ordering, the bits pulled during decoding are inverted to apply the
  *   more "natural" ordering starting with all zeros and incrementing.
+ *
+ * - Codes of up to h->bits bits are looked up in h->look[], indexed by the
+ *   next h->bits bits of the stream.  Longer codes, and codes at the end of
+ *   the input, are decoded bit by bit.
  */
 local int decode(struct state *s, struct huffman *h)
 {
@@ -133,40 +172,38 @@ local int decode(struct state *s, struct huffman *h)
     int first;          /* first code of length len */
     int count;          /* number of codes of length len */
     int index;          /* index of first code of length len in symbol table */
-    int bitbuf;         /* bits from stream */
-    int left;           /* bits left in next or left to process */
-    short *next;        /* next number of codes */
+    int entry;          /* table entry for the next h->bits bits */
+
+    peek(s, h->bits);
+    entry = h->look[s->bitbuf & ((1U << h->bits) - 1)];
+    len = entry >> 8;
+    if (len != 0 && len <= s->bitcnt) {
+        s->bitbuf >>= len;
+        s->bitcnt -= len;
+        return entry & 0xff;
+    }
 
-    bitbuf = s->bitbuf;
-    left = s->bitcnt;
     code = first = index = 0;
-    len = 1;
-    next = h->count + 1;
-    while (1) {
-        while (left--) {
-            code |= (bitbuf & 1) ^ 1;   /* invert code */
-            bitbuf >>= 1;
-            count = *next++;
-            if (code < first + count) { /* if length len, return symbol */
-                s->bitbuf = bitbuf;
-                s->bitcnt = (s->bitcnt - len) & 7;
-                return h->symbol[index + (code - first)];
+    for (len = 1; len <= MAXBITS; len++) {
+        if (s->bitcnt == 0) {
+            if (s->left == 0) {
+                s->left = s->infun(s->inhow, &(s->in));
+                if (s->left == 0) longjmp(s->env, 1);   /* out of input */
             }
-            index += count;             /* else update for next length */
-            first += count;
-            first <<= 1;
-            code <<= 1;
-            len++;
-        }
-        left = (MAXBITS+1) - len;
-        if (left == 0) break;
-        if (s->left == 0) {
-            s->left = s->infun(s->inhow, &(s->in));
-            if (s->left == 0) longjmp(s->env, 1);       /* out of input */
+            s->bitbuf = *(s->in)++;
+            s->left--;
+            s->bitcnt = 8;
         }
-        bitbuf = *(s->in)++;
-        s->left--;
-        if (left > 8) left = 8;
+        code |= (s->bitbuf & 1) ^ 1;    /* invert code */
+        s->bitbuf >>= 1;
+        s->bitcnt--;
+        count = h->count[len];
+        if (code < first + count)       /* if length len, return symbol */
+            return h->symbol[index + (code - first)];
+        index += count;                 /* else update for next length */
+        first += count;
+        first <<= 1;
+        code <<= 1;
     }
     return -9;                          /* ran out of codes */
 }
@@ -186,13 +223,15 @@ local int decode(struct state *s, struct huffman *h)
  * possible for decode() using that table to return an error--any stream of
  * enough bits will resolve to a symbol.  If the return value is positive, then
  * it is possible for decode() using that table to return an error for received
- * codes past the end of the incomplete lengths.
+ * codes past the end of the incomplete lengths.  The lookup table for codes
+ * of eight bits or less is only built if the return value is not negative.
  */
 local int construct(struct huffman *h, const unsigned char *rep, int n)
 {
     int symbol;         /* current symbol when stepping through length[] */
     int len;            /* current length when stepping through h->count[] */
     int left;           /* number of possible codes left of current length */
+    int code, first, index, bits;       /* for building h->look[] */
     short offs[MAXBITS+1];      /* offsets in symbol table for each length */
     short length[256];  /* code lengths */
 
@@ -211,6 +250,8 @@ local int construct(struct huffman *h, const unsigned char *rep, int n)
     /* count number of codes of each length */
     for (len = 0; len <= MAXBITS; len++)
         h->count[len] = 0;
+    for (bits = 0; bits < (1 << h->bits); bits++)
+        h->look[bits] = 0;
     for (symbol = 0; symbol < n; symbol++)
         (h->count[length[symbol]])++;   /* assumes lengths are within bounds */
     if (h->count[0] == n)               /* no codes! */
@@ -237,6 +278,25 @@ local int construct(struct huffman *h, const unsigned char *rep, int n)
         if (length[symbol] != 0)
             h->symbol[offs[length[symbol]]++] = symbol;
 
+    /*
+     * for each possible h->bits bits of input, run decode() on them and record
+     * the symbol and length of any code found.  Zero means no code was.
+     */
+    for (bits = 0; bits < (1 << h->bits); bits++) {
+        code = first = index = 0;
+        for (len = 1; len <= h->bits; len++) {
+            code |= ((bits >> (len - 1)) & 1) ^ 1;
+            if (code < first + h->count[len]) {
+                h->look[bits] = (len << 8) + h->symbol[index + (code - first)];
+                break;
+            }
+            index += h->count[len];
+            first += h->count[len];
+            first <<= 1;
+            code <<= 1;
+        }
+    }
+
     /* return zero for complete set, positive for incomplete set */
     return left;
 }
@@ -292,9 +352,12 @@ local int decomp(struct state *s)
     static short litcnt[MAXBITS+1], litsym[256];        /* litcode memory */
     static short lencnt[MAXBITS+1], lensym[16];         /* lencode memory */
     static short distcnt[MAXBITS+1], distsym[64];       /* distcode memory */
-    static struct huffman litcode = {litcnt, litsym};   /* length code */
-    static struct huffman lencode = {lencnt, lensym};   /* length code */
-    static struct huffman distcode = {distcnt, distsym};/* distance code */
+    static short litlook[1 << MAXBITS];                 /* litcode lookup */
+    static short lenlook[1 << 7];                       /* lencode lookup */
+    static short distlook[1 << 8];                      /* distcode lookup */
+    static struct huffman litcode = {litcnt, litsym, litlook, MAXBITS};
+    static struct huffman lencode = {lencnt, lensym, lenlook, 7};
+    static struct huffman distcode = {distcnt, distsym, distlook, 8};
         /* bit lengths of literal codes */
     static const unsigned char litlen[] = {
         11, 124, 8, 7, 28, 7, 188, 13, 76, 4, 10, 8, 12, 10, 12, 10, 8, 23, 8,
@@ -355,7 +418,9 @@ local int decomp(struct state *s)
                 if (copy > len) copy = len;
                 len -= copy;
                 s->next += copy;
-                do {
+                if (from + copy <= to || to + copy <= from)  /* no overlap */
+                    memcpy(to, from, copy);
+                else do {
                     *to++ = *from++;
                 } while (--copy);
                 if (s->next == MAXWIN) {
@@ -410,6 +475,13 @@ int blast(blast_in infun, void *inhow, blast_out outfun, void *outhow,
     else
         err = decomp(&s);               /* decompress */
 
+    /* whole bytes may be left in the bit buffer by peek(); give them back */
+    while (s.bitcnt >= 8) {
+        s.in--;
+        s.left++;
+        s.bitcnt -= 8;
+    }
+
     /* return unused input */
     if (left != NULL)
         *left = s.left;
@@ -80,7 +80,9 @@ static dsk_err_t comp_iopen(COMPRESS_DATA **cd, const char *filename, int nc)
             dsk_free(s);
         }
         else    dsk_report("Checking compression...");
+        dsk_trace_begin(NULL, cc->cc_name, DSK_OP_DECOMP, -1, -1, -1);
         err = (cc->cc_open)(*cd);
+        dsk_trace_end(NULL, cc->cc_name, DSK_OP_DECOMP, -1, -1, -1, err, 0);
         dsk_report_end();
     }
         if (err == DSK_ERR_OK) return err;
@@ -191,7 +193,9 @@ dsk_err_t comp_commit(COMPRESS_DATA **self)
     if (!self || (!(*self)) || (!(*self)->cd_class))    return DSK_ERR_BADPTR;
 
     dsk_report("Compressing...");
+    dsk_trace_begin(NULL, comp_name(*self), DSK_OP_COMP, -1, -1, -1);
     e = ((*self)->cd_class->cc_commit)(*self);
+    dsk_trace_end(NULL, comp_name(*self), DSK_OP_COMP, -1, -1, -1, e, 0);
     dsk_report_end();
 
     if ((*self)->cd_ufilename) remove((*self)->cd_ufilename);
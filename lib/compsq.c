@@ -325,7 +325,8 @@ static dsk_err_t huf_encode(SQ_COMPRESS_DATA *self, int ch)
 
 static dsk_err_t compress(SQ_COMPRESS_DATA *self)
 {
-	char *s = self->sq_truename;
+	/* An image that was opened rather than created has no name to hand */
+	char *s = self->sq_truename ? self->sq_truename : "";
 	dsk_err_t e;
 	unsigned short dictbase;
 	unsigned short dictlen;
@@ -392,11 +393,14 @@ static dsk_err_t squeeze(SQ_COMPRESS_DATA *self)
 
 static dsk_err_t readc(SQ_COMPRESS_DATA *self, unsigned char *c)
 {
-	int i;
-
-	i = fgetc(self->fp_in); 
-	if (i == EOF) return DSK_ERR_SYSERR;
-	*c = i;
+	if (self->sq_inpos >= self->sq_inlen)
+	{
+		self->sq_inpos = 0;
+		self->sq_inlen = fread(self->sq_inbuf, 1, 
+					sizeof(self->sq_inbuf), self->fp_in);
+		if (!self->sq_inlen) return DSK_ERR_SYSERR;
+	}
+	*c = self->sq_inbuf[self->sq_inpos++];
 	return DSK_ERR_OK;
 }
 
@@ -427,9 +431,25 @@ static dsk_err_t reads(SQ_COMPRESS_DATA *self, signed short *s)
 	return DSK_ERR_OK;
 }
 
+static dsk_err_t flushout(SQ_COMPRESS_DATA *self)
+{
+	if (self->sq_outlen && fwrite(self->sq_outbuf, 1, self->sq_outlen, 
+					self->fp_out) < self->sq_outlen)
+		return DSK_ERR_SYSERR;
+	self->sq_outlen = 0;
+	return DSK_ERR_OK;
+}
+
 static dsk_err_t ckputc(SQ_COMPRESS_DATA *self, unsigned char b)
 {
-	if (fputc(b, self->fp_out) == EOF) return DSK_ERR_SYSERR;
+	dsk_err_t err;
+
+	if (self->sq_outlen >= sizeof(self->sq_outbuf))
+	{
+		err = flushout(self);
+		if (err) return err;
+	}
+	self->sq_outbuf[self->sq_outlen++] = b;
 	self->ck_sum += b;
 	return DSK_ERR_OK;
 }
@@ -482,6 +502,47 @@ static dsk_err_t wrbyte(SQ_COMPRESS_DATA *self, unsigned char b)
 
 
 
+/* Build the lookup table for the first 8 bits of each code. Since nodes 
+ * are followed without any bounds checks after this, check that they all
+ * point within the dictionary. */
+static dsk_err_t huf_lookup(SQ_COMPRESS_DATA *self, unsigned short dictlen)
+{
+	unsigned short nd, node;
+	signed short code;
+	int bits, nbit;
+
+	for (nd = 0; nd < dictlen; nd++)
+	{
+		if (self->huf_node[nd].left  >= (signed short)dictlen ||
+		    self->huf_node[nd].right >= (signed short)dictlen)
+			return DSK_ERR_COMPRESS;
+	}
+	for (bits = 0; bits < 256; bits++)
+	{
+		node = 0;
+		code = 0;
+		for (nbit = 0; nbit < 8; nbit++)
+		{
+			if (bits & st_masks[nbit]) code = self->huf_node[node].right;
+			else			   code = self->huf_node[node].left;
+			if (code < 0) break;
+			node = code;
+		}
+		if (code < 0)
+		{
+			self->huf_look[bits] = code;
+			self->huf_lookbits[bits] = nbit + 1;
+		}
+		else
+		{
+			self->huf_look[bits] = node;
+			self->huf_lookbits[bits] = 8;
+		}
+	}
+	return DSK_ERR_OK;
+}
+
+
 static dsk_err_t unsqueeze(SQ_COMPRESS_DATA *self)
 {
 	dsk_err_t err;
@@ -489,10 +550,13 @@ static dsk_err_t unsqueeze(SQ_COMPRESS_DATA *self)
 	unsigned char c;
 	unsigned short dictlen;
 	unsigned short nd;
-	unsigned short node;
 	signed short code;
+	unsigned long bitbuf;
+	int bitcnt, nbits;
 	
 	self->ck_sum = 0;
+	self->sq_inlen = self->sq_inpos = 0;
+	self->sq_outlen = 0;
 	err = readu(self, &magic); 
 	if (err) return err;
 	if (magic != MAGIC) return DSK_ERR_COMPRESS;
@@ -515,39 +579,54 @@ static dsk_err_t unsqueeze(SQ_COMPRESS_DATA *self)
 		err = reads(self, &self->huf_node[nd].right); 
 		if (err) return err;
 	}
-	/* Now start decoding data */
-	self->huf_out = 0;
-	self->huf_nout = 8;
-	node = 0;
+	err = huf_lookup(self, dictlen);
+	if (err) return err;
+	/* Now start decoding data. Bits are taken from the bottom of 
+	 * 'bitbuf', which is kept topped up to at least 8 bits as long as
+	 * there is input left. */
+	bitbuf = 0;
+	bitcnt = 0;
 	rle_reset(self);
 /* if dictlen == 0, the file is empty */
 	if (dictlen) while (1)
 	{
-		if (self->huf_nout == 8)
+		while (bitcnt <= 24 && readc(self, &c) == DSK_ERR_OK)
 		{
-			self->huf_nout = 0;
-			err = readc(self, &self->huf_out);
-			if (err) return err;	
+			bitbuf |= ((unsigned long)c) << bitcnt;
+			bitcnt += 8;
 		}
-		code = self->huf_out & st_masks[self->huf_nout];
-		++self->huf_nout;
-		if (code) code = self->huf_node[node].right;
-		else	  code = self->huf_node[node].left;
-
-		if (code < 0)
+		code  = self->huf_look[bitbuf & 0xFF];
+		nbits = self->huf_lookbits[bitbuf & 0xFF];
+		/* Ran out of input in the middle of a code */
+		if (nbits > bitcnt) return DSK_ERR_SYSERR;
+		bitbuf >>= nbits;
+		bitcnt -= nbits;
+		/* Codes longer than 8 bits: follow the rest a bit at a time */
+		while (code >= 0)
 		{
-			if (-1 - code == SQ_EOF) break;	/* Reached EOF */
-			err = wrbyte(self, (unsigned char)(-1 - code));
-			if (err) return err;
-			node = 0;
+			if (!bitcnt)
+			{
+				err = readc(self, &c);
+				if (err) return err;
+				bitbuf = c;
+				bitcnt = 8;
+			}
+			if (bitbuf & 1) code = self->huf_node[code].right;
+			else		code = self->huf_node[code].left;
+			bitbuf >>= 1;
+			--bitcnt;
 		}
-		else node = code;
+		if (-1 - code == SQ_EOF) break;	/* Reached EOF */
+		err = wrbyte(self, (unsigned char)(-1 - code));
+		if (err) return err;
 	}
 	if (self->rle_char != -1)
 	{
 		err = ckputc(self, (unsigned char)(self->rle_char)); if (err) return err;
 
 	}
+	err = flushout(self);
+	if (err) return err;
 	if (checksum != self->ck_sum) return DSK_ERR_COMPRESS;
 	return DSK_ERR_OK;
 }
@@ -588,6 +667,7 @@ dsk_err_t sq_open(COMPRESS_DATA *self)
 	if (err) return DSK_ERR_NOTME;
 
 	/* Check for SQ signature */
+	sq_self->sq_inlen = sq_self->sq_inpos = 0;
 	err = readu(sq_self, &magic);
 	if (err) 	/* v1.1.11 Don't leak file handles */
 	{
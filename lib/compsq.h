@@ -32,6 +32,7 @@
 #define MAXLEAF 0x0101	/* 256 characters + EOF */
 #define MAXNODE 0x0202	/* Total size of tree */
 #define MAGIC 0xFF76	/* SQ file magic */
+#define SQ_BUFSZ 4096	/* Size of decompression buffers */
 
 typedef struct
 {
@@ -70,6 +71,16 @@ typedef struct
 	int huf_nout;
 
 	unsigned short ck_sum;		/* Checksum of source file */
+
+/* Decompression: buffered input and output, and a lookup table giving the
+ * node or leaf reached by following the next 8 bits of input from the 
+ * root of the tree, and how many of those bits it took to get there */
+	unsigned char sq_inbuf[SQ_BUFSZ];
+	unsigned sq_inlen, sq_inpos;
+	unsigned char sq_outbuf[SQ_BUFSZ];
+	unsigned sq_outlen;
+	signed short huf_look[256];
+	unsigned char huf_lookbits[256];
 	
 	FILE *fp_in;
 	FILE *fp_out;
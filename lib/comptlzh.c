@@ -244,56 +244,54 @@ static const unsigned char d_len[256] = {
 };
 
 
-/* this is old code duplicated in GetBit() and GetByte()
-    while (getlen <= 8) {
-        if ((i = getc(infile)) < 0) i = 0;
-        getbuf |= i << (8 - getlen);
-        getlen += 8;
-    }
-
-replace this with next_word() routine that handles block read
-*/
-static int next_word(TLZH_COMPRESS_DATA *self)
+/* The input is read a block at a time into inbuf[], and from there a 
+ * byte at a time into a bit reservoir, which holds up to 8 bits less than
+ * an unsigned long. Codes are then taken from the reservoir without any
+ * function call per bit.
+ *
+ * The old decoder (GetBit() / GetByte() on a 16-bit buffer) gave up on 
+ * any read that found all the input already in its buffer, even if the
+ * buffer had enough bits to satisfy it. Drivers have come to expect the
+ * output that gives, so it is emulated by check_reads() below. */
+#define TLZH_BITS ((int)(8 * sizeof(unsigned long)))
+
+static void fill_bits(TLZH_COMPRESS_DATA *self)
 {
-    if(self->ibufndx >= self->ibufcnt)
+    while (self->bitcnt <= TLZH_BITS - 8)
     {
-        self->ibufndx = 0;
-        self->ibufcnt = fread(self->inbuf,1, TLZH_BUFSZ, self->fp_in);
-        if(self->ibufcnt <= 0)
-            return(-1);
-    }
-    while (self->getlen <= 8) { // typically reads a word at a time
-        self->getbuf |= self->inbuf[self->ibufndx++] << (8 - self->getlen);
-        self->getlen += 8;
+        if (self->ibufndx >= self->ibufcnt)
+        {
+            if (self->ateof) return;
+            self->ibufndx = 0;
+            self->ibufcnt = (unsigned short)fread(self->inbuf, 1, 
+                                       TLZH_BUFSZ, self->fp_in);
+            if (!self->ibufcnt) 
+            {
+                self->ateof = 1;
+                return;
+            }
+        }
+        self->bitbuf = (self->bitbuf << 8) | self->inbuf[self->ibufndx++];
+        self->bitcnt += 8;
+        self->nread++;
     }
-    return(0);
 }
 
-
-static int GetBit(TLZH_COMPRESS_DATA *self)    /* get one bit */
+/* A code is about to be taken whose last two reads (in the old decoder)
+ * would have started at bit positions 'prev1 - 1' and 'last'. 'prev1' 
+ * is 0 if there was no read before 'last'. The old decoder would have 
+ * had (prev + 16) / 8 bytes of input at the start of the last read, and
+ * would have failed unless there was at least one more. Since it got 
+ * this far, the reads before that one must have succeeded. */
+static int check_reads(TLZH_COMPRESS_DATA *self, unsigned long prev1,
+                unsigned long last)
 {
-    short i;
-    if(next_word(self) < 0)
-        return(-1);
-    i = self->getbuf;
-    self->getbuf <<= 1;
-    self->getlen--;
-        if(i < 0)
-        return(1);
-    else
-        return(0);
-}
+    unsigned long need = prev1 ? (prev1 + 15) / 8 : 0;
 
-static int GetByte(TLZH_COMPRESS_DATA *self)    /* get a byte */
-{
-    unsigned short i;
-        if(next_word(self) != 0)
-        return(-1);
-    i = self->getbuf;
-    self->getbuf <<= 8;
-    self->getlen -= 8;
-        i = i >> 8;
-    return((int) i);
+    if (self->nread <= need) fill_bits(self);
+    if (self->nread <= need) return -1;
+    self->lastop = last + 1;
+    return 0;
 }
 
 
@@ -405,22 +403,36 @@ static void update(TLZH_COMPRESS_DATA *self, int c)
 
 static short DecodeChar(TLZH_COMPRESS_DATA *self)
 {
-    int ret;
+    unsigned long bitbuf, start = self->bitpos, n = 0;
+    int bitcnt;
     unsigned short c;
 
-    c = self->son[TLZH_R];
-
-    /*
-     * start searching tree from the root to leaves.
+    /* 
+     * The tree changes after every character, so it can't be turned into
+     * a lookup table; walk it a bit at a time, from the root to a leaf.
      * choose node #(son[]) if input bit == 0
      * else choose #(son[]+1) (input bit == 1)
      */
+    fill_bits(self);
+    bitbuf = self->bitbuf;
+    bitcnt = self->bitcnt;
+    c = self->son[TLZH_R];
     while (c < TLZH_T) {
-                if((ret = GetBit(self)) < 0)
-            return(-1);
-        c += (unsigned) ret;
-        c = self->son[c];
+        if (!bitcnt) {
+            self->bitcnt = 0;
+            fill_bits(self);
+            bitbuf = self->bitbuf;
+            bitcnt = self->bitcnt;
+            if (!bitcnt) return(-1);
+        }
+        c = self->son[c + (unsigned)((bitbuf >> --bitcnt) & 1)];
+        ++n;
     }
+    self->bitcnt = bitcnt;
+    if (check_reads(self, (n > 1) ? start + n - 1 : self->lastop, 
+                start + n - 1))
+        return(-1);
+    self->bitpos += n;
     c -= TLZH_T;
     update(self, c);
     return c;
@@ -428,24 +440,29 @@ static short DecodeChar(TLZH_COMPRESS_DATA *self)
 
 static short DecodePosition(TLZH_COMPRESS_DATA *self)
 {
-    short bit;
-    unsigned short i, j, c;
-
-    /* decode upper 6 bits from given table */
-        if((bit=GetByte(self)) < 0)
+    unsigned long start = self->bitpos, prev1, last;
+    unsigned short i, j;
+
+    /* The upper 6 bits are coded in the first byte, and the length of 
+     * the code tells how many more bits follow to make up the lower 6. 
+     * So read the first byte, look up the length, and then read the 
+     * whole code. */
+    fill_bits(self);
+    if (self->bitcnt < 8) return(-1);
+    i = (unsigned short)(self->bitbuf >> (self->bitcnt - 8)) & 0xFF;
+    j = d_len[i] - 2;
+    if (self->bitcnt < 8 + j) return(-1);
+    i = (unsigned short)(self->bitbuf >> (self->bitcnt - 8 - j)) & 
+                ((1 << (8 + j)) - 1);
+
+    /* In the old decoder, this was one GetByte() and j GetBit()s */
+    last  = j ? start + 8 + j - 1 : start;
+    prev1 = (j > 1) ? last : (j ? start + 1 : self->lastop);
+    if (check_reads(self, prev1, last))
         return(-1);
-    i = (unsigned short) bit;
-    c = (unsigned short)d_code[i] << 6;
-    j = d_len[i];
-
-    /* input lower 6 bits directly */
-    j -= 2;
-    while (j--) {
-                if((bit = GetBit(self)) < 0)
-                     return(-1);
-        i = (i << 1) + bit;
-    }
-    return(c | (i & 0x3f));
+    self->bitcnt -= 8 + j;
+    self->bitpos += 8 + j;
+    return (short)(((unsigned short)d_code[i >> j] << 6) | (i & 0x3f));
 }
 
 /* DeCompression 
@@ -459,6 +476,10 @@ static void init_Decode(TLZH_COMPRESS_DATA *self)
 	int i;
 
 	self->ibufcnt= self->ibufndx = 0; // input buffer is empty
+	self->bitbuf = 0;
+	self->bitcnt = 0;
+	self->ateof  = 0;
+	self->nread  = self->bitpos = self->lastop = 0;
 	self->bufcnt = 0;
 	StartHuff(self);
 	for (i = 0; i < TLZH_N - TLZH_F; i++)
@@ -474,38 +495,48 @@ static int Decode(TLZH_COMPRESS_DATA *self, unsigned char *buf, int len)
 {
     short c,pos;
     int  count;  // was an unsigned long, seems unnecessary
+    unsigned short r = self->r;
+    unsigned char *text_buf = self->text_buf;
+
     for (count = 0; count < len; ) {
             if(self->bufcnt == 0) {
                 if((c = DecodeChar(self)) < 0)
-                    return(count); // fatal error
+                    break; // fatal error
                 if (c < 256) {
                     *(buf++) = (unsigned char)c;
-                    self->text_buf[self->r++] = (unsigned char)c;
-                    self->r &= (TLZH_N - 1);
+                    text_buf[r++] = (unsigned char)c;
+                    r &= (TLZH_N - 1);
                     count++;                
                 } 
                 else {
                     if((pos = DecodePosition(self)) < 0)
-                           return(count); // fatal error
-                    self->bufpos = (self->r - pos - 1) & (TLZH_N - 1);
+                           break; // fatal error
+                    self->bufpos = (r - pos - 1) & (TLZH_N - 1);
                     self->bufcnt = c - 255 + TLZH_THRESHOLD;
                     self->bufndx = 0;
                  }
             }
             else { // still chars from last string
-                while( self->bufndx < self->bufcnt && count < len ) {
-                    c = self->text_buf[(self->bufpos + self->bufndx) & (TLZH_N - 1)];
+                unsigned short ndx = self->bufndx, bpos = self->bufpos;
+                unsigned short cnt = self->bufcnt;
+
+                if (cnt - ndx > len - count) cnt = ndx + (len - count);
+                count += cnt - ndx;
+                while (ndx < cnt) {
+                    c = text_buf[(bpos + ndx) & (TLZH_N - 1)];
                     *(buf++) = (unsigned char)c;
-                    self->bufndx++;
-                    self->text_buf[self->r++] = (unsigned char)c;
-                    self->r &= (TLZH_N - 1);
-                    count++;
+                    ndx++;
+                    text_buf[r++] = (unsigned char)c;
+                    r &= (TLZH_N - 1);
                 }
                 // reset bufcnt after copy string from text_buf[]
-                if(self->bufndx >= self->bufcnt) 
+                if(ndx >= self->bufcnt) 
                     self->bufndx = self->bufcnt = 0;
+                else
+                    self->bufndx = ndx;
         }
     }
+    self->r = r;
     return(count); // count == len, success
 }
 
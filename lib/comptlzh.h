@@ -30,7 +30,7 @@
 /******************************* compsq.h **********************************/
 
 /* Buffer size */
-#define TLZH_BUFSZ 512
+#define TLZH_BUFSZ 4096
 /* LZSS Parameters */
 #define TLZH_N         4096    /* Size of string buffer */
 #define TLZH_F           60    /* Size of look-ahead buffer */
@@ -78,8 +78,15 @@ typedef struct
 /* pointing children nodes (son[], son[] + 1)*/
 	short son[TLZH_T];
 
-	unsigned short getbuf /*= 0*/;
-	unsigned char getlen /*= 0*/;
+/* Bit reservoir: the next 'bitcnt' bits of input are the low bits of 
+ * 'bitbuf', most significant first */
+	unsigned long bitbuf;
+	int bitcnt;
+	int ateof;		/* No more input in the file */
+	unsigned long nread;	/* Bytes taken into the reservoir */
+	unsigned long bitpos;	/* Bits taken out of it */
+	unsigned long lastop;	/* 1 + bitpos at start of the last code read
+				 * by the old decoder, or 0 */
 
 
 
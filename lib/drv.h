@@ -21,6 +21,13 @@
  ***************************************************************************/
 
 struct ldbs;	/* To avoid requiring ldbs.h for all drivers */
+struct ldbs_trackhead;
+
+/* Receives one track during a streamed copy (see dc_to_stream below). This
+ * is the same as an LDBS_TRACK_CALLBACK, so the callbacks drivers already
+ * pass to ldbs_all_tracks() will do. */
+typedef dsk_err_t (*DSK_TRACK_SINK)(struct ldbs *store, dsk_pcyl_t cyl, 
+		dsk_phead_t head, struct ldbs_trackhead *th, void *param);
 
 typedef struct dsk_option
 {
@@ -43,6 +50,10 @@ typedef struct dsk_driver
 	int dr_dirty;		/* Has this device been written to? 
 				 * Set to 1 by writes and formats */
 	unsigned dr_retry_count; /* Number of times to retry if error */	
+	char *dr_filename;	/* Name the image was opened with, if known */
+	struct dsk_poolbuf *dr_pool;	/* Spare scratch buffers (dskpool.c) */
+	unsigned dr_poolcount;	/* Number of buffers in dr_pool */
+	struct dsk_stats *dr_stats;	/* Operation counters (dskperf.c) */
 } DSK_DRIVER;
 
 
@@ -159,6 +170,27 @@ typedef struct drv_class
 
 	/* Convert from LDBS format. */
 	dsk_err_t (*dc_from_ldbs)(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom);
+
+	/* Streamed conversion, used by dsk_copy() to avoid holding the 
+	 * whole disc in a temporary LDBS store. These are only used if 
+	 * provided by the same class as dc_to_ldbs / dc_from_ldbs. */
+
+	/* Export a track at a time. Each track is passed to 'sink' along
+	 * with the store holding its sectors. A driver that reads tracks 
+	 * on the fly puts them in 'store' and removes them again once the 
+	 * sink has returned; one that already has an LDBS store may pass
+	 * that instead. */
+	dsk_err_t (*dc_to_stream)(DSK_DRIVER *self, struct ldbs *store, 
+			DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param);
+
+	/* Get ready to import a track at a time. 'store' holds the metadata
+	 * (geometry, DPB, creator). Returns the sink to pass tracks to; once
+	 * all tracks have been passed, the sink is called one last time with
+	 * a NULL track header, whether or not the export succeeded. Returns 
+	 * DSK_ERR_NOTIMPL if this copy can't be streamed, in which case
+	 * dc_from_ldbs is used instead. */
+	dsk_err_t (*dc_from_stream)(DSK_DRIVER *self, struct ldbs *store, 
+			DSK_GEOMETRY *geom, DSK_TRACK_SINK *sink, void **param);
 } DRV_CLASS;
 
 /* Returns true of drv is an instance of dc. That is, either its driver class
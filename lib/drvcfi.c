@@ -48,24 +48,13 @@ DRV_CLASS dc_cfi =
 	cfi_close,	/* close */
 };
 
-static dsk_err_t cfi_rdword(FILE *fp, unsigned short *s)
-{
-	int c = fgetc(fp);
-	if (c == EOF) return DSK_ERR_SEEKFAIL;
-	*s = (c & 0xFF);
-	c = fgetc(fp);
-	if (c == EOF) return DSK_ERR_SEEKFAIL;
-	*s |= ((c << 8) & 0xFF00);
-	return DSK_ERR_OK;
-}
-
-
 /* Given a compressed buffer, either find its uncompressed length
  * or decompress it */
-static dsk_err_t cfi_uncompress(unsigned char *cdata, unsigned short clen,
+static dsk_err_t cfi_uncompress(const unsigned char *cdata, unsigned short clen,
 				unsigned char *udata, size_t *ulen)
 {
-	unsigned char *cdp, *udp;
+	const unsigned char *cdp;
+	unsigned char *udp;
 	unsigned short blklen;
 
 	cdp = cdata;
@@ -114,10 +103,12 @@ static dsk_err_t cfi_uncompress(unsigned char *cdata, unsigned short clen,
 
 
 
-static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk, FILE *fp)
+static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk, 
+				DSK_FBUF *fb)
 {
 	dsk_err_t err;
-	unsigned char *cbuf, *ubuf;
+	const unsigned char *cbuf;
+	unsigned char *ubuf;
 	unsigned short clen;
 	size_t ulen;
 	LDBS_TRACKHEAD *trkh;
@@ -129,40 +120,29 @@ static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk, FILE *fp
 	
 	/* Load the track (compressed) length. If EOF, then
 	 * return DSK_ERR_OVERRUN (EOF, but OK really) */
-	err = cfi_rdword(fp, &clen);
-	if (err == DSK_ERR_SEEKFAIL) return DSK_ERR_OVERRUN;
+	cbuf = dsk_fbuf_get(fb, 2);
+	if (!cbuf) return DSK_ERR_OVERRUN;
+	clen = ldbs_peek2(cbuf);
 	/* Compressed length must be at least 3; a block can't be any 
 	 * smaller! */
 	if (clen < 3) return DSK_ERR_NOTME;
-	cbuf = dsk_malloc(clen);
-	if (cbuf == NULL) return DSK_ERR_NOMEM;
-	/* Try to load the track buffer. If that fails, bail out */
-	if (fread(cbuf, 1, clen, fp) < clen) 
-	{
-		dsk_free(cbuf);
-		return DSK_ERR_NOTME;	
-	}
+	/* Get the compressed track. If it isn't all there, bail out */
+	cbuf = dsk_fbuf_get(fb, clen);
+	if (!cbuf) return DSK_ERR_NOTME;	
 
 	/* Determine the size of the track */
 	err = cfi_uncompress(cbuf, clen, NULL, &ulen);
-	if (err)
-	{
-		dsk_free(cbuf);
-		return err;
-	}
+	if (err) return err;
+
 	/* Allocate space for the uncompressed data */
 	ubuf = dsk_malloc(ulen);
-	if (!ubuf)
-	{
-		dsk_free(cbuf);
-		return DSK_ERR_NOMEM;
-	}
+	if (!ubuf) return DSK_ERR_NOMEM;
+
 	/* Decompress track */
 	err = cfi_uncompress(cbuf, clen, ubuf, &ulen);
 	if (err)
 	{
 		dsk_free(ubuf);
-		dsk_free(cbuf);
 		return DSK_ERR_NOMEM;
 	}
 	/* CFI files contain no information about geometry, relying on 
@@ -188,9 +168,16 @@ static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk, FILE *fp
 /* Sectors in this track. Should be the same for all tracks, because 
  * that's about all CFI can cope with. */
 	sectors = ulen / self->cfi_geom.dg_secsize;
+	if (sectors > self->cfi_geom.dg_sectors)
+		sectors = self->cfi_geom.dg_sectors;
 
 	/* Now create an LDBS track header */
 	trkh = ldbs_trackhead_alloc(self->cfi_geom.dg_sectors);
+	if (!trkh)
+	{
+		dsk_free(ubuf);
+		return DSK_ERR_NOMEM;
+	}
 	trkh->recmode = self->cfi_geom.dg_fm & RECMODE_MASK;	
 	trkh->gap3    = self->cfi_geom.dg_fmtgap;
 	trkh->filler  = 0xF6;
@@ -231,7 +218,6 @@ static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk, FILE *fp
 	
 	dsk_free(trkh);
 	dsk_free(ubuf);
-	dsk_free(cbuf);
 
 	return err;
 }
@@ -239,19 +225,10 @@ static dsk_err_t cfi_load_track(CFI_DSK_DRIVER *self, dsk_ltrack_t trk, FILE *fp
 
 static int number_same(unsigned char *c, int tlen)
 {
-	unsigned char m = (*c); 
-	int matched = 1;
-
-	while (tlen > 0)
-	{
-		++c;
-		--tlen;
-		if (!tlen) break;
-		if (*c != m) return matched;
-		++matched;	
-		if (matched == 0x7FFF) return matched;
-	}
-	return matched;	
+	/* A run can't be longer than 0x7FFF bytes */
+	if (tlen > 0x7FFF) tlen = 0x7FFF;
+	if (tlen < 1) return 1;
+	return (int)dsk_run_length(c, tlen);
 }
 
 
@@ -347,6 +324,7 @@ static dsk_err_t cfi_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 dsk_err_t cfi_open(DSK_DRIVER *self, const char *filename)
 {
 	FILE *fp;
+	DSK_FBUF fb;
 	CFI_DSK_DRIVER *cfiself;
 	dsk_err_t err;	
 	dsk_ltrack_t nt;
@@ -370,32 +348,42 @@ dsk_err_t cfi_open(DSK_DRIVER *self, const char *filename)
 		fclose(fp);
 		return DSK_ERR_NOMEM;
 	}
+	/* The tracks are parsed from memory */
+	err = dsk_fbuf_open(&fb, fp);
+	if (err)
+	{
+		dsk_free(cfiself->cfi_filename);
+		fclose(fp);
+		return err;
+	}
 	/* Initialise the blockstore */
 	err = ldbs_new(&cfiself->cfi_super.ld_store, NULL, LDBS_DSK_TYPE);
 	if (err)
 	{
 		dsk_free(cfiself->cfi_filename);
+		dsk_fbuf_close(&fb);
 		fclose(fp);
 		return err;
 	}
 	/* Now to load the tracks */
 	nt = 0;
 	dsk_report("Loading CFI file into memory");
-	while (!feof(fp))
+	do
 	{
-		err = cfi_load_track(cfiself, nt++, fp);
-		/* DSK_ERR_OVERRUN: End of file */
-		if (err == DSK_ERR_OVERRUN) break;
-		if (err) 
-		{
-			dsk_free(cfiself->cfi_filename);
-			dsk_report_end();
-			fclose(fp);
-			return err;
-		}
-	} 
+		err = cfi_load_track(cfiself, nt++, &fb);
+	}
+	while (!err);
 	dsk_report_end();
+	dsk_fbuf_close(&fb);
 	fclose(fp);
+	/* DSK_ERR_OVERRUN: End of file */
+	if (err != DSK_ERR_OVERRUN) 
+	{
+		dsk_free(cfiself->cfi_filename);
+		cfiself->cfi_filename = NULL;
+		ldbs_close(&cfiself->cfi_super.ld_store);
+		return err;
+	}
 	return ldbsdisk_attach(self);
 }
 
@@ -93,21 +93,30 @@ dsk_err_t cpcext_creat(DSK_DRIVER *self, const char *filename)
 
 
 
+/* Where a track record is in the file. All of these are found before
+ * any tracks are converted. */
+typedef struct cpc_trackindex
+{
+	unsigned long ti_offset;	/* Start of Track-Info */
+	size_t ti_len;			/* Length of track record, 0 if 
+					 * the track is unformatted */
+} CPC_TRACKINDEX;
+
+
 /* Migrate a track from CPCEMU .DSK to LDBS format. 
  *
- * For simplicity's sake, read the whole track into memory in one go, 
- * rather than one sector at a time.
+ * The track record, which is dsk_trklen bytes long, is the next thing
+ * in the file view fb. Sector data are stored from it directly.
  */
-static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self, 
+static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self, DSK_FBUF *fb,
 	dsk_pcyl_t cyl, dsk_phead_t head, unsigned char *dskhead, 
-	unsigned short **poffptr)
+	size_t dsk_trklen, unsigned short **poffptr)
 {
 	dsk_ltrack_t track = (cyl * dskhead[0x31]) + head;
-	unsigned char *dsk_track;	/* DSK track record */
+	const unsigned char *dsk_track;	/* DSK track record */
 	LDBS_TRACKHEAD *ldbs_track;	/* LDBS track header */
 	int sector;
-	int source;
-	size_t dsk_trklen;	/* Length of DSK track record */
+	size_t source;
 	size_t dsk_seclen;	/* Length of sector record */
 	size_t dsk_secsize;	/* Theoretical sector size */
 	unsigned char same;
@@ -115,31 +124,13 @@ static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self,
 	int n;
 	dsk_err_t err;
 
-	/* First: work out the length of the track. In a non-extended DSK
-	 * this is a constant in the header. */
-	if (dskhead[0] != 'E')
-	{
-		dsk_trklen = ldbs_peek2(dskhead + 0x32);
-	}
-	else	/* In an extended DSK it is held per track */
-	{
-		dsk_trklen = dskhead[0x34 + track] * 256;
-	}
-	/* Allocate and load the track */
-	dsk_track = dsk_malloc(dsk_trklen);
-	if (!dsk_track) return DSK_ERR_NOMEM;
-
-	memset(dsk_track, 0, dsk_trklen);
+	/* Get the whole track */
+	dsk_track = dsk_fbuf_get(fb, dsk_trklen);
+	if (!dsk_track) return DSK_ERR_SYSERR;
 
-	if (fread(dsk_track, 1, dsk_trklen, cpc_self->cpc_fp) < dsk_trklen)
-	{
-		dsk_free(dsk_track);
-		return DSK_ERR_SYSERR;
-	}
 	/* Check that the track header has the correct magic */
-	if (memcmp(dsk_track, "Track-Info\r\n", 12))
+	if (dsk_trklen < 256 || memcmp(dsk_track, "Track-Info\r\n", 12))
 	{
-		dsk_free(dsk_track);
 #ifndef HAVE_WINDOWS_H
 		fprintf(stderr, "Track-Info block %d not found\n", track);
 #endif
@@ -149,7 +140,6 @@ static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self,
 	ldbs_track = ldbs_trackhead_alloc(dsk_track[0x15]);
 	if (!ldbs_track)
 	{
-		dsk_free(dsk_track);
 		return DSK_ERR_NOMEM;
 	}
 	/* Generate the fixed part of the header */
@@ -174,6 +164,11 @@ static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self,
 		/* (Rounded up to a multiple of 256 bytes) */
 		source = (source + 255) & (~255);
 	}
+	if (source > dsk_trklen)
+	{
+		ldbs_free(ldbs_track);
+		return DSK_ERR_CORRUPT;
+	}
 	err = DSK_ERR_OK;
 	/* Now migrate each sector, one by one */
 	for (sector = 0; sector < dsk_track[0x15]; sector++)
@@ -208,8 +203,14 @@ static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self,
 			}
 		}
 
+		/* Don't go past the end of the track record */
+		if (dsk_seclen > dsk_trklen - source)
+		{
+			dsk_seclen = dsk_trklen - source;
+		}
 		/* See if sector is all one byte; if so, don't copy it */
-		same = dsk_track[source];
+		same = (source < dsk_trklen) ? dsk_track[source] : 
+						dsk_track[0x17];
 		for (n = 1; n < (int)dsk_seclen; n++) 
 		{
 			if (dsk_track[n+source] != same) break;
@@ -244,7 +245,6 @@ static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self,
 		if (err)
 		{
 			ldbs_free(ldbs_track);
-			free(dsk_track);
 			return err;
 		}
 		source += dsk_seclen;
@@ -253,7 +253,6 @@ static dsk_err_t track_to_ldbs(CPCEMU_DSK_DRIVER *cpc_self,
 	err = ldbs_put_trackhead(cpc_self->cpc_super.ld_store, ldbs_track, 
 				cyl, head);
 	ldbs_free(ldbs_track);
-	free(dsk_track);
 	return err;
 }
 
@@ -266,14 +265,15 @@ static dsk_err_t cpc_open(DSK_DRIVER *self, const char *filename, int extended)
 	CPCEMU_DSK_DRIVER *cpc_self;
 	dsk_err_t err;
 	unsigned char dskhead[256];
-	unsigned char trkhead[256];
-	long filepos = 0x100;
+	const unsigned char *trkhead, *buf;
+	unsigned long filepos = 0x100;
 	dsk_pcyl_t c;
 	dsk_phead_t h;
-	dsk_ltrack_t t;
-	unsigned char buf[15];
+	dsk_ltrack_t t, ntracks;
 	unsigned offs_count = 0;
 	unsigned short *offsets = NULL, *off_ptr = NULL;
+	CPC_TRACKINDEX *index;
+	DSK_FBUF fb;
 	
 	/* Sanity check: Is this meant for our driver? */
 	DC_CHECK(self)
@@ -313,118 +313,111 @@ static dsk_err_t cpc_open(DSK_DRIVER *self, const char *filename, int extended)
 		}
 	}
 	dsk_report("Parsing CPCEMU-format disk image");
-	/* OK, got signature. Now we have to convert to LDBS format.
-	 * First, we need to establish if there is an Offset-Info
-	 * block. This comes after the last track, so count the
-	 * number of tracks and sectors. */
-
-	if (extended)	/* Only extended DSKs have offset info */
+	/* OK, got signature. Now we have to convert to LDBS format. The
+	 * rest of the file is parsed from memory. */
+	err = dsk_fbuf_open(&fb, cpc_self->cpc_fp);
+	if (err)
 	{
-		dsk_report("Checking for Offset-Info extension");
-		for (t = 0, c = 0; c < dskhead[0x30]; c++)
-			for (h = 0; h < dskhead[0x31]; h++)
-		{
-/* Load each track header in turn... */
-			if (fseek(cpc_self->cpc_fp, filepos, SEEK_SET)) 
-			{
-				fclose(cpc_self->cpc_fp);
-				return DSK_ERR_SYSERR;
-			}
-			if (fread(trkhead, 1, 256, cpc_self->cpc_fp) < 256)
-			{
-				fclose(cpc_self->cpc_fp);
-				return DSK_ERR_CORRUPT;
-			}
+		fclose(cpc_self->cpc_fp);
+		return err;
+	}
+	/* First, index the tracks: find where each one starts, how long
+	 * it is and how many sectors it has. This also establishes if there
+	 * is an Offset-Info block, which comes after the last track. */
+	ntracks = dskhead[0x30] * dskhead[0x31];
+	index = dsk_malloc((ntracks ? ntracks : 1) * sizeof(CPC_TRACKINDEX));
+	if (!index)
+	{
+		dsk_fbuf_close(&fb);
+		fclose(cpc_self->cpc_fp);
+		return DSK_ERR_NOMEM;
+	}
+	for (t = 0; t < ntracks; t++)
+	{
+		index[t].ti_offset = filepos;
+		/* In a non-extended DSK the track length is a constant in
+		 * the header. In an extended DSK it is held per track, and
+		 * zero means the track is unformatted. */
+		if (extended) index[t].ti_len = 256L * dskhead[0x34 + t];
+		else	      index[t].ti_len = ldbs_peek2(dskhead + 0x32);
+		filepos += index[t].ti_len;
+
+		/* Only extended DSKs have offset info */
+		if (!extended || !index[t].ti_len) continue;
 /* The offset table has one entry for the track, and one for each sector
  * within the track */
-			offs_count += (trkhead[0x15] + 1);
-	
-			filepos += 256L * dskhead[0x34 + t];
-			++t;
-		}
-		offsets = dsk_malloc(offs_count * sizeof(unsigned short));
-		if (!offsets)
+		if (dsk_fbuf_seek(&fb, index[t].ti_offset) ||
+		    (trkhead = dsk_fbuf_get(&fb, 256)) == NULL)
 		{
-			fclose(cpc_self->cpc_fp);
-			return DSK_ERR_NOMEM;
+			err = DSK_ERR_CORRUPT;
+			goto done;
 		}
-		/* filepos is now where the Offset-Info extension should be.*/
-		if (fseek(cpc_self->cpc_fp, filepos, SEEK_SET)) 
+		offs_count += (trkhead[0x15] + 1);
+	}
+	/* filepos is now where the Offset-Info extension should be.*/
+	if (extended && !dsk_fbuf_seek(&fb, filepos) && 
+	    (buf = dsk_fbuf_get(&fb, 15)) != NULL &&
+	    !memcmp(buf, "Offset-Info\r\n", 13))
+	{
+		dsk_report("Loading Offset-Info extension");
+		offsets = dsk_malloc((offs_count ? offs_count : 1) * 
+				sizeof(unsigned short));
+		if (!offsets)
 		{
-			fclose(cpc_self->cpc_fp);
-			dsk_free(offsets);
-			return DSK_ERR_SYSERR;
+			err = DSK_ERR_NOMEM;
+			goto done;
 		}
-	/* See if there is an Offset-Info signature there */
-		if (fread(buf, 1, 15, cpc_self->cpc_fp) == sizeof(buf) &&
-	    	    !memcmp(buf, "Offset-Info\r\n", 13))
+		/* Read the offsets */
+		buf = dsk_fbuf_get(&fb, 2 * offs_count);
+		if (!buf)
 		{
-			t = 0;
-			/* Read the offsets */
-			while (offs_count)
-			{
-				if (fread(buf, 1, 2, cpc_self->cpc_fp) < 2) 
-				{
-					fclose(cpc_self->cpc_fp);
-					dsk_free(offsets);
-					return DSK_ERR_CORRUPT;
-				}
-				offsets[t++] = ldbs_peek2(buf);
-				--offs_count;
-			}		
+			err = DSK_ERR_CORRUPT;
+			goto done;
 		}
-		else	/* No Offset-Info block */
+		for (t = 0; t < offs_count; t++)
 		{
-			dsk_free(offsets);
-			offsets = NULL;
+			offsets[t] = ldbs_peek2(buf + 2 * t);
 		}
-		off_ptr = offsets;
 	}
+	off_ptr = offsets;
 
-	/* Now migrate each track in turn */
+	/* Now migrate each track in turn. This is done in file order, so
+	 * the blockstore always comes out the same. */
 	err = ldbs_new(&cpc_self->cpc_super.ld_store, NULL, LDBS_DSK_TYPE);
-	if (err)
-	{
-		if (offsets) dsk_free(offsets);
-		fclose(cpc_self->cpc_fp);
-		return err;
-	}
-	filepos = 0x100;
+	if (err) goto done;
 
 	dsk_report("Loading DSK file  ");
 	for (t = 0, c = 0; c < dskhead[0x30]; c++)
-		for (h = 0; h < dskhead[0x31]; h++)
+		for (h = 0; h < dskhead[0x31]; h++, t++)
 	{
-		if (fseek(cpc_self->cpc_fp, filepos, SEEK_SET)) 
+		/* An unformatted track has no Track-Info, and nothing 
+		 * goes into the blockstore for it */
+		if (!index[t].ti_len) continue;
+
+		if (dsk_fbuf_seek(&fb, index[t].ti_offset))
 		{
-			ldbs_close(&cpc_self->cpc_super.ld_store);
-			if (offsets) dsk_free(offsets);
-			fclose(cpc_self->cpc_fp);
-			return DSK_ERR_SYSERR;
+			err = DSK_ERR_SYSERR;
+		}
+		else
+		{
+			err = track_to_ldbs(cpc_self, &fb, c, h, dskhead, 
+					index[t].ti_len, &off_ptr);
 		}
-		err = track_to_ldbs(cpc_self, c, h, dskhead, &off_ptr);
 		if (err)
 		{
 			ldbs_close(&cpc_self->cpc_super.ld_store);
-			if (offsets) dsk_free(offsets);
-			fclose(cpc_self->cpc_fp);
-			return err;
+			goto done;
 		}	
-		if (extended)
-		{
-			filepos += 256L * dskhead[0x34 + t];
-		}
-		else
-		{
-			filepos += ldbs_peek2(dskhead + 0x32);
-		}
-		++t;
 	}
-	if (offsets) dsk_free(offsets);
-	dsk_report_end();
 	cpc_self->cpc_filename = dsk_malloc_string(filename);
 	cpc_self->cpc_extended = extended;
+done:
+	if (offsets) dsk_free(offsets);
+	dsk_free(index);
+	dsk_report_end();
+	dsk_fbuf_close(&fb);
 	fclose(cpc_self->cpc_fp);
+	if (err) return err;
 	return ldbsdisk_attach(self);
 }
 
@@ -269,7 +269,7 @@ dsk_err_t dc42_open(DSK_DRIVER *self, const char *filename)
 			}
 			else
 			{
-				trkh->recmode  = 0x01;	/* MFM */
+				trkh->recmode  = 0x02;	/* MFM */
 			}
 			trkh->gap3     = geom.dg_fmtgap;
 			trkh->filler   = 0xE5;
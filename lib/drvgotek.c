@@ -264,6 +264,7 @@ static dsk_err_t gotek_open_create(DSK_DRIVER *self, const char *filename, int c
 	if (create && !gxself->gotek_fp)
 	{
 		gxself->gotek_fp = fopen(gxself->gotek_filename, "w+b");
+		gxself->gotek_readonly = 0;
 	}
 	if (!gxself->gotek_fp) 
 	{
@@ -272,6 +273,7 @@ static dsk_err_t gotek_open_create(DSK_DRIVER *self, const char *filename, int c
 	}
         if (fseek(gxself->gotek_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
         gxself->gotek_filesize = ftell(gxself->gotek_fp);
+	dsk_fill_options(self);
 
 	return DSK_ERR_OK;
 }
@@ -442,11 +444,9 @@ static dsk_err_t seekto(GOTEK_DSK_DRIVER *self, unsigned long offset)
 	{
 		if (fseek(self->gotek_fp, self->gotek_filesize, SEEK_SET)) 
 			return DSK_ERR_SYSERR;
-		while (self->gotek_filesize < offset)
-		{
-			if (fputc(0xE5, self->gotek_fp) == EOF) return DSK_ERR_SYSERR;
-			++self->gotek_filesize;
-		}
+		if (dsk_fill(self->gotek_fp, 0xE5, offset - self->gotek_filesize))
+			return DSK_ERR_SYSERR;
+		self->gotek_filesize = offset;
 	}
 	if (fseek(self->gotek_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 	return DSK_ERR_OK;
@@ -549,12 +549,12 @@ dsk_err_t gotek_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 #endif
 	if (!gxself->gotek_fp) return DSK_ERR_NOTRDY;
 
+	err = dsk_fill_at(self, gxself->gotek_fp, gxself->gotek_filesize, 
+			offset, filler, trklen);
+	if (err) return err;
 	if (gxself->gotek_filesize < offset + trklen)
 		gxself->gotek_filesize = offset + trklen;
 
-	for (++trklen; trklen > 1; trklen--)
-		if (fputc(filler, gxself->gotek_fp) == EOF) return DSK_ERR_SYSERR;	
-
 	return DSK_ERR_OK;
 }
 
@@ -680,13 +680,13 @@ dsk_err_t gotek_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 
 		geom = &bootgeom;	
 	}
-	secbuf = dsk_malloc(geom->dg_secsize);
+	secbuf = dsk_pool_alloc(self, geom->dg_secsize);
 	if (!secbuf) return DSK_ERR_NOMEM;
 
 	err = ldbs_new(result, NULL, LDBS_DSK_TYPE);
 	if (err)
 	{
-		dsk_free(secbuf);
+		dsk_pool_free(self, secbuf);
 		return err;
 	}
 	/* If a geometry was provided, save it in the file */
@@ -694,16 +694,16 @@ dsk_err_t gotek_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 	if (err)
 	{
 		ldbs_close(result);
-		dsk_free(secbuf);
+		dsk_pool_free(self, secbuf);
 		return err;
 	}
 	for (cyl = 0; cyl < geom->dg_cylinders; cyl++)
 	    for (head = 0; head < geom->dg_heads; head++)
 	{
-		th = ldbs_trackhead_alloc(geom->dg_sectors);
+		th = ldbs_trackhead_reuse(*result, geom->dg_sectors);
 		if (!th)
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			ldbs_close(result);
 			return DSK_ERR_NOMEM;
 		}
@@ -714,7 +714,7 @@ dsk_err_t gotek_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 			if (err)
 			{
 				ldbs_free(th);
-				dsk_free(secbuf);
+				dsk_pool_free(self, secbuf);
 				ldbs_close(result);
 				return err;
 			}
@@ -749,22 +749,22 @@ dsk_err_t gotek_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 				if (err)
 				{
 					ldbs_free(th);
-					dsk_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					ldbs_close(result);
 					return err;
 				}
 			}	
 		}	/* End of loop over sectors */
 		err = ldbs_put_trackhead(*result, th, cyl, head);
-		ldbs_free(th);
+		ldbs_trackhead_release(*result, th);
 		if (err)
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			ldbs_close(result);
 			return err;
 		}
 	}	/* End of loop over cyls / heads */
-	dsk_free(secbuf);	
+	dsk_pool_free(self, secbuf);	
 	return ldbs_sync(*result);
 }
 
@@ -784,7 +784,7 @@ static dsk_err_t gotek_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 	{
 		return DSK_ERR_OK;
 	}
-	if (se->id_sec >= 1 && se->id_sec <= gxself->gotek_spt)
+	if (se->id_sec < 1 || se->id_sec > gxself->gotek_spt)
 	{
 		return DSK_ERR_OK;
 	}
@@ -792,9 +792,13 @@ static dsk_err_t gotek_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 	offset = gotek_offset(gxself, cyl, head, se->id_sec);
 	len = 512;
 
-	/* Ensure the file is big enough to hold the sector */
-	err = seekto(gxself, offset + len);
-	if (err) return err;
+	/* Ensure the file is big enough to hold the sector. Filler is left
+	 * to dsk_fill_at(), which may leave it as a hole. */
+	if (se->copies)
+	{
+		err = seekto(gxself, offset + len);
+		if (err) return err;
+	}
 	/* Then seek to the start of the sector */
 	err = seekto(gxself, offset);
 	if (err) return err;
@@ -834,13 +838,11 @@ static dsk_err_t gotek_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 				return DSK_ERR_SYSERR;
 			}
 			/* Pad to 512 bytes */
-			while (len < 512)
+			if (len < 512 && dsk_fill(gxself->gotek_fp, se->filler,
+						512 - len))
 			{
-				if (fputc(se->filler, gxself->gotek_fp) == EOF)
-				{
-					return DSK_ERR_SYSERR;
-				}
-				++len;
+				ldbs_free(secbuf);
+				return DSK_ERR_SYSERR;
 			}
 		}
 		ldbs_free(secbuf);
@@ -865,14 +867,13 @@ static dsk_err_t gotek_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 		else
 #endif
 		{
-			while (len > 0)
-			{
-				if (fputc(se->filler, gxself->gotek_fp) == EOF)
-				{
-					return DSK_ERR_SYSERR;
-				}
-				--len;
-			}
+			err = dsk_fill_at(&gxself->gotek_super, 
+					gxself->gotek_fp, 
+					gxself->gotek_filesize, offset,
+					se->filler, len);
+			if (err) return err;
+			if (gxself->gotek_filesize < offset + len)
+				gxself->gotek_filesize = offset + len;
 		}		
 	}
 	return DSK_ERR_OK;
@@ -884,25 +885,38 @@ static dsk_err_t gotek_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 dsk_err_t gotek_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom)
 {
 	GOTEK_DSK_DRIVER *gxself;
-	long pos;
+	unsigned long len;
+	dsk_err_t err;
 
 	if (!self || !source) return DSK_ERR_BADPTR;
 	CHECK_CLASS(self);
 
-	/* Erase anything existing in the file */
+	/* Erase anything existing in the file. The part of the image (if 
+	 * any) beyond the end of the file has nothing to erase; it is 
+	 * filled in as sectors are written, so that zero-filled sectors 
+	 * there can be left as holes. */
 	if (fseek(gxself->gotek_fp, gxself->gotek_base, SEEK_SET)) 
 		return DSK_ERR_SYSERR;
 
-	for (pos = 0; pos < (long)(gxself->gotek_gap); pos++)
+	len = gxself->gotek_gap;
+	if (gxself->gotek_filesize < gxself->gotek_base + len)
 	{
-		if (fputc(0xE5, gxself->gotek_fp) == EOF) return DSK_ERR_SYSERR;
+		if (gxself->gotek_filesize > gxself->gotek_base)
+			len = gxself->gotek_filesize - gxself->gotek_base;
+		else	len = 0;
 	}
+	if (dsk_fill(gxself->gotek_fp, 0xE5, len))
+		return DSK_ERR_SYSERR;
 	if (fseek(gxself->gotek_fp, gxself->gotek_base, SEEK_SET)) 
 		return DSK_ERR_SYSERR;
 
 	/* And populate with whatever is in the blockstore */	
-	return ldbs_all_sectors(source, gotek_from_ldbs_callback,
+	err = ldbs_all_sectors(source, gotek_from_ldbs_callback,
 				SIDES_ALT, gxself);
+	if (err) return err;
+
+	/* Then pad the image out to its full length */
+	return seekto(gxself, gxself->gotek_base + gxself->gotek_gap);
 }
 
 
@@ -93,6 +93,8 @@
 
 /* Initialise custom formats */
 dsk_err_t dg_custom_init(void);
+/* Look up a format by name, with case significant */
+dsk_err_t dg_exactformat(dsk_cchar_t name, dsk_format_t *formatid);
 const char *dg_homedir(void);
 const char *dg_sharedir(void);
 dsk_err_t dg_parseline(char *linebuf, DSK_GEOMETRY *dg, char *description);
@@ -100,6 +102,81 @@ dsk_err_t dg_parse(FILE *fp, DSK_GEOMETRY *dg, char *description);
 dsk_err_t dg_store(FILE *fp, DSK_GEOMETRY *dg, char *description);
 /* The default geometry probe; driver geometry probes can call it */
 dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom);
+/* Cache of results from the default geometry probe (dskgcach.c) */
+dsk_err_t dg_cache_lookup(DSK_DRIVER *self, DSK_GEOMETRY *geom);
+void      dg_cache_store (DSK_DRIVER *self, const DSK_GEOMETRY *geom);
+/* Scratch buffers that are reused for the life of a driver (dskpool.c) */
+void *dsk_pool_alloc(DSK_DRIVER *self, size_t size);
+void  dsk_pool_free(DSK_DRIVER *self, void *ptr);
+void  dsk_pool_release(DSK_DRIVER *self);
+/* Read-only view of an image file that is parsed when it is opened, 
+ * mapped or loaded into memory where possible (dskfbuf.c) */
+typedef struct dsk_fbuf
+{
+	FILE *fb_fp;
+	const unsigned char *fb_data;	/* File contents, if in memory */
+	unsigned long fb_len;		/* File length */
+	unsigned long fb_pos;		/* Current read position */
+	int fb_mapped;			/* fb_data is mapped, not loaded */
+	unsigned char *fb_scratch;	/* dsk_fbuf_get() buffer for stdio */
+	size_t fb_scratchlen;
+} DSK_FBUF;
+dsk_err_t dsk_fbuf_open(DSK_FBUF *fb, FILE *fp);
+void      dsk_fbuf_close(DSK_FBUF *fb);
+int       dsk_fbuf_getc(DSK_FBUF *fb);
+const unsigned char *dsk_fbuf_get(DSK_FBUF *fb, size_t count);
+dsk_err_t dsk_fbuf_seek(DSK_FBUF *fb, unsigned long pos);
+/* Output buffer that a writer encodes one track into before writing it
+ * out in a single call (dskfbuf.c). Errors are sticky: the put functions
+ * record them and dsk_wbuf_flush() returns them. */
+typedef struct dsk_wbuf
+{
+	unsigned char *wb_data;
+	size_t wb_len;			/* Bytes waiting to be written */
+	size_t wb_size;			/* Bytes allocated */
+	dsk_err_t wb_err;
+} DSK_WBUF;
+void      dsk_wbuf_init(DSK_WBUF *wb);
+void      dsk_wbuf_close(DSK_WBUF *wb);
+unsigned char *dsk_wbuf_reserve(DSK_WBUF *wb, size_t count);
+void      dsk_wbuf_put(DSK_WBUF *wb, const void *data, size_t count);
+void      dsk_wbuf_putc(DSK_WBUF *wb, int c);
+dsk_err_t dsk_wbuf_flush(DSK_WBUF *wb, FILE *fp);
+/* Operation counters and timings (dskperf.c) */
+unsigned long dsk_stats_now(void);
+unsigned long dsk_stats_begin(DSK_DRIVER *self, int op, long cylinder, 
+		long head, long sector);
+void dsk_stats_end(DSK_DRIVER *self, int op, unsigned long start, 
+		long cylinder, long head, long sector,
+		dsk_err_t err, unsigned tries, unsigned long bytes);
+void dsk_stats_release(DSK_DRIVER *self);
+/* Trace events (dsktrace.c). 'name' is the compression method when there
+ * is no driver. */
+void dsk_trace_begin(DSK_DRIVER *self, const char *name, int op, 
+		long cylinder, long head, long sector);
+void dsk_trace_end(DSK_DRIVER *self, const char *name, int op, 
+		long cylinder, long head, long sector,
+		dsk_err_t err, unsigned long bytes);
+/* Runs of identical bytes (dskrun.c) */
+size_t dsk_run_length(const void *buf, size_t len);
+size_t dsk_mismatch(const void *a, const void *b, size_t len);
+/* Bulk and sparse filling of raw image files (dskfill.c) */
+dsk_err_t dsk_fill(FILE *fp, unsigned char filler, unsigned long count);
+dsk_err_t dsk_fill_at(DSK_DRIVER *self, FILE *fp, unsigned long filesize,
+		unsigned long offset, unsigned char filler, 
+		unsigned long count);
+void dsk_fill_options(DSK_DRIVER *self);
+/* dsk_ptrackids(), falling back to the IDs that 'geom' implies (dsktrkid.c) */
+dsk_err_t dsk_trackids_geom(DSK_PDRIVER self, const DSK_GEOMETRY *geom,
+		dsk_pcyl_t cylinder, dsk_phead_t head,
+		dsk_psect_t *count, DSK_FORMAT **results);
+int dsk_same_trackids(const DSK_FORMAT *a, const DSK_FORMAT *b,
+		dsk_psect_t count);
+/* Read the sector with the given ID, with dsk_xread() if the driver has 
+ * it or dsk_pread() if not (dskread.c) */
+dsk_err_t dsk_read_id(DSK_PDRIVER self, const DSK_GEOMETRY *geom, void *buf,
+		dsk_pcyl_t cylinder, dsk_phead_t head, const DSK_FORMAT *id,
+		int *deleted);
 /* The default system for storing optional integer properties */
 dsk_err_t dsk_isetoption(DSK_DRIVER *self, const char *name, int value, 
 		int add_if_not_present);
@@ -66,28 +66,25 @@ DRV_CLASS dc_imd =
  *
  * If only interested in one terminating character, pass c2 = c1
  */
-static dsk_err_t imd_readto(FILE *fp, char c1, char c2, int *count, int *termch)
+static dsk_err_t imd_readto(DSK_FBUF *fb, char c1, char c2, int *count, int *termch)
 {
 	int ch;
-	long pos = ftell(fp);
+	unsigned long pos = fb->fb_pos;
 	int cnt = 0;
 
 	*termch = EOF;	
-	if (pos < 0)
-	{
-		return DSK_ERR_SYSERR;
-	}
 	while (1)
 	{
 		++cnt;
-		ch = fgetc(fp);
-		if (ch == EOF || ch == c1 || ch == c2) 
+		ch = dsk_fbuf_getc(fb);
+		if (ch == EOF || ch == (unsigned char)c1 || 
+				 ch == (unsigned char)c2) 
 		{
 			*termch = ch;
 			break;
 		}	
 	}
-	if (fseek(fp, pos, SEEK_SET))
+	if (dsk_fbuf_seek(fb, pos))
 	{
 		return DSK_ERR_SYSERR;
 	}
@@ -156,7 +153,7 @@ typedef struct
 
 
 static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count, 
-	FILE *fp)
+	DSK_FBUF *fb)
 {
 	/* Start by loading the track header: Fixed */
 	LDBS_TRACKHEAD *trkh;
@@ -164,17 +161,19 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 	dsk_err_t err;
 	int n, psh, c, status;
 	unsigned short datalen[256];
+	const unsigned char *p;
 
 	/* Load the track header: 5 bytes */
-	if (fread(&tmp.imdt_mode, 1, 4, fp) < 4)
-	{
-		return DSK_ERR_OVERRUN;	/* EOF */
-	}
-	psh = fgetc(fp);
-	if (psh == EOF)
+	p = dsk_fbuf_get(fb, 5);
+	if (!p)
 	{
 		return DSK_ERR_OVERRUN;	/* EOF */
 	}
+	tmp.imdt_mode     = p[0];
+	tmp.imdt_cylinder = p[1];
+	tmp.imdt_head     = p[2];
+	tmp.imdt_sectors  = p[3];
+	psh = p[4];
 	if (psh == 0xFF) 
 	{
 		tmp.imdt_seclen = 0xFFFF;
@@ -221,60 +220,57 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 		trkh->sector[n].datalen = 128 << psh;
 	}
 	/* Load sector IDs */	
+	p = dsk_fbuf_get(fb, tmp.imdt_sectors);
+	if (!p) 
+	{
+		ldbs_free(trkh);
+		return DSK_ERR_SYSERR;
+	}
 	for (n = 0; n < tmp.imdt_sectors; n++)
 	{
-		c = fgetc(fp); 	
-		if (c == EOF) 
-		{
-			ldbs_free(trkh);
-			return DSK_ERR_SYSERR;
-		}
-		trkh->sector[n].id_sec = c;			
+		trkh->sector[n].id_sec = p[n];			
 	}
 	/* Load sector cylinder map (if present) */
 	if (tmp.imdt_head & 0x80)
 	{
+		p = dsk_fbuf_get(fb, tmp.imdt_sectors);
+		if (!p) 
+		{
+			ldbs_free(trkh);
+			return DSK_ERR_SYSERR;
+		}
 		for (n = 0; n < tmp.imdt_sectors; n++)
 		{
-			c = fgetc(fp); 	
-			if (c == EOF) 
-			{
-				ldbs_free(trkh);
-				return DSK_ERR_SYSERR;
-			}
-			trkh->sector[n].id_cyl = c;			
+			trkh->sector[n].id_cyl = p[n];			
 		}
 	}
 
 	/* Load sector head map (if present) */
 	if (tmp.imdt_head & 0x40)
 	{
+		p = dsk_fbuf_get(fb, tmp.imdt_sectors);
+		if (!p) 
+		{
+			ldbs_free(trkh);
+			return DSK_ERR_SYSERR;
+		}
 		for (n = 0; n < tmp.imdt_sectors; n++)
 		{
-			c = fgetc(fp); 	
-			if (c == EOF) 
-			{
-				ldbs_free(trkh);
-				return DSK_ERR_SYSERR;
-			}
-			trkh->sector[n].id_head = c;			
+			trkh->sector[n].id_head = p[n];			
 		}
 	}
 	/* Load sector lengths (if present) */
 	if (tmp.imdt_seclen == 0xFFFF)
 	{
-		int l, h;
-
+		p = dsk_fbuf_get(fb, 2 * tmp.imdt_sectors);
+		if (!p) 
+		{
+			ldbs_free(trkh);
+			return DSK_ERR_SYSERR;
+		}
 		for (n = 0; n < tmp.imdt_sectors; n++)
 		{
-			l = fgetc(fp); 	
-			h = fgetc(fp); 	
-			if (l == EOF || h == EOF) 
-			{
-				ldbs_free(trkh);
-				return DSK_ERR_SYSERR;
-			}
-			datalen[n] = (l & 0xFF) | ((h << 8) & 0xFF00);
+			datalen[n] = ldbs_peek2(p + 2 * n);
 			trkh->sector[n].id_psh = dsk_get_psh(datalen[n]);
 		}
 	}
@@ -282,14 +278,13 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 
 	for (n = 0; n < tmp.imdt_sectors; n++)
 	{
-		unsigned char *buf;
 		char secid[4];
 
 		ldbs_encode_secid(secid, tmp.imdt_cylinder,
 			tmp.imdt_head & 0x3F, trkh->sector[n].id_sec);
 		
 		/* Get status for sector */
-		c = fgetc(fp); 	
+		c = dsk_fbuf_getc(fb); 	
 		if (c == EOF) 
 		{
 			ldbs_free(trkh);
@@ -327,7 +322,7 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 			case ST_CDELETED:
 			case ST_CDATAERR:
 			case ST_CDELERR: 	
-				c = fgetc(fp);
+				c = dsk_fbuf_getc(fb);
 				if (c == EOF) 
 				{
 					ldbs_free(trkh);
@@ -344,22 +339,16 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 			case ST_DELERR: 
 				trkh->sector[n].copies = 1;
 				trkh->sector[n].filler = 0xF6;	
-				buf = dsk_malloc(datalen[n]);
-				if (!buf)
-				{
-					ldbs_free(trkh);
-					return DSK_ERR_NOMEM;
-				}
-				if (fread(buf, 1, datalen[n], fp) < datalen[n])
+				/* Store the data straight from the file buffer */
+				p = dsk_fbuf_get(fb, datalen[n]);
+				if (!p)
 				{
-					dsk_free(buf);
 					ldbs_free(trkh);
 					return DSK_ERR_SYSERR;
 				}
 				err = ldbs_putblock(self->imd_super.ld_store, 
 					&trkh->sector[n].blockid, 
-					secid, buf, datalen[n]);
-				dsk_free(buf);
+					secid, p, datalen[n]);
 				if (err)
 				{
 					ldbs_free(trkh);
@@ -372,7 +361,7 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 	err = ldbs_put_trackhead(self->imd_super.ld_store, trkh, 
 				tmp.imdt_cylinder, tmp.imdt_head & 0x3F);
 	ldbs_free(trkh);
-	return DSK_ERR_OK;
+	return err;
 }
 
 
@@ -380,12 +369,15 @@ static dsk_err_t imd_load_track(IMD_DSK_DRIVER *self, dsk_ltrack_t count,
 dsk_err_t imd_open(DSK_DRIVER *self, const char *filename)
 {
 	FILE *fp;
+	DSK_FBUF fb;
 	IMD_DSK_DRIVER *imdself;
 	dsk_err_t err;	
 	int ccmt;
 	dsk_ltrack_t count = 0;
 	char *comment, *ucomment;
 	int termch;
+	const unsigned char *p;
+	unsigned char magic[4];
 
 	/* Sanity check: Is this meant for our driver? */
 	if (self->dr_class != &dc_imd) return DSK_ERR_BADPTR;
@@ -399,43 +391,36 @@ dsk_err_t imd_open(DSK_DRIVER *self, const char *filename)
 	}
 	if (!fp) return DSK_ERR_NOTME;
 
-	/* Try to check the magic number. Read the first line, which
- 	 * may terminate with '\n' if a comment follows, or 0x1A 
-	 * otherwise. */
-	err = imd_readto(fp, '\n', 0x1A, &ccmt, &termch);
-	if (err)
-	{
-		fclose(fp);
-		return DSK_ERR_NOTME;
-	}
-	comment = dsk_malloc(1 + ccmt);
-	if (!comment)
+	/* IMD signature is 4 bytes magic, then the rest of the line is 
+	 * freeform (but probably includes a date stamp). Check the magic
+	 * before going any further, so that other files are turned away 
+	 * without being read in. */
+	if (fread(magic, 1, 4, fp) < 4 || memcmp(magic, "IMD ", 4))
 	{
 		fclose(fp);
 		return DSK_ERR_NOTME;
 	}
-	if ((int)fread(comment, 1, ccmt, fp) < ccmt)
+	err = dsk_fbuf_open(&fb, fp);
+	if (err)
 	{
 		fclose(fp);
 		return DSK_ERR_NOTME;
 	}
-	comment[ccmt] = 0;
-
-/*	printf("Header='%s' pos=%ld\n", comment, ftell(fp)); */
-
-	/* IMD signature is 4 bytes magic, then the rest of the line is 
-	 * freeform (but probably includes a date stamp) */
-	if (memcmp(comment, "IMD ", 4))
+	/* Read the first line, which may terminate with '\n' if a comment 
+	 * follows, or 0x1A otherwise. */
+	err = imd_readto(&fb, '\n', 0x1A, &ccmt, &termch);
+	if (err || termch == EOF)
 	{
-		dsk_free(comment);
+		dsk_fbuf_close(&fb);
 		fclose(fp);
 		return DSK_ERR_NOTME;
 	}
-	dsk_free(comment);
+	dsk_fbuf_seek(&fb, ccmt);
 
 	err = ldbs_new(&imdself->imd_super.ld_store, NULL, LDBS_DSK_TYPE);
 	if (err)
 	{
+		dsk_fbuf_close(&fb);
 		fclose(fp);
 		return err;
 	}
@@ -445,39 +430,41 @@ dsk_err_t imd_open(DSK_DRIVER *self, const char *filename)
 	{
 		int n;
 
-		err = imd_readto(fp, 0x1A, 0x1A, &ccmt, &termch);
-		if (err)
+		comment = NULL;
+		err = imd_readto(&fb, 0x1A, 0x1A, &ccmt, &termch);
+		if (!err && termch == EOF) err = DSK_ERR_SYSERR;
+		if (!err)
 		{
-			fclose(fp);
-			return DSK_ERR_NOTME;
+			p = dsk_fbuf_get(&fb, ccmt);
+			comment = dsk_malloc(ccmt);
+			if (!p) err = DSK_ERR_SYSERR;
+			else if (!comment) err = DSK_ERR_NOMEM;
 		}
-		comment = dsk_malloc(1 + ccmt);
-		if (!comment)
+		if (err)
 		{
+			if (comment) dsk_free(comment);
+			ldbs_close(&imdself->imd_super.ld_store);
+			dsk_fbuf_close(&fb);
 			fclose(fp);
-			return DSK_ERR_NOMEM;
+			return err;
 		}
-		if ((int)fread(comment, 1, ccmt, fp) < ccmt)
-		{
-			dsk_free(comment);
-			fclose(fp);
-			return DSK_ERR_SYSERR;
-		}	
+		memcpy(comment, p, ccmt - 1);
 		comment[ccmt - 1] = 0;
 		n = cp437_to_utf8(comment, NULL, -1);
 		ucomment = dsk_malloc(n);
-		if (!ucomment)
+		if (ucomment)
 		{
-			dsk_free(comment);
-			fclose(fp);
-			return DSK_ERR_NOMEM;
+			cp437_to_utf8(comment, ucomment, -1);
+			err = ldbs_put_comment(imdself->imd_super.ld_store, 
+					ucomment);
+			dsk_free(ucomment);
 		}
-		cp437_to_utf8(comment, ucomment, -1);
-		err = ldbs_put_comment(imdself->imd_super.ld_store, ucomment);
-		dsk_free(ucomment);
+		else	err = DSK_ERR_NOMEM;
 		dsk_free(comment);
 		if (err)
 		{
+			ldbs_close(&imdself->imd_super.ld_store);
+			dsk_fbuf_close(&fb);
 			fclose(fp);
 			return err;
 		}
@@ -486,36 +473,31 @@ dsk_err_t imd_open(DSK_DRIVER *self, const char *filename)
 	imdself->imd_filename = dsk_malloc_string(filename);
 	if (!imdself->imd_filename) 
 	{
+		dsk_fbuf_close(&fb);
 		fclose(fp);
 		ldbs_close(&imdself->imd_super.ld_store);
 		return DSK_ERR_NOMEM;
 	}
 	/* And now we're onto the tracks */
-	ccmt = 0;
 	dsk_report("Loading IMD file into memory");
 
-	err = DSK_ERR_OK;
-
-	while (!feof(fp))
+	/* Tracks follow each other up to the end of the file */
+	do
 	{
-		err = imd_load_track(imdself, count, fp);
-		if (err == DSK_ERR_OVERRUN) 	/* EOF */
-		{
-			dsk_report_end();
-			fclose(fp);
-			return ldbsdisk_attach(self);
-		}
-		else if (err) 
-		{
-			dsk_free(imdself->imd_filename);
-			ldbs_close(&imdself->imd_super.ld_store);
-			dsk_report_end();
-			return err;
-		}
-		++count;
-	} 
-	/* Should never get here! */
+		err = imd_load_track(imdself, count++, &fb);
+	}
+	while (!err);
+
 	dsk_report_end();
+	dsk_fbuf_close(&fb);
+	fclose(fp);
+	if (err != DSK_ERR_OVERRUN) 	/* Anything other than EOF */
+	{
+		dsk_free(imdself->imd_filename);
+		imdself->imd_filename = NULL;
+		ldbs_close(&imdself->imd_super.ld_store);
+		return err;
+	}
 	return ldbsdisk_attach(self);
 }
 
@@ -551,6 +533,7 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 			LDBS_TRACKHEAD *th, void *param)
 {
 	IMD_DSK_DRIVER *self = param;
+	DSK_WBUF *wb = &self->imd_wb;
 	IMD_TRACK tmp;
 	int fm = (th->recmode == 1);	
 	unsigned char psh;
@@ -581,15 +564,13 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 	tmp.imdt_head = head;
 	tmp.imdt_sectors = (unsigned char)(th->count);
 
+	/* The track is built up in self->imd_wb and written in one go */
 	if (th->count == 0)
 	{
 		/* Write fixed part of header */
-		if (fwrite(&tmp.imdt_mode, 1, 4, self->imd_fp) < 4
-		||  fputc(0, self->imd_fp) == EOF)
-		{
-			return DSK_ERR_SYSERR;
-		}
-		return DSK_ERR_OK;
+		dsk_wbuf_put(wb, &tmp.imdt_mode, 4);
+		dsk_wbuf_putc(wb, 0);
+		return dsk_wbuf_flush(wb, self->imd_fp);
 	}
 	/* OK, we have at least one sector */
 	psh = th->sector[0].id_psh;
@@ -621,25 +602,20 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 	}
 	
 	/* Write fixed part of header */
-	if (fwrite(&tmp.imdt_mode, 1, 4, self->imd_fp) < 4
-	||  fputc(psh, self->imd_fp) == EOF)
-	{
-		return DSK_ERR_SYSERR;
-	}
+	dsk_wbuf_put(wb, &tmp.imdt_mode, 4);
+	dsk_wbuf_putc(wb, psh);
 		
 	/* Write sector IDs */	
 	for (nsec = 0; nsec < th->count; nsec++)
 	{
-		if (fputc(th->sector[nsec].id_sec, self->imd_fp) == EOF)
-			return DSK_ERR_SYSERR;
+		dsk_wbuf_putc(wb, th->sector[nsec].id_sec);
 	}
 	/* Write cylinder IDs, if necessary */
 	if (tmp.imdt_head & 0x80)
 	{
 		for (nsec = 0; nsec < th->count; nsec++)
 		{
-			if (fputc(th->sector[nsec].id_cyl, self->imd_fp) == EOF)
-				return DSK_ERR_SYSERR;
+			dsk_wbuf_putc(wb, th->sector[nsec].id_cyl);
 		}
 	}
 	/* Write head IDs, if necessary */
@@ -647,8 +623,7 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 	{
 		for (nsec = 0; nsec < th->count; nsec++)
 		{
-			if (fputc(th->sector[nsec].id_head, self->imd_fp) == EOF)
-				return DSK_ERR_SYSERR;
+			dsk_wbuf_putc(wb, th->sector[nsec].id_head);
 		}
 	}
 	/* Write sector sizes, if necessary */
@@ -656,10 +631,8 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 	{
 		for (nsec = 0; nsec < th->count; nsec++)
 		{
-			if (fputc(seclen[nsec] & 0xFF, self->imd_fp) == EOF)
-				return DSK_ERR_SYSERR;
-			if (fputc(seclen[nsec] >> 8, self->imd_fp) == EOF)
-				return DSK_ERR_SYSERR;
+			dsk_wbuf_putc(wb, (int)(seclen[nsec] & 0xFF));
+			dsk_wbuf_putc(wb, (int)(seclen[nsec] >> 8));
 		}
 	}
 
@@ -668,6 +641,27 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 	{
 		char status = ST_NORMAL;
 		int compressed = (th->sector[nsec].copies == 0);
+		unsigned char filler = th->sector[nsec].filler;
+		size_t datalen = seclen[nsec];
+
+		buf = NULL;
+		if (!compressed && !(th->sector[nsec].st1 & 4))
+		{
+			err = ldbs_getblock_a(ldbs, th->sector[nsec].blockid,
+					NULL, &buf, &buflen);
+			if (err) return err;
+
+			/* A sector that was stored in full may still turn out
+			 * to be all one byte */
+			if (buflen >= datalen && datalen > 0 &&
+			    dsk_run_length(buf, datalen) == datalen)
+			{
+				compressed = 1;
+				filler = ((unsigned char *)buf)[0];
+				ldbs_free(buf);
+				buf = NULL;
+			}
+		}
 
 		if (th->sector[nsec].st1 & 4)	/* No data */
 		{
@@ -684,55 +678,34 @@ static dsk_err_t imd_save_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 			case 0x60: status = compressed ?ST_CDELERR : ST_DELERR;
 				   break;
 		}	
-		if (fputc(status, self->imd_fp) == EOF)
-			return DSK_ERR_SYSERR;
+		dsk_wbuf_putc(wb, status);
 		if (status == ST_NODATA) continue;
 
 		if (compressed)
 		{
-			if (fputc(th->sector[nsec].filler, self->imd_fp) == EOF)
-				return DSK_ERR_SYSERR;
+			dsk_wbuf_putc(wb, filler);
 		}
 		else
 		{
-			size_t datalen = seclen[nsec];
-
-			err = ldbs_getblock_a(ldbs, th->sector[nsec].blockid,
-					NULL, &buf, &buflen);
-			if (err) return err;
-
 			/* If sector is short, pad to stated length. Should
 			 * never happen because that's the size recorded 
 			 * in the blockstore in the first place! */
 			if (buflen < datalen)
 			{
-				if (fwrite(buf, 1, datalen, self->imd_fp) < buflen)
-				{
-					ldbs_free(buf);
-					return DSK_ERR_SYSERR;
-				}
-				while (buflen < datalen)
-				{
-					if (fputc(0xCC, self->imd_fp) == EOF)
-					{
-						ldbs_free(buf);
-						return DSK_ERR_SYSERR;
-					}
-					++buflen;
-				}
+				unsigned char *pad;
+
+				dsk_wbuf_put(wb, buf, buflen);
+				pad = dsk_wbuf_reserve(wb, datalen - buflen);
+				if (pad) memset(pad, 0xCC, datalen - buflen);
 			}
 			else
 			{
-				if (fwrite(buf, 1, datalen, self->imd_fp) < datalen)
-				{
-					ldbs_free(buf);
-					return DSK_ERR_SYSERR;
-				}	
+				dsk_wbuf_put(wb, buf, datalen);
 			}
 			ldbs_free(buf);
 		}
 	}
-	return DSK_ERR_OK;
+	return dsk_wbuf_flush(wb, self->imd_fp);
 }
 
 
@@ -794,8 +767,10 @@ dsk_err_t imd_close(DSK_DRIVER *self)
 		dsk_report_end();
 		return err;
 	}
+	dsk_wbuf_init(&imdself->imd_wb);
 	err = ldbs_all_tracks(imdself->imd_super.ld_store, imd_save_track,
 				SIDES_ALT, imdself);
+	dsk_wbuf_close(&imdself->imd_wb);
 	if (err)
 	{
 		ldbs_close(&imdself->imd_super.ld_store);
@@ -32,6 +32,7 @@ typedef struct
 	char		*imd_filename;
 	/* State while saving */
 	FILE *imd_fp;
+	DSK_WBUF imd_wb;	/* Track being encoded */
 } IMD_DSK_DRIVER;
 
 dsk_err_t imd_open(DSK_DRIVER *self, const char *filename);
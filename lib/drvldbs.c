@@ -55,6 +55,8 @@ DRV_CLASS dc_ldbsdisk =
 	NULL,			/* Read raw track, including sector headers */
 	ldbsdisk_to_ldbs,	/* Convert to LDBS format (trivially easy) */
 	ldbsdisk_from_ldbs,	/* Convert from LDBS format (ditto) */
+	ldbsdisk_to_stream,	/* Export a track at a time */
+	NULL,			/* Import a track at a time */
 };
 
 
@@ -77,7 +79,9 @@ static dsk_err_t ldbsdisk_flush_cur_track(LDBSDISK_DSK_DRIVER *self)
 						self->ld_cur_cyl, self->ld_cur_head);
 		}
 
-		dsk_free(self->ld_cur_track);
+		/* Hand the header back to the store, so that the next
+		 * track selected can reuse it */
+		ldbs_trackhead_release(self->ld_store, self->ld_cur_track);
 		self->ld_cur_track = NULL;
 		self->ld_cur_cyl = -1;
 		self->ld_cur_head = -1;
@@ -109,36 +113,36 @@ static dsk_err_t ldbsdisk_select_track(LDBSDISK_DSK_DRIVER *self,
 }
 
 
-/* See if the currently-loaded track has the same data rate and recording
- * mode as the caller wants. If not return DSK_ERR_NOADDR */
-static dsk_err_t check_density(LDBSDISK_DSK_DRIVER *self, 
+/* See if a track has the same data rate and recording mode as the
+ * caller wants. If not return DSK_ERR_NOADDR */
+dsk_err_t ldbsdisk_check_density(const LDBS_TRACKHEAD *track, 
 				const DSK_GEOMETRY *geom)
 {
 	unsigned sector_size;
 	unsigned char rate, recording;
 
 	/* No track loaded, test is vacuous */
-	if (!self->ld_cur_track || 0 == self->ld_cur_track->count) return DSK_ERR_OK;
+	if (!track || 0 == track->count) return DSK_ERR_OK;
 
 	/* We have a track loaded... */
 	
 	/* Check if the track density and recording mode match the density
 	 * and recording mode in the geometry. */
-	sector_size = self->ld_cur_track->sector[0].datalen;
+	sector_size = track->sector[0].datalen;
 
-	rate	  = self->ld_cur_track->datarate;
-	recording = self->ld_cur_track->recmode;
+	rate	  = track->datarate;
+	recording = track->recmode;
 
 	/* Guess the data rate used. We assume Double Density, and then
 	 * look at the number of sectors in the track to see if the
 	 * format looks like a High Density one. */
 	if (rate == 0)
 	{
-		if (sector_size == 1024 && self->ld_cur_track->count >= 7)
+		if (sector_size == 1024 && track->count >= 7)
 		{
 			rate = 2; /* ADFS F */
 		}
-		else if (sector_size == 512 && self->ld_cur_track->count >= 15)
+		else if (sector_size == 512 && track->count >= 15)
 		{
 			rate = 2; /* IBM PC 1.2M or 1.4M */
 		}
@@ -149,7 +153,7 @@ static dsk_err_t check_density(LDBSDISK_DSK_DRIVER *self,
 	 * 256-byte sectors and they're recorded using MFM. */
 	if (recording == 0)
 	{
-		if (sector_size == 256 && self->ld_cur_track->count == 10)
+		if (sector_size == 256 && track->count == 10)
 		{
 			recording = 1;  /* BBC Micro DFS */
 		}
@@ -192,6 +196,13 @@ static dsk_err_t check_density(LDBSDISK_DSK_DRIVER *self,
 }
 
 
+static dsk_err_t check_density(LDBSDISK_DSK_DRIVER *self, 
+				const DSK_GEOMETRY *geom)
+{
+	return ldbsdisk_check_density(self->ld_cur_track, geom);
+}
+
+
 
 /* Open DSK image, checking for the magic number */
 dsk_err_t ldbsdisk_open(DSK_DRIVER *pdriver, const char *filename)
@@ -208,7 +219,8 @@ dsk_err_t ldbsdisk_open(DSK_DRIVER *pdriver, const char *filename)
 	err = ldbs_open(&self->ld_store, filename, type, &self->ld_readonly);
 	if (err) return err;
 	if (memcmp(type, LDBS_DSK_TYPE, 4) &&
-	    memcmp(type, LDBS_DSK_TYPE_V1, 4))
+	    memcmp(type, LDBS_DSK_TYPE_V1, 4) &&
+	    memcmp(type, LDBS_DSK_TYPE_SHARED, 4))
 	{
 		ldbs_close(&self->ld_store);
 		return DSK_ERR_NOTME;
@@ -599,7 +611,6 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 {
 	dsk_err_t err;
 	LDBSDISK_DSK_DRIVER *self;
-	int n;
 	size_t size_actual = size_expect;
 	int allsame;
 	LDBS_SECTOR_ENTRY *cursec;
@@ -612,15 +623,7 @@ dsk_err_t ldbsdisk_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 	if (self->ld_readonly) return DSK_ERR_RDONLY;
 
 	/* See if the requested sector contains all the same values */
-	allsame = 1;
-	for (n = 1; n < (int)size_expect; n++)
-	{
-		if (data[n] != data[0]) 
-		{
-			allsame = 0;
-			break;
-		}
-	}
+	allsame = (dsk_run_length(data, size_expect) == size_expect);
 
 	/* See if the requested cylinder exists */
 	err = ldbsdisk_select_track(self, cylinder, head);
@@ -723,7 +726,8 @@ dsk_err_t ldbsdisk_format(DSK_DRIVER *pdriver, DSK_GEOMETRY *geom,
 
 	/* The track's sectors have been removed. All that remains is 
 	 * its header (empty). Create a new header that will replace it. */
-	self->ld_cur_track = ldbs_trackhead_alloc(geom->dg_sectors);
+	self->ld_cur_track = ldbs_trackhead_reuse(self->ld_store, 
+							geom->dg_sectors);
 	if (!self->ld_cur_track)
 	{
 		return DSK_ERR_NOMEM;
@@ -1040,12 +1044,12 @@ dsk_err_t ldbsdisk_status(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
 
 
 
-/* CP/M-specific filesystem parameters */
+/* CP/M-specific filesystem parameters, then options for the LDBS file */
 static char *option_names[] = 
 {
 	"FS:CP/M:BSH", "FS:CP/M:BLM", "FS:CP/M:EXM",
 	"FS:CP/M:DSM", "FS:CP/M:DRM", "FS:CP/M:AL0", "FS:CP/M:AL1",
-	"FS:CP/M:CKS", "FS:CP/M:OFF",
+	"FS:CP/M:CKS", "FS:CP/M:OFF", "LDBS:DEDUP",
 };
 
 #define MAXOPTION (sizeof(option_names) / sizeof(option_names[0]))
@@ -1101,6 +1105,7 @@ dsk_err_t ldbsdisk_option_set(DSK_DRIVER *self, const char *optname, int value)
 			break;
 		case 8: ldbs_self->ld_dpb.off = value;	// OFF
 			break;
+		case 9: return ldbs_set_dedup(ldbs_self->ld_store, value);
 	}
 	return DSK_ERR_OK;
 }
@@ -1123,6 +1128,12 @@ dsk_err_t ldbsdisk_option_get(DSK_DRIVER *self, const char *optname, int *value)
 	}
 	if (idx >= MAXOPTION) return DSK_ERR_BADOPT;
 
+	if (idx == 9)	/* LDBS:DEDUP */
+	{
+		if (value) *value = ldbs_get_dedup(ldbs_self->ld_store);
+		return DSK_ERR_OK;
+	}
+
 	/* If no DPB is populated, return DSK_ERR_NULLOPT */
 	if (ldbs_self->ld_dpb.spt == 0 && ldbs_self->ld_dpb.dsm == 0 &&
 	    ldbs_self->ld_dpb.drm == 0 && ldbs_self->ld_dpb.al[0] == 0)
@@ -1186,6 +1197,27 @@ dsk_err_t ldbsdisk_to_ldbs(DSK_DRIVER *self, struct ldbs **result, 						DSK_GEO
 	return ldbsdisk_attach(self);
 }
 
+/* Export a track at a time. The tracks are already in our blockstore, 
+ * so they are passed on from there and 'store' isn't needed. */
+dsk_err_t ldbsdisk_to_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param)
+{
+	dsk_err_t err, err2;
+	LDBSDISK_DSK_DRIVER *ldbs_self;
+
+	if (!self || !sink) return DSK_ERR_BADPTR;
+	DC_CHECK(self)
+	ldbs_self = (LDBSDISK_DSK_DRIVER *)self;
+
+	/* Ensure our blockstore is up to date */
+	err = ldbsdisk_detach(self);
+	if (err) return err;
+
+	err  = ldbs_all_tracks(ldbs_self->ld_store, sink, SIDES_ALT, param);
+	err2 = ldbsdisk_attach(self);
+	return err ? err : err2;
+}
+
 /* Import from LDBS format. */
 dsk_err_t ldbsdisk_from_ldbs(DSK_DRIVER *self, struct ldbs *source, 
 				DSK_GEOMETRY *geom)
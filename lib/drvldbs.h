@@ -45,6 +45,12 @@ typedef struct
  * attempting to write back the contents of ld_store */
 dsk_err_t ldbsdisk_attach(DSK_DRIVER *self);
 dsk_err_t ldbsdisk_detach(DSK_DRIVER *self);
+/* Empty the current track, deleting the blocks that held its sectors */
+dsk_err_t ldbsdisk_wipe_track(LDBSDISK_DSK_DRIVER *self);
+/* Returns DSK_ERR_NOADDR if a track can't be read with 'geom' because
+ * its data rate or recording mode is wrong */
+dsk_err_t ldbsdisk_check_density(const LDBS_TRACKHEAD *track,
+				const DSK_GEOMETRY *geom);
 
 dsk_err_t ldbsdisk_open(DSK_DRIVER *self, const char *filename);
 dsk_err_t ldbsdisk_creat(DSK_DRIVER *self, const char *filename);
@@ -89,3 +95,7 @@ dsk_err_t ldbsdisk_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY
 /* Convert from LDBS format. */
 dsk_err_t ldbsdisk_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom);
 
+/* Export a track at a time, straight from the blockstore. */
+dsk_err_t ldbsdisk_to_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param);
+
@@ -60,7 +60,9 @@ DRV_CLASS dc_logical =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	logical_to_ldbs,	/* export as LDBS */
-	logical_from_ldbs	/* import as LDBS */
+	logical_from_ldbs,	/* import as LDBS */
+	logical_to_stream,	/* export a track at a time */
+	logical_from_stream	/* import a track at a time */
 };
 
 dsk_err_t logical_open(DSK_DRIVER *self, const char *filename)
@@ -84,6 +86,7 @@ dsk_err_t logical_open(DSK_DRIVER *self, const char *filename)
  * and under UNIX, the entire directory is filled with zeroes. */
         if (fseek(lpxself->lpx_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
         lpxself->lpx_filesize = ftell(lpxself->lpx_fp);
+	dsk_fill_options(self);
 
 	return DSK_ERR_OK;
 }
@@ -101,6 +104,7 @@ dsk_err_t logical_creat(DSK_DRIVER *self, const char *filename)
 	lpxself->lpx_readonly = 0;
 	if (!lpxself->lpx_fp) return DSK_ERR_SYSERR;
 	lpxself->lpx_filesize = 0;
+	dsk_fill_options(self);
 	return DSK_ERR_OK;
 }
 
@@ -156,11 +160,9 @@ static dsk_err_t seekto(LOGICAL_DSK_DRIVER *self, unsigned long offset)
 	if (self->lpx_filesize < offset)
 	{
 		if (fseek(self->lpx_fp, self->lpx_filesize, SEEK_SET)) return DSK_ERR_SYSERR;
-		while (self->lpx_filesize < offset)
-		{
-			if (fputc(0xE5, self->lpx_fp) == EOF) return DSK_ERR_SYSERR;
-			++self->lpx_filesize;
-		}
+		if (dsk_fill(self->lpx_fp, 0xE5, offset - self->lpx_filesize))
+			return DSK_ERR_SYSERR;
+		self->lpx_filesize = offset;
 	}
 	if (fseek(self->lpx_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 	return DSK_ERR_OK;
@@ -225,12 +227,12 @@ dsk_err_t logical_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 
 	err = seekto(lpxself, offset);
 	if (err) return err;
+	err = dsk_fill_at(self, lpxself->lpx_fp, lpxself->lpx_filesize, offset,
+			filler, trklen);
+	if (err) return err;
 	if (lpxself->lpx_filesize < offset + trklen)
 		lpxself->lpx_filesize = offset + trklen;
 
-	while (trklen--) 
-		if (fputc(filler, lpxself->lpx_fp) == EOF) return DSK_ERR_SYSERR;	
-
 	return DSK_ERR_OK;
 }
 
@@ -274,12 +276,16 @@ dsk_err_t logical_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 }
 
 
-dsk_err_t logical_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom)
+/* Read the disc a track at a time into 'store'. If 'sink' is NULL the
+ * tracks are kept there; otherwise each track is passed to the sink as
+ * soon as it has been read, and then dropped again. */
+static dsk_err_t logical_export(DSK_DRIVER *self, PLDBS store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param)
 {
 	unsigned char bootblock[512];
 	DSK_GEOMETRY bootgeom;
 	LOGICAL_DSK_DRIVER *lpxself;
-	dsk_err_t err;
+	dsk_err_t err = DSK_ERR_OK;
 	dsk_pcyl_t cyl;
 	dsk_phead_t head;
 	dsk_psect_t sec;
@@ -287,7 +293,7 @@ dsk_err_t logical_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *
 	LDBS_TRACKHEAD *th;
 	int n;
 
-	if (!self || !result || self->dr_class != &dc_logical) return DSK_ERR_BADPTR;
+	if (self->dr_class != &dc_logical) return DSK_ERR_BADPTR;
 	lpxself = (LOGICAL_DSK_DRIVER *)self;
 
 	if (lpxself->lpx_readonly) return DSK_ERR_RDONLY;
@@ -305,47 +311,24 @@ dsk_err_t logical_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *
 
 		geom = &bootgeom;	
 	}
-	secbuf = dsk_malloc(geom->dg_secsize);
+	secbuf = dsk_pool_alloc(self, geom->dg_secsize);
 	if (!secbuf) return DSK_ERR_NOMEM;
 
-	err = ldbs_new(result, NULL, LDBS_DSK_TYPE);
-	if (err)
-	{
-		dsk_free(secbuf);
-		return err;
-	}
-	/* If a geometry was provided, save it in the file */
-	if (geom != &bootgeom)
+	for (cyl = 0; cyl < geom->dg_cylinders && !err; cyl++)
+	    for (head = 0; head < geom->dg_heads && !err; head++)
 	{
-		err = ldbs_put_geometry(*result, geom);
-		if (err)
-		{
-			ldbs_close(result);
-			dsk_free(secbuf);
-			return err;
-		}
-	}
-	for (cyl = 0; cyl < geom->dg_cylinders; cyl++)
-	    for (head = 0; head < geom->dg_heads; head++)
-	{
-		th = ldbs_trackhead_alloc(geom->dg_sectors);
+		th = ldbs_trackhead_reuse(store, geom->dg_sectors);
 		if (!th)
 		{
-			dsk_free(secbuf);
-			ldbs_close(result);
-			return DSK_ERR_NOMEM;
+			err = DSK_ERR_NOMEM;
+			break;
 		}
 		for (sec = 0; sec < geom->dg_sectors; sec++)
 		{
 			err = logical_read(self, geom, secbuf, cyl, head, 
 					sec + geom->dg_secbase);
-			if (err)
-			{
-				ldbs_free(th);
-				dsk_free(secbuf);
-				ldbs_close(result);
-				return err;
-			}
+			if (err) break;
+
 			th->sector[sec].id_cyl  = cyl;
 			th->sector[sec].id_head = head;
 			th->sector[sec].id_sec  = sec + geom->dg_secbase;
@@ -370,30 +353,56 @@ dsk_err_t logical_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *
 			
 				ldbs_encode_secid(secid, cyl, head, 	
 						sec + geom->dg_secbase);
-				err = ldbs_putblock(*result, 
+				err = ldbs_putblock(store, 
 						&th->sector[sec].blockid,
 							secid, secbuf,
 							geom->dg_secsize);
-				if (err)
-				{
-					ldbs_free(th);
-					dsk_free(secbuf);
-					ldbs_close(result);
-					return err;
-				}
+				if (err) break;
 			}	
 		}	/* End of loop over sectors */
-		err = ldbs_put_trackhead(*result, th, cyl, head);
-		ldbs_free(th);
-		if (err)
+		if (!err)
 		{
-			dsk_free(secbuf);
-			ldbs_close(result);
-			return err;
+			if (sink) err = (*sink)(store, cyl, head, th, param);
+			else	  err = ldbs_put_trackhead(store, th, cyl, head);
+		}
+		/* When streaming, the track's sectors are finished with */
+		if (sink) for (sec = 0; sec < geom->dg_sectors; sec++)
+		{
+			if (th->sector[sec].blockid)
+				ldbs_delblock(store, th->sector[sec].blockid);
 		}
+		ldbs_trackhead_release(store, th);
 	}	/* End of loop over cyls / heads */
-	dsk_free(secbuf);	
-	return ldbs_sync(*result);
+	dsk_pool_free(self, secbuf);	
+	return err;
+}
+
+
+dsk_err_t logical_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom)
+{
+	dsk_err_t err;
+
+	if (!self || !result || self->dr_class != &dc_logical) return DSK_ERR_BADPTR;
+
+	err = ldbs_new(result, NULL, LDBS_DSK_TYPE);
+	if (err) return err;
+
+	/* If a geometry was provided, save it in the file */
+	if (geom) err = ldbs_put_geometry(*result, geom);
+	if (!err) err = logical_export(self, *result, geom, NULL, NULL);
+	if (!err) return ldbs_sync(*result);
+
+	ldbs_close(result);
+	return err;
+}
+
+
+dsk_err_t logical_to_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param)
+{
+	if (!self || !store || !sink) return DSK_ERR_BADPTR;
+
+	return logical_export(self, store, geom, sink, param);
 }
 
 static dsk_err_t logical_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
@@ -427,10 +436,25 @@ static dsk_err_t logical_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 
 
 
+/* Erase anything existing in the file, ready for an import */
+static dsk_err_t logical_erase(LOGICAL_DSK_DRIVER *lpxself, DSK_GEOMETRY *geom)
+{
+	lpxself->lpx_export_geom = geom;
+	if (fseek(lpxself->lpx_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+
+	if (dsk_fill(lpxself->lpx_fp, 0xE5, lpxself->lpx_filesize))
+		return DSK_ERR_SYSERR;
+	if (fseek(lpxself->lpx_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+
+	lpxself->lpx_secbuf = dsk_malloc(geom->dg_secsize);
+	if (!lpxself->lpx_secbuf) return DSK_ERR_NOMEM;
+	return DSK_ERR_OK;
+}
+
+
 dsk_err_t logical_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom)
 {
 	LOGICAL_DSK_DRIVER *lpxself;
-	long pos;
 	dsk_err_t err;
 
 	if (!self || !source || self->dr_class != &dc_logical) return DSK_ERR_BADPTR;
@@ -442,26 +466,64 @@ dsk_err_t logical_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY
 		/* XXX Probe geometry from boot sector */
 		return DSK_ERR_BADFMT;
 	}
-
-	lpxself->lpx_export_geom = geom;
-	/* Erase anything existing in the file */
-	if (fseek(lpxself->lpx_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
-
-	for (pos = 0; pos < (long)(lpxself->lpx_filesize); pos++)
-	{
-		if (fputc(0xE5, lpxself->lpx_fp) == EOF) return DSK_ERR_SYSERR;
-	}
-	if (fseek(lpxself->lpx_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
-
-	lpxself->lpx_secbuf = dsk_malloc(geom->dg_secsize);
-	if (!lpxself->lpx_secbuf) return DSK_ERR_NOMEM;
+	err = logical_erase(lpxself, geom);
+	if (err) return err;
 
 	/* And populate with whatever is in the blockstore */	
 	err =  ldbs_all_sectors(source, logical_from_ldbs_callback,
 				geom->dg_sidedness, lpxself);
 	dsk_free(lpxself->lpx_secbuf);
+	lpxself->lpx_secbuf = NULL;
 	return err;
 }
 
 
+/* Streamed import: write out each track's sectors as they arrive */
+static dsk_err_t logical_from_stream_callback(PLDBS ldbs, dsk_pcyl_t cyl,
+	 dsk_phead_t head, LDBS_TRACKHEAD *th, void *param)
+{
+	LOGICAL_DSK_DRIVER *lpxself = param;
+	dsk_err_t err;
+	int n;
+
+	/* End of the copy */
+	if (!th)
+	{
+		dsk_free(lpxself->lpx_secbuf);
+		lpxself->lpx_secbuf = NULL;
+		return DSK_ERR_OK;
+	}
+	for (n = 0; n < th->count; n++)
+	{
+		err = logical_from_ldbs_callback(ldbs, cyl, head, 
+				&th->sector[n], th, param);
+		if (err) return err;
+	}
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t logical_from_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK *sink, void **param)
+{
+	LOGICAL_DSK_DRIVER *lpxself;
+	dsk_err_t err;
+
+	if (!self || !store || !sink || !param || 
+	    self->dr_class != &dc_logical) return DSK_ERR_BADPTR;
+
+	lpxself = (LOGICAL_DSK_DRIVER *)self;
+
+	/* Leave logical_from_ldbs() to report the missing geometry */
+	if (!geom) return DSK_ERR_NOTIMPL;
+
+	err = logical_erase(lpxself, geom);
+	if (err) return err;
+
+	*sink  = logical_from_stream_callback;
+	*param = lpxself;
+	return DSK_ERR_OK;
+}
+
+
 
@@ -51,4 +51,8 @@ dsk_err_t logical_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
                                 dsk_phead_t head, unsigned char *result);
 dsk_err_t logical_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom);
 dsk_err_t logical_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom);
+dsk_err_t logical_to_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param);
+dsk_err_t logical_from_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK *sink, void **param);
 
@@ -89,6 +89,7 @@ dsk_err_t nwasp_open(DSK_DRIVER *self, const char *filename)
  * and under UNIX, the entire directory is filled with zeroes. */
         if (fseek(nwself->nw_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
         nwself->nw_filesize = ftell(nwself->nw_fp);
+	dsk_fill_options(self);
 
 	return DSK_ERR_OK;
 }
@@ -105,6 +106,7 @@ dsk_err_t nwasp_creat(DSK_DRIVER *self, const char *filename)
 	nwself->nw_readonly = 0;
 	if (!nwself->nw_fp) return DSK_ERR_SYSERR;
 	nwself->nw_filesize = 0;
+	dsk_fill_options(self);
 	return DSK_ERR_OK;
 }
 
@@ -164,11 +166,9 @@ static dsk_err_t seekto(NWASP_DSK_DRIVER *self, unsigned long offset)
 	if (self->nw_filesize < offset)
 	{
 		if (fseek(self->nw_fp, self->nw_filesize, SEEK_SET)) return DSK_ERR_SYSERR;
-		while (self->nw_filesize < offset)
-		{
-			if (fputc(0xE5, self->nw_fp) == EOF) return DSK_ERR_SYSERR;
-			++self->nw_filesize;
-		}
+		if (dsk_fill(self->nw_fp, 0xE5, offset - self->nw_filesize))
+			return DSK_ERR_SYSERR;
+		self->nw_filesize = offset;
 	}
 	if (fseek(self->nw_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 	return DSK_ERR_OK;
@@ -235,12 +235,12 @@ dsk_err_t nwasp_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 
 	err = seekto(nwself, offset);
 	if (err) return err;
+	err = dsk_fill_at(self, nwself->nw_fp, nwself->nw_filesize, offset,
+			filler, trklen);
+	if (err) return err;
 	if (nwself->nw_filesize < offset + trklen)
 		nwself->nw_filesize = offset + trklen;
 
-	while (trklen--) 
-		if (fputc(filler, nwself->nw_fp) == EOF) return DSK_ERR_SYSERR;	
-
 	return DSK_ERR_OK;
 }
 
@@ -463,7 +463,6 @@ static dsk_err_t nwasp_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 dsk_err_t nwasp_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom)
 {
 	NWASP_DSK_DRIVER *nwasp_self;
-	long pos;
 
 	if (!self || !source || self->dr_class != &dc_nwasp) 
 		return DSK_ERR_BADPTR;
@@ -474,10 +473,8 @@ dsk_err_t nwasp_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *g
 	/* Erase anything existing in the file */
 	if (fseek(nwasp_self->nw_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
 
-	for (pos = 0; pos < (long)(nwasp_self->nw_filesize); pos++)
-	{
-		if (fputc(0xE5, nwasp_self->nw_fp) == EOF) return DSK_ERR_SYSERR;
-	}
+	if (dsk_fill(nwasp_self->nw_fp, 0xE5, nwasp_self->nw_filesize))
+		return DSK_ERR_SYSERR;
 
 	/* And populate with whatever is in the blockstore */	
 	return ldbs_all_sectors(source, nwasp_from_ldbs_callback,
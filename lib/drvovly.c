@@ -0,0 +1,869 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Copy-on-write overlay on another disc image.
+ *
+ * The overlay is an LDBS disc (the 'delta') holding only the tracks that
+ * have been written to or formatted. Anything else is read from the base
+ * image, which is never written to except by dsk_overlay_commit(). The
+ * first write to a track copies the whole track up from the base into
+ * the delta, and from then on the track is read and written there.
+ *
+ * An overlay is opened either with dsk_overlay(), on a drive that is
+ * already open, or with dsk_open() / dsk_creat() on a filename of the
+ * form "overlay:base,delta". */
+
+#include <stdio.h>
+#include "libdsk.h"
+#include "drvi.h"
+#include "drvldbs.h"
+#include "drvovly.h"
+
+
+DRV_CLASS dc_overlay =
+{
+	sizeof(OVERLAY_DSK_DRIVER),
+	&dc_ldbsdisk,	/* superclass */
+	"overlay\0",
+	"Copy-on-write overlay",
+	ovl_open,	/* open */
+	ovl_creat,	/* create new */
+	ovl_close,	/* close */
+	ovl_read,	/* read sector, working from physical address */
+	ovl_write,	/* write sector, working from physical address */
+	NULL,		/* format track: as LDBS */
+	ovl_getgeom,	/* get geometry */
+	ovl_secid,	/* logical sector ID */
+	ovl_xseek,	/* seek to track */
+	ovl_status,	/* get drive status */
+	ovl_xread,	/* read sector */
+	ovl_xwrite,	/* write sector */
+	NULL,		/* Read a track (8272 READ TRACK command) */
+	NULL,		/* Read a track: Version where the sector ID doesn't necessarily match */
+	ovl_option_enum,	/* List driver-specific options */
+	ovl_option_set,		/* Set a driver-specific option */
+	ovl_option_get,		/* Get a driver-specific option */
+	ovl_trackids,		/* Read headers for an entire track at once */
+	NULL,			/* Read raw track, including sector headers */
+	ovl_to_ldbs,		/* Convert to LDBS format */
+	ovl_from_ldbs,		/* Convert from LDBS format */
+	ovl_to_stream,		/* Export a track at a time */
+	NULL,			/* Import a track at a time */
+};
+
+#define DC_CHECK(self) if (!drv_instanceof(self, &dc_overlay)) return DSK_ERR_BADPTR;
+
+
+/* Geometry to pass to the base drive. Any complementing of the data is
+ * done by the dsk_* call on the overlay, so it mustn't be done again
+ * on the base. */
+static const DSK_GEOMETRY *base_geom(const DSK_GEOMETRY *geom,
+		DSK_GEOMETRY *buf)
+{
+	if (!(geom->dg_fm & RECMODE_COMPLEMENT)) return geom;
+
+	memcpy(buf, geom, sizeof(*buf));
+	buf->dg_fm &= ~RECMODE_COMPLEMENT;
+	return buf;
+}
+
+
+/* Is the given track in the delta? This loads it as the current track
+ * if it is, and records that it isn't if not, so asking again is cheap. */
+static dsk_err_t in_delta(OVERLAY_DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+		dsk_pcyl_t cylinder, dsk_phead_t head, int *result)
+{
+	dsk_err_t err;
+
+	err = ldbsdisk_xseek(&self->ov_super.ld_super, geom, cylinder, head);
+	*result = (self->ov_super.ld_cur_track != NULL);
+	return err;
+}
+
+
+/* Copy a track from 'source' into an LDBS disc. The track is formatted 
+ * with the sector IDs found on the source, and then each sector is copied
+ * across. Sectors that can't be read are marked with the error that 
+ * reading them gave, and a blank track becomes one with no sectors. 
+ *
+ * The overlay does this to the first write to a track, from its base into 
+ * its delta; dsk_diff() does it to make its deltas. */
+dsk_err_t ovl_copy_track(LDBSDISK_DSK_DRIVER *ld, DSK_PDRIVER source,
+		const DSK_GEOMETRY *geom, dsk_pcyl_t cylinder, 
+		dsk_phead_t head)
+{
+	DSK_GEOMETRY dg;
+	DSK_FORMAT *ids = NULL;
+	dsk_psect_t count, n;
+	unsigned char *buf;
+	size_t buflen = geom->dg_secsize;
+	LDBS_SECTOR_ENTRY *se;
+	int deleted;
+	dsk_err_t err, err2;
+
+	memcpy(&dg, geom, sizeof(dg));
+	dg.dg_fm &= ~RECMODE_COMPLEMENT;
+	dg.dg_noskip = 1;
+
+	err = dsk_trackids_geom(source, &dg, cylinder, head, &count, &ids);
+	if (err == DSK_ERR_NOADDR)
+	{
+		count = 0;
+		err = DSK_ERR_OK;
+	}
+	if (err) return err;
+
+	for (n = 0; n < count; n++)
+	{
+		if (ids[n].fmt_secsize > buflen) buflen = ids[n].fmt_secsize;
+	}
+	buf = dsk_malloc(buflen);
+	if (!buf)
+	{
+		if (ids) dsk_free(ids);
+		return DSK_ERR_NOMEM;
+	}
+	dg.dg_sectors = count;
+	err = ldbsdisk_format(&ld->ld_super, &dg, cylinder, head, ids,
+			0xE5);
+	for (n = 0; !err && n < count; n++)
+	{
+		err2 = dsk_read_id(source, &dg, buf, cylinder, head, &ids[n],
+				&deleted);
+		if (err2 == DSK_ERR_OK || err2 == DSK_ERR_DATAERR)
+		{
+			err = ldbsdisk_xwrite(&ld->ld_super, &dg, buf,
+				cylinder, head, ids[n].fmt_cylinder,
+				ids[n].fmt_head, ids[n].fmt_sector,
+				ids[n].fmt_secsize, deleted);
+			if (err) break;
+		}
+		else if (err2 != DSK_ERR_NOADDR && err2 != DSK_ERR_NODATA)
+		{
+			err = err2;
+			break;
+		}
+		if (err2 == DSK_ERR_OK) continue;
+
+		/* Record the error against the sector */
+		err = ldbsdisk_xseek(&ld->ld_super, &dg, cylinder, head);
+		if (err || !ld->ld_cur_track) break;
+		se = &ld->ld_cur_track->sector[n];
+		switch (err2)
+		{
+			case DSK_ERR_DATAERR: se->st1 |= 0x20;
+					      se->st2 |= 0x20; break;
+			case DSK_ERR_NODATA:  se->st1 |= 0x04; break;
+			case DSK_ERR_NOADDR:  se->st1 |= 0x01; break;
+		}
+		ld->ld_cur_track->dirty = 1;
+	}
+	dsk_free(buf);
+	if (ids) dsk_free(ids);
+	/* Don't leave a half-copied track in the delta */
+	if (err && !ldbsdisk_xseek(&ld->ld_super, &dg, cylinder, head) &&
+		ld->ld_cur_track)
+	{
+		ldbsdisk_wipe_track(ld);
+		ldbs_put_trackhead(ld->ld_store, NULL, cylinder, head);
+	}
+	return err;
+}
+
+
+/* Open or create the delta. If 'deltaname' is NULL, it is a temporary
+ * file which goes away when the overlay is closed. */
+static dsk_err_t attach_delta(OVERLAY_DSK_DRIVER *self, const char *deltaname,
+		int create)
+{
+	LDBSDISK_DSK_DRIVER *ld = &self->ov_super;
+	FILE *fp;
+	char type[4];
+	dsk_err_t err;
+
+	if (deltaname)
+	{
+		self->ov_deltaname = dsk_malloc_string(deltaname);
+		if (!self->ov_deltaname) return DSK_ERR_NOMEM;
+		/* An existing delta is used, unless we were asked for a
+		 * new one */
+		if (!create && (fp = fopen(deltaname, "rb")) != NULL)
+		{
+			fclose(fp);
+			ld->ld_readonly = 0;
+			err = ldbs_open(&ld->ld_store, deltaname, type,
+					&ld->ld_readonly);
+			if (!err && memcmp(type, LDBS_DSK_TYPE, 4) &&
+				    memcmp(type, LDBS_DSK_TYPE_SHARED, 4))
+			{
+				ldbs_close(&ld->ld_store);
+				err = DSK_ERR_BADFMT;
+			}
+			if (!err) err = ldbsdisk_attach(&ld->ld_super);
+			if (err)
+			{
+				if (ld->ld_store) ldbs_close(&ld->ld_store);
+				dsk_free(self->ov_deltaname);
+				self->ov_deltaname = NULL;
+			}
+			return err;
+		}
+	}
+	ld->ld_readonly = 0;
+	err = ldbs_new(&ld->ld_store, deltaname, LDBS_DSK_TYPE);
+	if (!err) err = ldbs_put_creator(ld->ld_store, "LIBDSK " LIBDSK_VERSION);
+	if (!err) err = ldbsdisk_attach(&ld->ld_super);
+	if (err)
+	{
+		if (ld->ld_store) ldbs_close(&ld->ld_store);
+		if (self->ov_deltaname) dsk_free(self->ov_deltaname);
+		self->ov_deltaname = NULL;
+	}
+	return err;
+}
+
+
+static dsk_err_t ovl_open_create(DSK_DRIVER *pdriver, const char *filename,
+		int create)
+{
+	OVERLAY_DSK_DRIVER *self;
+	const char *sep;
+	char *basename;
+	dsk_err_t err;
+
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	/* Filename passed is of the format: overlay:base,delta */
+	if (strncmp(filename, "overlay:", 8)) return DSK_ERR_NOTME;
+	sep = strrchr(filename + 8, ',');
+	if (!sep || sep == filename + 8 || !sep[1]) return DSK_ERR_NOTME;
+
+	basename = dsk_malloc(sep - filename - 7);
+	if (!basename) return DSK_ERR_NOMEM;
+	memcpy(basename, filename + 8, sep - filename - 8);
+	basename[sep - filename - 8] = 0;
+	err = dsk_open(&self->ov_base, basename, NULL, NULL);
+	dsk_free(basename);
+	if (err) return err;
+
+	err = attach_delta(self, sep + 1, create);
+	if (err) dsk_close(&self->ov_base);
+	return err;
+}
+
+
+dsk_err_t ovl_open(DSK_DRIVER *self, const char *filename)
+{
+	return ovl_open_create(self, filename, 0);
+}
+
+
+dsk_err_t ovl_creat(DSK_DRIVER *self, const char *filename)
+{
+	return ovl_open_create(self, filename, 1);
+}
+
+
+dsk_err_t ovl_close(DSK_DRIVER *pdriver)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err, err2 = DSK_ERR_OK;
+
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = ldbsdisk_close(pdriver);
+	if (self->ov_base) err2 = dsk_close(&self->ov_base);
+	if (self->ov_deltaname) dsk_free(self->ov_deltaname);
+	self->ov_deltaname = NULL;
+	return err ? err : err2;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_overlay(DSK_PDRIVER *result,
+		DSK_PDRIVER base, const char *deltaname)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+
+	if (!result || !base) return DSK_ERR_BADPTR;
+
+	self = dsk_malloc(sizeof(OVERLAY_DSK_DRIVER));
+	if (!self) return DSK_ERR_NOMEM;
+	memset(self, 0, sizeof(OVERLAY_DSK_DRIVER));
+	self->ov_super.ld_super.dr_class = &dc_overlay;
+	self->ov_super.ld_super.dr_retry_count = 1;
+	self->ov_base = base;
+
+	err = attach_delta(self, deltaname, 0);
+	if (err)
+	{
+		dsk_free(self);
+		return err;
+	}
+	*result = &self->ov_super.ld_super;
+	return DSK_ERR_OK;
+}
+
+
+/* Write one track of a delta to the drive it applies to. The track is 
+ * only reformatted if its sector layout has changed. A track with no 
+ * sectors is reformatted with none, which fails on drives that can't 
+ * hold an empty track. */
+typedef struct
+{
+	DSK_PDRIVER target;
+	const DSK_GEOMETRY *geom;
+} COMMIT_PARAM;
+
+static dsk_err_t commit_track(PLDBS store, dsk_pcyl_t cylinder,
+		dsk_phead_t head, LDBS_TRACKHEAD *th, void *param)
+{
+	COMMIT_PARAM *cp = param;
+	DSK_PDRIVER base = cp->target;
+	DSK_GEOMETRY dg;
+	DSK_FORMAT *ids = NULL, *fmt = NULL, blank;
+	dsk_psect_t count, n;
+	unsigned char *buf;
+	size_t len, buflen = cp->geom->dg_secsize;
+	char type[4];
+	int same;
+	dsk_err_t err;
+
+	memcpy(&dg, cp->geom, sizeof(dg));
+	dg.dg_fm &= ~RECMODE_COMPLEMENT;
+
+	if (th->count)
+	{
+		fmt = dsk_malloc(th->count * sizeof(DSK_FORMAT));
+		if (!fmt) return DSK_ERR_NOMEM;
+	}
+	for (n = 0; n < th->count; n++)
+	{
+		fmt[n].fmt_cylinder = th->sector[n].id_cyl;
+		fmt[n].fmt_head     = th->sector[n].id_head;
+		fmt[n].fmt_sector   = th->sector[n].id_sec;
+		fmt[n].fmt_secsize  = th->sector[n].datalen;
+		if (fmt[n].fmt_secsize > buflen) buflen = fmt[n].fmt_secsize;
+	}
+	err = dsk_trackids_geom(base, &dg, cylinder, head, &count, &ids);
+	if (err == DSK_ERR_NOADDR)
+	{
+		count = 0;
+		err = DSK_ERR_OK;
+	}
+	same = (!err && count == th->count &&
+		dsk_same_trackids(ids, fmt, count));
+	if (ids) dsk_free(ids);
+	ids = NULL;
+
+	err = DSK_ERR_OK;
+	if (!same)
+	{
+		dg.dg_sectors = th->count;
+		memset(&blank, 0, sizeof(blank));
+		err = dsk_pformat(base, &dg, cylinder, head, 
+				fmt ? fmt : &blank, th->filler);
+		memcpy(&dg, cp->geom, sizeof(dg));
+		dg.dg_fm &= ~RECMODE_COMPLEMENT;
+	}
+	/* A driver with no way to record an empty track will have left
+	 * sectors on it */
+	if (!same && !err && !th->count)
+	{
+		err = dsk_trackids_geom(base, &dg, cylinder, head, 
+				&count, &ids);
+		if (err == DSK_ERR_NOADDR) 
+		{
+			count = 0;
+			err = DSK_ERR_OK;
+		}
+		if (ids) dsk_free(ids);
+		if (!err && count) err = DSK_ERR_BADFMT;
+	}
+	buf = dsk_malloc(buflen);
+	if (!buf) err = DSK_ERR_NOMEM;
+	for (n = 0; !err && n < th->count; n++)
+	{
+		LDBS_SECTOR_ENTRY *se = &th->sector[n];
+
+		len = se->datalen;
+		if (se->copies == 0 || se->blockid == LDBLOCKID_NULL)
+		{
+			memset(buf, se->filler, len);
+		}
+		else
+		{
+			err = ldbs_getblock(store, se->blockid, type, buf, &len);
+			if (err == DSK_ERR_OVERRUN) err = DSK_ERR_OK;
+			if (err) break;
+			if (len < se->datalen)
+				memset(buf + len, se->filler, se->datalen - len);
+		}
+		err = dsk_xwrite(base, &dg, buf, cylinder, head,
+				se->id_cyl, se->id_head, se->id_sec,
+				se->datalen, (se->st1 & 0x40) ? 1 : 0);
+		if (err == DSK_ERR_NOTIMPL && !(se->st1 & 0x40) &&
+				se->datalen == dg.dg_secsize)
+		{
+			err = dsk_pwrite(base, &dg, buf, cylinder, head,
+					se->id_sec);
+		}
+	}
+	if (buf) dsk_free(buf);
+	if (fmt) dsk_free(fmt);
+	return err;
+}
+
+
+/* Write every track in 'delta' to 'target' */
+dsk_err_t ovl_apply_delta(DSK_PDRIVER target, const DSK_GEOMETRY *geom,
+		struct ldbs *delta)
+{
+	COMMIT_PARAM cp;
+
+	cp.target = target;
+	cp.geom = geom;
+	return ldbs_all_tracks(delta, commit_track, SIDES_ALT, &cp);
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_overlay_commit(DSK_PDRIVER pdriver,
+		const DSK_GEOMETRY *geom)
+{
+	OVERLAY_DSK_DRIVER *self;
+	LDBSDISK_DSK_DRIVER *ld;
+	int dedup;
+	char type[4];
+	dsk_err_t err, err2;
+
+	if (!pdriver || !geom) return DSK_ERR_BADPTR;
+	if (!drv_instanceof(pdriver, &dc_overlay)) return DSK_ERR_NOTIMPL;
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+	ld = &self->ov_super;
+
+	if (ld->ld_readonly) return DSK_ERR_RDONLY;
+
+	err = ldbsdisk_detach(pdriver);
+	if (err) return err;
+
+	err = ovl_apply_delta(self->ov_base, geom, ld->ld_store);
+	if (!err)
+	{
+		/* Everything is in the base now, so start a fresh delta. 
+		 * ldbs_close() lets go of the old one even if it fails. */
+		dedup = ldbs_get_dedup(ld->ld_store);
+		err = ldbs_close(&ld->ld_store);
+		err2 = ldbs_new(&ld->ld_store, self->ov_deltaname,
+					LDBS_DSK_TYPE);
+		if (!err2) 
+		{
+			err2 = ldbs_put_creator(ld->ld_store, 
+					"LIBDSK " LIBDSK_VERSION);
+		}
+		else if (self->ov_deltaname)
+		{
+			/* The old delta has nothing in it that the base 
+			 * doesn't, so it can carry on being used. It hasn't 
+			 * been emptied, so the error still stands. */
+			ldbs_open(&ld->ld_store, self->ov_deltaname, 
+					type, &ld->ld_readonly);
+		}
+		if (ld->ld_store) ldbs_set_dedup(ld->ld_store, dedup);
+		if (!err) err = err2;
+	}
+	/* The drive must be left with a delta to attach to. If there is
+	 * no other, use a temporary one. */
+	if (!ld->ld_store)
+	{
+		ld->ld_readonly = 0;
+		err2 = ldbs_new(&ld->ld_store, NULL, LDBS_DSK_TYPE);
+		if (err2) return err ? err : err2;
+	}
+	err2 = ldbsdisk_attach(pdriver);
+	return err ? err : err2;
+}
+
+
+
+dsk_err_t ovl_read(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+		      void *buf, dsk_pcyl_t cylinder,
+		      dsk_phead_t head, dsk_psect_t sector)
+{
+	OVERLAY_DSK_DRIVER *self;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	int found;
+
+	if (!buf || !geom || !pdriver) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (err) return err;
+	if (found) return ldbsdisk_read(pdriver, geom, buf, cylinder,
+					head, sector);
+	return dsk_pread(self->ov_base, base_geom(geom, &dg), buf,
+			cylinder, head, sector);
+}
+
+
+dsk_err_t ovl_xread(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom, void *buf,
+		       dsk_pcyl_t cylinder,   dsk_phead_t head,
+		       dsk_pcyl_t cyl_expect, dsk_phead_t head_expect,
+		       dsk_psect_t sector, size_t size_expect, int *deleted)
+{
+	OVERLAY_DSK_DRIVER *self;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	int found;
+
+	if (!buf || !geom || !pdriver) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (err) return err;
+	if (found) return ldbsdisk_xread(pdriver, geom, buf, cylinder, head,
+				cyl_expect, head_expect, sector, size_expect,
+				deleted);
+	return dsk_xread(self->ov_base, base_geom(geom, &dg), buf,
+			cylinder, head, cyl_expect, head_expect, sector,
+			size_expect, deleted);
+}
+
+
+dsk_err_t ovl_write(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			const void *buf, dsk_pcyl_t cylinder,
+			dsk_phead_t head, dsk_psect_t sector)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+	int found;
+
+	if (!buf || !geom || !pdriver) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	if (self->ov_super.ld_readonly) return DSK_ERR_RDONLY;
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (!err && !found) err = ovl_copy_track(&self->ov_super, 
+					self->ov_base, geom, cylinder, head);
+	if (err) return err;
+	return ldbsdisk_write(pdriver, geom, buf, cylinder, head, sector);
+}
+
+
+dsk_err_t ovl_xwrite(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			  const void *buf,
+			  dsk_pcyl_t cylinder,   dsk_phead_t head,
+			  dsk_pcyl_t cyl_expect, dsk_phead_t head_expect,
+			  dsk_psect_t sector, size_t size_expect,
+			  int deleted)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+	int found;
+
+	if (!buf || !geom || !pdriver) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	if (self->ov_super.ld_readonly) return DSK_ERR_RDONLY;
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (!err && !found) err = ovl_copy_track(&self->ov_super, 
+					self->ov_base, geom, cylinder, head);
+	if (err) return err;
+	return ldbsdisk_xwrite(pdriver, geom, buf, cylinder, head,
+			cyl_expect, head_expect, sector, size_expect, deleted);
+}
+
+
+/* Unless the boot sector has been changed, the base can say what its
+ * geometry is. If it has, probe it through the overlay. */
+dsk_err_t ovl_getgeom(DSK_DRIVER *pdriver, DSK_GEOMETRY *geom)
+{
+	OVERLAY_DSK_DRIVER *self;
+	LDBS_TRACKHEAD *th;
+	dsk_err_t err;
+
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = ldbs_get_trackhead(self->ov_super.ld_store, &th, 0, 0);
+	if (err) return err;
+	if (th)
+	{
+		ldbs_trackhead_release(self->ov_super.ld_store, th);
+		return DSK_ERR_NOTME;
+	}
+	return dsk_getgeom(self->ov_base, geom);
+}
+
+
+dsk_err_t ovl_secid(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			dsk_pcyl_t cylinder, dsk_phead_t head,
+			DSK_FORMAT *result)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+	int found;
+
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (err) return err;
+	if (found) return ldbsdisk_secid(pdriver, geom, cylinder, head,
+					result);
+	return dsk_psecid(self->ov_base, geom, cylinder, head, result);
+}
+
+
+dsk_err_t ovl_xseek(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			dsk_pcyl_t cylinder, dsk_phead_t head)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+	int found;
+
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (err || found) return err;
+	return dsk_pseek(self->ov_base, geom, cylinder, head);
+}
+
+
+dsk_err_t ovl_trackids(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			  dsk_pcyl_t cylinder, dsk_phead_t head,
+			  dsk_psect_t *count, DSK_FORMAT **result)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+	int found;
+
+	if (!pdriver || !geom || !result) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = in_delta(self, geom, cylinder, head, &found);
+	if (err) return err;
+	if (found) return ldbsdisk_trackids(pdriver, geom, cylinder, head,
+					count, result);
+	return dsk_ptrackids(self->ov_base, geom, cylinder, head,
+			count, result);
+}
+
+
+/* The base may well be read-only, but the overlay isn't unless the delta
+ * is */
+dsk_err_t ovl_status(DSK_DRIVER *pdriver, const DSK_GEOMETRY *geom,
+			dsk_phead_t head, unsigned char *result)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err;
+
+	if (!pdriver || !geom || !result) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	err = dsk_drive_status(self->ov_base, geom, head, result);
+	if (err) return err;
+	*result &= ~DSK_ST3_RO;
+	if (self->ov_super.ld_readonly) *result |= DSK_ST3_RO;
+	return DSK_ERR_OK;
+}
+
+
+/* Options are those of the base, plus deduplication in the delta */
+dsk_err_t ovl_option_enum(DSK_DRIVER *pdriver, int idx, char **optname)
+{
+	OVERLAY_DSK_DRIVER *self;
+
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	if (idx == 0)
+	{
+		if (optname) *optname = "LDBS:DEDUP";
+		return DSK_ERR_OK;
+	}
+	return dsk_option_enum(self->ov_base, idx - 1, optname);
+}
+
+
+dsk_err_t ovl_option_set(DSK_DRIVER *pdriver, const char *optname, int value)
+{
+	OVERLAY_DSK_DRIVER *self;
+
+	if (!pdriver || !optname) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	if (!strcmp(optname, "LDBS:DEDUP"))
+		return ldbs_set_dedup(self->ov_super.ld_store, value);
+	return dsk_set_option(self->ov_base, optname, value);
+}
+
+
+dsk_err_t ovl_option_get(DSK_DRIVER *pdriver, const char *optname, int *value)
+{
+	OVERLAY_DSK_DRIVER *self;
+
+	if (!pdriver || !optname) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	if (!strcmp(optname, "LDBS:DEDUP"))
+	{
+		if (value) *value = ldbs_get_dedup(self->ov_super.ld_store);
+		return DSK_ERR_OK;
+	}
+	return dsk_get_option(self->ov_base, optname, value);
+}
+
+
+/* Copy a track from one store to another, replacing any track that is
+ * already there. */
+static dsk_err_t merge_track(PLDBS store, dsk_pcyl_t cylinder,
+		dsk_phead_t head, LDBS_TRACKHEAD *th, void *param)
+{
+	PLDBS target = param;
+	LDBS_TRACKHEAD *old, *copy;
+	void *buf;
+	size_t len;
+	char type[4];
+	int n;
+	dsk_err_t err;
+
+	err = ldbs_get_trackhead(target, &old, cylinder, head);
+	if (err) return err;
+	if (old)
+	{
+		for (n = 0; n < old->count; n++)
+		{
+			if (old->sector[n].blockid == LDBLOCKID_NULL) continue;
+			err = ldbs_delblock(target, old->sector[n].blockid);
+			if (err) break;
+		}
+		ldbs_trackhead_release(target, old);
+		if (err) return err;
+	}
+	copy = ldbs_trackhead_alloc(th->count);
+	if (!copy) return DSK_ERR_NOMEM;
+	copy->datarate  = th->datarate;
+	copy->recmode   = th->recmode;
+	copy->gap3      = th->gap3;
+	copy->filler    = th->filler;
+	copy->total_len = th->total_len;
+	memcpy(copy->sector, th->sector, th->count * sizeof(LDBS_SECTOR_ENTRY));
+	for (n = 0; n < th->count; n++)
+	{
+		if (th->sector[n].blockid == LDBLOCKID_NULL) continue;
+		err = ldbs_getblock_a(store, th->sector[n].blockid, type,
+				&buf, &len);
+		if (err) break;
+		copy->sector[n].blockid = LDBLOCKID_NULL;
+		err = ldbs_putblock(target, &copy->sector[n].blockid, type,
+				buf, len);
+		ldbs_free(buf);
+		if (err) break;
+	}
+	if (!err) err = ldbs_put_trackhead(target, copy, cylinder, head);
+	ldbs_free(copy);
+	return err;
+}
+
+
+/* Convert to LDBS format: the base, with the tracks in the delta laid
+ * over it. */
+dsk_err_t ovl_to_ldbs(DSK_DRIVER *pdriver, struct ldbs **result,
+		DSK_GEOMETRY *geom)
+{
+	OVERLAY_DSK_DRIVER *self;
+	DRV_CLASS *dc;
+	dsk_err_t err, err2;
+
+	if (!pdriver || !result) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	dc = self->ov_base->dr_class;
+	WALK_VTABLE(dc, dc_to_ldbs)
+	if (!dc->dc_to_ldbs) return DSK_ERR_NOTIMPL;
+
+	err = (*dc->dc_to_ldbs)(self->ov_base, result, geom);
+	if (err) return err;
+
+	err = ldbsdisk_detach(pdriver);
+	if (!err) err = ldbs_all_tracks(self->ov_super.ld_store, merge_track,
+					SIDES_ALT, *result);
+	err2 = ldbsdisk_attach(pdriver);
+	if (!err) err = err2;
+	if (err) ldbs_close(result);
+	return err;
+}
+
+
+/* Streamed export has to go through a merged copy, since the tracks come
+ * from two places */
+dsk_err_t ovl_to_stream(DSK_DRIVER *pdriver, struct ldbs *store,
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param)
+{
+	PLDBS merged = NULL;
+	dsk_err_t err;
+
+	if (!pdriver || !sink) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+
+	err = ovl_to_ldbs(pdriver, &merged, geom);
+	if (err) return err;
+	err = ldbs_all_tracks(merged, sink, SIDES_ALT, param);
+	ldbs_close(&merged);
+	return err;
+}
+
+
+/* Import from LDBS format. All the imported tracks go into the delta. */
+dsk_err_t ovl_from_ldbs(DSK_DRIVER *pdriver, struct ldbs *source,
+		DSK_GEOMETRY *geom)
+{
+	OVERLAY_DSK_DRIVER *self;
+	dsk_err_t err, err2;
+
+	if (!pdriver || !source) return DSK_ERR_BADPTR;
+	DC_CHECK(pdriver)
+	self = (OVERLAY_DSK_DRIVER *)pdriver;
+
+	if (self->ov_super.ld_readonly) return DSK_ERR_RDONLY;
+
+	err = ldbsdisk_detach(pdriver);
+	if (err) return err;
+	err = ldbs_all_tracks(source, merge_track, SIDES_ALT,
+			self->ov_super.ld_store);
+	pdriver->dr_dirty = 1;
+	err2 = ldbsdisk_attach(pdriver);
+	return err ? err : err2;
+}
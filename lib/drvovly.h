@@ -0,0 +1,77 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/* Declarations for the copy-on-write overlay driver */
+
+typedef struct
+{
+	LDBSDISK_DSK_DRIVER ov_super;	/* The delta, as an LDBS disc */
+	DSK_PDRIVER ov_base;		/* Image the overlay sits on */
+	char *ov_deltaname;		/* Filename of the delta, NULL if 
+					 * it is a temporary file */
+} OVERLAY_DSK_DRIVER;
+
+extern DRV_CLASS dc_overlay;
+
+/* Used by dsk_diff() as well */
+dsk_err_t ovl_copy_track(LDBSDISK_DSK_DRIVER *ld, DSK_PDRIVER source,
+		const DSK_GEOMETRY *geom, dsk_pcyl_t cylinder, 
+		dsk_phead_t head);
+dsk_err_t ovl_apply_delta(DSK_PDRIVER target, const DSK_GEOMETRY *geom,
+		struct ldbs *delta);
+
+dsk_err_t ovl_open(DSK_DRIVER *self, const char *filename);
+dsk_err_t ovl_creat(DSK_DRIVER *self, const char *filename);
+dsk_err_t ovl_close(DSK_DRIVER *self);
+dsk_err_t ovl_read(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t ovl_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                              const void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t ovl_getgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom);
+dsk_err_t ovl_secid(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                                dsk_pcyl_t cylinder, dsk_phead_t head,
+                                DSK_FORMAT *result);
+dsk_err_t ovl_xseek(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                                dsk_pcyl_t cylinder, dsk_phead_t head);
+dsk_err_t ovl_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                  dsk_phead_t head, unsigned char *result);
+dsk_err_t ovl_xread(DSK_DRIVER *self, const DSK_GEOMETRY *geom, void *buf,
+                              dsk_pcyl_t cylinder, dsk_phead_t head,
+                              dsk_pcyl_t cyl_expected, dsk_phead_t head_expected,
+                              dsk_psect_t sector, size_t sector_size, int *deleted);
+dsk_err_t ovl_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom, const void *buf,
+                              dsk_pcyl_t cylinder, dsk_phead_t head,
+                              dsk_pcyl_t cyl_expected, dsk_phead_t head_expected,
+                              dsk_psect_t sector, size_t sector_size, int deleted);
+dsk_err_t ovl_option_enum(DSK_DRIVER *self, int idx, char **optname);
+dsk_err_t ovl_option_set(DSK_DRIVER *self, const char *optname, int value);
+dsk_err_t ovl_option_get(DSK_DRIVER *self, const char *optname, int *value);
+dsk_err_t ovl_trackids(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
+                            dsk_pcyl_t cylinder, dsk_phead_t head,
+                            dsk_psect_t *count, DSK_FORMAT **result);
+dsk_err_t ovl_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom);
+dsk_err_t ovl_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom);
+dsk_err_t ovl_to_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param);
@@ -59,7 +59,9 @@ DRV_CLASS dc_posixalt =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	posix_to_ldbs,	/* export as LDBS */
-	posix_from_ldbs	/* import as LDBS */
+	posix_from_ldbs, /* import as LDBS */
+	posix_to_stream, /* export a track at a time */
+	posix_from_stream /* import a track at a time */
 };
 
 DRV_CLASS dc_posixoo = 
@@ -88,7 +90,9 @@ DRV_CLASS dc_posixoo =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	posix_to_ldbs,	/* export as LDBS */
-	posix_from_ldbs	/* import as LDBS */
+	posix_from_ldbs, /* import as LDBS */
+	posix_to_stream, /* export a track at a time */
+	posix_from_stream /* import a track at a time */
 };
 
 DRV_CLASS dc_posixob = 
@@ -117,7 +121,9 @@ DRV_CLASS dc_posixob =
 	NULL,		/* trackids */
 	NULL,		/* rtread */
 	posix_to_ldbs,	/* export as LDBS */
-	posix_from_ldbs	/* import as LDBS */
+	posix_from_ldbs, /* import as LDBS */
+	posix_to_stream, /* export a track at a time */
+	posix_from_stream /* import a track at a time */
 };
 
 #define CHECK_CLASS(s) \
@@ -150,6 +156,7 @@ dsk_err_t posix_open(DSK_DRIVER *self, const char *filename, dsk_sides_t s)
  * and under UNIX, the entire directory is filled with zeroes. */
         if (fseek(pxself->px_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
         pxself->px_filesize = ftell(pxself->px_fp);
+	dsk_fill_options(self);
 
 	return DSK_ERR_OK;
 }
@@ -182,6 +189,7 @@ dsk_err_t posix_creat(DSK_DRIVER *self, const char *filename, dsk_sides_t s)
 	pxself->px_readonly = 0;
 	if (!pxself->px_fp) return DSK_ERR_SYSERR;
 	pxself->px_filesize = 0;
+	dsk_fill_options(self);
 	return DSK_ERR_OK;
 }
 
@@ -283,11 +291,9 @@ static dsk_err_t seekto(POSIX_DSK_DRIVER *self, unsigned long offset)
 	if (self->px_filesize < offset)
 	{
 		if (fseek(self->px_fp, self->px_filesize, SEEK_SET)) return DSK_ERR_SYSERR;
-		while (self->px_filesize < offset)
-		{
-			if (fputc(0xE5, self->px_fp) == EOF) return DSK_ERR_SYSERR;
-			++self->px_filesize;
-		}
+		if (dsk_fill(self->px_fp, 0xE5, offset - self->px_filesize))
+			return DSK_ERR_SYSERR;
+		self->px_filesize = offset;
 	}
 	if (fseek(self->px_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 	return DSK_ERR_OK;
@@ -355,12 +361,12 @@ dsk_err_t posix_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 	trklen = geom->dg_secsize * geom->dg_sectors;
 	err = seekto(pxself, offset);
 	if (err) return err;
+	err = dsk_fill_at(self, pxself->px_fp, pxself->px_filesize, offset, 
+			filler, trklen);
+	if (err) return err;
 	if (pxself->px_filesize < offset + trklen)
 		pxself->px_filesize = offset + trklen;
 
-	for (++trklen; trklen > 1; trklen--)
-		if (fputc(filler, pxself->px_fp) == EOF) return DSK_ERR_SYSERR;	
-
 	return DSK_ERR_OK;
 }
 
@@ -406,12 +412,16 @@ dsk_err_t posix_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 }
 
 
-dsk_err_t posix_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom)
+/* Read the disc a track at a time into 'store'. If 'sink' is NULL the
+ * tracks are kept there; otherwise each track is passed to the sink as
+ * soon as it has been read, and then dropped again. */
+static dsk_err_t posix_export(DSK_DRIVER *self, PLDBS store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param)
 {
 	unsigned char bootblock[512];
 	DSK_GEOMETRY bootgeom;
 	POSIX_DSK_DRIVER *pxself;
-	dsk_err_t err;
+	dsk_err_t err = DSK_ERR_OK;
 	dsk_pcyl_t cyl;
 	dsk_phead_t head;
 	dsk_psect_t sec;
@@ -419,7 +429,6 @@ dsk_err_t posix_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 	LDBS_TRACKHEAD *th;
 	int n;
 
-	if (!self || !result) return DSK_ERR_BADPTR;
 	CHECK_CLASS(self);
 
 	if (geom == NULL)
@@ -436,47 +445,24 @@ dsk_err_t posix_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 
 		geom = &bootgeom;	
 	}
-	secbuf = dsk_malloc(geom->dg_secsize);
+	secbuf = dsk_pool_alloc(self, geom->dg_secsize);
 	if (!secbuf) return DSK_ERR_NOMEM;
 
-	err = ldbs_new(result, NULL, LDBS_DSK_TYPE);
-	if (err)
-	{
-		dsk_free(secbuf);
-		return err;
-	}
-	/* If a geometry was provided, save it in the file */
-	if (geom != &bootgeom)
-	{
-		err = ldbs_put_geometry(*result, geom);
-		if (err)
-		{
-			ldbs_close(result);
-			dsk_free(secbuf);
-			return err;
-		}
-	}
-	for (cyl = 0; cyl < geom->dg_cylinders; cyl++)
-	    for (head = 0; head < geom->dg_heads; head++)
+	for (cyl = 0; cyl < geom->dg_cylinders && !err; cyl++)
+	    for (head = 0; head < geom->dg_heads && !err; head++)
 	{
-		th = ldbs_trackhead_alloc(geom->dg_sectors);
+		th = ldbs_trackhead_reuse(store, geom->dg_sectors);
 		if (!th)
 		{
-			dsk_free(secbuf);
-			ldbs_close(result);
-			return DSK_ERR_NOMEM;
+			err = DSK_ERR_NOMEM;
+			break;
 		}
 		for (sec = 0; sec < geom->dg_sectors; sec++)
 		{
 			err = posix_read(self, geom, secbuf, cyl, head, 
 					sec + geom->dg_secbase);
-			if (err)
-			{
-				ldbs_free(th);
-				dsk_free(secbuf);
-				ldbs_close(result);
-				return err;
-			}
+			if (err) break;
+
 			th->sector[sec].id_cyl  = cyl;
 			th->sector[sec].id_head = head;
 			th->sector[sec].id_sec  = sec + geom->dg_secbase;
@@ -501,30 +487,56 @@ dsk_err_t posix_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *ge
 			
 				ldbs_encode_secid(secid, cyl, head, 	
 						sec + geom->dg_secbase);
-				err = ldbs_putblock(*result, 
+				err = ldbs_putblock(store, 
 						&th->sector[sec].blockid,
 							secid, secbuf,
 							geom->dg_secsize);
-				if (err)
-				{
-					ldbs_free(th);
-					dsk_free(secbuf);
-					ldbs_close(result);
-					return err;
-				}
+				if (err) break;
 			}	
 		}	/* End of loop over sectors */
-		err = ldbs_put_trackhead(*result, th, cyl, head);
-		ldbs_free(th);
-		if (err)
+		if (!err)
 		{
-			dsk_free(secbuf);
-			ldbs_close(result);
-			return err;
+			if (sink) err = (*sink)(store, cyl, head, th, param);
+			else	  err = ldbs_put_trackhead(store, th, cyl, head);
 		}
+		/* When streaming, the track's sectors are finished with */
+		if (sink) for (sec = 0; sec < geom->dg_sectors; sec++)
+		{
+			if (th->sector[sec].blockid)
+				ldbs_delblock(store, th->sector[sec].blockid);
+		}
+		ldbs_trackhead_release(store, th);
 	}	/* End of loop over cyls / heads */
-	dsk_free(secbuf);	
-	return ldbs_sync(*result);
+	dsk_pool_free(self, secbuf);	
+	return err;
+}
+
+
+dsk_err_t posix_to_ldbs(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom)
+{
+	dsk_err_t err;
+
+	if (!self || !result) return DSK_ERR_BADPTR;
+
+	err = ldbs_new(result, NULL, LDBS_DSK_TYPE);
+	if (err) return err;
+
+	/* If a geometry was provided, save it in the file */
+	if (geom) err = ldbs_put_geometry(*result, geom);
+	if (!err) err = posix_export(self, *result, geom, NULL, NULL);
+	if (!err) return ldbs_sync(*result);
+
+	ldbs_close(result);
+	return err;
+}
+
+
+dsk_err_t posix_to_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK sink, void *param)
+{
+	if (!self || !store || !sink) return DSK_ERR_BADPTR;
+
+	return posix_export(self, store, geom, sink, param);
 }
 
 static dsk_err_t posix_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
@@ -534,9 +546,12 @@ static dsk_err_t posix_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 	dsk_err_t err;
 	int n;
 	size_t len;
+	size_t used;
 	unsigned char *secbuf;
 	long offset;
 
+	/* End of a streamed copy: nothing to tidy up */
+	if (!th) return DSK_ERR_OK;
 	if (pxself->px_readonly) return DSK_ERR_RDONLY;
 
 	/* If no geometry is supplied, just dump out all the sectors in
@@ -557,9 +572,14 @@ static dsk_err_t posix_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 					cyl, head, th->sector[n].id_sec);
 			len = pxself->px_export_geom->dg_secsize;
 
-			/* Ensure the file is big enough to hold the sector */
-			err = seekto(pxself, offset + len);
-			if (err) return err;
+			/* Ensure the file is big enough to hold the sector.
+			 * Filler is left to dsk_fill_at(), which may leave 
+			 * it as a hole. */
+			if (th->sector[n].copies)
+			{
+				err = seekto(pxself, offset + len);
+				if (err) return err;
+			}
 			/* Then seek to the start of the sector */
 			err = seekto(pxself, offset);
 			if (err) return err;
@@ -583,30 +603,45 @@ static dsk_err_t posix_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 			}
 			else	/* No copies, write the filler byte */
 			{
-				while (len > 0)
-				{
-					if (fputc(th->sector[n].filler,
-						pxself->px_fp) == EOF)
-					{
-						return DSK_ERR_SYSERR;
-					}
-					--len;
-				}	
+				err = dsk_fill_at(&pxself->px_super, 
+						pxself->px_fp, 
+						pxself->px_filesize, offset,
+						th->sector[n].filler, len);
+				if (err) return err;
+				if (pxself->px_filesize < offset + len)
+					pxself->px_filesize = offset + len;
 			}
 		}	/* End loop over sectors */
 	}	/* End if geometry provided */
 	else
 	{
-		/* Otherwise just regurgitate the whole track in one hit */
+		/* Otherwise just regurgitate the whole track in one hit. 
+		 * Zeroes at the end of it (such as blank sectors) go through
+		 * dsk_fill_at(), so that they can be left as a hole. */
 		err = ldbs_load_track(ldbs, th, (void *)&secbuf, &len, 0,
 				LLTO_DATA_ONLY);
 		if (err) return err;
-		if (fwrite(secbuf, 1, len, pxself->px_fp) < len)
+		offset = ftell(pxself->px_fp);
+		if (offset < 0)
+		{
+			ldbs_free(secbuf);
+			return DSK_ERR_SYSERR;
+		}
+		for (used = len; used > 0 && !secbuf[used - 1]; used--);
+		if (fwrite(secbuf, 1, used, pxself->px_fp) < used)
 		{
 			ldbs_free(secbuf);
 			return DSK_ERR_SYSERR;
 		}
 		ldbs_free(secbuf);
+		if (pxself->px_filesize < offset + used)
+			pxself->px_filesize = offset + used;
+		err = dsk_fill_at(&pxself->px_super, pxself->px_fp, 
+				pxself->px_filesize, offset + used, 0, 
+				len - used);
+		if (err) return err;
+		if (pxself->px_filesize < offset + len)
+			pxself->px_filesize = offset + len;
 	}
 	return DSK_ERR_OK;
 }
@@ -614,23 +649,29 @@ static dsk_err_t posix_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 
 
 
+/* Erase anything existing in the file, ready for an import */
+static dsk_err_t posix_erase(POSIX_DSK_DRIVER *pxself, DSK_GEOMETRY *geom)
+{
+	pxself->px_export_geom = geom;
+	if (fseek(pxself->px_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+
+	if (dsk_fill(pxself->px_fp, 0xE5, pxself->px_filesize))
+		return DSK_ERR_SYSERR;
+	if (fseek(pxself->px_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+	return DSK_ERR_OK;
+}
+
+
 dsk_err_t posix_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom)
 {
 	POSIX_DSK_DRIVER *pxself;
-	long pos;
+	dsk_err_t err;
 
 	if (!self || !source) return DSK_ERR_BADPTR;
 	CHECK_CLASS(self);
 
-	pxself->px_export_geom = geom;
-	/* Erase anything existing in the file */
-	if (fseek(pxself->px_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
-
-	for (pos = 0; pos < (long)(pxself->px_filesize); pos++)
-	{
-		if (fputc(0xE5, pxself->px_fp) == EOF) return DSK_ERR_SYSERR;
-	}
-	if (fseek(pxself->px_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+	err = posix_erase(pxself, geom);
+	if (err) return err;
 
 	/* And populate with whatever is in the blockstore */	
 	return ldbs_all_tracks(source, posix_from_ldbs_callback,
@@ -638,3 +679,26 @@ dsk_err_t posix_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *g
 }
 
 
+dsk_err_t posix_from_stream(DSK_DRIVER *self, struct ldbs *store, 
+		DSK_GEOMETRY *geom, DSK_TRACK_SINK *sink, void **param)
+{
+	POSIX_DSK_DRIVER *pxself;
+	dsk_err_t err;
+
+	if (!self || !store || !sink || !param) return DSK_ERR_BADPTR;
+	CHECK_CLASS(self);
+
+	/* Without a geometry, each track is written straight after the 
+	 * one before, so they have to arrive in the file's own order.
+	 * Streamed tracks come in cylinder order, alternating heads. */
+	if (!geom && pxself->px_sides != SIDES_ALT) return DSK_ERR_NOTIMPL;
+
+	err = posix_erase(pxself, geom);
+	if (err) return err;
+
+	*sink  = posix_from_ldbs_callback;
+	*param = pxself;
+	return DSK_ERR_OK;
+}
+
+
@@ -249,46 +249,64 @@ static dsk_err_t drv_qm_load_header(QM_DSK_DRIVER * qm_self, unsigned char *head
 
 typedef struct rlestate
 {
-	FILE *fp;
+	DSK_FBUF *fb;
 	signed short len;
 	unsigned char rep;	
 } RLESTATE;
 
-static dsk_err_t drv_qm_next_byte(unsigned char *c, RLESTATE *rs)
+/* Unpack the next 'count' bytes of the RLE stream into 'buf'. Runs 
+ * carry on from one sector to the next, so rs keeps track of how much
+ * of the current run is left. */
+static dsk_err_t drv_qm_unpack(unsigned char *buf, size_t count, RLESTATE *rs)
 {
-	int nextc = 0;
-	unsigned char buf[2];
+	const unsigned char *p;
+	size_t n;
+	int c;
 
-	/* Start of next block */
-	if (rs->len == 0)
+	while (count)
 	{
-		if (fread(buf, 1, 2, rs->fp) < 2) return DSK_ERR_NOTME;
-		rs->len = get_i16(buf, 0);
-		if (rs->len < 0)	/* Repeated run */
+		/* Start of next block */
+		if (rs->len == 0)
 		{
-			nextc = fgetc(rs->fp);
-			if (nextc == EOF) return DSK_ERR_NOTME;
+			p = dsk_fbuf_get(rs->fb, 2);
+			if (!p) return DSK_ERR_NOTME;
+			rs->len = get_i16((unsigned char *)p, 0);
+			rs->rep = 0;
+			if (rs->len < 0)	/* Repeated run */
+			{
+				c = dsk_fbuf_getc(rs->fb);
+				if (c == EOF) return DSK_ERR_NOTME;
+				rs->rep = c;
+			}
+			/* An empty block stands for a single filler byte */
+			if (rs->len == 0)
+			{
+				*buf++ = 0xF6;
+				--count;
+				continue;
+			}
 		}
-		rs->rep = nextc;
-	}
-	/* Literal run */
-	if (rs->len > 0)
-	{
-		nextc = fgetc(rs->fp);
-		if (nextc == EOF) return DSK_ERR_NOTME;
-		*c = nextc;
-		--rs->len;
-		return DSK_ERR_OK;	
-	}
-	/* Repeating run */
-	if (rs->len < 0)
-	{
-		*c = rs->rep;
-		++rs->len;
-		return DSK_ERR_OK;
+		/* Literal run */
+		if (rs->len > 0)
+		{
+			n = rs->len;
+			if (n > count) n = count;
+			p = dsk_fbuf_get(rs->fb, n);
+			if (!p) return DSK_ERR_NOTME;
+			memcpy(buf, p, n);
+			rs->len -= n;
+		}
+		/* Repeating run */
+		else
+		{
+			n = -rs->len;
+			if (n > count) n = count;
+			memset(buf, rs->rep, n);
+			rs->len += n;
+		}
+		buf   += n;
+		count -= n;
 	}
-	/* Should never get here */
-	*c = 0xF6;
 	return DSK_ERR_OK;
 }
 
@@ -296,7 +314,7 @@ static dsk_err_t drv_qm_next_byte(unsigned char *c, RLESTATE *rs)
  * read run length coded data                   *
  * used by drv_qm_open                          *
  ************************************************/
-static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, FILE * fp)
+static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, DSK_FBUF * fb)
 {
 	int n;
 	dsk_err_t errcond = DSK_ERR_OK;
@@ -307,9 +325,10 @@ static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, FILE * fp)
 	unsigned char *secbuf;
 	LDBS_TRACKHEAD *trkh;
 	RLESTATE rle_state;
+	unsigned long crc;
 
 	/* Set the position after the header and comment */
-	if(fseek(fp, QM_HEADER_SIZE + qm_self->qm_h_comment_len, SEEK_SET))
+	if (dsk_fbuf_seek(fb, QM_HEADER_SIZE + qm_self->qm_h_comment_len))
 		return DSK_ERR_NOTME;
 
 	/* Allocate a buffer for the current sector */
@@ -324,7 +343,7 @@ static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, FILE * fp)
 		dsk_free(secbuf);
 		return errcond;
 	}
-	rle_state.fp = fp;
+	rle_state.fb = fb;
 	rle_state.len = 0;
 	rle_state.rep = 0;
 
@@ -369,17 +388,14 @@ static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, FILE * fp)
 				trkh->sector[sec].id_psh = dsk_get_psh(seclen);
 				trkh->sector[sec].datalen = seclen;
 				/* Load sector data */
-				for (n = 0; n < (int)seclen; n++)
+				errcond = drv_qm_unpack(secbuf, seclen, 
+						&rle_state);
+				if (errcond)
 				{
-					errcond = drv_qm_next_byte(&secbuf[n], 
-							&rle_state);
-					if (errcond)
-					{
-						ldbs_free(trkh);
-						ldbs_close(&qm_self->qm_super.ld_store);
-						dsk_free(secbuf);
-						return errcond;
-					}
+					ldbs_free(trkh);
+					ldbs_close(&qm_self->qm_super.ld_store);
+					dsk_free(secbuf);
+					return errcond;
 				}
 /* Check for all bytes being the same */
 				trkh->sector[sec].copies = 0;
@@ -392,11 +408,12 @@ static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, FILE * fp)
 					}
 				}
 /* Update CRC */
+				crc = qm_self->qm_calc_crc;
 				for (n = 0; n < (int)seclen; n++)
 				{
-					drv_qm_update_crc(&qm_self->qm_calc_crc,
-						secbuf[n]);
+					drv_qm_update_crc(&crc, secbuf[n]);
 				}
+				qm_self->qm_calc_crc = crc;
 				if (trkh->sector[sec].copies)
 				{
 					char sector_id[4];
@@ -456,81 +473,48 @@ static dsk_err_t drv_qm_load_image(QM_DSK_DRIVER * qm_self, FILE * fp)
  * write run length coded data                  *
  * used by drv_qm_close                         *
  ************************************************/
-static int drv_qm_write_rl(int rl, FILE * fp)
+static void drv_qm_write_rl(int rl, DSK_WBUF * wb)
 {
-	unsigned char rlbuf[2];
+	unsigned char *rlbuf = dsk_wbuf_reserve(wb, 2);
 
-	put_u16(rlbuf, 0, (unsigned int) rl);
-	return (1 == fwrite(rlbuf, 2, 1, fp));		   /* TRUE if succesful */
+	if (rlbuf) put_u16(rlbuf, 0, (unsigned int) rl);
 }
 
-/* Write RL coded data block */
-static dsk_err_t drv_qm_dump_compressed(FILE * fp, unsigned long *pcrc, 
+/* RL code a data block into wb. The caller writes it out. */
+static void drv_qm_dump_compressed(DSK_WBUF * wb, unsigned long *pcrc, 
 					unsigned char *rd_ptr, size_t size)
 {
-	unsigned char *p;
-	unsigned char a;
-	int i, l, len;
+	unsigned char *p, *lit, *end;
+	unsigned long crc = *pcrc;
+	size_t i, run;
 
-	for(i = 0; i < (int)size; i++)
+	for(i = 0; i < size; i++)
 	{
-		drv_qm_update_crc(pcrc, rd_ptr[i]);   /* warming up cache */
+		drv_qm_update_crc(&crc, rd_ptr[i]);   /* warming up cache */
 	}
-	for(p = rd_ptr, i = 0, l = 0, len = size - 4; l < len;)
+	*pcrc = crc;
+	for(p = lit = rd_ptr, end = rd_ptr + size; p < end; p += run)
 	{
-		a = p[i];   /* equals break even after 3, minimum 4 required */
-			    /* [JCE] CopyQM actually uses minimum 5, because */
-			    /* of the 2-byte overhead of starting a new block */
-		if((a == p[i + 1]) && (a == p[i + 2]) && (a == p[i + 3] &&
-		    a == p[i + 4]))
-		{
-			if(i)	   /* flush out previous non-equals */
-	    		{
-				if(!drv_qm_write_rl(i, fp)) /* positive length */
-				{
-					return DSK_ERR_SYSERR;
-				}
-				if(1 != fwrite(p, i, 1, fp))   /* runlen unencoded data */
-				{
-					return DSK_ERR_SYSERR;
-				}
-				p += i;
-	    		}
-			for(a = *p, i = 0; (l < (int)size) && (a == *p);)   /* find true length of equals */
-	    		{
-				i++;
-				l++;
-				p++;
-			}
-			if(!drv_qm_write_rl(-i, fp))	   /* negative length */
-			{
-				return DSK_ERR_SYSERR;
-			}
-			if(1 != fwrite(&a, 1, 1, fp))   /* runlen data */
-			{
-				return DSK_ERR_SYSERR;
-			}
-			i = 0;
-		}
-		else
+		/* equals break even after 3, minimum 4 required */
+		/* [JCE] CopyQM actually uses minimum 5, because */
+		/* of the 2-byte overhead of starting a new block */
+		run = dsk_run_length(p, end - p);
+		if (run < 5) continue;	/* No byte in a short run can */
+					/* start a long one */
+		if(p > lit)	   /* flush out previous non-equals */
 		{
-			i++;
-			l++;
+			drv_qm_write_rl((int)(p - lit), wb); /* positive length */
+			dsk_wbuf_put(wb, lit, p - lit);	/* runlen unencoded data */
 		}
+		drv_qm_write_rl(-(int)run, wb);	   /* negative length */
+		dsk_wbuf_putc(wb, *p);		   /* runlen data */
+		lit = p + run;
 	}
-	if(i || (l < (int)size))   /* dump remaining buffer after end of block */
+	if(lit < end)   /* dump remaining buffer after end of block */
 	{
-		i += size - l;
-		if(!drv_qm_write_rl(i, fp))	   /* unencoded rest of block */
-		{
-			return DSK_ERR_NOTME;
-		}
-		if(1 != fwrite(p, i, 1, fp))	   /* runlen data */
-		{
-			return DSK_ERR_NOTME;
-		}
+		drv_qm_write_rl((int)(end - lit), wb);  /* unencoded rest of block */
+		dsk_wbuf_put(wb, lit, end - lit);	   /* runlen data */
 	}
-	return DSK_ERR_OK;
 }
 
 /************************************************
@@ -542,6 +526,7 @@ static dsk_err_t drv_qm_dump_compressed(FILE * fp, unsigned long *pcrc,
 dsk_err_t drv_qm_open(DSK_DRIVER * self, const char *filename)
 {
 	FILE *fp;
+	DSK_FBUF fb;
 	unsigned char header[QM_HEADER_SIZE];
 	char *comment_buf = NULL;
 	dsk_err_t errcond = DSK_ERR_OK;
@@ -594,6 +579,16 @@ dsk_err_t drv_qm_open(DSK_DRIVER * self, const char *filename)
 		return errcond;
 	}
 
+	/* The header looks right, so parse the rest of the file from 
+	 * memory */
+	errcond = dsk_fbuf_open(&fb, fp);
+	if (errcond)
+	{
+		fclose(fp);
+		dsk_free(qm_self->qm_filename);
+		return errcond;
+	}
+
 	/* If there's a comment, allocate a temporary buffer for it and load it. */
 	if(errcond == DSK_ERR_OK && qm_self->qm_h_comment_len)
 	{
@@ -601,27 +596,29 @@ dsk_err_t drv_qm_open(DSK_DRIVER * self, const char *filename)
 		/* If malloc fails, ignore it - comments aren't essential */
 		if(comment_buf)
 		{
-			if (fseek(fp, QM_HEADER_SIZE, SEEK_SET)) 
+			const unsigned char *p = NULL;
+
+			if (!dsk_fbuf_seek(&fb, QM_HEADER_SIZE)) 
+			{
+				p = dsk_fbuf_get(&fb, 
+					qm_self->qm_h_comment_len);
+			}
+			if (!p)
 			{
 				errcond = DSK_ERR_NOTME;
 			}
-	    		else
-	    		{
-				if(1 != fread(comment_buf, qm_self->qm_h_comment_len, 1, fp))
-				{
-					errcond = DSK_ERR_NOTME;
-				}
-				else
-				{
-				    comment_buf[qm_self->qm_h_comment_len] = '\0';
-				}
+			else
+			{
+				memcpy(comment_buf, p, 
+					qm_self->qm_h_comment_len);
+				comment_buf[qm_self->qm_h_comment_len] = '\0';
 			}
 		}
 	}
 	/* Load the rest */
 	if(errcond == DSK_ERR_OK)
 	{
-		errcond = drv_qm_load_image(qm_self, fp);
+		errcond = drv_qm_load_image(qm_self, &fb);
 		if(errcond != DSK_ERR_OK)
 		{
 #ifdef DRV_QM_DEBUG
@@ -662,6 +659,7 @@ dsk_err_t drv_qm_open(DSK_DRIVER * self, const char *filename)
 	}
 	if (comment_buf != NULL) dsk_free(comment_buf);
 	/* Close the file */
+	dsk_fbuf_close(&fb);
 	if(fp) fclose(fp);
 
 	if (!errcond)
@@ -671,7 +669,11 @@ dsk_err_t drv_qm_open(DSK_DRIVER * self, const char *filename)
 	}
 	if (errcond) 
 	{
-		ldbs_close(&qm_self->qm_super.ld_store);
+		/* drv_qm_load_image() closes the blockstore if it fails */
+		if (qm_self->qm_super.ld_store)
+			ldbs_close(&qm_self->qm_super.ld_store);
+		dsk_free(qm_self->qm_filename);
+		qm_self->qm_filename = NULL;
 		return errcond;
 	}
 	return ldbsdisk_attach(self);
@@ -932,6 +934,7 @@ dsk_err_t drv_qm_close(DSK_DRIVER * self)
 	dsk_pcyl_t wr_cyl;
 	dsk_phead_t wr_hd;
 	size_t trk_size;
+	DSK_WBUF wb;		/* Track being compressed */
 	time_t mod;
 	struct tm *lz;
 	LDBS_STATS stats;
@@ -1161,6 +1164,7 @@ dsk_err_t drv_qm_close(DSK_DRIVER * self)
 		ldbs_close(&qm_self->qm_super.ld_store);
 		return DSK_ERR_NOMEM;
 	}
+	dsk_wbuf_init(&wb);
 	for (wr_cyl = 0; wr_cyl <= stats.max_cylinder; wr_cyl++)
 	{
 		for(wr_hd = 0; wr_hd <= stats.max_head; wr_hd++)
@@ -1173,6 +1177,7 @@ dsk_err_t drv_qm_close(DSK_DRIVER * self)
 			if (errcond)
 			{
 				if (trk_buf) dsk_free(trk_buf);
+				dsk_wbuf_close(&wb);
 				if (ucmt) { ldbs_free(ucmt); ucmt = NULL; }
 				if (trkh) ldbs_free(trkh);
 				fclose(fp);
@@ -1185,6 +1190,7 @@ dsk_err_t drv_qm_close(DSK_DRIVER * self)
 				if (errcond)
 				{
 					if (trk_buf) dsk_free(trk_buf);
+					dsk_wbuf_close(&wb);
 					if (ucmt) { ldbs_free(ucmt); ucmt = NULL; }
 					if (trkh) ldbs_free(trkh);
 					fclose(fp);
@@ -1217,11 +1223,12 @@ dsk_err_t drv_qm_close(DSK_DRIVER * self)
 				}
 			}
 			/* Track loaded into trk_buf */
-			errcond = drv_qm_dump_compressed(fp, &crc, 
-							trk_buf, trk_size);
+			drv_qm_dump_compressed(&wb, &crc, trk_buf, trk_size);
+			errcond = dsk_wbuf_flush(&wb, fp);
 			if (errcond)
 			{
 				if (trk_buf) dsk_free(trk_buf);
+				dsk_wbuf_close(&wb);
 				fclose(fp);
 				ldbs_close(&qm_self->qm_super.ld_store);
 				return errcond;
@@ -1230,6 +1237,7 @@ dsk_err_t drv_qm_close(DSK_DRIVER * self)
 	}
 	dsk_report("Finalizing");
 	if (trk_buf) dsk_free(trk_buf);
+	dsk_wbuf_close(&wb);
 	ldbs_close(&qm_self->qm_super.ld_store);
 #ifdef DRV_QM_DEBUG
 	fprintf(stderr, "qm: CRC 0x%08lx\n", crc);
@@ -454,7 +454,8 @@ static size_t compress(QRST_DSK_DRIVER *qrself,
 		}
 		dptr += (n - pos + 1);
 		pos = n;
-		/* Now a compressed run */
+		/* Now a compressed run. If the literal run used up the 
+		 * track this is empty, and there is no byte to repeat. */
 		for (n = pos; (n - pos) < 255 && n < buflen; n++)
 		{
 			/* If next byte differs from this, break */
@@ -463,7 +464,7 @@ static size_t compress(QRST_DSK_DRIVER *qrself,
 		if (dest)
 		{
 			dest[dptr]   = (n - pos);
-			dest[dptr+1] = src[pos]; 
+			dest[dptr+1] = (pos < buflen) ? src[pos] : 0; 
 		}
 		dptr += 2;
 		pos = n;
@@ -606,6 +607,7 @@ static dsk_err_t save_callback(PLDBS self, dsk_pcyl_t cyl, dsk_phead_t head,
 			return DSK_ERR_SYSERR;
 		}
 	}
+	ldbs_free(buffer);
 	return DSK_ERR_OK;
 }
 
@@ -393,22 +393,12 @@ static dsk_err_t rcpmfs_option(RCPMFS_DSK_DRIVER *self, char *variable,
 	if (!strcmp(variable, "format"))
 	{
 /* Try to find format by name */
-		int fmt = 0;
-		dsk_cchar_t fname;
+		dsk_format_t fmt;
 
-		do
-		{
-			err = dg_stdformat(NULL, fmt, &fname, NULL);
-	/*	  RTRACE(("value='%s' fname='%s'\n", value, fname)); */
-			if (err == DSK_ERR_OK && fname &&
-				!strcmp(value, fname))
-			{
-				return dg_stdformat(&self->rc_geom, fmt,
-					NULL, NULL);	
-			}
-			++fmt;
-		} while (err != DSK_ERR_BADFMT);
-		return err;
+/* Format names here have always been case-sensitive */
+		err = dg_exactformat(value, &fmt);
+		if (err) return err;
+		return dg_stdformat(&self->rc_geom, fmt, NULL, NULL);
 	}
 /* If line not recognised, see if the disk geometry parser recognises it */
 	sprintf(tempbuf, "%s=%s", variable, value);
@@ -206,11 +206,10 @@ dsk_err_t simh_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 	if (simh_self->simh_filesize < offset)
 	{
 		if (fseek(simh_self->simh_fp, simh_self->simh_filesize, SEEK_SET)) return DSK_ERR_SYSERR;
-		while (simh_self->simh_filesize < (offset + geom->dg_secsize))
-		{
-			if (fputc(0xE5, simh_self->simh_fp) == EOF) return DSK_ERR_SYSERR;
-			++simh_self->simh_filesize;
-		}
+		if (dsk_fill(simh_self->simh_fp, 0xE5, 
+			offset + geom->dg_secsize - simh_self->simh_filesize))
+			return DSK_ERR_SYSERR;
+		simh_self->simh_filesize = offset + geom->dg_secsize;
 	}	
 	if (fseek(simh_self->simh_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 
@@ -261,16 +260,14 @@ dsk_err_t simh_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 	if (simh_self->simh_filesize < offset)
 	{
 		if (fseek(simh_self->simh_fp, simh_self->simh_filesize, SEEK_SET)) return DSK_ERR_SYSERR;
-		while (simh_self->simh_filesize < offset + trklen)
-		{
-			if (fputc(0xE5, simh_self->simh_fp) == EOF) return DSK_ERR_SYSERR;
-			++simh_self->simh_filesize;
-		}
+		if (dsk_fill(simh_self->simh_fp, 0xE5, 
+				offset + trklen - simh_self->simh_filesize))
+			return DSK_ERR_SYSERR;
+		simh_self->simh_filesize = offset + trklen;
 	}	
 	if (fseek(simh_self->simh_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 
-	while (trklen--) 
-		if (fputc(filler, simh_self->simh_fp) == EOF) return DSK_ERR_SYSERR;	
+	if (dsk_fill(simh_self->simh_fp, filler, trklen)) return DSK_ERR_SYSERR;
 	if (fseek(simh_self->simh_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
 	simh_self->simh_filesize = ftell(simh_self->simh_fp);
 
@@ -472,12 +469,10 @@ static dsk_err_t simh_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 	{
 		if (fseek(simh_self->simh_fp, simh_self->simh_filesize, SEEK_SET)) 
 			return DSK_ERR_SYSERR;
-		while ((long)simh_self->simh_filesize < offset)
-		{
-			if (fputc(0xE5, simh_self->simh_fp) == EOF) 
-				return DSK_ERR_SYSERR;
-			++simh_self->simh_filesize;
-		}
+		if (dsk_fill(simh_self->simh_fp, 0xE5, 
+				offset - simh_self->simh_filesize))
+			return DSK_ERR_SYSERR;
+		simh_self->simh_filesize = offset;
 	}
 	/* Write the sector */
 	if (fseek(simh_self->simh_fp, offset, SEEK_SET) ||
@@ -503,7 +498,6 @@ static dsk_err_t simh_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 dsk_err_t simh_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom)
 {
 	SIMH_DSK_DRIVER *simh_self;
-	long pos;
 
 	if (!self || !source || self->dr_class != &dc_simh) 
 		return DSK_ERR_BADPTR;
@@ -513,10 +507,8 @@ dsk_err_t simh_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *ge
 	/* Erase anything existing in the file */
 	if (fseek(simh_self->simh_fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
 
-	for (pos = 0; pos < (long)simh_self->simh_filesize; pos++)
-	{
-		if (fputc(0xE5, simh_self->simh_fp) == EOF) return DSK_ERR_SYSERR;
-	}
+	if (dsk_fill(simh_self->simh_fp, 0xE5, simh_self->simh_filesize))
+		return DSK_ERR_SYSERR;
 
 	/* And populate with whatever is in the blockstore */	
 	return ldbs_all_sectors(source, simh_from_ldbs_callback,
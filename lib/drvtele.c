@@ -85,27 +85,38 @@ DRV_CLASS dc_tele =
 /* Read a number of bytes from the file we're processing, and return a 
  * dsk_err_t in case of error or EOF. The original intention was that 
  * it could be expanded to handle compressed TD0 files, but instead a 
- * separate compression driver was written.  */
+ * separate compression driver was written. 
+ *
+ * The file is parsed from memory (see dskfbuf.c); pass buf = NULL to 
+ * skip bytes. */
 static dsk_err_t tele_fread(TELE_DSK_DRIVER *self, tele_byte *buf, int count)
 {
+	const unsigned char *p;
+
 	if (!buf) 
 	{
-		if (fseek(self->tele_fp, count, SEEK_CUR))
-		{
-			return DSK_ERR_SYSERR;
-		}
+		return dsk_fbuf_seek(&self->tele_fb, 
+				self->tele_fb.fb_pos + count);
 	}
-	else
+	p = dsk_fbuf_get(&self->tele_fb, count);
+	if (!p)
 	{
-		if (fread(buf, 1, count, self->tele_fp) < (size_t)count)
-		{
-			return DSK_ERR_SYSERR;
-		}
+		return DSK_ERR_SYSERR;
 	}
+	memcpy(buf, p, count);
 	return DSK_ERR_OK;
 }
 
 
+/* Finished loading: release the file */
+static void tele_load_end(TELE_DSK_DRIVER *self)
+{
+	dsk_fbuf_close(&self->tele_fb);
+	fclose(self->tele_fp);
+	self->tele_fp = NULL;
+}
+
+
 /* Expand a compressed Teledisk sector to an LDBS sector, updating its
  * entry in the track header trkh. */
 static dsk_err_t convert_sector(TELE_DSK_DRIVER *self, LDBS_TRACKHEAD *trkh,
@@ -201,9 +212,14 @@ static dsk_err_t convert_sector(TELE_DSK_DRIVER *self, LDBS_TRACKHEAD *trkh,
 					continue;
 				}
 				/*  Compressed run */
+				if (ptype > 8) 
+				{ 
+					dsk_free(secbuf); 
+					return DSK_ERR_CORRUPT; 
+				}
 				err = tele_fread(self, pattern, (1 << ptype));
 				if (err) { dsk_free(secbuf); return err; }
-				for (n = 0; n < plen; n++)
+				for (n = 0; n < plen && pos < ulen; n++)
 				{
 /* Ensure the amount of data written does not exceed len */
 					if ((unsigned int)(1 << ptype) > wleft)
@@ -307,11 +323,19 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 		fclose(self->tele_fp);
 		return DSK_ERR_NOTIMPL;
 	}
+	/* It's a Teledisk file; parse the rest of it from memory */
+	err = dsk_fbuf_open(&self->tele_fb, self->tele_fp);
+	if (!err) err = dsk_fbuf_seek(&self->tele_fb, sizeof(header));
+	if (err)
+	{
+		tele_load_end(self);
+		return err;
+	}
 	/* Create an LDBS instance */
 	err = ldbs_new(&self->tele_super.ld_store, NULL, LDBS_DSK_TYPE);
 	if (err)
 	{
-		fclose(self->tele_fp);
+		tele_load_end(self);
 		return err;
 	}
 
@@ -325,7 +349,8 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 		/* Load comment header */
 		if (tele_fread(self, header, 10))
 		{
-			fclose(self->tele_fp);
+			ldbs_close(&self->tele_super.ld_store);
+			tele_load_end(self);
 			return DSK_ERR_SYSERR;
 		}
 		comment_len  = ldbs_peek2(header + 2);
@@ -333,14 +358,14 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 		if (!comment_data)
 		{
 			ldbs_close(&self->tele_super.ld_store);
-			fclose(self->tele_fp);
+			tele_load_end(self);
 			return DSK_ERR_NOMEM;
 		}
 		if (tele_fread(self, (tele_byte *)comment_data, comment_len))
 		{
 			dsk_free(comment_data);
 			ldbs_close(&self->tele_super.ld_store);
-			fclose(self->tele_fp);
+			tele_load_end(self);
 			return DSK_ERR_SYSERR;
 		}
 		/* 0-terminate the loaded comment */
@@ -362,7 +387,7 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 		{
 			dsk_free(comment_data);
 			ldbs_close(&self->tele_super.ld_store);
-			fclose(self->tele_fp);
+			tele_load_end(self);
 			return DSK_ERR_NOMEM;
 		}
 		/* In a Teledisk file, the comment record has a timestamp.
@@ -380,7 +405,7 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 		if (err)
 		{
 			ldbs_close(&self->tele_super.ld_store);
-			fclose(self->tele_fp);
+			tele_load_end(self);
 			return err;
 		}
 	}
@@ -390,14 +415,14 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 	if (err)
 	{
 		ldbs_close(&self->tele_super.ld_store);
-		fclose(self->tele_fp);
+		tele_load_end(self);
 		return err;
 	}
 
 	/* Now to parse the tracks. 
  	 * TODO: When we reach EOF, if this is a multi-file set, close 
 	 * the TD0 file and look for TD1, TD2 etc. */
-	while (!feof(self->tele_fp))
+	while (1)
 	{
 		LDBS_TRACKHEAD *trkh;
 		dsk_pcyl_t cyl;
@@ -406,14 +431,7 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 
 		/* Try to read the track header. If it isn't present because
 		 * of EOF, fine. */
-		if (tele_fread(self, header, 4))
-		{
-			if (feof(self->tele_fp)) break;
-
-			ldbs_close(&self->tele_super.ld_store);
-			fclose(self->tele_fp);
-			return err;
-		}
+		if (tele_fread(self, header, 4)) break;
 		/* header[0] = sectors / track, if 0xFF then break */
 		if (header[0] == 0xFF) break;
 		cyl = header[1];
@@ -448,7 +466,7 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 			{
 				ldbs_free(trkh);
 				ldbs_close(&self->tele_super.ld_store);
-				fclose(self->tele_fp);
+				tele_load_end(self);
 				return err;
 			}
 		}
@@ -458,12 +476,11 @@ dsk_err_t tele_open(DSK_DRIVER *s, const char *filename)
 		if (err)
 		{
 			ldbs_close(&self->tele_super.ld_store);
-			fclose(self->tele_fp);
+			tele_load_end(self);
 			return err;
 		}
 	}
-	fclose(self->tele_fp);
-	self->tele_fp = NULL;
+	tele_load_end(self);
 	self->tele_filename = dsk_malloc_string(filename);
 	if (!self->tele_filename)
 	{
@@ -582,16 +599,14 @@ static dsk_err_t tele_datarate(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
  */
 static int type2_repeats(tele_byte *src, size_t remaining, size_t patlen)
 {
-	int count = 0;
-	int pos = patlen;	/* Start looking patlen bytes in */
-
-	for (pos = patlen; pos + patlen <= remaining; pos += patlen)
-	{
-		if (memcmp(src, src + pos, patlen)) break;
-		count++;
-		if (count == 0xFE) break;	/* Can't have > 255 repeats */
-	}
-	return count + 1;	
+	/* Can't have > 255 repeats */
+	if (remaining > 0xFF * patlen) remaining = 0xFF * patlen;
+	if (remaining < 2 * patlen) return 1;
+
+	/* The pattern repeats for as long as the data match themselves
+	 * patlen bytes on */
+	return (int)((patlen + dsk_mismatch(src, src + patlen, 
+				remaining - patlen)) / patlen);
 }
 
 
@@ -678,19 +693,22 @@ static size_t type2_compress(tele_byte *buffer, tele_byte *dest, size_t len)
 }
 
 
-/* Write an LDBS track out as a Teledisk track */
+/* Write an LDBS track out as a Teledisk track. The track is encoded into
+ * self->tele_wb and written in one go. */
 static dsk_err_t tele_write_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 				LDBS_TRACKHEAD *th, void *param)
 {
 	TELE_DSK_DRIVER *self = param;
-	unsigned char thead[4];
+	DSK_WBUF *wb = &self->tele_wb;
+	unsigned char *thead;
 	unsigned char *secdata;
 	dsk_err_t err;
 	unsigned sec, crc;
-	size_t buflen, complen;
-	int n;
+	size_t buflen, complen, reslen;
 
 	/* Create the 4-byte track header */
+	thead = dsk_wbuf_reserve(wb, 4);
+	if (!thead) return dsk_wbuf_flush(wb, self->tele_fp);
 	thead[0] = (unsigned char)(th->count);
 	thead[1] = (unsigned char)(cyl);
 	thead[2] = (unsigned char)(head);
@@ -698,21 +716,21 @@ static dsk_err_t tele_write_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 	if (th->recmode == 1) thead[2] |= 0x80;	/* FM indicator */
 	thead[3] = (unsigned char)(teledisk_crc(thead, 3));
 
-	/* Write track header */
-	if (fwrite(thead, 1, 4, self->tele_fp) < 4) return DSK_ERR_SYSERR;
-
 	/* For each sector... */
 	for (sec = 0; sec < th->count; sec++)
 	{
 		size_t seclen = th->sector[sec].datalen;
 
-		/* Allocate space for the sector (2 copies: compressed 
-		 * and uncompressed) plus a 9-byte header */
-		secdata = dsk_malloc(2*seclen + 9);	
-		if (!secdata) return DSK_ERR_NOMEM;
+		/* Reserve space for a 9-byte header, the sector, and its
+		 * type 2 compressed form (which, if compression fails, can
+		 * be up to 2 bytes per 255 longer than the sector). 
+		 * Whatever isn't used is given back at the end. */
+		reslen = 9 + 2 * seclen + 2 * (seclen / 255) + 4;
+		secdata = dsk_wbuf_reserve(wb, reslen);
+		if (!secdata) return dsk_wbuf_flush(wb, self->tele_fp);
 
 		/* Blank the buffer with the sector's filler byte */
-		memset(secdata, th->sector[sec].filler, 2 * seclen + 9);
+		memset(secdata, th->sector[sec].filler, reslen);
 		buflen = seclen; 
 		/* Load the sector if it's present */
 		if (th->sector[sec].blockid)
@@ -736,27 +754,15 @@ static dsk_err_t tele_write_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 		if (secdata[4] & 0x30)	/* Sector header only, no data */
 		{
 			secdata[5] = (unsigned char)(teledisk_crc(secdata, 5));
-			if (fwrite(secdata, 1, 6, self->tele_fp) < 6) 
-			{
-				dsk_free(secdata);
-				return DSK_ERR_SYSERR;
-			}
-			dsk_free(secdata);
+			wb->wb_len -= reslen - 6;
 			continue;
 		}
 		/* Need to write the full sector. */
 
-		/* See if it can be stored as type 1 RLE */
-		secdata[8] = 1;
-		for (n = 2; n < (int)seclen; n += 2)
-		{
-			if (secdata[ 9 + n] != secdata[ 9] ||
-		 	    secdata[10 + n] != secdata[10])
-			{
-				secdata[8] = 0;
-				break;
-			}
-		}
+		/* See if it can be stored as type 1 RLE: a 2-byte pattern 
+		 * repeated throughout */
+		secdata[8] = (seclen < 2 || dsk_mismatch(secdata + 9, 
+			secdata + 11, seclen - 2) == seclen - 2) ? 1 : 0;
 		/* <http://www.classiccmp.org/dunfield/img54306/td0notes.txt>
 		 * says that the CRC covers headers and data. But in my 
 		 * tests it seems to cover just the sector body. */
@@ -771,22 +777,16 @@ static dsk_err_t tele_write_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 			/* The pattern is already present in secdata[11-12] */
 
 			secdata[5] = crc;
-			if (fwrite(secdata, 1, 13, self->tele_fp) < 13) 
-			{
-				dsk_free(secdata);
-				return DSK_ERR_SYSERR;
-			}
-			dsk_free(secdata);
+			wb->wb_len -= reslen - 13;
 			continue;
 		}
-		/* Type 1 wasn't possible. See if type 2 compression will			 * have any effect. */
-		complen = type2_compress(secdata + 9, NULL, seclen);	
+		/* Type 1 wasn't possible. See if type 2 compression will
+		 * have any effect. */
+		complen = type2_compress(secdata + 9, secdata + seclen + 9,
+					seclen);	
 
 		if (complen < seclen)	/* It will! */
 		{
-			/* Compress sector for real */
-			type2_compress(secdata + 9, secdata + seclen + 9,
-					seclen);
 			/* Save compressed length in header (+1 for compression
 			 * type) */
 			ldbs_poke2(secdata + 6, (unsigned short)(complen + 1));
@@ -794,11 +794,7 @@ static dsk_err_t tele_write_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 			secdata[5] = crc;
 			/* Copy compressed buffer to after header */
 			memcpy(secdata + 9, secdata + seclen + 9, complen);
-			if (fwrite(secdata, 1, complen + 9, self->tele_fp) < complen + 9)
-			{
-				dsk_free(secdata);
-				return DSK_ERR_SYSERR;
-			}	
+			wb->wb_len -= reslen - (complen + 9);
 		}
 		else	/* Can't compress; save uncompressed */
 		{	
@@ -807,15 +803,10 @@ static dsk_err_t tele_write_track(PLDBS ldbs, dsk_pcyl_t cyl, dsk_phead_t head,
 			secdata[8] = 0; /* Uncompressed */
 
 			secdata[5] = crc;
-			if (fwrite(secdata, 1, seclen + 9, self->tele_fp) < seclen + 9)
-			{
-				dsk_free(secdata);
-				return DSK_ERR_SYSERR;
-			}	
+			wb->wb_len -= reslen - (seclen + 9);
 		}
-		dsk_free(secdata);
 	}
-	return DSK_ERR_OK;
+	return dsk_wbuf_flush(wb, self->tele_fp);
 }
 
 
@@ -1102,8 +1093,10 @@ dsk_err_t tele_close(DSK_DRIVER *s)
 	}
 	/* Now ready to write out the tracks */
 
+	dsk_wbuf_init(&self->tele_wb);
 	err = ldbs_all_tracks(self->tele_super.ld_store, tele_write_track, 
 				SIDES_ALT, self);
+	dsk_wbuf_close(&self->tele_wb);
 
 	/* Write the last track header [EOF] */
 	header[0] = header[1] = header[2] = 0xFF;
@@ -68,6 +68,8 @@ typedef struct
 	char 		*tele_filename;
 	TELE_HEADER	tele_head;	
 	FILE		*tele_fp;
+	DSK_FBUF	tele_fb;	/* File being loaded by tele_open() */
+	DSK_WBUF	tele_wb;	/* Track being saved by tele_close() */
 
 	/* Stats used when saving */
 	unsigned tele_fm;	/* Number of FM tracks */
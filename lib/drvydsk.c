@@ -136,12 +136,10 @@ static dsk_err_t ydsk_seek(YDSK_DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 	{
 		if (fseek(self->ydsk_fp, self->ydsk_filesize, 
 					SEEK_SET)) return DSK_ERR_SYSERR;
-		while (self->ydsk_filesize < (offset + secsize))
-		{
-			if (fputc(0xE5, self->ydsk_fp) == EOF) 
-				return DSK_ERR_SYSERR;
-			++self->ydsk_filesize;
-		}
+		if (dsk_fill(self->ydsk_fp, 0xE5, 
+				offset + secsize - self->ydsk_filesize))
+			return DSK_ERR_SYSERR;
+		self->ydsk_filesize = offset + secsize;
 	}
 	if (fseek(self->ydsk_fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
 	return DSK_ERR_OK;
@@ -180,6 +178,7 @@ dsk_err_t ydsk_open(DSK_DRIVER *self, const char *filename)
  * and under UNIX, the entire directory is filled with zeroes. */
 	if (fseek(ydsk_self->ydsk_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
 	ydsk_self->ydsk_filesize = ftell(ydsk_self->ydsk_fp);
+	dsk_fill_options(self);
 
 	return DSK_ERR_OK;
 }
@@ -209,6 +208,7 @@ dsk_err_t ydsk_creat(DSK_DRIVER *self, const char *filename)
 		fclose(ydsk_self->ydsk_fp);
 		return DSK_ERR_SYSERR;
 	}
+	dsk_fill_options(self);
 	return DSK_ERR_OK;
 }
 
@@ -307,7 +307,7 @@ dsk_err_t ydsk_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
  */
 	YDSK_DSK_DRIVER *ydsk_self;
 	unsigned short spt, psh;
-	unsigned long secsize, tracklen;
+	unsigned long secsize, tracklen, offset;
 	dsk_err_t err;
 
 	(void)format;
@@ -325,13 +325,24 @@ dsk_err_t ydsk_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 	 * existing YDSK geometry */
 	update_geometry(ydsk_self, geom);
 
-	err = ydsk_seek(ydsk_self, geom, cylinder, head, 0, 1);
+	err = ydsk_seek(ydsk_self, geom, cylinder, head, 0, 0);
 	if (err) return err;
+	offset = ftell(ydsk_self->ydsk_fp);
 
-	while (tracklen--) 
+	/* If the file is smaller than required, grow it up to the start of 
+	 * the track. The track itself may be left as a hole. */
+	if (ydsk_self->ydsk_filesize < offset)
 	{
-		if (fputc(filler, ydsk_self->ydsk_fp) == EOF) return DSK_ERR_SYSERR;	
+		if (fseek(ydsk_self->ydsk_fp, ydsk_self->ydsk_filesize, 
+			SEEK_SET)) return DSK_ERR_SYSERR;
+		if (dsk_fill(ydsk_self->ydsk_fp, 0xE5, 
+				offset - ydsk_self->ydsk_filesize))
+			return DSK_ERR_SYSERR;
+		ydsk_self->ydsk_filesize = offset;
 	}
+	err = dsk_fill_at(self, ydsk_self->ydsk_fp, ydsk_self->ydsk_filesize,
+			offset, filler, tracklen);
+	if (err) return err;
 	if (fseek(ydsk_self->ydsk_fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
 	ydsk_self->ydsk_filesize = ftell(ydsk_self->ydsk_fp);
 
@@ -574,7 +585,7 @@ dsk_err_t ydsk_to_ldbs(DSK_DRIVER *self, struct ldbs **result,
 		ldbs_close(result);
 		return err;
 	}
-	secbuf = dsk_malloc(dg.dg_secsize);
+	secbuf = dsk_pool_alloc(self, dg.dg_secsize);
 	if (!secbuf)
 	{
 		ldbs_close(result);
@@ -583,11 +594,11 @@ dsk_err_t ydsk_to_ldbs(DSK_DRIVER *self, struct ldbs **result,
 	/* Write out as a single-sided LDBS file */
 	for (cyl = 0; cyl < dg.dg_cylinders; cyl++)
 	{
-		LDBS_TRACKHEAD *trkh = ldbs_trackhead_alloc(dg.dg_sectors);
+		LDBS_TRACKHEAD *trkh = ldbs_trackhead_reuse(*result, dg.dg_sectors);
 	
 		if (!trkh)
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			ldbs_close(result);
 			return DSK_ERR_NOMEM;
 		}
@@ -601,7 +612,7 @@ dsk_err_t ydsk_to_ldbs(DSK_DRIVER *self, struct ldbs **result,
 			err = ydsk_read(self, &dg, secbuf, cyl, 0, sec);
 			if (err)
 			{
-				dsk_free(secbuf);
+				dsk_pool_free(self, secbuf);
 				ldbs_free(trkh);
 				ldbs_close(result);
 				return err;
@@ -633,7 +644,7 @@ dsk_err_t ydsk_to_ldbs(DSK_DRIVER *self, struct ldbs **result,
 					dg.dg_secsize);
 				if (err)
 				{
-					ldbs_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					ldbs_free(trkh);
 					ldbs_close(result);
 					return err;
@@ -642,15 +653,15 @@ dsk_err_t ydsk_to_ldbs(DSK_DRIVER *self, struct ldbs **result,
 		}
 		/* All sectors transferred */
 		err = ldbs_put_trackhead(*result, trkh, cyl, 0);
-		ldbs_free(trkh);
+		ldbs_trackhead_release(*result, trkh);
 		if (err)
 		{
-			ldbs_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			ldbs_close(result);
 			return err;
 		}
 	}
-	ldbs_free(secbuf);
+	dsk_pool_free(self, secbuf);
 	return ldbs_sync(*result);
 }
 
@@ -684,7 +695,6 @@ static dsk_err_t ydsk_from_ldbs_callback(PLDBS ldbs, dsk_pcyl_t cyl,
 dsk_err_t ydsk_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom)
 {
 	YDSK_DSK_DRIVER *ydsk_self;
-	long pos;
 	LDBS_DPB dpb;
 	DSK_GEOMETRY lgeom;
 	dsk_err_t err;
@@ -699,11 +709,8 @@ dsk_err_t ydsk_from_ldbs(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *ge
 	/* Erase anything existing in the file after the header */
 	if (fseek(ydsk_self->ydsk_fp, 128, SEEK_SET)) return DSK_ERR_SYSERR;
 
-	for (pos = 0; pos < (long)ydsk_self->ydsk_filesize; pos++)
-	{
-		if (fputc(0xE5, ydsk_self->ydsk_fp) == EOF) 
-			return DSK_ERR_SYSERR;
-	}
+	if (dsk_fill(ydsk_self->ydsk_fp, 0xE5, ydsk_self->ydsk_filesize))
+		return DSK_ERR_SYSERR;
 	/* If there is a DPB, update the header */
 	err = ldbs_get_dpb(source, &dpb);
 	if (!err && dpb.spt && dpb.dsm && dpb.drm)
@@ -41,7 +41,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pcheck(DSK_DRIVER *self, const DSK_GEOMETRY
 	WALK_VTABLE(dc, dc_read)
 
 	if (!dc->dc_read) return DSK_ERR_NOTIMPL;
-	buf2 = dsk_malloc(geom->dg_secsize); 
+	buf2 = dsk_pool_alloc(self, geom->dg_secsize); 
 	if (!buf2) return DSK_ERR_NOMEM;
 
 	for (n = 0; n < self->dr_retry_count; n++)
@@ -53,7 +53,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pcheck(DSK_DRIVER *self, const DSK_GEOMETRY
 	{
 		e = DSK_ERR_MISMATCH;
 	}
-	dsk_free(buf2);
+	dsk_pool_free(self, buf2);
 	return e;   
 }
 
@@ -66,12 +66,12 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_lcheck(DSK_DRIVER *self, const DSK_GEOMETRY
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
-	buf2 = dsk_malloc(geom->dg_secsize);
+	buf2 = dsk_pool_alloc(self, geom->dg_secsize);
 	if (!buf2) return DSK_ERR_NOMEM;
 
 	e = dsk_lread(self,geom,buf2,sector);
 	if (e == 0 && memcmp(buf, buf2, geom->dg_secsize)) e = DSK_ERR_MISMATCH;
-	dsk_free(buf2);
+	dsk_pool_free(self, buf2);
 	return e;   
 }
 
@@ -94,7 +94,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xcheck(DSK_DRIVER *self, const DSK_GEOMETRY
 	WALK_VTABLE(dc, dc_xread)
 
 	if (!dc->dc_xread) return DSK_ERR_NOTIMPL;
-	buf2 = dsk_malloc(geom->dg_secsize); 
+	buf2 = dsk_pool_alloc(self, geom->dg_secsize); 
 	if (!buf2) return DSK_ERR_NOMEM;
 
 	for (n = 0; n < self->dr_retry_count; n++)
@@ -107,7 +107,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xcheck(DSK_DRIVER *self, const DSK_GEOMETRY
 	{
 		e = DSK_ERR_MISMATCH;
 	}
-	dsk_free(buf2);
+	dsk_pool_free(self, buf2);
 	return e;   
 }
 
@@ -23,39 +23,15 @@
 #include "drvi.h"
 #include "ldbs.h"
 
-LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_copy(DSK_GEOMETRY *geom, 
-				DSK_PDRIVER source, DSK_PDRIVER dest)
+/* Fill in the creator, geometry and DPB records in 'temp', if the driver
+ * that exported it didn't */
+static void copy_metadata(DSK_GEOMETRY *geom, DSK_PDRIVER source, PLDBS temp)
 {
 	dsk_err_t err;
-	DRV_CLASS *dc;
-	PLDBS temp = NULL;
 	char *creator;
 	DSK_GEOMETRY probed_geom;
 	LDBS_DPB dpb;
-	dsk_err_t (*src_to_ldbs)(DSK_DRIVER *self, struct ldbs **result, DSK_GEOMETRY *geom);
-	dsk_err_t (*dest_from_ldbs)(DSK_DRIVER *self, struct ldbs *source, DSK_GEOMETRY *geom);
 
-	/* Does source provide an export to LDBS format? */
-	dc = source->dr_class;
-	WALK_VTABLE(dc, dc_to_ldbs);
-	src_to_ldbs = dc->dc_to_ldbs;
-	/* And does destination provide an import from LDBS format? */
-	dc = dest->dr_class;
-	WALK_VTABLE(dc, dc_from_ldbs);
-	dest_from_ldbs = dc->dc_from_ldbs;
-
-	if (!src_to_ldbs || !dest_from_ldbs)
-	{
-		return DSK_ERR_NOTIMPL;	
-	}
-	dsk_report("Reading source file...");
-	err = (*src_to_ldbs)(source, &temp, geom);
-	if (err) 
-	{
-		dsk_report_end();
-		if (temp) ldbs_close(&temp);
-		return err;
-	}
 	dsk_report("Setting creator info");
 	/* Set the creator if the exporting driver didn't */
 	err = ldbs_get_creator(temp, &creator);
@@ -99,7 +75,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_copy(DSK_GEOMETRY *geom,
 		memset(&dpb, 0, sizeof(dpb));
 		dpb.psh = dsk_get_psh(probed_geom.dg_secsize);
 		dpb.phm = (1 << dpb.psh) - 1;	
-	
+
 		dpb.spt = probed_geom.dg_sectors << dpb.psh;
 		if (!dsk_get_option(source, "FS:CP/M:BSH", &v)) dpb.bsh = v;
 		if (!dsk_get_option(source, "FS:CP/M:BLM", &v)) dpb.blm = v;
@@ -115,12 +91,84 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_copy(DSK_GEOMETRY *geom,
 		{
 			ldbs_put_dpb(temp, &dpb);
 		}	
-	}			
+	}
+}
+
+/* Copy a track at a time from one driver to the other. Only the metadata
+ * is kept in the temporary store; each track passes through it and is 
+ * then dropped. Returns DSK_ERR_NOTIMPL if the destination can't take 
+ * this copy as a stream, before anything has been written. */
+static dsk_err_t copy_stream(DSK_GEOMETRY *geom, DSK_PDRIVER source, 
+		DSK_PDRIVER dest, DRV_CLASS *src_dc, DRV_CLASS *dest_dc)
+{
+	dsk_err_t err, err2;
+	PLDBS temp = NULL;
+	DSK_TRACK_SINK sink;
+	void *param;
+
+	err = ldbs_new(&temp, NULL, LDBS_DSK_TYPE);
+	if (err) return err;
+
+	copy_metadata(geom, source, temp);
+
+	err = (*dest_dc->dc_from_stream)(dest, temp, geom, &sink, &param);
+	if (!err)
+	{
+		dsk_report("Copying tracks...");
+		err  = (*src_dc->dc_to_stream)(source, temp, geom, sink, param);
+		/* Let the destination know the copy has finished */
+		err2 = (*sink)(temp, 0, 0, NULL, param);
+		if (!err) err = err2;
+	}
+	ldbs_close(&temp);
+	return err;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_copy(DSK_GEOMETRY *geom, 
+				DSK_PDRIVER source, DSK_PDRIVER dest)
+{
+	dsk_err_t err;
+	DRV_CLASS *src_dc, *dest_dc;
+	PLDBS temp = NULL;
+
+	/* Does source provide an export to LDBS format? */
+	src_dc = source->dr_class;
+	WALK_VTABLE(src_dc, dc_to_ldbs);
+	/* And does destination provide an import from LDBS format? */
+	dest_dc = dest->dr_class;
+	WALK_VTABLE(dest_dc, dc_from_ldbs);
+
+	if (!src_dc->dc_to_ldbs || !dest_dc->dc_from_ldbs)
+	{
+		return DSK_ERR_NOTIMPL;	
+	}
+	/* If the classes doing the conversion can also stream it, there's
+	 * no need to hold the whole disc in a temporary store */
+	if (src_dc->dc_to_stream && dest_dc->dc_from_stream)
+	{
+		err = copy_stream(geom, source, dest, src_dc, dest_dc);
+		if (err != DSK_ERR_NOTIMPL)
+		{
+			dsk_report_end();
+			return err;
+		}
+	}
+	dsk_report("Reading source file...");
+	err = (*src_dc->dc_to_ldbs)(source, &temp, geom);
+	if (err) 
+	{
+		dsk_report_end();
+		if (temp) ldbs_close(&temp);
+		return err;
+	}
+	copy_metadata(geom, source, temp);
+
 	err = ldbs_sync(temp);
 	if (!err)
 	{
 		dsk_report("Writing destination...");
-		err = (*dest_from_ldbs)(dest, temp, geom);
+		err = (*dest_dc->dc_from_ldbs)(dest, temp, geom);
 	}
 	dsk_report("Cleaning up");
 	if (temp) ldbs_close(&temp);
@@ -0,0 +1,438 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Comparing two drives, and recording the differences between them.
+ *
+ * dsk_diff() walks both drives a track at a time. The sector IDs on the
+ * track are compared first, and only if they match are the sectors.
+ * Where both drives hold their images as LDBS, the track headers are
+ * taken straight from the two blockstores: sectors stored as a filler
+ * byte are compared without reading anything, and sector blocks are only
+ * read if their lengths match. Otherwise the sectors are read from both
+ * drives with dsk_xread().
+ *
+ * The delta is an LDBS disc holding the tracks of the second drive that
+ * differ from the first. This is what the copy-on-write overlay keeps its
+ * changes in (see drvovly.c), so "overlay:first,delta" reads as the
+ * second image, and dsk_diff_apply() does what committing the overlay
+ * would. The delta also holds the dsk_hash() fingerprint of the first
+ * drive, so that dsk_diff_apply() can refuse to patch any other.
+ */
+
+#include "drvi.h"
+#include "drvldbs.h"
+#include "drvovly.h"
+
+/* LDBS block holding the fingerprint of the drive a delta applies to,
+ * followed by the number of cylinders and heads it covers (2 bytes each).
+ * Lowercase types are left by the LDBS spec for uses such as this. */
+#define DIFF_BASE_TYPE "base"
+#define DIFF_BASE_LEN  (DSK_HASH_LEN + 4)
+
+typedef struct
+{
+	DSK_PDRIVER first, second;
+	DSK_GEOMETRY geom;
+	PLDBS store1, store2;	/* Set if both drives are LDBS discs */
+	DSK_PDRIVER delta;
+	unsigned char *buf1, *buf2;
+	size_t buflen;
+} DIFF_STATE;
+
+
+/* Is the whole image in the driver's blockstore? The overlay's only
+ * holds the tracks that have been changed. */
+static int is_ldbs(DSK_PDRIVER self)
+{
+	return drv_instanceof(self, &dc_ldbsdisk) &&
+		!drv_instanceof(self, &dc_overlay);
+}
+
+
+static dsk_err_t diff_buffers(DIFF_STATE *ds, size_t len)
+{
+	if (len <= ds->buflen) return DSK_ERR_OK;
+
+	if (ds->buf1) dsk_free(ds->buf1);
+	if (ds->buf2) dsk_free(ds->buf2);
+	ds->buf1 = dsk_malloc(len);
+	ds->buf2 = dsk_malloc(len);
+	if (!ds->buf1 || !ds->buf2)
+	{
+		ds->buflen = 0;
+		return DSK_ERR_NOMEM;
+	}
+	ds->buflen = len;
+	return DSK_ERR_OK;
+}
+
+
+/* A track that has no sectors, or that is past the end of the image */
+static int blank_track(dsk_err_t err)
+{
+	return (err == DSK_ERR_NOADDR || err == DSK_ERR_NODATA ||
+		err == DSK_ERR_SEEKFAIL);
+}
+
+
+/* Compare a track by reading it from both drives */
+static dsk_err_t diff_track_read(DIFF_STATE *ds, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t *total, dsk_psect_t *differ)
+{
+	DSK_FORMAT *ids1 = NULL, *ids2 = NULL;
+	dsk_psect_t n1 = 0, n2 = 0, n;
+	int del1, del2;
+	dsk_err_t err, err1, err2;
+
+	err1 = dsk_trackids_geom(ds->first, &ds->geom, cylinder, head,
+			&n1, &ids1);
+	if (blank_track(err1)) { n1 = 0; err1 = DSK_ERR_OK; }
+	err2 = dsk_trackids_geom(ds->second, &ds->geom, cylinder, head,
+			&n2, &ids2);
+	if (blank_track(err2)) { n2 = 0; err2 = DSK_ERR_OK; }
+	err = err1 ? err1 : err2;
+
+	*total  = (n1 > n2) ? n1 : n2;
+	*differ = 0;
+	if (!err && (n1 != n2 || !dsk_same_trackids(ids1, ids2, n1)))
+	{
+		*differ = *total;
+	}
+	else for (n = 0; !err && n < n1; n++)
+	{
+		err = diff_buffers(ds, ids1[n].fmt_secsize);
+		if (err) break;
+
+		err1 = dsk_read_id(ds->first, &ds->geom, ds->buf1, cylinder,
+				head, &ids1[n], &del1);
+		err2 = dsk_read_id(ds->second, &ds->geom, ds->buf2, cylinder,
+				head, &ids2[n], &del2);
+		if (err1 != err2 || del1 != del2)
+		{
+			++*differ;
+			continue;
+		}
+		switch (err1)
+		{
+			case DSK_ERR_OK:
+			case DSK_ERR_DATAERR:
+				if (memcmp(ds->buf1, ds->buf2,
+					ids1[n].fmt_secsize)) ++*differ;
+				break;
+			case DSK_ERR_NOADDR:
+			case DSK_ERR_NODATA:
+				break;
+			/* Anything else is a problem with the drives, not
+			 * with the sector */
+			default: err = err1; break;
+		}
+	}
+	if (ids1) dsk_free(ids1);
+	if (ids2) dsk_free(ids2);
+	return err;
+}
+
+
+/* What would dsk_xread() of this sector return, other than data? */
+static int sector_status(const LDBS_SECTOR_ENTRY *se)
+{
+	int st = se->st1 & 0x40;	/* Deleted data */
+
+	/* No address or data mark: there is no data to compare */
+	if ((se->st1 & 0x01) || (se->st2 & 0x01)) return st | 0x01;
+	if (se->st1 & 0x04) return st | 0x04;
+	if ((se->st1 & 0x20) || (se->st2 & 0x20)) st |= 0x20;
+	return st;
+}
+
+
+/* Load a sector block. Only the first 'datalen' bytes of a sector stored
+ * once are ever read back, so only those are loaded. */
+static dsk_err_t load_sector(PLDBS store, const LDBS_SECTOR_ENTRY *se,
+		unsigned char *buf, size_t *len)
+{
+	dsk_err_t err;
+	char type[4];
+
+	if (se->copies <= 1 && *len > se->datalen) *len = se->datalen;
+	err = ldbs_getblock(store, se->blockid, type, buf, len);
+	if (err == DSK_ERR_OVERRUN) err = DSK_ERR_OK;
+	return err;
+}
+
+
+/* Compare two sectors in the LDBS blockstores */
+static dsk_err_t diff_sector_ldbs(DIFF_STATE *ds, const LDBS_SECTOR_ENTRY *s1,
+		const LDBS_SECTOR_ENTRY *s2, int *same)
+{
+	int blank1 = (s1->copies == 0 || s1->blockid == LDBLOCKID_NULL);
+	int blank2 = (s2->copies == 0 || s2->blockid == LDBLOCKID_NULL);
+	char type[4];
+	size_t len1 = 0, len2 = 0;
+	dsk_err_t err;
+
+	*same = 0;
+	if (sector_status(s1) != sector_status(s2)) return DSK_ERR_OK;
+	if (sector_status(s1) & 0x05)
+	{
+		*same = 1;
+		return DSK_ERR_OK;
+	}
+	if (blank1 && blank2)
+	{
+		*same = (s1->filler == s2->filler);
+		return DSK_ERR_OK;
+	}
+	if (!blank1)
+	{
+		err = ldbs_get_blockinfo(ds->store1, s1->blockid, type, &len1);
+		if (err) return err;
+	}
+	if (!blank2)
+	{
+		err = ldbs_get_blockinfo(ds->store2, s2->blockid, type, &len2);
+		if (err) return err;
+	}
+	/* A filler against a stored sector: the stored one must be a
+	 * single copy of the filler byte */
+	if (blank1 || blank2)
+	{
+		const LDBS_SECTOR_ENTRY *se = blank1 ? s2 : s1;
+		PLDBS store = blank1 ? ds->store2 : ds->store1;
+		unsigned char filler = blank1 ? s1->filler : s2->filler;
+		size_t len = blank1 ? len2 : len1;
+
+		if (se->copies > 1 || len < se->datalen) return DSK_ERR_OK;
+		err = diff_buffers(ds, len);
+		if (!err) err = load_sector(store, se, ds->buf1, &len);
+		if (err) return err;
+		*same = (ds->buf1[0] == filler &&
+			dsk_run_length(ds->buf1, len) == len);
+		return DSK_ERR_OK;
+	}
+	/* Two stored sectors. Multiple copies are compared as they are
+	 * stored; otherwise the data beyond 'datalen' doesn't matter. */
+	if (s1->copies != s2->copies) return DSK_ERR_OK;
+	if (s1->copies == 1)
+	{
+		if (len1 > s1->datalen) len1 = s1->datalen;
+		if (len2 > s2->datalen) len2 = s2->datalen;
+	}
+	if (len1 != len2) return DSK_ERR_OK;
+
+	err = diff_buffers(ds, len1);
+	if (!err) err = load_sector(ds->store1, s1, ds->buf1, &len1);
+	if (!err) err = load_sector(ds->store2, s2, ds->buf2, &len2);
+	if (err) return err;
+	*same = !memcmp(ds->buf1, ds->buf2, len1);
+	return DSK_ERR_OK;
+}
+
+
+/* Compare a track by looking at its headers in the two blockstores */
+static dsk_err_t diff_track_ldbs(DIFF_STATE *ds, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t *total, dsk_psect_t *differ)
+{
+	LDBS_TRACKHEAD *t1 = NULL, *t2 = NULL;
+	LDBS_SECTOR_ENTRY *s1, *s2;
+	unsigned n1, n2, n;
+	int same;
+	dsk_err_t err;
+
+	err = ldbs_get_trackhead(ds->store1, &t1, cylinder, head);
+	if (!err) err = ldbs_get_trackhead(ds->store2, &t2, cylinder, head);
+	if (err)
+	{
+		if (t1) ldbs_free(t1);
+		return err;
+	}
+	n1 = t1 ? t1->count : 0;
+	n2 = t2 ? t2->count : 0;
+
+	*total  = (n1 > n2) ? n1 : n2;
+	*differ = 0;
+	if (n1 != n2) *differ = *total;
+	for (n = 0; n < n1 && !*differ; n++)
+	{
+		s1 = &t1->sector[n];
+		s2 = &t2->sector[n];
+		if (s1->id_cyl  != s2->id_cyl || s1->id_head != s2->id_head ||
+		    s1->id_sec  != s2->id_sec || s1->datalen != s2->datalen)
+		{
+			*differ = *total;
+		}
+	}
+	for (n = 0; n < n1 && !*differ; n++)
+	{
+		err = diff_sector_ldbs(ds, &t1->sector[n], &t2->sector[n],
+				&same);
+		if (err) break;
+		if (!same) ++*differ;
+	}
+	if (t1) ldbs_free(t1);
+	if (t2) ldbs_free(t2);
+	return err;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_diff(DSK_PDRIVER first,
+				DSK_PDRIVER second, const DSK_GEOMETRY *geom,
+				const char *deltafile, DSK_DIFF_STATS *stats,
+				DSK_DIFFFUNC func, void *param)
+{
+	DIFF_STATE ds;
+	DSK_DIFF_STATS dd;
+	unsigned char base[DIFF_BASE_LEN];
+	dsk_pcyl_t cyl;
+	dsk_phead_t head;
+	dsk_psect_t total, differ;
+	dsk_err_t err = DSK_ERR_OK, err2;
+
+	if (!first || !second || !geom) return DSK_ERR_BADPTR;
+
+	memset(&ds, 0, sizeof(ds));
+	memset(&dd, 0, sizeof(dd));
+	ds.first  = first;
+	ds.second = second;
+	/* Complementing the data from both drives wouldn't change whether
+	 * they are the same */
+	memcpy(&ds.geom, geom, sizeof(ds.geom));
+	ds.geom.dg_fm &= ~RECMODE_COMPLEMENT;
+	ds.geom.dg_noskip = 1;
+
+	/* Fingerprint the first drive while it is still attached */
+	if (deltafile)
+	{
+		err = dsk_hash(first, geom, base, NULL, NULL);
+		if (err) return err;
+		ldbs_poke2(base + DSK_HASH_LEN,
+				(unsigned short)geom->dg_cylinders);
+		ldbs_poke2(base + DSK_HASH_LEN + 2,
+				(unsigned short)geom->dg_heads);
+	}
+
+	if (is_ldbs(first) && is_ldbs(second))
+	{
+		/* Get the blockstores up to date */
+		err = ldbsdisk_detach(first);
+		if (!err) err = ldbsdisk_detach(second);
+		if (err) return err;
+		ds.store1 = ((LDBSDISK_DSK_DRIVER *)first )->ld_store;
+		ds.store2 = ((LDBSDISK_DSK_DRIVER *)second)->ld_store;
+	}
+	if (deltafile)
+	{
+		err = dsk_creat(&ds.delta, deltafile, "ldbs", NULL);
+		if (!err) err = ldbs_putblock_d(
+				((LDBSDISK_DSK_DRIVER *)ds.delta)->ld_store,
+				DIFF_BASE_TYPE, base, sizeof(base));
+	}
+
+	dsk_report("Comparing tracks...");
+	for (cyl = 0; !err && cyl < geom->dg_cylinders; cyl++)
+	{
+		for (head = 0; !err && head < geom->dg_heads; head++)
+		{
+			if (ds.store1) err = diff_track_ldbs(&ds, cyl, head,
+						&total, &differ);
+			else	       err = diff_track_read(&ds, cyl, head,
+						&total, &differ);
+			if (err) break;
+
+			++dd.dd_tracks;
+			dd.dd_sectors += total;
+			if (!differ) continue;
+
+			++dd.dd_tracks_differ;
+			dd.dd_sectors_differ += differ;
+			if (func) (*func)(cyl, head, differ, param);
+			if (ds.delta) err = ovl_copy_track(
+					(LDBSDISK_DSK_DRIVER *)ds.delta,
+					second, geom, cyl, head);
+		}
+	}
+	dsk_report_end();
+
+	if (ds.delta)
+	{
+		err2 = dsk_close(&ds.delta);
+		if (!err) err = err2;
+	}
+	if (ds.store1)
+	{
+		/* Copying tracks to the delta reads them through the
+		 * driver, so let go of the last one it loaded */
+		err2 = ldbsdisk_detach(second);
+		if (!err) err = err2;
+		err2 = ldbsdisk_attach(first);
+		if (!err) err = err2;
+		err2 = ldbsdisk_attach(second);
+		if (!err) err = err2;
+	}
+	if (ds.buf1) dsk_free(ds.buf1);
+	if (ds.buf2) dsk_free(ds.buf2);
+	if (stats) memcpy(stats, &dd, sizeof(dd));
+	return err;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_diff_apply(DSK_PDRIVER self,
+				const DSK_GEOMETRY *geom,
+				const char *deltafile)
+{
+	PLDBS delta;
+	char type[4];
+	unsigned char base[DIFF_BASE_LEN], hash[DSK_HASH_LEN];
+	DSK_GEOMETRY dg;
+	size_t len = sizeof(base);
+	int readonly = 1;
+	dsk_err_t err;
+
+	if (!self || !geom || !deltafile) return DSK_ERR_BADPTR;
+
+	err = ldbs_open(&delta, deltafile, type, &readonly);
+	if (err) return err;
+	if (memcmp(type, LDBS_DSK_TYPE, 4) && 
+	    memcmp(type, LDBS_DSK_TYPE_SHARED, 4)) err = DSK_ERR_NOTME;
+	/* A delta that says which drive it was made against may only be
+	 * applied to that one. An overlay's delta doesn't say. */
+	if (!err) err = ldbs_getblock_d(delta, DIFF_BASE_TYPE, base, &len);
+	if (err == DSK_ERR_OVERRUN || (!err && len && len != sizeof(base)))
+	{
+		err = DSK_ERR_CORRUPT;
+	}
+	if (!err && len)
+	{
+		/* Fingerprint the same tracks as dsk_diff() did */
+		memcpy(&dg, geom, sizeof(dg));
+		dg.dg_cylinders = ldbs_peek2(base + DSK_HASH_LEN);
+		dg.dg_heads     = ldbs_peek2(base + DSK_HASH_LEN + 2);
+		err = dsk_hash(self, &dg, hash, NULL, NULL);
+		if (!err && memcmp(base, hash, sizeof(hash)))
+		{
+			err = DSK_ERR_MISMATCH;
+		}
+	}
+	if (!err) err = ovl_apply_delta(self, geom, delta);
+	ldbs_close(&delta);
+	return err;
+}
@@ -0,0 +1,269 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Read-only view of an image file, for the drivers (IMD, CopyQM, Teledisk)
+ * that convert a whole file to LDBS when it is opened; and an output
+ * buffer for the same drivers when they convert back on close.
+ *
+ * Those formats are a stream of small headers and variable-length records,
+ * and parsing them with fgetc() and lots of little fread() calls spends
+ * most of its time in stdio. Instead the file is mapped into memory
+ * (or, where that can't be done, loaded into memory) and parsed from
+ * there. If neither is possible -- a 16-bit system with a large image,
+ * say -- reads go through stdio as before.
+ *
+ * On the way out, the writers used to emit each track as a string of
+ * fputc() and small fwrite() calls. Now they encode a whole track into a
+ * DSK_WBUF and write it with one call.
+ */
+
+#include "drvi.h"
+
+#ifndef DSK_FBUF_USE_MMAP
+# if defined(__unix__) || defined(__APPLE__)
+#  define DSK_FBUF_USE_MMAP 1
+# else
+#  define DSK_FBUF_USE_MMAP 0
+# endif
+#endif
+
+#if DSK_FBUF_USE_MMAP
+#include <sys/types.h>
+#include <sys/mman.h>
+#endif
+
+
+/* Set up fb to read from fp. The position is set to the start of the
+ * file. fp must stay open until dsk_fbuf_close() is called. */
+dsk_err_t dsk_fbuf_open(DSK_FBUF *fb, FILE *fp)
+{
+	long len;
+	unsigned char *buf;
+
+	memset(fb, 0, sizeof(*fb));
+	fb->fb_fp = fp;
+
+	if (fseek(fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
+	len = ftell(fp);
+	if (len < 0 || fseek(fp, 0, SEEK_SET)) return DSK_ERR_SYSERR;
+	fb->fb_len = len;
+
+	/* An empty file, or one too big to hold in memory, is read through
+	 * stdio. */
+	if (len == 0 || (unsigned long)len > (size_t)-1) return DSK_ERR_OK;
+#if DSK_FBUF_USE_MMAP
+	{
+		void *p = mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED,
+				fileno(fp), 0);
+		if (p != MAP_FAILED)
+		{
+			fb->fb_data   = p;
+			fb->fb_mapped = 1;
+			return DSK_ERR_OK;
+		}
+	}
+#endif
+	buf = dsk_malloc((size_t)len);
+	if (!buf) return DSK_ERR_OK;
+	if (fread(buf, 1, (size_t)len, fp) < (size_t)len)
+	{
+		dsk_free(buf);
+		return DSK_ERR_SYSERR;
+	}
+	fb->fb_data = buf;
+	return DSK_ERR_OK;
+}
+
+
+/* Release the memory held by fb. This does not close the file. */
+void dsk_fbuf_close(DSK_FBUF *fb)
+{
+	if (fb->fb_data)
+	{
+#if DSK_FBUF_USE_MMAP
+		if (fb->fb_mapped)
+			munmap((void *)fb->fb_data, (size_t)fb->fb_len);
+		else
+#endif
+		dsk_free((void *)fb->fb_data);
+	}
+	if (fb->fb_scratch) dsk_free(fb->fb_scratch);
+	fb->fb_data    = NULL;
+	fb->fb_scratch = NULL;
+	fb->fb_mapped  = 0;
+}
+
+
+/* Get one byte, or EOF at the end of the file */
+int dsk_fbuf_getc(DSK_FBUF *fb)
+{
+	int c;
+
+	if (fb->fb_data)
+	{
+		if (fb->fb_pos >= fb->fb_len) return EOF;
+		return fb->fb_data[fb->fb_pos++];
+	}
+	c = fgetc(fb->fb_fp);
+	if (c != EOF) ++fb->fb_pos;
+	return c;
+}
+
+
+/* Get the next 'count' bytes. The pointer returned is valid until the
+ * next call. Returns NULL if the file doesn't have 'count' more bytes
+ * (or, when reading through stdio, if no buffer could be allocated). */
+const unsigned char *dsk_fbuf_get(DSK_FBUF *fb, size_t count)
+{
+	const unsigned char *p;
+	size_t got;
+
+	if (fb->fb_data)
+	{
+		if (fb->fb_pos > fb->fb_len || fb->fb_len - fb->fb_pos < count)
+		{
+			fb->fb_pos = fb->fb_len;
+			return NULL;
+		}
+		p = fb->fb_data + fb->fb_pos;
+		fb->fb_pos += count;
+		return p;
+	}
+	if (count > fb->fb_scratchlen)
+	{
+		unsigned char *nb = dsk_malloc(count);
+
+		if (!nb) return NULL;
+		if (fb->fb_scratch) dsk_free(fb->fb_scratch);
+		fb->fb_scratch    = nb;
+		fb->fb_scratchlen = count;
+	}
+	got = fread(fb->fb_scratch, 1, count, fb->fb_fp);
+	fb->fb_pos += got;
+	if (got < count) return NULL;
+	return fb->fb_scratch;
+}
+
+
+/* Move to an absolute position. As with fseek(), it is not an error to
+ * go past the end of the file, but nothing more can be read there. */
+dsk_err_t dsk_fbuf_seek(DSK_FBUF *fb, unsigned long pos)
+{
+	if (!fb->fb_data && fseek(fb->fb_fp, (long)pos, SEEK_SET))
+		return DSK_ERR_SYSERR;
+	fb->fb_pos = pos;
+	return DSK_ERR_OK;
+}
+
+
+/* Set up an empty output buffer */
+void dsk_wbuf_init(DSK_WBUF *wb)
+{
+	memset(wb, 0, sizeof(*wb));
+}
+
+
+/* Release the memory held by wb. Anything not yet flushed is lost. */
+void dsk_wbuf_close(DSK_WBUF *wb)
+{
+	if (wb->wb_data) dsk_free(wb->wb_data);
+	wb->wb_data = NULL;
+	wb->wb_len  = 0;
+	wb->wb_size = 0;
+}
+
+
+/* Append 'count' bytes to the buffer, returning a pointer to them for the
+ * caller to fill in. The pointer is valid until the next call. Returns
+ * NULL (and records DSK_ERR_NOMEM) if the buffer can't be grown. */
+unsigned char *dsk_wbuf_reserve(DSK_WBUF *wb, size_t count)
+{
+	unsigned char *p;
+
+	if (wb->wb_err) return NULL;
+	if (count > wb->wb_size - wb->wb_len)
+	{
+		size_t nsize = wb->wb_size ? wb->wb_size : 4096;
+		unsigned char *nb;
+
+		while (nsize - wb->wb_len < count)
+		{
+			if (nsize * 2 < nsize)	/* Overflow */
+			{
+				wb->wb_err = DSK_ERR_NOMEM;
+				return NULL;
+			}
+			nsize *= 2;
+		}
+		nb = dsk_malloc(nsize);
+		if (!nb)
+		{
+			wb->wb_err = DSK_ERR_NOMEM;
+			return NULL;
+		}
+		if (wb->wb_len) memcpy(nb, wb->wb_data, wb->wb_len);
+		if (wb->wb_data) dsk_free(wb->wb_data);
+		wb->wb_data = nb;
+		wb->wb_size = nsize;
+	}
+	p = wb->wb_data + wb->wb_len;
+	wb->wb_len += count;
+	return p;
+}
+
+
+/* Append a block of bytes */
+void dsk_wbuf_put(DSK_WBUF *wb, const void *data, size_t count)
+{
+	unsigned char *p;
+
+	if (!count) return;
+	p = dsk_wbuf_reserve(wb, count);
+	if (p) memcpy(p, data, count);
+}
+
+
+/* Append one byte */
+void dsk_wbuf_putc(DSK_WBUF *wb, int c)
+{
+	if (wb->wb_len < wb->wb_size && !wb->wb_err)
+		wb->wb_data[wb->wb_len++] = (unsigned char)c;
+	else
+	{
+		unsigned char *p = dsk_wbuf_reserve(wb, 1);
+		if (p) *p = (unsigned char)c;
+	}
+}
+
+
+/* Write out and empty the buffer. Returns the first error that happened
+ * while it was being filled, if any. */
+dsk_err_t dsk_wbuf_flush(DSK_WBUF *wb, FILE *fp)
+{
+	size_t len = wb->wb_len;
+
+	wb->wb_len = 0;
+	if (wb->wb_err) return wb->wb_err;
+	if (len && fwrite(wb->wb_data, 1, len, fp) < len)
+		return DSK_ERR_SYSERR;
+	return DSK_ERR_OK;
+}
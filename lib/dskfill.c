@@ -0,0 +1,114 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Filling areas of raw image files.
+ *
+ * Formatting a track, or padding a file out to where a sector is to be
+ * written, means writing the same byte many times over. This is done a
+ * buffer at a time rather than with fputc(). If the "RAW:SPARSE" option
+ * is set on the drive, areas of zeroes at the end of the file are not
+ * written at all: the file is extended with ftruncate(), leaving a hole
+ * which the host reads back as zeroes without allocating space for it.
+ */
+
+#include "drvi.h"
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
+#define FILL_CHUNK 512
+
+
+/* Write 'count' copies of 'filler' at the current position in 'fp' */
+dsk_err_t dsk_fill(FILE *fp, unsigned char filler, unsigned long count)
+{
+	unsigned char buf[FILL_CHUNK];
+	size_t len;
+
+	memset(buf, filler, count < FILL_CHUNK ? (size_t)count : FILL_CHUNK);
+	while (count > 0)
+	{
+		len = (count < FILL_CHUNK) ? (size_t)count : FILL_CHUNK;
+		if (fwrite(buf, 1, len, fp) < len) return DSK_ERR_SYSERR;
+		count -= len;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Write 'count' copies of 'filler' at 'offset' in 'fp', which is
+ * currently 'filesize' bytes long. The caller has already padded the
+ * file out to 'offset' if it was shorter. */
+dsk_err_t dsk_fill_at(DSK_DRIVER *self, FILE *fp, unsigned long filesize,
+		unsigned long offset, unsigned char filler,
+		unsigned long count)
+{
+#ifdef HAVE_FTRUNCATE
+	int sparse = 0;
+
+	/* Holes can only be left at the end of the file, and only read back
+	 * as zeroes */
+	if (filler == 0 && offset >= filesize &&
+	    dsk_get_option(self, "RAW:SPARSE", &sparse) == DSK_ERR_OK &&
+	    sparse)
+	{
+		if (fflush(fp)) return DSK_ERR_SYSERR;
+		if (ftruncate(fileno(fp), (off_t)(offset + count)))
+			return DSK_ERR_SYSERR;
+		if (fseek(fp, offset + count, SEEK_SET)) return DSK_ERR_SYSERR;
+		return DSK_ERR_OK;
+	}
+#endif
+	if (fseek(fp, offset, SEEK_SET)) return DSK_ERR_SYSERR;
+	return dsk_fill(fp, filler, count);
+}
+
+
+/* Raw drivers call this when they open a file, so that the RAW:SPARSE
+ * option can be set on them */
+void dsk_fill_options(DSK_DRIVER *self)
+{
+	dsk_isetoption(self, "RAW:SPARSE", 0, 1);
+}
+
+
+/* Called on a closed file, so that everything has been written out */
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_get_filesize(const char *filename,
+		unsigned long *logical, unsigned long *allocated)
+{
+#ifdef HAVE_SYS_STAT_H
+	struct stat st;
+
+	if (!filename || !logical || !allocated) return DSK_ERR_BADPTR;
+	if (stat(filename, &st)) return DSK_ERR_SYSERR;
+	*logical = (unsigned long)st.st_size;
+# if defined(__unix__) || defined(__APPLE__)
+	*allocated = (unsigned long)st.st_blocks * 512UL;
+# else
+	*allocated = *logical;
+# endif
+	return DSK_ERR_OK;
+#else
+	if (!filename || !logical || !allocated) return DSK_ERR_BADPTR;
+	return DSK_ERR_NOTIMPL;
+#endif
+}
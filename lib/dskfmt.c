@@ -32,6 +32,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pformat(DSK_DRIVER *self, DSK_GEOMETRY *geom
         DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
 	unsigned n;
+	unsigned long t0;
 
         if (!self || !geom || !format || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -42,11 +43,15 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pformat(DSK_DRIVER *self, DSK_GEOMETRY *geom
 
 	WALK_VTABLE(dc, dc_format)
         if (!dc->dc_format) return DSK_ERR_NOTIMPL;
+	t0 = dsk_stats_begin(self, DSK_OP_FORMAT, cylinder, head, -1);
 	for (n = 0; n < self->dr_retry_count; n++)
 	{
 	        e = (dc->dc_format)(self,geom,cylinder,head,format,filler);      
 		if (!DSK_TRANSIENT_ERROR(e)) break;
 	}
+	dsk_stats_end(self, DSK_OP_FORMAT, t0, cylinder, head, -1, e,
+		(n < self->dr_retry_count) ? n + 1 : n,
+		(unsigned long)geom->dg_sectors * geom->dg_secsize);
 	if (e == DSK_ERR_OK) self->dr_dirty = 1;
 	return e;
 }
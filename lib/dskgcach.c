@@ -0,0 +1,557 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Geometry probe cache.
+ *
+ * dsk_defgetgeom() may have to try several data rates and recording modes
+ * and read a number of sectors before it can identify a disc. For disc
+ * image files, the result is remembered, keyed on the driver and the
+ * file's identity (device and inode, so that different paths to the same
+ * file share an entry), and checked against a fingerprint of the file
+ * (its size, its modification time and a hash of its first few
+ * kilobytes). Opening the same unchanged image again then skips the probe.
+ *
+ * The cache is held in memory, and holds at most GC_MAXENTRIES images;
+ * beyond that, the least recently used is dropped. If a cache file has
+ * been selected (either with dsk_geomcache_file() or by setting the
+ * LIBDSK_GEOMCACHE environment variable) then it also persists between
+ * sessions.
+ *
+ * Drives and anything else that is not a regular file are never cached,
+ * since the disc in them can change without warning.
+ */
+
+#include "drvi.h"
+
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
+#define GC_HASHLEN 4096		/* Bytes of the image that get hashed */
+#define GC_MAXENTRIES 256	/* Images held in the cache */
+#define GC_MAGIC   "LIBDSK-GEOMCACHE 2"
+#define GC_MAGICPFX "LIBDSK-GEOMCACHE "	/* Any version of the above */
+
+#ifdef PATH_MAX
+# define GC_LINELEN (PATH_MAX + 1024)
+#else
+# define GC_LINELEN 5120
+#endif
+
+typedef struct geomcache
+{
+	struct geomcache *gc_next;
+	char *gc_filename;	/* As it was opened; used only for display */
+	char *gc_drvname;
+	unsigned long gc_dev;	/* The file's identity */
+	unsigned long gc_ino;
+	unsigned long gc_size;
+	unsigned long gc_mtime;
+	unsigned long gc_hash;
+	DSK_GEOMETRY gc_geom;
+	DSK_OPTION *gc_options;	/* Filesystem options set by the probe */
+} GEOMCACHE;
+
+static GEOMCACHE *st_cache;	/* Most recently used first */
+static int st_count;		/* Entries in st_cache */
+static char *st_cachefile;
+static int st_loaded;		/* Has the cache file been read? */
+static int st_stale;		/* Count of superseded lines in it */
+static int st_readonly;		/* Cache file isn't ours to write */
+
+static void gc_free(GEOMCACHE *gc)
+{
+	DSK_OPTION *opt, *opt2;
+
+	for (opt = gc->gc_options; opt; opt = opt2)
+	{
+		opt2 = opt->do_next;
+		dsk_free(opt);
+	}
+	if (gc->gc_filename) dsk_free(gc->gc_filename);
+	if (gc->gc_drvname)  dsk_free(gc->gc_drvname);
+	dsk_free(gc);
+}
+
+
+/* Options are kept in the order they were set, so that they will be
+ * listed in the same order whether or not the cache was used */
+static dsk_err_t gc_addopt(GEOMCACHE *gc, const char *name, int value)
+{
+	DSK_OPTION *opt, **tail;
+
+	opt = dsk_malloc(sizeof(DSK_OPTION) + strlen(name));
+	if (!opt) return DSK_ERR_NOMEM;
+	opt->do_next = NULL;
+	opt->do_value = value;
+	strcpy(opt->do_name, name);
+	for (tail = &gc->gc_options; *tail; tail = &(*tail)->do_next);
+	*tail = opt;
+	return DSK_ERR_OK;
+}
+
+/* Identify a disc image file and get its size and modification time.
+ * Returns DSK_ERR_NOTME if the file is not a candidate for caching. */
+static dsk_err_t gc_stat(const char *filename, GEOMCACHE *key)
+{
+#ifdef HAVE_SYS_STAT_H
+	struct stat st;
+
+	if (stat(filename, &st) || !S_ISREG(st.st_mode)) return DSK_ERR_NOTME;
+	key->gc_dev   = (unsigned long)st.st_dev;
+	key->gc_ino   = (unsigned long)st.st_ino;
+	key->gc_size  = (unsigned long)st.st_size;
+	key->gc_mtime = (unsigned long)st.st_mtime;
+	return DSK_ERR_OK;
+#else
+	return DSK_ERR_NOTME;
+#endif
+}
+
+
+/* Hash the start of a disc image file */
+static dsk_err_t gc_hash(const char *filename, unsigned long *hash)
+{
+	FILE *fp;
+	unsigned char *buf;
+	size_t n, len;
+	unsigned long h;
+
+	buf = dsk_malloc(GC_HASHLEN);
+	if (!buf) return DSK_ERR_NOMEM;
+	fp = fopen(filename, "rb");
+	if (!fp)
+	{
+		dsk_free(buf);
+		return DSK_ERR_NOTME;
+	}
+	len = fread(buf, 1, GC_HASHLEN, fp);
+	fclose(fp);
+
+	/* 32-bit FNV-1a */
+	h = 2166136261UL;
+	for (n = 0; n < len; n++)
+	{
+		h ^= buf[n];
+		h = (h * 16777619UL) & 0xFFFFFFFFUL;
+	}
+	dsk_free(buf);
+	*hash = h;
+	return DSK_ERR_OK;
+}
+
+
+static GEOMCACHE *gc_find(unsigned long dev, unsigned long ino,
+		const char *drvname)
+{
+	GEOMCACHE *gc;
+
+	for (gc = st_cache; gc; gc = gc->gc_next)
+	{
+		if (gc->gc_dev == dev && gc->gc_ino == ino &&
+		    !strcmp(gc->gc_drvname,  drvname)) return gc;
+	}
+	return NULL;
+}
+
+
+/* Take an entry out of the list without freeing it */
+static void gc_detach(GEOMCACHE *target)
+{
+	GEOMCACHE *gc, *prev = NULL;
+
+	for (gc = st_cache; gc; gc = gc->gc_next)
+	{
+		if (gc == target)
+		{
+			if (prev) prev->gc_next = gc->gc_next;
+			else	  st_cache      = gc->gc_next;
+			--st_count;
+			return;
+		}
+		prev = gc;
+	}
+}
+
+
+static void gc_unlink(GEOMCACHE *target)
+{
+	gc_detach(target);
+	gc_free(target);
+}
+
+
+/* Add an entry as the most recently used, replacing any existing entry
+ * for the same image and dropping the least recently used if the cache
+ * is full. Each entry dropped leaves a dead line in the cache file. */
+static void gc_insert(GEOMCACHE *gc)
+{
+	GEOMCACHE *old, **pp;
+
+	old = gc_find(gc->gc_dev, gc->gc_ino, gc->gc_drvname);
+	if (old)
+	{
+		gc_unlink(old);
+		++st_stale;
+	}
+	gc->gc_next = st_cache;
+	st_cache = gc;
+	++st_count;
+	while (st_count > GC_MAXENTRIES)
+	{
+		for (pp = &st_cache; (*pp)->gc_next; pp = &(*pp)->gc_next);
+		gc_free(*pp);
+		*pp = NULL;
+		--st_count;
+		++st_stale;
+	}
+}
+
+/* Write one cache entry as a line of text:
+ *
+ * driver <TAB> device <TAB> inode <TAB> size <TAB> mtime <TAB> hash <TAB>
+ * geometry <TAB> options <TAB> filename
+ *
+ * The filename comes last so that it may contain spaces. */
+static void gc_write(FILE *fp, GEOMCACHE *gc)
+{
+	const DSK_GEOMETRY *g = &gc->gc_geom;
+	DSK_OPTION *opt;
+
+	fprintf(fp, "%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%d %u %u %u %u %lu %d %u %u %d %d %d\t",
+		gc->gc_drvname, gc->gc_dev, gc->gc_ino,
+		gc->gc_size, gc->gc_mtime, gc->gc_hash,
+		(int)g->dg_sidedness, g->dg_cylinders, g->dg_heads,
+		g->dg_sectors, g->dg_secbase, (unsigned long)g->dg_secsize,
+		(int)g->dg_datarate, g->dg_rwgap, g->dg_fmtgap,
+		(int)g->dg_fm, g->dg_nomulti, g->dg_noskip);
+	for (opt = gc->gc_options; opt; opt = opt->do_next)
+	{
+		fprintf(fp, "%s=%d;", opt->do_name, opt->do_value);
+	}
+	fprintf(fp, "\t%s\n", gc->gc_filename);
+}
+
+
+static dsk_err_t gc_parse(char *line, GEOMCACHE **result)
+{
+	GEOMCACHE *gc;
+	char *field[9], *opt, *eq, *semi;
+	int n, sidedness, rate, fm, nomulti, noskip;
+	unsigned cyls, heads, secs, secbase, rwgap, fmtgap;
+	unsigned long secsize;
+
+	*result = NULL;
+	for (n = 0; n < 9; n++)
+	{
+		field[n] = line;
+		line = (n < 8) ? strchr(line, '\t') : strchr(line, '\n');
+		if (!line)
+		{
+			if (n < 8) return DSK_ERR_BADFMT;
+			break;
+		}
+		*line++ = 0;
+	}
+	if (sscanf(field[6], "%d %u %u %u %u %lu %d %u %u %d %d %d",
+		&sidedness, &cyls, &heads, &secs, &secbase, &secsize,
+		&rate, &rwgap, &fmtgap, &fm, &nomulti, &noskip) != 12)
+		return DSK_ERR_BADFMT;
+
+	gc = dsk_malloc(sizeof(GEOMCACHE));
+	if (!gc) return DSK_ERR_NOMEM;
+	memset(gc, 0, sizeof(GEOMCACHE));
+	gc->gc_drvname  = dsk_malloc_string(field[0]);
+	gc->gc_filename = dsk_malloc_string(field[8]);
+	if (!gc->gc_drvname || !gc->gc_filename)
+	{
+		gc_free(gc);
+		return DSK_ERR_NOMEM;
+	}
+	gc->gc_dev   = strtoul(field[1], NULL, 10);
+	gc->gc_ino   = strtoul(field[2], NULL, 10);
+	gc->gc_size  = strtoul(field[3], NULL, 10);
+	gc->gc_mtime = strtoul(field[4], NULL, 10);
+	gc->gc_hash  = strtoul(field[5], NULL, 10);
+	gc->gc_geom.dg_sidedness = (dsk_sides_t)sidedness;
+	gc->gc_geom.dg_cylinders = cyls;
+	gc->gc_geom.dg_heads     = heads;
+	gc->gc_geom.dg_sectors   = secs;
+	gc->gc_geom.dg_secbase   = secbase;
+	gc->gc_geom.dg_secsize   = secsize;
+	gc->gc_geom.dg_datarate  = (dsk_rate_t)rate;
+	gc->gc_geom.dg_rwgap     = (unsigned char)rwgap;
+	gc->gc_geom.dg_fmtgap    = (unsigned char)fmtgap;
+	gc->gc_geom.dg_fm        = fm;
+	gc->gc_geom.dg_nomulti   = nomulti;
+	gc->gc_geom.dg_noskip    = noskip;
+
+	for (opt = field[7]; (semi = strchr(opt, ';')); opt = semi + 1)
+	{
+		*semi = 0;
+		eq = strchr(opt, '=');
+		if (!eq) continue;
+		*eq = 0;
+		if (gc_addopt(gc, opt, atoi(eq + 1)))
+		{
+			gc_free(gc);
+			return DSK_ERR_NOMEM;
+		}
+	}
+	*result = gc;
+	return DSK_ERR_OK;
+}
+
+
+/* Write the entries oldest first, so that reloading the file puts them
+ * back in the same order. The list is never longer than GC_MAXENTRIES. */
+static void gc_write_all(FILE *fp, GEOMCACHE *gc)
+{
+	if (!gc) return;
+	gc_write_all(fp, gc->gc_next);
+	gc_write(fp, gc);
+}
+
+
+/* Rewrite the cache file from the in-memory copy */
+static void gc_save(void)
+{
+	FILE *fp;
+
+	if (!st_cachefile || st_readonly) return;
+	fp = fopen(st_cachefile, "w");
+	if (!fp) return;
+	fprintf(fp, "%s\n", GC_MAGIC);
+	gc_write_all(fp, st_cache);
+	fclose(fp);
+	st_stale = 0;
+}
+
+
+static void gc_load(void)
+{
+	FILE *fp;
+	char *line;
+	GEOMCACHE *gc;
+	int upgrade = 0;
+
+	if (st_loaded) return;
+	st_loaded = 1;
+	st_stale = 0;
+	st_readonly = 0;
+
+	if (!st_cachefile)
+	{
+		const char *s = getenv("LIBDSK_GEOMCACHE");
+		if (!s || !s[0]) return;
+		st_cachefile = dsk_malloc_string(s);
+		if (!st_cachefile) return;
+	}
+	fp = fopen(st_cachefile, "r");
+	if (!fp) return;
+	line = dsk_malloc(GC_LINELEN);
+	if (!line)
+	{
+		fclose(fp);
+		st_readonly = 1;
+		return;
+	}
+	if (!fgets(line, GC_LINELEN, fp))
+	{
+		/* Empty file: it gets a header when the first entry is added */
+		dsk_free(line);
+		fclose(fp);
+		return;
+	}
+	if (strncmp(line, GC_MAGIC, strlen(GC_MAGIC)))
+	{
+		/* A cache file from an earlier version gets replaced; anything
+		 * else isn't ours, so leave it alone. */
+		if (!strncmp(line, GC_MAGICPFX, strlen(GC_MAGICPFX)))
+			upgrade = 1;
+		else	st_readonly = 1;
+		dsk_free(line);
+		fclose(fp);
+		if (upgrade) gc_save();
+		return;
+	}
+	while (fgets(line, GC_LINELEN, fp))
+	{
+		if (gc_parse(line, &gc) || !gc) continue;
+
+		/* Entries are appended as they are made, so a later line
+		 * for the same image supersedes an earlier one */
+		gc_insert(gc);
+	}
+	dsk_free(line);
+	fclose(fp);
+	/* Compact the file if it's mostly dead entries */
+	if (st_stale > st_count) gc_save();
+}
+
+
+/* Look up the geometry of a disc in the cache. Returns DSK_ERR_OK and
+ * populates 'geom' (and any filesystem options) if found. */
+dsk_err_t dg_cache_lookup(DSK_DRIVER *self, DSK_GEOMETRY *geom)
+{
+	GEOMCACHE *gc, key;
+	DSK_OPTION *opt;
+	unsigned long hash;
+
+	if (!self->dr_filename || self->dr_dirty) return DSK_ERR_NOTME;
+
+	gc_load();
+	if (gc_stat(self->dr_filename, &key)) return DSK_ERR_NOTME;
+	gc = gc_find(key.gc_dev, key.gc_ino, self->dr_class->dc_drvname);
+	if (!gc) return DSK_ERR_NOTME;
+
+	if (gc->gc_size != key.gc_size || gc->gc_mtime != key.gc_mtime ||
+	    gc_hash(self->dr_filename, &hash) || gc->gc_hash != hash)
+	{
+		return DSK_ERR_NOTME;
+	}
+	/* Most recently used goes to the front */
+	gc_detach(gc);
+	gc->gc_next = st_cache;
+	st_cache = gc;
+	++st_count;
+
+	memcpy(geom, &gc->gc_geom, sizeof(*geom));
+	for (opt = gc->gc_options; opt; opt = opt->do_next)
+	{
+		dsk_isetoption(self, opt->do_name, opt->do_value, 1);
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Record the result of a successful geometry probe */
+void dg_cache_store(DSK_DRIVER *self, const DSK_GEOMETRY *geom)
+{
+	GEOMCACHE *gc;
+	DSK_OPTION *opt;
+	FILE *fp;
+
+	if (!self->dr_filename || self->dr_dirty) return;
+	/* Names with control characters would break the cache file */
+	if (strchr(self->dr_filename, '\t') ||
+	    strchr(self->dr_filename, '\n')) return;
+
+	gc_load();
+	gc = dsk_malloc(sizeof(GEOMCACHE));
+	if (!gc) return;
+	memset(gc, 0, sizeof(GEOMCACHE));
+	if (gc_stat(self->dr_filename, gc) ||
+	    gc_hash(self->dr_filename, &gc->gc_hash))
+	{
+		gc_free(gc);
+		return;
+	}
+	gc->gc_filename = dsk_malloc_string(self->dr_filename);
+	gc->gc_drvname  = dsk_malloc_string(self->dr_class->dc_drvname);
+	if (!gc->gc_filename || !gc->gc_drvname)
+	{
+		gc_free(gc);
+		return;
+	}
+	memcpy(&gc->gc_geom, geom, sizeof(*geom));
+	for (opt = self->dr_options; opt; opt = opt->do_next)
+	{
+		if (strncmp(opt->do_name, "FS:", 3)) continue;
+		if (gc_addopt(gc, opt->do_name, opt->do_value))
+		{
+			gc_free(gc);
+			return;
+		}
+	}
+	gc_insert(gc);
+
+	if (!st_cachefile || st_readonly) return;
+	/* If enough entries have been superseded or dropped, rewrite the
+	 * whole file rather than letting it grow */
+	if (st_stale > st_count)
+	{
+		gc_save();
+		return;
+	}
+	fp = fopen(st_cachefile, "a");
+	if (!fp) return;
+	/* New file? Give it a header */
+	if (ftell(fp) == 0) fprintf(fp, "%s\n", GC_MAGIC);
+	gc_write(fp, gc);
+	fclose(fp);
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_geomcache_file(const char *filename)
+{
+	GEOMCACHE *gc;
+
+	if (st_cachefile) dsk_free(st_cachefile);
+	st_cachefile = NULL;
+	/* Discard what we have. If there's a new cache file, it will be
+	 * loaded on next use. */
+	while (st_cache)
+	{
+		gc = st_cache->gc_next;
+		gc_free(st_cache);
+		st_cache = gc;
+	}
+	st_count = 0;
+	st_readonly = 0;
+	st_loaded = 0;
+	if (!filename)
+	{
+		/* Don't fall back on the environment variable either */
+		st_loaded = 1;
+		return DSK_ERR_OK;
+	}
+	st_cachefile = dsk_malloc_string(filename);
+	if (!st_cachefile) return DSK_ERR_NOMEM;
+	return DSK_ERR_OK;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_geomcache_invalidate(const char *filename)
+{
+	GEOMCACHE *gc, *next, key;
+	int found = 0, bykey = 0;
+
+	gc_load();
+	/* Match by file identity if the file still exists, so that any
+	 * name for it will do; otherwise fall back on the name. */
+	if (filename && !gc_stat(filename, &key)) bykey = 1;
+	for (gc = st_cache; gc; gc = next)
+	{
+		next = gc->gc_next;
+		if (filename == NULL ||
+		    ( bykey && gc->gc_dev == key.gc_dev &&
+			       gc->gc_ino == key.gc_ino) ||
+		    (!bykey && !strcmp(gc->gc_filename, filename)))
+		{
+			gc_unlink(gc);
+			found = 1;
+		}
+	}
+	if (found || filename == NULL) gc_save();
+	return DSK_ERR_OK;
+}
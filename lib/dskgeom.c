@@ -212,7 +212,8 @@ static void set_dfs_fs(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_getgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 {
         DRV_CLASS *dc; 
-	dsk_err_t e;
+	dsk_err_t e = DSK_ERR_NOTIMPL;
+	unsigned long t0;
 
         if (!self || !geom || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -220,20 +221,39 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_getgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom
 	 * then use its geometry probe, which is probably more limited. */
 	dc = self->dr_class; 
 	memset(geom, 0, sizeof(*geom));
+	t0 = dsk_stats_begin(self, DSK_OP_GETGEOM, -1, -1, -1);
 
 	WALK_VTABLE(dc, dc_getgeom)
 	if (dc->dc_getgeom)
 	{
 		e = (dc->dc_getgeom)(self, geom);
-		if (e != DSK_ERR_NOTME && e != DSK_ERR_NOTIMPL) return e;	
 	}	
-	return dsk_defgetgeom(self, geom);
+	if (e == DSK_ERR_NOTME || e == DSK_ERR_NOTIMPL)
+		e = dsk_defgetgeom(self, geom);
+	dsk_stats_end(self, DSK_OP_GETGEOM, t0, -1, -1, -1, e, 1, 0);
+	return e;
 }
 
 
 	
-/* Probe the geometry of a disc. This will always use the boot sector. */
+static dsk_err_t dg_probe(DSK_DRIVER *self, DSK_GEOMETRY *geom);
+
+/* Probe the geometry of a disc. This will always use the boot sector, 
+ * unless the result of probing this image before has been cached. */
 dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
+{
+	dsk_err_t e;
+
+        if (!self || !geom || !self->dr_class) return DSK_ERR_BADPTR;
+
+	if (dg_cache_lookup(self, geom) == DSK_ERR_OK) return DSK_ERR_OK;
+	e = dg_probe(self, geom);
+	if (e == DSK_ERR_OK) dg_cache_store(self, geom);
+	return e;
+}
+
+
+static dsk_err_t dg_probe(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 {
 	DSK_FORMAT secid;
 	dsk_err_t e;
@@ -249,7 +269,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 	e = dg_stdformat(geom, FMT_180K, NULL, NULL);
 	if (e) return e;
 	/* Allocate buffer for boot sector (512 bytes) */
-	secbuf = dsk_malloc(geom->dg_secsize);
+	secbuf = dsk_pool_alloc(self, geom->dg_secsize);
 	if (!secbuf) return DSK_ERR_NOMEM;
 
 
@@ -282,7 +302,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 		if ((secid.fmt_sector & 0xF0) == 0x10 &&
 		     secid.fmt_secsize == 512) 	/* Ampro 40 track double sided */
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			e = dg_stdformat(geom, FMT_AMPRO400D, NULL, NULL);
 			if (!e) set_fixed_fs(self, FMT_AMPRO400D);
 			return e;
@@ -290,7 +310,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 		if ((secid.fmt_sector & 0xC0) == 0x40 &&
 		     secid.fmt_secsize == 512) 	/* CPC system */
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			e = dg_stdformat(geom, FMT_CPCSYS, NULL, NULL);
 			if (!e) set_pcw_fs(self, geom, boot_cpcsys);
 			return e;
@@ -298,7 +318,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 		if ((secid.fmt_sector & 0xC0) == 0xC0 &&
 		     secid.fmt_secsize == 512)	/* CPC data */
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			e = dg_stdformat(geom, FMT_CPCDATA, NULL, NULL);
 			if (!e) set_pcw_fs(self, geom, boot_cpcdata);
 			return e;
@@ -316,7 +336,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 				if (!e) e = dg_dfsgeom(geom, secbuf, 
 						secbuf + 256);
 				if (!e) set_dfs_fs(self, geom, secbuf + 256);
-				dsk_free(secbuf);
+				dsk_pool_free(self, secbuf);
 				return e;
 			}
 			else	/* MFM */
@@ -325,14 +345,14 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 				if (!e) e = dsk_lread(self, geom, secbuf, 0);
 				if (e)
 				{
-					dsk_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					return DSK_ERR_BADFMT;
 				}
 				/* Acorn ADFS discs have a size in sectors at 0xFC in the
 				 * first sector */
 				dsksize = secbuf[0xFC] + 256 * secbuf[0xFD] +
 					65536L * secbuf[0xFE];
-				dsk_free(secbuf);
+				dsk_pool_free(self, secbuf);
 				if (dsksize ==  640) return dg_stdformat(geom, FMT_ACORN160, NULL, NULL);
 				if (dsksize == 1280) return dg_stdformat(geom, FMT_ACORN320, NULL, NULL);
 				if (dsksize == 2560) return dg_stdformat(geom, FMT_ACORN640, NULL, NULL);
@@ -348,7 +368,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 			/* Ampro 80 track double sided */
 			if ((secid.fmt_sector & 0xF0) == 0x10)
 			{
-				dsk_free(secbuf);
+				dsk_pool_free(self, secbuf);
 				e = dg_stdformat(geom, FMT_AMPRO800, NULL, NULL);
 				if (!e) set_fixed_fs(self, FMT_AMPRO800);
 				return e;	
@@ -356,7 +376,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 			/* Save the data rate, which we know to be correct */
 			rate = geom->dg_datarate;
 
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			/* Switch to a format with 1k sectors */
 			if (geom->dg_datarate == RATE_HD)
 				e = dg_stdformat(geom, FMT_ACORN1600, NULL, NULL);	
@@ -365,7 +385,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 			/* And restore it. */
 			geom->dg_datarate = rate;
 			/* Allocate buffer for boot sector (1k bytes) */
-			secbuf = dsk_malloc(geom->dg_secsize);
+			secbuf = dsk_pool_alloc(self, geom->dg_secsize);
 			if (!secbuf) return DSK_ERR_NOMEM;
 			e = dsk_lread(self, geom, secbuf, 0);
 			if (!e)
@@ -376,20 +396,20 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 				if (geom->dg_datarate == RATE_HD)
 				{
 				/* XXX Need a better check for Acorn 1600k */
-					dsk_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					return DSK_ERR_OK;
 				}
 				/* Check for D-format magic */
 				if (dsksize == 3200) 
 				{
-					dsk_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					return DSK_ERR_OK;
 				}
 				/* Check for E-format magic */
 				if (secbuf[4] == 10 && secbuf[5] == 5 &&
 				    secbuf[6] == 2  && secbuf[7] == 2)
 				{
-					dsk_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					return DSK_ERR_OK;
 				}
 			}
@@ -403,17 +423,17 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 				    secbuf[1] == 0xFF && 
 				    secbuf[2] == 0xFF)
 				{
-					dsk_free(secbuf);
+					dsk_pool_free(self, secbuf);
 					return DSK_ERR_OK;
 				}
 			}
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			return DSK_ERR_BADFMT;
 		}	
 		/* Can't handle other discs with non-512 sector sizes. */
 		if ((secid.fmt_secsize != 512))
 		{
-			dsk_free(secbuf);
+			dsk_pool_free(self, secbuf);
 			return DSK_ERR_BADFMT;
 		}
 	}
@@ -423,7 +443,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 	if (!e) e = dsk_lread(self, geom, secbuf, 0);
 	if (e) 
 	{ 	
-		dsk_free(secbuf);
+		dsk_pool_free(self, secbuf);
 		return e; 
 	}
 	oldrate = geom->dg_datarate;	
@@ -439,7 +459,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 			if (!dg_hfsgeom(geom, secbuf2))
 			{
 				set_hfs_fs(self, geom, secbuf2);
-				dsk_free(secbuf);
+				dsk_pool_free(self, secbuf);
 				return DSK_ERR_OK; 
 			}
 		}
@@ -509,7 +529,7 @@ dsk_err_t dsk_defgetgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 			geom->dg_datarate = oldrate;
 		}
 	}	
-	dsk_free(secbuf);
+	dsk_pool_free(self, secbuf);
 	return e;
 }
 
@@ -0,0 +1,506 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Fingerprinting the contents of a drive.
+ *
+ * Everything is hashed with SHA-256, in three layers:
+ *
+ * - A sector's hash is the hash of its data. A sector with no data has
+ *   the hash of no bytes.
+ * - A track's hash covers its cylinder and head, the number of sectors,
+ *   and for each sector its ID, a status byte and its hash. The sectors
+ *   are taken in order of ID rather than as they are laid out on the
+ *   track, since not every image format records the interleave.
+ * - The image's hash is the hash of its track hashes, in order.
+ *
+ * Numbers are stored big-endian: 2 bytes each for cylinder, head, sector
+ * count and ID cylinder, head and sector; 4 for the sector size.
+ *
+ * Where the drive is an LDBS disc, sectors that are stored as a filler
+ * byte are hashed without being read, and the hash of the last run of
+ * filler is kept, since a blank disc is mostly made of identical ones.
+ */
+
+#include "drvi.h"
+#include "drvldbs.h"
+#include "drvovly.h"
+
+/* Bits in the status byte */
+#define HS_DELETED	0x01
+#define HS_DATAERR	0x02
+#define HS_NODATA	0x04
+
+typedef struct
+{
+	unsigned long state[8];
+	unsigned long count;		/* Bytes hashed, mod 2^32 */
+	unsigned long count_hi;
+	unsigned char block[64];
+	unsigned blocklen;
+} SHA256_CTX;
+
+
+static const unsigned long sha_k[64] =
+{
+	0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+	0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+	0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+	0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+	0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+	0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+	0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+	0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+	0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+	0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+	0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+	0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+	0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+	0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+	0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+	0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+/* unsigned long may be wider than 32 bits, so mask after every shift
+ * or addition that could carry out of them */
+#define ROR(x, n) ((((x) >> (n)) | ((x) << (32 - (n)))) & 0xFFFFFFFFUL)
+
+static void sha256_init(SHA256_CTX *ctx)
+{
+	ctx->state[0] = 0x6a09e667UL;
+	ctx->state[1] = 0xbb67ae85UL;
+	ctx->state[2] = 0x3c6ef372UL;
+	ctx->state[3] = 0xa54ff53aUL;
+	ctx->state[4] = 0x510e527fUL;
+	ctx->state[5] = 0x9b05688cUL;
+	ctx->state[6] = 0x1f83d9abUL;
+	ctx->state[7] = 0x5be0cd19UL;
+	ctx->count = ctx->count_hi = 0;
+	ctx->blocklen = 0;
+}
+
+
+static void sha256_block(SHA256_CTX *ctx, const unsigned char *p)
+{
+	unsigned long w[64], s[8], t1, t2;
+	int n;
+
+	for (n = 0; n < 16; n++, p += 4)
+	{
+		w[n] = ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+		       ((unsigned long)p[2] << 8)  | p[3];
+	}
+	for (n = 16; n < 64; n++)
+	{
+		t1 = ROR(w[n-2], 17) ^ ROR(w[n-2], 19) ^ (w[n-2] >> 10);
+		t2 = ROR(w[n-15], 7) ^ ROR(w[n-15], 18) ^ (w[n-15] >> 3);
+		w[n] = (t1 + w[n-7] + t2 + w[n-16]) & 0xFFFFFFFFUL;
+	}
+	for (n = 0; n < 8; n++) s[n] = ctx->state[n];
+	for (n = 0; n < 64; n++)
+	{
+		t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+		     ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha_k[n] + w[n];
+		t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+		     ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		s[7] = s[6];
+		s[6] = s[5];
+		s[5] = s[4];
+		s[4] = (s[3] + t1) & 0xFFFFFFFFUL;
+		s[3] = s[2];
+		s[2] = s[1];
+		s[1] = s[0];
+		s[0] = (t1 + t2) & 0xFFFFFFFFUL;
+	}
+	for (n = 0; n < 8; n++)
+	{
+		ctx->state[n] = (ctx->state[n] + s[n]) & 0xFFFFFFFFUL;
+	}
+}
+
+
+static void sha256_update(SHA256_CTX *ctx, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	unsigned long c = ctx->count;
+
+	ctx->count = (c + len) & 0xFFFFFFFFUL;
+	if (ctx->count < c) ++ctx->count_hi;
+	while (len)
+	{
+		size_t n = 64 - ctx->blocklen;
+
+		if (n > len) n = len;
+		/* Hash whole blocks straight from the caller's buffer */
+		if (n == 64)
+		{
+			sha256_block(ctx, p);
+		}
+		else
+		{
+			memcpy(ctx->block + ctx->blocklen, p, n);
+			ctx->blocklen += n;
+			if (ctx->blocklen < 64) break;
+			sha256_block(ctx, ctx->block);
+		}
+		ctx->blocklen = 0;
+		p += n;
+		len -= n;
+	}
+}
+
+
+static void sha256_final(SHA256_CTX *ctx, unsigned char *hash)
+{
+	unsigned char tail[8];
+	unsigned long hi, lo;
+	int n;
+
+	/* Length in bits */
+	hi = ((ctx->count_hi << 3) | (ctx->count >> 29)) & 0xFFFFFFFFUL;
+	lo = (ctx->count << 3) & 0xFFFFFFFFUL;
+	for (n = 0; n < 4; n++)
+	{
+		tail[n]     = (unsigned char)(hi >> (24 - 8 * n));
+		tail[n + 4] = (unsigned char)(lo >> (24 - 8 * n));
+	}
+	ctx->block[ctx->blocklen++] = 0x80;
+	if (ctx->blocklen > 56)
+	{
+		memset(ctx->block + ctx->blocklen, 0, 64 - ctx->blocklen);
+		sha256_block(ctx, ctx->block);
+		ctx->blocklen = 0;
+	}
+	memset(ctx->block + ctx->blocklen, 0, 56 - ctx->blocklen);
+	memcpy(ctx->block + 56, tail, 8);
+	sha256_block(ctx, ctx->block);
+
+	for (n = 0; n < 32; n++)
+	{
+		hash[n] = (unsigned char)(ctx->state[n / 4] >> (24 - 8 * (n % 4)));
+	}
+}
+
+
+static void sha256_word(SHA256_CTX *ctx, unsigned long value, int len)
+{
+	unsigned char buf[4];
+	int n;
+
+	for (n = 0; n < len; n++)
+	{
+		buf[n] = (unsigned char)(value >> (8 * (len - 1 - n)));
+	}
+	sha256_update(ctx, buf, len);
+}
+
+
+typedef struct
+{
+	DSK_FORMAT id;
+	unsigned char status;
+	unsigned char hash[DSK_HASH_LEN];
+} HASH_SECTOR;
+
+typedef struct
+{
+	DSK_PDRIVER self;
+	DSK_GEOMETRY geom;
+	PLDBS store;		/* Set if the drive is an LDBS disc */
+	unsigned char *buf;
+	size_t buflen;
+	HASH_SECTOR *sec;
+	dsk_psect_t seclen;
+	/* The last filler sector hashed */
+	int fill_valid;
+	unsigned char fill_byte;
+	size_t fill_len;
+	unsigned char fill_hash[DSK_HASH_LEN];
+} HASH_STATE;
+
+
+static dsk_err_t hash_alloc(HASH_STATE *hs, size_t len, dsk_psect_t count)
+{
+	if (len > hs->buflen)
+	{
+		if (hs->buf) dsk_free(hs->buf);
+		hs->buf = dsk_malloc(len);
+		hs->buflen = hs->buf ? len : 0;
+		if (!hs->buf) return DSK_ERR_NOMEM;
+	}
+	if (count > hs->seclen)
+	{
+		if (hs->sec) dsk_free(hs->sec);
+		hs->sec = dsk_malloc(count * sizeof(HASH_SECTOR));
+		hs->seclen = hs->sec ? count : 0;
+		if (!hs->sec) return DSK_ERR_NOMEM;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Hash a sector that is 'len' copies of 'filler' */
+static void hash_filler(HASH_STATE *hs, unsigned char filler, size_t len,
+		unsigned char *hash)
+{
+	SHA256_CTX ctx;
+	unsigned char buf[64];
+	size_t n;
+
+	if (!hs->fill_valid || hs->fill_byte != filler || hs->fill_len != len)
+	{
+		memset(buf, filler, sizeof(buf));
+		sha256_init(&ctx);
+		for (n = len; n >= sizeof(buf); n -= sizeof(buf))
+		{
+			sha256_update(&ctx, buf, sizeof(buf));
+		}
+		sha256_update(&ctx, buf, n);
+		sha256_final(&ctx, hs->fill_hash);
+		hs->fill_valid = 1;
+		hs->fill_byte  = filler;
+		hs->fill_len   = len;
+	}
+	memcpy(hash, hs->fill_hash, DSK_HASH_LEN);
+}
+
+
+/* Read a sector through the driver and hash it */
+static dsk_err_t hash_read(HASH_STATE *hs, dsk_pcyl_t cylinder,
+		dsk_phead_t head, HASH_SECTOR *hsec)
+{
+	SHA256_CTX ctx;
+	int deleted;
+	dsk_err_t err;
+
+	err = hash_alloc(hs, hsec->id.fmt_secsize, 0);
+	if (err) return err;
+	/* A short sector only fills part of the buffer */
+	memset(hs->buf, 0, hsec->id.fmt_secsize);
+	err = dsk_read_id(hs->self, &hs->geom, hs->buf, cylinder, head,
+			&hsec->id, &deleted);
+
+	hsec->status = deleted ? HS_DELETED : 0;
+	sha256_init(&ctx);
+	switch (err)
+	{
+		case DSK_ERR_DATAERR:
+			hsec->status |= HS_DATAERR;
+			/* FALLTHROUGH */
+		case DSK_ERR_OK:
+			sha256_update(&ctx, hs->buf, hsec->id.fmt_secsize);
+			break;
+		case DSK_ERR_NOADDR:
+		case DSK_ERR_NODATA:
+			hsec->status |= HS_NODATA;
+			break;
+		default: return err;
+	}
+	sha256_final(&ctx, hsec->hash);
+	return DSK_ERR_OK;
+}
+
+
+/* Can a sector in an LDBS track be hashed from its header? It must be
+ * stored as a filler byte with no errors, and be the first sector on
+ * the track with its ID, which is the one that dsk_xread() finds. */
+static int is_filler(const LDBS_TRACKHEAD *th, unsigned n)
+{
+	const LDBS_SECTOR_ENTRY *se = &th->sector[n];
+	unsigned m;
+
+	if (se->copies != 0 && se->blockid != LDBLOCKID_NULL) return 0;
+	if ((se->st1 & 0x65) || (se->st2 & 0x21)) return 0;
+	for (m = 0; m < n; m++)
+	{
+		if (th->sector[m].id_cyl  == se->id_cyl &&
+		    th->sector[m].id_head == se->id_head &&
+		    th->sector[m].id_sec  == se->id_sec) return 0;
+	}
+	return 1;
+}
+
+
+static dsk_err_t hash_track(HASH_STATE *hs, dsk_pcyl_t cylinder,
+		dsk_phead_t head, unsigned char *hash, DSK_HASHFUNC func,
+		void *param)
+{
+	LDBS_TRACKHEAD *th = NULL;
+	DSK_FORMAT *ids = NULL;
+	dsk_psect_t count = 0, n, m;
+	HASH_SECTOR tmp;
+	SHA256_CTX ctx;
+	int fast = 0;
+	dsk_err_t err;
+
+	if (hs->store)
+	{
+		err = ldbs_get_trackhead(hs->store, &th, cylinder, head);
+		if (err) return err;
+		if (th) count = th->count;
+		fast = (th && !ldbsdisk_check_density(th, &hs->geom));
+	}
+	else
+	{
+		err = dsk_trackids_geom(hs->self, &hs->geom, cylinder, head,
+				&count, &ids);
+		if (err == DSK_ERR_NOADDR || err == DSK_ERR_NODATA ||
+		    err == DSK_ERR_SEEKFAIL)
+		{
+			count = 0;
+			err = DSK_ERR_OK;
+		}
+		if (err) return err;
+	}
+	err = hash_alloc(hs, 0, count);
+	for (n = 0; !err && n < count; n++)
+	{
+		HASH_SECTOR *hsec = &hs->sec[n];
+
+		if (th)
+		{
+			hsec->id.fmt_cylinder = th->sector[n].id_cyl;
+			hsec->id.fmt_head     = th->sector[n].id_head;
+			hsec->id.fmt_sector   = th->sector[n].id_sec;
+			hsec->id.fmt_secsize  = th->sector[n].datalen;
+		}
+		else	hsec->id = ids[n];
+
+		if (fast && is_filler(th, n))
+		{
+			hsec->status = 0;
+			hash_filler(hs, th->sector[n].filler,
+				hsec->id.fmt_secsize, hsec->hash);
+		}
+		else err = hash_read(hs, cylinder, head, hsec);
+		if (!err && func) (*func)(cylinder, head, &hsec->id,
+					hsec->hash, param);
+	}
+	if (th)  ldbs_free(th);
+	if (ids) dsk_free(ids);
+	if (err) return err;
+
+	/* Sort the sectors into order of ID. This is an insertion sort, so
+	 * that sectors with the same ID stay in the order they were found */
+	for (n = 1; n < count; n++)
+	{
+		tmp = hs->sec[n];
+		for (m = n; m > 0; m--)
+		{
+			DSK_FORMAT *id = &hs->sec[m-1].id;
+
+			if (id->fmt_cylinder < tmp.id.fmt_cylinder) break;
+			if (id->fmt_cylinder == tmp.id.fmt_cylinder)
+			{
+				if (id->fmt_head < tmp.id.fmt_head) break;
+				if (id->fmt_head == tmp.id.fmt_head)
+				{
+					if (id->fmt_sector < tmp.id.fmt_sector)
+						break;
+					if (id->fmt_sector == tmp.id.fmt_sector
+					 && id->fmt_secsize <= tmp.id.fmt_secsize)
+						break;
+				}
+			}
+			hs->sec[m] = hs->sec[m-1];
+		}
+		hs->sec[m] = tmp;
+	}
+
+	sha256_init(&ctx);
+	sha256_word(&ctx, cylinder, 2);
+	sha256_word(&ctx, head, 2);
+	sha256_word(&ctx, count, 2);
+	for (n = 0; n < count; n++)
+	{
+		HASH_SECTOR *hsec = &hs->sec[n];
+
+		sha256_word(&ctx, hsec->id.fmt_cylinder, 2);
+		sha256_word(&ctx, hsec->id.fmt_head, 2);
+		sha256_word(&ctx, hsec->id.fmt_sector, 2);
+		sha256_word(&ctx, (unsigned long)hsec->id.fmt_secsize, 4);
+		sha256_update(&ctx, &hsec->status, 1);
+		sha256_update(&ctx, hsec->hash, DSK_HASH_LEN);
+	}
+	sha256_final(&ctx, hash);
+	if (func) (*func)(cylinder, head, NULL, hash, param);
+	return DSK_ERR_OK;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_hash(DSK_PDRIVER self,
+				const DSK_GEOMETRY *geom, unsigned char *hash,
+				DSK_HASHFUNC func, void *param)
+{
+	HASH_STATE hs;
+	SHA256_CTX ctx;
+	unsigned char trkhash[DSK_HASH_LEN];
+	dsk_pcyl_t cyl;
+	dsk_phead_t head;
+	dsk_err_t err = DSK_ERR_OK, err2;
+
+	if (!self || !geom || !hash) return DSK_ERR_BADPTR;
+
+	memset(&hs, 0, sizeof(hs));
+	hs.self = self;
+	/* Hash the data as it is on the disc, and don't skip over deleted
+	 * sectors */
+	memcpy(&hs.geom, geom, sizeof(hs.geom));
+	hs.geom.dg_fm &= ~RECMODE_COMPLEMENT;
+	hs.geom.dg_noskip = 1;
+
+	/* The overlay's blockstore only holds the tracks that have been
+	 * changed, so it has to be read like any other drive */
+	if (drv_instanceof(self, &dc_ldbsdisk) &&
+	    !drv_instanceof(self, &dc_overlay))
+	{
+		/* Get the blockstore up to date */
+		err = ldbsdisk_detach(self);
+		if (err) return err;
+		hs.store = ((LDBSDISK_DSK_DRIVER *)self)->ld_store;
+	}
+
+	sha256_init(&ctx);
+	dsk_report("Hashing tracks...");
+	for (cyl = 0; !err && cyl < geom->dg_cylinders; cyl++)
+	{
+		for (head = 0; !err && head < geom->dg_heads; head++)
+		{
+			err = hash_track(&hs, cyl, head, trkhash, func, param);
+			if (!err) sha256_update(&ctx, trkhash, DSK_HASH_LEN);
+		}
+	}
+	dsk_report_end();
+	if (!err) sha256_final(&ctx, hash);
+
+	if (hs.store)
+	{
+		/* Sectors that weren't filler were read through the driver,
+		 * so let go of the last track it loaded */
+		err2 = ldbsdisk_detach(self);
+		if (!err) err = err2;
+		err2 = ldbsdisk_attach(self);
+		if (!err) err = err2;
+	}
+	if (hs.buf) dsk_free(hs.buf);
+	if (hs.sec) dsk_free(hs.sec);
+	return err;
+}
@@ -467,7 +467,8 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_write__Luk_co_demon_
 
 	buf = (*env)->GetByteArrayElements(env, arr, NULL);
 	if (!err) err = dsk_pwrite(drv, &dg, buf, cyl, head, sec);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	/* The array is only read, so there is no need to copy it back */
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
 	check_error(env, err);
 }
 
@@ -490,7 +491,7 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_write__Luk_co_demon_
 
 	buf = (*env)->GetByteArrayElements(env, arr, NULL);
 	if (!err) err = dsk_lwrite(drv, &dg, buf, lsec);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
 	check_error(env, err);
 }
 
@@ -514,7 +515,7 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_write__Luk_co_demon_
 
 	buf = (*env)->GetByteArrayElements(env, arr, NULL);
 	if (!err) err = dsk_xwrite(drv, &dg, buf, cyl, head, cyl_expected, head_expected, sector, sector_len, deleted);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
 	check_error(env, err);
 }
 
@@ -537,7 +538,7 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_verify__Luk_co_demon
 
 	buf = (*env)->GetByteArrayElements(env, arr, NULL);
 	if (!err) err = dsk_pcheck(drv, &dg, buf, cyl, head, sec);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
 	check_error(env, err);
 }
 
@@ -561,7 +562,7 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_verify__Luk_co_demon
 
 	buf = (*env)->GetByteArrayElements(env, arr, NULL);
 	if (!err) err = dsk_lcheck(drv, &dg, buf, lsec);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
 	check_error(env, err);
 }
 
@@ -585,7 +586,7 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_verify__Luk_co_demon
 
 	buf = (*env)->GetByteArrayElements(env, arr, NULL);
 	if (!err) err = dsk_xcheck(drv, &dg, buf, cyl, head, cyl_expected, head_expected, sector, sector_len);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
 	check_error(env, err);
 }
 
@@ -714,6 +715,216 @@ JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_readTrack__Luk_co_de
 	check_error(env, err);
 }
 
+/************************* Multi-sector transfers **************************/
+
+/* Operations for Drive.nio(). These must match the NIO_ constants in 
+ * Drive.java */
+#define NIO_READ   0
+#define NIO_LREAD  1
+#define NIO_WRITE  2
+#define NIO_LWRITE 3
+#define NIO_TREAD  4
+
+/* Check that a buffer of 'avail' bytes can hold 'count' sectors */
+static dsk_err_t check_size(const DSK_GEOMETRY *dg, jint count, jlong avail)
+{
+	if (count < 0 || (jlong)count * (jlong)dg->dg_secsize > avail) 
+		return DSK_ERR_BADPARM;
+	return DSK_ERR_OK;
+}
+
+/* Transfer 'count' consecutive sectors. If 'logical' is set, 'a' is the 
+ * first logical sector; otherwise a, b and c are the cylinder, head and 
+ * first sector. The number of sectors transferred is returned in *done. */
+static dsk_err_t do_sectors(DSK_PDRIVER drv, const DSK_GEOMETRY *dg,
+		unsigned char *buf, int writing, int logical, 
+		jint a, jint b, jint c, jint count, jint *done)
+{
+	dsk_err_t err = DSK_ERR_OK;
+	jint n;
+
+	for (n = 0; n < count; n++, buf += dg->dg_secsize)
+	{
+		if (logical && writing) err = dsk_lwrite(drv, dg, buf, a + n);
+		else if (logical)       err = dsk_lread (drv, dg, buf, a + n);
+		else if (writing)       err = dsk_pwrite(drv, dg, buf, a, b, c + n);
+		else                    err = dsk_pread (drv, dg, buf, a, b, c + n);
+		if (err) break;
+	}
+	if (done) *done = n;
+	return err;
+}
+
+/* Read sectors into a Java array. They are read into native memory and 
+ * copied into the array once, rather than the array being copied out 
+ * and back again. */
+static dsk_err_t read_to_array(JNIEnv *env, DSK_PDRIVER drv, 
+		const DSK_GEOMETRY *dg, jbyteArray arr, int logical,
+		jint a, jint b, jint c, jint count)
+{
+	unsigned char *buf;
+	dsk_err_t err;
+	jint done;
+
+	err = check_size(dg, count, (*env)->GetArrayLength(env, arr));
+	if (err || !count) return err;
+
+	buf = malloc(count * dg->dg_secsize);
+	if (!buf) return DSK_ERR_NOMEM;
+	err = do_sectors(drv, dg, buf, 0, logical, a, b, c, count, &done);
+	/* Pass back whatever was read before any error */
+	(*env)->SetByteArrayRegion(env, arr, 0, (jsize)(done * dg->dg_secsize), 
+			(jbyte *)buf);
+	free(buf);
+	return err;
+}
+
+/* Write sectors from a Java array */
+static dsk_err_t write_from_array(JNIEnv *env, DSK_PDRIVER drv, 
+		const DSK_GEOMETRY *dg, jbyteArray arr, int logical,
+		jint a, jint b, jint c, jint count)
+{
+	jbyte *buf;
+	dsk_err_t err;
+
+	err = check_size(dg, count, (*env)->GetArrayLength(env, arr));
+	if (err || !count) return err;
+
+	buf = (*env)->GetByteArrayElements(env, arr, NULL);
+	if (!buf) return DSK_ERR_NOMEM;
+	err = do_sectors(drv, dg, (unsigned char *)buf, 1, logical, 
+			a, b, c, count, NULL);
+	(*env)->ReleaseByteArrayElements(env, arr, buf, JNI_ABORT);
+	return err;
+}
+
+/*
+ * Class:     uk_co_demon_seasip_libdsk_Drive
+ * Method:    readSectors
+ * Signature: (Luk/co/demon/seasip/libdsk/Geometry;[BIIII)V
+ */
+JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_readSectors__Luk_co_demon_seasip_libdsk_Geometry_2_3BIIII
+  (JNIEnv *env, jobject self, jobject jg, jbyteArray arr, jint cyl, jint head, jint sec, jint count)
+{
+	DSK_PDRIVER   drv;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	
+	drv   = driver_from_java(env, self);
+	err   = geom_from_java  (env, jg, &dg);
+
+	if (!err) err = read_to_array(env, drv, &dg, arr, 0, cyl, head, sec, count);
+	check_error(env, err);
+}
+
+/*
+ * Class:     uk_co_demon_seasip_libdsk_Drive
+ * Method:    readSectors
+ * Signature: (Luk/co/demon/seasip/libdsk/Geometry;[BII)V
+ */
+JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_readSectors__Luk_co_demon_seasip_libdsk_Geometry_2_3BII
+  (JNIEnv *env, jobject self, jobject jg, jbyteArray arr, jint lsec, jint count)
+{
+	DSK_PDRIVER   drv;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	
+	drv   = driver_from_java(env, self);
+	err   = geom_from_java  (env, jg, &dg);
+
+	if (!err) err = read_to_array(env, drv, &dg, arr, 1, lsec, 0, 0, count);
+	check_error(env, err);
+}
+
+/*
+ * Class:     uk_co_demon_seasip_libdsk_Drive
+ * Method:    writeSectors
+ * Signature: (Luk/co/demon/seasip/libdsk/Geometry;[BIIII)V
+ */
+JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_writeSectors__Luk_co_demon_seasip_libdsk_Geometry_2_3BIIII
+  (JNIEnv *env, jobject self, jobject jg, jbyteArray arr, jint cyl, jint head, jint sec, jint count)
+{
+	DSK_PDRIVER   drv;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	
+	drv   = driver_from_java(env, self);
+	err   = geom_from_java  (env, jg, &dg);
+
+	if (!err) err = write_from_array(env, drv, &dg, arr, 0, cyl, head, sec, count);
+	check_error(env, err);
+}
+
+/*
+ * Class:     uk_co_demon_seasip_libdsk_Drive
+ * Method:    writeSectors
+ * Signature: (Luk/co/demon/seasip/libdsk/Geometry;[BII)V
+ */
+JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_writeSectors__Luk_co_demon_seasip_libdsk_Geometry_2_3BII
+  (JNIEnv *env, jobject self, jobject jg, jbyteArray arr, jint lsec, jint count)
+{
+	DSK_PDRIVER   drv;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	
+	drv   = driver_from_java(env, self);
+	err   = geom_from_java  (env, jg, &dg);
+
+	if (!err) err = write_from_array(env, drv, &dg, arr, 1, lsec, 0, 0, count);
+	check_error(env, err);
+}
+
+/*
+ * Class:     uk_co_demon_seasip_libdsk_Drive
+ * Method:    nio
+ * Signature: (Luk/co/demon/seasip/libdsk/Geometry;Ljava/nio/ByteBuffer;IIIIIII)V
+ *
+ * Transfers to and from a direct ByteBuffer, which is used in place. 
+ * 'length' bytes are available from 'offset' onwards.
+ */
+JNIEXPORT void JNICALL Java_uk_co_demon_seasip_libdsk_Drive_nio
+  (JNIEnv *env, jobject self, jobject jg, jobject jbuf, jint offset, 
+   jint length, jint op, jint a, jint b, jint c, jint count)
+{
+	DSK_PDRIVER   drv;
+	DSK_GEOMETRY dg;
+	dsk_err_t err;
+	unsigned char *buf;
+	jlong capacity;
+	
+	drv   = driver_from_java(env, self);
+	err   = geom_from_java  (env, jg, &dg);
+
+	buf      = (*env)->GetDirectBufferAddress(env, jbuf);
+	capacity = (*env)->GetDirectBufferCapacity(env, jbuf);
+	/* Not a direct buffer, or the range is outside it */
+	if (!err && (!buf || offset < 0 || length < 0 || 
+			(jlong)offset + length > capacity))
+	{
+		err = DSK_ERR_BADPARM;
+	}
+	if (!err) err = check_size(&dg, count, length);
+	if (!err) 
+	{
+		buf += offset;
+		switch (op)
+		{
+			case NIO_READ:   err = do_sectors(drv, &dg, buf, 0, 0, 
+						a, b, c, count, NULL); break;
+			case NIO_LREAD:  err = do_sectors(drv, &dg, buf, 0, 1, 
+						a, b, c, count, NULL); break;
+			case NIO_WRITE:  err = do_sectors(drv, &dg, buf, 1, 0, 
+						a, b, c, count, NULL); break;
+			case NIO_LWRITE: err = do_sectors(drv, &dg, buf, 1, 1,
+						a, b, c, count, NULL); break;
+			case NIO_TREAD:  err = dsk_ptread(drv, &dg, buf, a, b); 
+					 break;
+			default:	 err = DSK_ERR_BADPARM; break;
+		}
+	}
+	check_error(env, err);
+}
+
 /*
  * Class:     uk_co_demon_seasip_libdsk_Drive
  * Method:    autoFormat
@@ -70,6 +70,7 @@ static dsk_err_t dsk_icreat(DSK_DRIVER **self, const char *filename, int ndrv, C
 {
 	DRV_CLASS *dc = classes[ndrv];
 	dsk_err_t err;
+	unsigned long t0;
 
 	if (!dc) return DSK_ERR_BADPTR;
 	
@@ -77,13 +78,19 @@ static dsk_err_t dsk_icreat(DSK_DRIVER **self, const char *filename, int ndrv, C
 	if (!*self) return DSK_ERR_NOMEM;
 	dr_construct(*self, dc);
 
+	t0 = dsk_stats_begin(*self, DSK_OP_OPEN, -1, -1, -1);
 	if (dc->dc_creat) err = (dc->dc_creat)(*self, filename);
 	else err = DSK_ERR_NOTIMPL;
+	dsk_stats_end(*self, DSK_OP_OPEN, t0, -1, -1, -1, err, 1, 0);
 	if (err == DSK_ERR_OK) 
 	{
 		(*self)->dr_compress = cd;
+		(*self)->dr_filename = dsk_malloc_string(cd ? cd->cd_cfilename : filename);
 		return err;
 	}
+	/* The driver may have used the buffer pool before failing */
+	dsk_pool_release(*self);
+	dsk_stats_release(*self);
 	dsk_free (*self);
 	*self = NULL;
 	return err;
@@ -95,6 +102,8 @@ static dsk_err_t dsk_iopen(DSK_DRIVER **self, const char *filename, int ndrv, CO
 {
 	DRV_CLASS *dc = classes[ndrv];
 	dsk_err_t err;
+	unsigned long t0;
+	const char *truename = filename;
 
 	/* If we're handling compressed data, use the temporary uncompressed file */
 	if (cd) filename = cd->cd_ufilename;
@@ -105,13 +114,20 @@ static dsk_err_t dsk_iopen(DSK_DRIVER **self, const char *filename, int ndrv, CO
 	if (!*self) return DSK_ERR_NOMEM;
 	dr_construct(*self, dc);
 
+	t0 = dsk_stats_begin(*self, DSK_OP_OPEN, -1, -1, -1);
 	err = (dc->dc_open)(*self, filename);
+	dsk_stats_end(*self, DSK_OP_OPEN, t0, -1, -1, -1, err, 1, 0);
 /*	printf("%s: open %s = %d\n", dc->dc_drvname, filename, err); */
 	if (err == DSK_ERR_OK) 
 	{
 		(*self)->dr_compress = cd;
+		/* Used to key the geometry cache */
+		(*self)->dr_filename = dsk_malloc_string(truename);
 		return err;
 	}
+	/* The driver may have used the buffer pool before failing */
+	dsk_pool_release(*self);
+	dsk_stats_release(*self);
 	dsk_free (*self);
 	*self = NULL;
 	return err;
@@ -208,6 +224,11 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_close(DSK_DRIVER **self)
 
 	e = ((*self)->dr_class->dc_close)(*self);
 
+	/* If the image has been changed, any cached geometry for it is 
+	 * suspect */
+	if ((*self)->dr_dirty && (*self)->dr_filename)
+		dsk_geomcache_invalidate((*self)->dr_filename);
+
 	dc = (*self)->dr_compress;
 	if (dc)
 	{
@@ -226,6 +247,9 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_close(DSK_DRIVER **self)
 	}
 	/* And any comments */
 	dsk_set_comment(*self, NULL);
+	if ((*self)->dr_filename) dsk_free((*self)->dr_filename);
+	dsk_pool_release(*self);
+	dsk_stats_release(*self);
 	dsk_free (*self);
 	*self = NULL;
 	return e;
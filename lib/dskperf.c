@@ -0,0 +1,143 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Per-driver operation counters and timings.
+ *
+ * The dsk_* wrappers call dsk_stats_begin() before they call into the
+ * driver and dsk_stats_end() afterwards, which adds the call to the
+ * counters for that operation and passes both ends to the trace
+ * function, if there is one (see dsktrace.c). The counters are
+ * allocated the first time they are needed and freed by dsk_close().
+ */
+
+#include "drvi.h"
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+# include <sys/time.h>
+# define PERF_GETTIMEOFDAY
+#endif
+
+static const char *op_names[DSK_OP_MAX] =
+{
+	"read", "write", "format", "getgeom", "secid", "seek", "status",
+	"xread", "xwrite", "tread", "xtread", "trackids", "rtread",
+	"open", "rpc", "decompress", "compress"
+};
+
+
+/* Current time in microseconds. Only differences between two calls are
+ * of any interest, so it doesn't matter when the count starts or that
+ * it wraps. */
+unsigned long dsk_stats_now(void)
+{
+#if defined(PERF_GETTIMEOFDAY)
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+#elif defined(HAVE_WINDOWS_H)
+	return GetTickCount() * 1000UL;
+#else
+	return (unsigned long)(clock() * (1000000.0 / CLOCKS_PER_SEC));
+#endif
+}
+
+
+/* Start of a call of operation 'op' at the given location */
+unsigned long dsk_stats_begin(DSK_DRIVER *self, int op, long cylinder, 
+		long head, long sector)
+{
+	dsk_trace_begin(self, NULL, op, cylinder, head, sector);
+	return dsk_stats_now();
+}
+
+
+/* Record one call of operation 'op', which started at 'start' at the
+ * location passed to dsk_stats_begin(), and returned 'err' after 'tries'
+ * attempts at it. 'bytes' is the amount of data transferred if the call
+ * succeeded. */
+void dsk_stats_end(DSK_DRIVER *self, int op, unsigned long start,
+		long cylinder, long head, long sector,
+		dsk_err_t err, unsigned tries, unsigned long bytes)
+{
+	DSK_OPSTATS *st;
+	unsigned long us = dsk_stats_now() - start;
+	unsigned long b;
+	int n;
+
+	dsk_trace_end(self, NULL, op, cylinder, head, sector, err,
+			err ? 0 : bytes);
+	if (!self || op < 0 || op >= DSK_OP_MAX) return;
+	/* A failed open leaves no handle to ask about it */
+	if (op == DSK_OP_OPEN && err) return;
+	if (!self->dr_stats)
+	{
+		self->dr_stats = dsk_malloc(sizeof(DSK_STATS));
+		/* Failing to keep statistics is not an error */
+		if (!self->dr_stats) return;
+		memset(self->dr_stats, 0, sizeof(DSK_STATS));
+	}
+	st = &self->dr_stats->st_op[op];
+	++st->ds_calls;
+	if (err) ++st->ds_errors;
+	else	 st->ds_bytes += bytes;
+	if (tries > 1) st->ds_retries += tries - 1;
+	st->ds_total_us += us;
+	if (us > st->ds_max_us) st->ds_max_us = us;
+
+	/* Bucket is floor(log2(us)) */
+	for (n = 0, b = us; b > 1 && n < DSK_STATS_BUCKETS - 1; n++) b >>= 1;
+	++st->ds_hist[n];
+}
+
+
+void dsk_stats_release(DSK_DRIVER *self)
+{
+	if (self->dr_stats) dsk_free(self->dr_stats);
+	self->dr_stats = NULL;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_get_stats(DSK_PDRIVER self, DSK_STATS *stats)
+{
+	if (!self || !stats) return DSK_ERR_BADPTR;
+
+	if (self->dr_stats) memcpy(stats, self->dr_stats, sizeof(DSK_STATS));
+	else		    memset(stats, 0, sizeof(DSK_STATS));
+	return DSK_ERR_OK;
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_reset_stats(DSK_PDRIVER self)
+{
+	if (!self) return DSK_ERR_BADPTR;
+
+	if (self->dr_stats) memset(self->dr_stats, 0, sizeof(DSK_STATS));
+	return DSK_ERR_OK;
+}
+
+
+LDPUBLIC32 const char * LDPUBLIC16 dsk_op_name(int op)
+{
+	if (op < 0 || op >= DSK_OP_MAX) return NULL;
+	return op_names[op];
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Per-driver pool of scratch buffers.
+ *
+ * Sector buffers for checking, complementing, probing and converting are
+ * needed for the duration of one call, and the same sizes are asked for
+ * again and again. Rather than going to malloc() each time, buffers that
+ * have been finished with are kept on a short list attached to the
+ * driver and handed out again. Everything on the list is freed by
+ * dsk_close(), or when the driver fails to open.
+ */
+
+#include "drvi.h"
+
+#define POOL_MAX   8	/* Most buffers to keep on the list */
+#define POOL_ROUND 64	/* Sizes are rounded up to a multiple of this */
+
+typedef struct dsk_poolbuf
+{
+	union
+	{
+		struct
+		{
+			struct dsk_poolbuf *next;
+			size_t size;
+		} h;
+		/* Make sure the data that follows is suitably aligned */
+		double align_d;
+		long   align_l;
+		void  *align_p;
+	} pb;
+} DSK_POOLBUF;
+
+
+void *dsk_pool_alloc(DSK_DRIVER *self, size_t size)
+{
+	DSK_POOLBUF *pb, **prev;
+
+	size = (size + POOL_ROUND - 1) & ~(size_t)(POOL_ROUND - 1);
+
+	/* Take the first buffer that is big enough without being
+	 * wastefully large */
+	for (prev = &self->dr_pool; *prev; prev = &(*prev)->pb.h.next)
+	{
+		pb = *prev;
+		if (pb->pb.h.size >= size && pb->pb.h.size <= 2 * size)
+		{
+			*prev = pb->pb.h.next;
+			--self->dr_poolcount;
+			return pb + 1;
+		}
+	}
+	pb = dsk_malloc(sizeof(DSK_POOLBUF) + size);
+	if (!pb) return NULL;
+	pb->pb.h.size = size;
+	return pb + 1;
+}
+
+
+void dsk_pool_free(DSK_DRIVER *self, void *ptr)
+{
+	DSK_POOLBUF *pb;
+
+	if (!ptr) return;
+	pb = ((DSK_POOLBUF *)ptr) - 1;
+	if (self->dr_poolcount >= POOL_MAX)
+	{
+		dsk_free(pb);
+		return;
+	}
+	pb->pb.h.next = self->dr_pool;
+	self->dr_pool = pb;
+	++self->dr_poolcount;
+}
+
+
+void dsk_pool_release(DSK_DRIVER *self)
+{
+	DSK_POOLBUF *pb;
+
+	while (self->dr_pool)
+	{
+		pb = self->dr_pool;
+		self->dr_pool = pb->pb.h.next;
+		dsk_free(pb);
+	}
+	self->dr_poolcount = 0;
+}
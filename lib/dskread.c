@@ -29,6 +29,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pread(DSK_DRIVER *self, const DSK_GEOMETRY *
 	DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
 	unsigned n, m;
+	unsigned long t0;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -40,6 +41,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pread(DSK_DRIVER *self, const DSK_GEOMETRY *
 	{
 		return DSK_ERR_NOTIMPL;
 	}
+	t0 = dsk_stats_begin(self, DSK_OP_READ, cylinder, head, sector);
 	for (n = 0; n < self->dr_retry_count; n++)
 	{
 		e = (dc->dc_read)(self,geom,buf,cylinder,head,sector);
@@ -52,8 +54,10 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pread(DSK_DRIVER *self, const DSK_GEOMETRY *
 			}
 		}	
 /* 		LDTRACE(("  err=%d\n", e)); */
-		if (!DSK_TRANSIENT_ERROR(e)) return e; 
+		if (!DSK_TRANSIENT_ERROR(e)) break;
 	}
+	dsk_stats_end(self, DSK_OP_READ, t0, cylinder, head, sector, e,
+		(n < self->dr_retry_count) ? n + 1 : n, geom->dg_secsize);
 	return e;
 }
 
@@ -80,6 +84,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xread(DSK_DRIVER *self, const DSK_GEOMETRY *
 	DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
 	unsigned n, m;
+	unsigned long t0;
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
 	dc = self->dr_class;
@@ -91,6 +96,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xread(DSK_DRIVER *self, const DSK_GEOMETRY *
 	{
 		return DSK_ERR_NOTIMPL;
 	}
+	t0 = dsk_stats_begin(self, DSK_OP_XREAD, cylinder, head, sector);
 	for (n = 0; n < self->dr_retry_count; n++)
 	{
 		e = (dc->dc_xread)(self,geom,buf,cylinder,head,
@@ -104,8 +110,29 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xread(DSK_DRIVER *self, const DSK_GEOMETRY *
 			}
 		}
 		/* LDTRACE(("  err=%d\n", e)); */
-		if (!DSK_TRANSIENT_ERROR(e)) return e;
+		if (!DSK_TRANSIENT_ERROR(e)) break;
 	}
+	dsk_stats_end(self, DSK_OP_XREAD, t0, cylinder, head, sector, e,
+		(n < self->dr_retry_count) ? n + 1 : n, sector_len);
 	return e;
 }
 
+/* Drivers that don't have xread can still do a plain read, if the sector
+ * is the size that the geometry says it should be */
+dsk_err_t dsk_read_id(DSK_PDRIVER self, const DSK_GEOMETRY *geom, void *buf,
+		dsk_pcyl_t cylinder, dsk_phead_t head, const DSK_FORMAT *id,
+		int *deleted)
+{
+	dsk_err_t err;
+
+	*deleted = 0;
+	err = dsk_xread(self, geom, buf, cylinder, head, id->fmt_cylinder,
+			id->fmt_head, id->fmt_sector, id->fmt_secsize, deleted);
+	if (err == DSK_ERR_NOTIMPL && id->fmt_secsize == geom->dg_secsize)
+	{
+		err = dsk_pread(self, geom, buf, cylinder, head,
+				id->fmt_sector);
+	}
+	return err;
+}
+
@@ -28,7 +28,9 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_rtread(DSK_PDRIVER self,
 	                dsk_pcyl_t cylinder,  dsk_phead_t head, int reserved)
 {
 	DRV_CLASS *dc;
-	size_t bufsiz;
+	size_t bufsiz = 0;
+	dsk_err_t err;
+	unsigned long t0;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -36,6 +38,10 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_rtread(DSK_PDRIVER self,
 
 	WALK_VTABLE(dc, dc_rtread)
         if (!dc->dc_rtread) return DSK_ERR_NOTIMPL;
-	return (dc->dc_rtread)(self,geom,buf,cylinder,head,reserved, &bufsiz);	
+	t0 = dsk_stats_begin(self, DSK_OP_RTREAD, cylinder, head, -1);
+	err = (dc->dc_rtread)(self,geom,buf,cylinder,head,reserved, &bufsiz);	
+	dsk_stats_end(self, DSK_OP_RTREAD, t0, cylinder, head, -1, err, 1,
+			bufsiz);
+	return err;
 
 }
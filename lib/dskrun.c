@@ -0,0 +1,142 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/* Run detection for the image writers.
+ *
+ * Before a sector is written, most drivers want to know whether it is all
+ * one byte (so it can be stored as a filler) or where the runs in it are
+ * (for run-length encoding). These two primitives answer both questions,
+ * using SSE2 where the compiler provides it (and AVX2 if that has been 
+ * enabled, eg with -mavx2), otherwise a byte at a time.
+ */
+
+#include "drvi.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define RUN_SSE2 1
+# include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+# include <immintrin.h>
+#endif
+
+#if defined(RUN_SSE2) || defined(__AVX2__)
+/* Index of the lowest clear bit in a comparison mask */
+static unsigned first_clear(unsigned mask)
+{
+# ifdef __GNUC__
+	return (unsigned)__builtin_ctz(~mask);
+# else
+	unsigned n = 0;
+
+	while (mask & 1)
+	{
+		mask >>= 1;
+		++n;
+	}
+	return n;
+# endif
+}
+#endif
+
+
+/* Return how many bytes at the start of 'buf' are the same as the first */
+size_t dsk_run_length(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	unsigned char c;
+	size_t n = 0;
+
+	if (!len) return 0;
+	c = p[0];
+#ifdef __AVX2__
+	{
+		__m256i v = _mm256_set1_epi8((char)c);
+		unsigned m;
+
+		for (; n + 32 <= len; n += 32)
+		{
+			m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			    _mm256_loadu_si256((const __m256i *)(p + n)), v));
+			if (m != 0xFFFFFFFFU) return n + first_clear(m);
+		}
+	}
+#endif
+#ifdef RUN_SSE2
+	{
+		__m128i v = _mm_set1_epi8((char)c);
+		unsigned m;
+
+		for (; n + 16 <= len; n += 16)
+		{
+			m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			    _mm_loadu_si128((const __m128i *)(p + n)), v));
+			if (m != 0xFFFF) return n + first_clear(m);
+		}
+	}
+#endif
+	while (n < len && p[n] == c) ++n;
+	return n;
+}
+
+
+/* Return the offset of the first byte that differs between 'a' and 'b',
+ * or 'len' if they are the same. The two may overlap: comparing a buffer
+ * with itself 'k' bytes further on gives the length of the part of it 
+ * that repeats with period 'k', less 'k'. */
+size_t dsk_mismatch(const void *a, const void *b, size_t len)
+{
+	const unsigned char *pa = a;
+	const unsigned char *pb = b;
+	size_t n = 0;
+
+#ifdef __AVX2__
+	{
+		unsigned m;
+
+		for (; n + 32 <= len; n += 32)
+		{
+			m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			    _mm256_loadu_si256((const __m256i *)(pa + n)),
+			    _mm256_loadu_si256((const __m256i *)(pb + n))));
+			if (m != 0xFFFFFFFFU) return n + first_clear(m);
+		}
+	}
+#endif
+#ifdef RUN_SSE2
+	{
+		unsigned m;
+
+		for (; n + 16 <= len; n += 16)
+		{
+			m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			    _mm_loadu_si128((const __m128i *)(pa + n)),
+			    _mm_loadu_si128((const __m128i *)(pb + n))));
+			if (m != 0xFFFF) return n + first_clear(m);
+		}
+	}
+#endif
+	while (n < len && pa[n] == pb[n]) ++n;
+	return n;
+}
@@ -29,6 +29,8 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_psecid(DSK_DRIVER *self, const DSK_GEOMETRY
                                 DSK_FORMAT *result)
 {
 	DRV_CLASS *dc;
+	dsk_err_t err;
+	unsigned long t0;
 	if (!self || !geom || !result || !self->dr_class) return DSK_ERR_BADPTR;
 
 	dc = self->dr_class;
@@ -38,7 +40,10 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_psecid(DSK_DRIVER *self, const DSK_GEOMETRY
 	{
 		return DSK_ERR_NOTIMPL;
 	}
-	return (dc->dc_secid)(self,geom,cylinder,head,result);	
+	t0 = dsk_stats_begin(self, DSK_OP_SECID, cylinder, head, -1);
+	err = (dc->dc_secid)(self,geom,cylinder,head,result);	
+	dsk_stats_end(self, DSK_OP_SECID, t0, cylinder, head, -1, err, 1, 0);
+	return err;
 
 }
 
@@ -28,6 +28,8 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pseek(DSK_DRIVER *self, const DSK_GEOMETRY *
                                 dsk_pcyl_t cylinder, dsk_phead_t head)
 {
 	DRV_CLASS *dc;
+	dsk_err_t err;
+	unsigned long t0;
 	if (!self || !geom || !self->dr_class) return DSK_ERR_BADPTR;
 
 	dc = self->dr_class;
@@ -37,7 +39,10 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pseek(DSK_DRIVER *self, const DSK_GEOMETRY *
 	{
 		return DSK_ERR_NOTIMPL;
 	}
-	return (dc->dc_xseek)(self,geom,cylinder,head);	
+	t0 = dsk_stats_begin(self, DSK_OP_SEEK, cylinder, head, -1);
+	err = (dc->dc_xseek)(self,geom,cylinder,head);	
+	dsk_stats_end(self, DSK_OP_SEEK, t0, cylinder, head, -1, err, 1, 0);
+	return err;
 
 }
 
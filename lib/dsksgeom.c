@@ -22,6 +22,10 @@
 
 #include "drvi.h"
 
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
 /* Standard disc geometries. These are used 
  * (i)  when logging in a disc, if the superblock is recognised
  * (ii) when formatting */
@@ -259,6 +263,96 @@ const char *dg_sharedir()
 
 static DSK_NAMEDGEOM *customgeom = NULL;
 
+/* Index of the formats, built once the custom ones have been loaded.
+ * customtab[n] is custom format n (counting from the end of stdg[]), and
+ * namehash[] chains all the formats, standard and custom, by name. */
+static DSK_NAMEDGEOM **customtab = NULL;
+static unsigned customcount = 0;
+static int *namehash = NULL;    /* Format index at head of each chain, or -1 */
+static int *namenext = NULL;    /* Next format index in the same chain */
+static unsigned namehashsize = 0;
+
+#define STDCOUNT (sizeof(stdg) / sizeof(stdg[0]))
+
+/* Format names are matched without regard to case */
+static unsigned dg_namehash(const char *name)
+{
+    unsigned long h = 5381;
+
+    while (*name)
+    {
+        h = ((h << 5) + h) ^ (unsigned char)tolower((unsigned char)*name);
+        ++name;
+    }
+    return (unsigned)(h & 0xFFFF);
+}
+
+static int dg_namecmp(const char *a, const char *b)
+{
+    while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b))
+    {
+        ++a;
+        ++b;
+    }
+    return tolower((unsigned char)*a) - tolower((unsigned char)*b);
+}
+
+static DSK_NAMEDGEOM *dg_byindex(unsigned idx)
+{
+    if (idx < STDCOUNT) return &stdg[idx];
+    return customtab[idx - STDCOUNT];
+}
+
+static dsk_err_t dg_build_index(void)
+{
+    DSK_NAMEDGEOM *pg;
+    unsigned n, total, h;
+    int m;
+
+    customcount = 0;
+    for (pg = customgeom; pg; pg = pg->next) ++customcount;
+    total = STDCOUNT + customcount;
+
+    if (customtab)  dsk_free(customtab);
+    if (namehash)   dsk_free(namehash);
+    if (namenext)   dsk_free(namenext);
+    namehashsize = 16;
+    while (namehashsize < 2 * total) namehashsize *= 2;
+    customtab = dsk_malloc((customcount + 1) * sizeof(DSK_NAMEDGEOM *));
+    namehash  = dsk_malloc(namehashsize * sizeof(int));
+    namenext  = dsk_malloc(total * sizeof(int));
+    if (!customtab || !namehash || !namenext)
+    {
+        if (customtab) dsk_free(customtab);
+        if (namehash)  dsk_free(namehash);
+        if (namenext)  dsk_free(namenext);
+        customtab = NULL;
+        namehash  = NULL;
+        namenext  = NULL;
+        customcount = 0;
+        return DSK_ERR_NOMEM;
+    }
+    for (n = 0, pg = customgeom; pg; pg = pg->next) customtab[n++] = pg;
+    for (n = 0; n < namehashsize; n++) namehash[n] = -1;
+
+    for (n = 0; n < total; n++)
+    {
+        pg = dg_byindex(n);
+        namenext[n] = -1;
+        h = dg_namehash(pg->name) & (namehashsize - 1);
+/* If two formats have the same name, only the first can be found by name,
+ * as it always could be when the list was searched in order. */
+        for (m = namehash[h]; m >= 0; m = namenext[m])
+        {
+            if (!dg_namecmp(dg_byindex(m)->name, pg->name)) break;
+        }
+        if (m >= 0) continue;
+        namenext[n] = namehash[h];
+        namehash[h] = n;
+    }
+    return DSK_ERR_OK;
+}
+
 
 dsk_err_t dg_parse(FILE *fp, DSK_GEOMETRY *dg, char *description)
 {
@@ -493,13 +587,246 @@ static dsk_err_t dg_parse_file(FILE *fp)
     return DSK_ERR_OK;
 }
 
-dsk_err_t dg_custom_init(void)
+
+/* The custom formats from the libdskrc files are also saved in a
+ * precompiled form, so that short-lived processes need not parse the
+ * files every time they start. The cache records the size and timestamp
+ * of each file it was built from, and is rebuilt if any of them change.
+ *
+ * All numbers in it are 32-bit little-endian. */
+#define RCCACHE_NAME  ".libdskrc.cache"
+#define RCCACHE_MAGIC "LIBDSKRC-CACHE 1"
+#define RCCACHE_NRC   2     /* Number of libdskrc files */
+
+typedef struct rc_stamp
 {
-    const char *path;
+    unsigned long present;
+    unsigned long size;
+    unsigned long mtime;
+} RC_STAMP;
+
+#ifdef HAVE_SYS_STAT_H
+static void rc_stamp(const char *filename, RC_STAMP *stamp)
+{
+    struct stat st;
+
+    memset(stamp, 0, sizeof(*stamp));
+    if (filename[0] && !stat(filename, &st))
+    {
+        stamp->present = 1;
+        stamp->size    = (unsigned long)st.st_size;
+        stamp->mtime   = (unsigned long)st.st_mtime;
+    }
+}
+
+static void rc_put32(FILE *fp, unsigned long v)
+{
+    fputc((int)( v        & 0xFF), fp);
+    fputc((int)((v >>  8) & 0xFF), fp);
+    fputc((int)((v >> 16) & 0xFF), fp);
+    fputc((int)((v >> 24) & 0xFF), fp);
+}
+
+static int rc_get32(FILE *fp, unsigned long *v)
+{
+    unsigned char b[4];
+
+    if (fread(b, 1, 4, fp) < 4) return 0;
+    *v = b[0] | (((unsigned long)b[1]) << 8) |
+        (((unsigned long)b[2]) << 16) | (((unsigned long)b[3]) << 24);
+    return 1;
+}
+
+static void rc_putstr(FILE *fp, const char *s)
+{
+    rc_put32(fp, (unsigned long)strlen(s));
+    fputs(s, fp);
+}
+
+/* Read a string into buf, and check that it matches 'expect' if that
+ * is not NULL */
+static int rc_getstr(FILE *fp, char *buf, size_t buflen, const char *expect)
+{
+    unsigned long len;
+
+    if (!rc_get32(fp, &len) || len >= buflen) return 0;
+    if (fread(buf, 1, len, fp) < len) return 0;
+    buf[len] = 0;
+    return (!expect || !strcmp(buf, expect));
+}
+
+/* Read a string into newly-allocated memory, whatever its length */
+static char *rc_allocstr(FILE *fp)
+{
+    unsigned long len;
+    char *s;
+
+    if (!rc_get32(fp, &len) || len > 0xFFFF) return NULL;
+    s = dsk_malloc(len + 1);
+    if (!s) return NULL;
+    if (fread(s, 1, len, fp) < len)
+    {
+        dsk_free(s);
+        return NULL;
+    }
+    s[len] = 0;
+    return s;
+}
+
+static int rc_load_cache(const char *cachename, 
+        char rcname[RCCACHE_NRC][2 * PATH_MAX], RC_STAMP *stamp)
+{
+    FILE *fp;
     char buf[2 * PATH_MAX];
+    char *formname = NULL, *formdesc = NULL;
+    unsigned long count, n, v[15];
+    DSK_NAMEDGEOM *head = NULL, **tail = &head, *pg;
+    int m, ok;
+
+    fp = fopen(cachename, "rb");
+    if (!fp) return 0;
+
+    ok = (fread(buf, 1, sizeof(RCCACHE_MAGIC), fp) == sizeof(RCCACHE_MAGIC)
+         && !memcmp(buf, RCCACHE_MAGIC, sizeof(RCCACHE_MAGIC)));
+    for (m = 0; ok && m < RCCACHE_NRC; m++)
+    {
+        ok = rc_getstr(fp, buf, sizeof(buf), rcname[m]) &&
+             rc_get32(fp, &v[0]) && rc_get32(fp, &v[1]) && 
+             rc_get32(fp, &v[2]) && v[0] == stamp[m].present && 
+             v[1] == stamp[m].size && v[2] == stamp[m].mtime;
+    }
+    if (ok) ok = rc_get32(fp, &count);
+    for (n = 0; ok && n < count; n++)
+    {
+        formname = rc_allocstr(fp);
+        formdesc = formname ? rc_allocstr(fp) : NULL;
+        ok = (formdesc != NULL);
+        for (m = 0; ok && m < 12; m++) ok = rc_get32(fp, &v[m]);
+        pg = ok ? dsk_malloc(sizeof(DSK_NAMEDGEOM) + 2 +
+                strlen(formdesc) + strlen(formname)) : NULL;
+        if (pg)
+        {
+            pg->name = ((char *)pg) + sizeof(DSK_NAMEDGEOM);
+            pg->desc = ((char *)pg) + sizeof(DSK_NAMEDGEOM) + 1 + 
+                    strlen(formname);
+            strcpy((char *)pg->name, formname);
+            strcpy((char *)pg->desc, formdesc);
+        }
+        if (formname) dsk_free(formname);
+        if (formdesc) dsk_free(formdesc);
+        formname = formdesc = NULL;
+        if (!pg) { ok = 0; break; }
+        pg->dg.dg_sidedness = (dsk_sides_t)v[0];
+        pg->dg.dg_cylinders = (dsk_pcyl_t)v[1];
+        pg->dg.dg_heads     = (dsk_phead_t)v[2];
+        pg->dg.dg_sectors   = (dsk_psect_t)v[3];
+        pg->dg.dg_secbase   = (dsk_psect_t)v[4];
+        pg->dg.dg_secsize   = (size_t)v[5];
+        pg->dg.dg_datarate  = (dsk_rate_t)v[6];
+        pg->dg.dg_rwgap     = (dsk_gap_t)v[7];
+        pg->dg.dg_fmtgap    = (dsk_gap_t)v[8];
+        pg->dg.dg_fm        = (int)v[9];
+        pg->dg.dg_nomulti   = (int)v[10];
+        pg->dg.dg_noskip    = (int)v[11];
+        pg->next = NULL;
+        *tail = pg;
+        tail = &pg->next;
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        while (head)
+        {
+            pg = head->next;
+            dsk_free(head);
+            head = pg;
+        }
+        return 0;
+    }
+    *tail = customgeom;
+    customgeom = head;
+    return 1;
+}
+
+
+static void rc_save_cache(const char *cachename, 
+        char rcname[RCCACHE_NRC][2 * PATH_MAX], RC_STAMP *stamp)
+{
+    char tmpname[2 * PATH_MAX + 4];
+    DSK_NAMEDGEOM *pg;
+    unsigned long count = 0;
+    FILE *fp;
+    int m, err;
+
+    sprintf(tmpname, "%s.tmp", cachename);
+    fp = fopen(tmpname, "wb");
+    if (!fp) return;
+    fwrite(RCCACHE_MAGIC, 1, sizeof(RCCACHE_MAGIC), fp);
+    for (m = 0; m < RCCACHE_NRC; m++)
+    {
+        rc_putstr(fp, rcname[m]);
+        rc_put32(fp, stamp[m].present);
+        rc_put32(fp, stamp[m].size);
+        rc_put32(fp, stamp[m].mtime);
+    }
+    for (pg = customgeom; pg; pg = pg->next) ++count;
+    rc_put32(fp, count);
+    for (pg = customgeom; pg; pg = pg->next)
+    {
+        rc_putstr(fp, pg->name);
+        rc_putstr(fp, pg->desc);
+        rc_put32(fp, (unsigned long)pg->dg.dg_sidedness);
+        rc_put32(fp, (unsigned long)pg->dg.dg_cylinders);
+        rc_put32(fp, (unsigned long)pg->dg.dg_heads);
+        rc_put32(fp, (unsigned long)pg->dg.dg_sectors);
+        rc_put32(fp, (unsigned long)pg->dg.dg_secbase);
+        rc_put32(fp, (unsigned long)pg->dg.dg_secsize);
+        rc_put32(fp, (unsigned long)pg->dg.dg_datarate);
+        rc_put32(fp, (unsigned long)pg->dg.dg_rwgap);
+        rc_put32(fp, (unsigned long)pg->dg.dg_fmtgap);
+        rc_put32(fp, (unsigned long)pg->dg.dg_fm);
+        rc_put32(fp, (unsigned long)pg->dg.dg_nomulti);
+        rc_put32(fp, (unsigned long)pg->dg.dg_noskip);
+    }
+    err = ferror(fp);
+    if (fclose(fp) || err)
+    {
+        remove(tmpname);
+        return;
+    }
+    if (rename(tmpname, cachename))
+    {
+/* Some platforms won't rename over an existing file */
+        remove(cachename);
+        if (rename(tmpname, cachename)) remove(tmpname);
+    }
+}
+#endif /* def HAVE_SYS_STAT_H */
+
+
+static dsk_err_t dg_load_rc(const char *filename)
+{
     FILE *fp;
     dsk_err_t err;
 
+    if (!filename[0]) return DSK_ERR_OK;
+    fp = fopen(filename, "r");
+    if (!fp) return DSK_ERR_OK;
+    err = dg_parse_file(fp);
+    fclose(fp);
+    return err;
+}
+
+dsk_err_t dg_custom_init(void)
+{
+    const char *path;
+    char rcname[RCCACHE_NRC][2 * PATH_MAX];
+    dsk_err_t err;
+#ifdef HAVE_SYS_STAT_H
+    char cachename[2 * PATH_MAX];
+    RC_STAMP stamp[RCCACHE_NRC];
+#endif
+
     static int custom_inited = 0;
 
 /* Assert that the format names and numeric IDs are in sync. */
@@ -511,39 +838,47 @@ dsk_err_t dg_custom_init(void)
     assert(!strcmp(stdg[FMT_1440F].name, "ibm1440"));
     assert(!strcmp(stdg[FMT_ACORN160].name, "acorn160"));
     assert(!strcmp(stdg[FMT_AMPRO800].name, "ampro800"));
+#endif
+    if (custom_inited >= 3) return DSK_ERR_OK;
+
+    path = dg_sharedir();
+    if (path) sprintf(rcname[0], "%s%s", path, "libdskrc");
+    else      rcname[0][0] = 0;
+    path = dg_homedir();
+    if (path) sprintf(rcname[1], "%s%s", path, ".libdskrc");
+    else      rcname[1][0] = 0;
+
+#ifdef HAVE_SYS_STAT_H
+/* The cache goes in the home directory, alongside .libdskrc */
+    cachename[0] = 0;
+    if (path) sprintf(cachename, "%s%s", path, RCCACHE_NAME);
+    rc_stamp(rcname[0], &stamp[0]);
+    rc_stamp(rcname[1], &stamp[1]);
+    if (custom_inited < 1 && cachename[0] && 
+        rc_load_cache(cachename, rcname, stamp))
+    {
+        custom_inited = 2;
+    }
 #endif
     if (custom_inited < 1)
     {
-        path = dg_sharedir();
-        if (path)
-        {
-            sprintf(buf, "%s%s", path, "libdskrc");
-            fp = fopen(buf, "r");
-            if (fp)
-            {
-                err = dg_parse_file(fp);
-                fclose(fp);
-                if (err) return err;
-            }
-        }
+        err = dg_load_rc(rcname[0]);
+        if (err) return err;
         custom_inited = 1;
     }
     if (custom_inited < 2)
     {
-        path = dg_homedir();
-        if (path)
-        {
-            sprintf(buf, "%s%s", path, ".libdskrc");
-            fp = fopen(buf, "r");
-            if (fp)
-            {
-                err = dg_parse_file(fp);
-                fclose(fp);
-                if (err) return err;
-            }       
-        }
+        err = dg_load_rc(rcname[1]);
+        if (err) return err;
         custom_inited = 2;
+#ifdef HAVE_SYS_STAT_H
+        if (cachename[0] && (stamp[0].present || stamp[1].present))
+            rc_save_cache(cachename, rcname, stamp);
+#endif
     }
+    err = dg_build_index();
+    if (err) return err;
+    custom_inited = 3;
     return DSK_ERR_OK;
 }
 
@@ -557,19 +892,14 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dg_stdformat(DSK_GEOMETRY *self, dsk_format_t fo
 
     dg_custom_init();
 
-/* If index is out of range in the standard set, search the custom set */
-    if ((unsigned)idx >= (sizeof(stdg)/sizeof(stdg[0]))  ) 
+/* If index is out of range in the standard set, look in the custom set */
+    if ((unsigned)idx >= STDCOUNT) 
     {
-        DSK_NAMEDGEOM *cg = customgeom;
-        idx -= (sizeof(stdg) / sizeof(stdg[0]));
+        DSK_NAMEDGEOM *cg;
+        idx -= STDCOUNT;
 
-        while (idx)
-        {
-            if (!cg) return DSK_ERR_BADFMT;
-            cg = cg->next;
-            --idx;
-        }
-        if (!cg) return DSK_ERR_BADFMT;
+        if (idx < 0 || (unsigned)idx >= customcount) return DSK_ERR_BADFMT;
+        cg = customtab[idx];
 
         if (self) memcpy(self, &cg->dg, sizeof(*self));
         if (fname) *fname = cg->name;
@@ -585,3 +915,52 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dg_stdformat(DSK_GEOMETRY *self, dsk_format_t fo
 
 
 
+
+
+/* Find a standard or custom format by name */
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dg_namedformat(dsk_cchar_t name, 
+            dsk_format_t *formatid)
+{
+    dsk_err_t err;
+    int n;
+
+    if (!name || !formatid) return DSK_ERR_BADPTR;
+    err = dg_custom_init();
+    if (err) return err;
+
+    for (n = namehash[dg_namehash(name) & (namehashsize - 1)]; 
+         n >= 0; n = namenext[n])
+    {
+        if (!dg_namecmp(dg_byindex(n)->name, name))
+        {
+            *formatid = (dsk_format_t)(FMT_180K + n);
+            return DSK_ERR_OK;
+        }
+    }
+    return DSK_ERR_BADFMT;
+}
+
+
+/* As dg_namedformat(), but the name must match exactly, including case */
+dsk_err_t dg_exactformat(dsk_cchar_t name, dsk_format_t *formatid)
+{
+    dsk_err_t err;
+    unsigned n, total;
+
+    err = dg_namedformat(name, formatid);
+    if (err) return err;
+    if (!strcmp(dg_byindex(*formatid - FMT_180K)->name, name)) 
+        return DSK_ERR_OK;
+/* The index only holds the first of several names that differ only in 
+ * case, so look for the others in order */
+    total = STDCOUNT + customcount;
+    for (n = 0; n < total; n++)
+    {
+        if (!strcmp(dg_byindex(n)->name, name))
+        {
+            *formatid = (dsk_format_t)(FMT_180K + n);
+            return DSK_ERR_OK;
+        }
+    }
+    return DSK_ERR_BADFMT;
+}
@@ -30,6 +30,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_drive_status(DSK_DRIVER *self, const DSK_GEO
 	DRV_CLASS *dc;
 	dsk_err_t err;
 	unsigned char ro = 0;
+	unsigned long t0;
 
 	if (!self || !geom || !status || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -50,7 +51,9 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_drive_status(DSK_DRIVER *self, const DSK_GEO
 	{
 		return DSK_ERR_OK;
 	}
+	t0 = dsk_stats_begin(self, DSK_OP_STATUS, -1, head, -1);
 	err = (dc->dc_status)(self,geom,head,status);	
+	dsk_stats_end(self, DSK_OP_STATUS, t0, -1, head, -1, err, 1, 0);
 	
 	*status |= ro;
 	return err;
@@ -0,0 +1,215 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Trace events, and a trace function that writes them out in the JSON
+ * format used by Chrome's trace viewer. */
+
+#include "drvi.h"
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+# include <sys/time.h>
+# define TRACE_GETTIMEOFDAY
+#endif
+
+static DSK_TRACEFUNC st_tracefunc;
+static void *st_traceparam;
+
+LDPUBLIC32 void LDPUBLIC16 dsk_tracefunc_set(DSK_TRACEFUNC func, void *param)
+{
+	st_tracefunc  = func;
+	st_traceparam = param;
+}
+
+
+LDPUBLIC32 void LDPUBLIC16 dsk_tracefunc_get(DSK_TRACEFUNC *func, void **param)
+{
+	if (func)  *func  = st_tracefunc;
+	if (param) *param = st_traceparam;
+}
+
+
+static void trace_time(DSK_TRACE_EVENT *ev)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ev->te_sec  = ts.tv_sec;
+	ev->te_nsec = ts.tv_nsec;
+#elif defined(TRACE_GETTIMEOFDAY)
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	ev->te_sec  = tv.tv_sec;
+	ev->te_nsec = tv.tv_usec * 1000UL;
+#elif defined(HAVE_WINDOWS_H)
+	DWORD ms = GetTickCount();
+
+	ev->te_sec  = ms / 1000;
+	ev->te_nsec = (ms % 1000) * 1000000UL;
+#else
+	clock_t c = clock();
+
+	ev->te_sec  = c / CLOCKS_PER_SEC;
+	ev->te_nsec = (unsigned long)((c % CLOCKS_PER_SEC) *
+			(1000000000.0 / CLOCKS_PER_SEC));
+#endif
+}
+
+
+static void trace_init(DSK_TRACE_EVENT *ev, int phase, DSK_DRIVER *self,
+		const char *name, int op)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->te_phase = phase;
+	ev->te_op    = op;
+	ev->te_drive = self;
+	if (self) ev->te_name = dsk_drvname(self);
+	else	  ev->te_name = name;
+	ev->te_cylinder = ev->te_head = ev->te_sector = -1;
+}
+
+
+void dsk_trace_begin(DSK_DRIVER *self, const char *name, int op,
+		long cylinder, long head, long sector)
+{
+	DSK_TRACE_EVENT ev;
+
+	if (!st_tracefunc) return;
+	trace_init(&ev, DSK_TRACE_BEGIN, self, name, op);
+	ev.te_cylinder = cylinder;
+	ev.te_head     = head;
+	ev.te_sector   = sector;
+	trace_time(&ev);
+	(*st_tracefunc)(&ev, st_traceparam);
+}
+
+
+void dsk_trace_end(DSK_DRIVER *self, const char *name, int op,
+		long cylinder, long head, long sector,
+		dsk_err_t err, unsigned long bytes)
+{
+	DSK_TRACE_EVENT ev;
+
+	if (!st_tracefunc) return;
+	trace_init(&ev, DSK_TRACE_END, self, name, op);
+	ev.te_cylinder = cylinder;
+	ev.te_head     = head;
+	ev.te_sector   = sector;
+	ev.te_err   = err;
+	ev.te_bytes = bytes;
+	trace_time(&ev);
+	(*st_tracefunc)(&ev, st_traceparam);
+}
+
+
+/* Chrome trace output. The file is a JSON array of events; the viewer
+ * pairs up 'B' and 'E' events on the same thread into spans. */
+static FILE *st_chrome;
+static int st_chrome_count;
+static unsigned long st_chrome_sec, st_chrome_nsec;
+
+static void chrome_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; s && *s; s++)
+	{
+		if (*s == '"' || *s == '\\') fputc('\\', fp);
+		if ((unsigned char)*s >= ' ') fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+
+static void chrome_event(const DSK_TRACE_EVENT *ev, void *param)
+{
+	FILE *fp = param;
+	double ts;
+	const char *name = dsk_op_name(ev->te_op);
+
+	/* Timestamps are in microseconds from the start of the trace */
+	ts = (ev->te_sec - st_chrome_sec) * 1000000.0 +
+	     ((double)ev->te_nsec - (double)st_chrome_nsec) / 1000.0;
+
+	fprintf(fp, "%s{\"name\":", st_chrome_count++ ? ",\n" : "");
+	chrome_string(fp, name ? name : "unknown");
+	fprintf(fp, ",\"cat\":");
+	chrome_string(fp, ev->te_name);
+	fprintf(fp, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{",
+		ev->te_phase == DSK_TRACE_BEGIN ? 'B' : 'E', ts);
+	if (ev->te_phase == DSK_TRACE_BEGIN)
+	{
+		int comma = 0;
+
+		if (ev->te_cylinder >= 0)
+		{
+			fprintf(fp, "\"cylinder\":%ld", ev->te_cylinder);
+			comma = 1;
+		}
+		if (ev->te_head >= 0)
+		{
+			fprintf(fp, "%s\"head\":%ld", comma ? "," : "",
+				ev->te_head);
+			comma = 1;
+		}
+		if (ev->te_sector >= 0)
+			fprintf(fp, "%s\"sector\":%ld", comma ? "," : "",
+				ev->te_sector);
+	}
+	else
+	{
+		fprintf(fp, "\"bytes\":%lu,\"err\":%d", ev->te_bytes,
+				(int)ev->te_err);
+		if (ev->te_err)
+		{
+			fprintf(fp, ",\"result\":");
+			chrome_string(fp, dsk_strerror(ev->te_err));
+		}
+	}
+	fprintf(fp, "}}");
+}
+
+
+LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_trace_chrome(const char *filename)
+{
+	DSK_TRACE_EVENT ev;
+
+	/* Finish any trace already in progress */
+	if (st_chrome)
+	{
+		if (st_tracefunc == chrome_event) dsk_tracefunc_set(NULL, NULL);
+		fprintf(st_chrome, "\n]\n");
+		fclose(st_chrome);
+		st_chrome = NULL;
+	}
+	if (!filename) return DSK_ERR_OK;
+
+	st_chrome = fopen(filename, "w");
+	if (!st_chrome) return DSK_ERR_SYSERR;
+	fprintf(st_chrome, "[\n");
+	st_chrome_count = 0;
+	trace_time(&ev);
+	st_chrome_sec  = ev.te_sec;
+	st_chrome_nsec = ev.te_nsec;
+	dsk_tracefunc_set(chrome_event, st_chrome);
+	return DSK_ERR_OK;
+}
@@ -29,6 +29,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_ptread(DSK_DRIVER *self, const DSK_GEOMETRY
 	dsk_err_t err;
 	unsigned char *b;
 	DRV_CLASS *dc;
+	unsigned long t0;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -37,6 +38,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_ptread(DSK_DRIVER *self, const DSK_GEOMETRY
 	WALK_VTABLE(dc, dc_tread)
 	if (dc->dc_tread) 
 	{
+		t0 = dsk_stats_begin(self, DSK_OP_TREAD, cylinder, head, -1);
 		err = (dc->dc_tread)(self,geom,buf,cylinder,head);	
 
 		/* If set to store bytes complemented, flip them as they come
@@ -51,7 +53,16 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_ptread(DSK_DRIVER *self, const DSK_GEOMETRY
 			}
 		}
 
-		if (err != DSK_ERR_NOTIMPL) return err;
+		if (err != DSK_ERR_NOTIMPL)
+		{
+			dsk_stats_end(self, DSK_OP_TREAD, t0, cylinder, head,
+				-1, err, 1,
+				(unsigned long)geom->dg_sectors * geom->dg_secsize);
+			return err;
+		}
+		/* Close the trace span, but don't count the call */
+		dsk_trace_end(self, NULL, DSK_OP_TREAD, cylinder, head, -1,
+				err, 0);
 	}
 
 	b = (unsigned char *)buf;
@@ -87,6 +98,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xtread(DSK_DRIVER *self, const DSK_GEOMETRY
 	dsk_err_t err;
 	unsigned char *b;
 	DRV_CLASS *dc;
+	unsigned long t0;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
 
@@ -95,6 +107,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xtread(DSK_DRIVER *self, const DSK_GEOMETRY
 	WALK_VTABLE(dc, dc_xtread)
 	if (dc->dc_xtread) 
 	{
+		t0 = dsk_stats_begin(self, DSK_OP_XTREAD, cylinder, head, -1);
 		err = (dc->dc_xtread)(self,geom,buf,cylinder,head,
 				cyl_expected, head_expected);	
 		/* If set to store bytes complemented, flip them as they come
@@ -109,7 +122,16 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xtread(DSK_DRIVER *self, const DSK_GEOMETRY
 			}
 		}
 
-		if (err != DSK_ERR_NOTIMPL) return err;
+		if (err != DSK_ERR_NOTIMPL)
+		{
+			dsk_stats_end(self, DSK_OP_XTREAD, t0, cylinder, head,
+				-1, err, 1,
+				(unsigned long)geom->dg_sectors * geom->dg_secsize);
+			return err;
+		}
+		/* Close the trace span, but don't count the call */
+		dsk_trace_end(self, NULL, DSK_OP_XTREAD, cylinder, head, -1,
+				err, 0);
 	}
 
 	b = (unsigned char *)buf;
@@ -36,6 +36,7 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_ptrackids(DSK_PDRIVER self,
 	DRV_CLASS *dc;
 	DSK_FORMAT fmt;
 	DSK_GEOMETRY gtemp;
+	unsigned long t0;
 
 	if (!self || !geom || !self->dr_class || !count || !results)
 	       	return DSK_ERR_BADPTR;
@@ -45,8 +46,17 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_ptrackids(DSK_PDRIVER self,
 	WALK_VTABLE(dc, dc_trackids)
         if (dc->dc_trackids) 
 	{
+		t0 = dsk_stats_begin(self, DSK_OP_TRACKIDS, cylinder, head, -1);
 		err = (dc->dc_trackids)(self,geom,cylinder,head,count,results);
-		if (err != DSK_ERR_NOTIMPL) return err;
+		if (err != DSK_ERR_NOTIMPL)
+		{
+			dsk_stats_end(self, DSK_OP_TRACKIDS, t0, cylinder, head,
+					-1, err, 1, 0);
+			return err;
+		}
+		/* Close the trace span, but don't count the call */
+		dsk_trace_end(self, NULL, DSK_OP_TRACKIDS, cylinder, head, -1,
+				err, 0);
 	}
 
 	dc = self->dr_class;
@@ -104,6 +114,51 @@ LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_ptrackids(DSK_PDRIVER self,
 }
 
 
+/* As dsk_ptrackids(), but if the driver can't list the sector IDs on the 
+ * track, assume it is laid out as 'geom' describes. */
+dsk_err_t dsk_trackids_geom(DSK_PDRIVER self, const DSK_GEOMETRY *geom,
+		dsk_pcyl_t cylinder, dsk_phead_t head,
+		dsk_psect_t *count, DSK_FORMAT **results)
+{
+	dsk_err_t err;
+	dsk_psect_t n;
+
+	err = dsk_ptrackids(self, geom, cylinder, head, count, results);
+	if (err != DSK_ERR_NOTIMPL) return err;
+
+	*results = dsk_malloc(geom->dg_sectors * sizeof(DSK_FORMAT));
+	if (!*results) return DSK_ERR_NOMEM;
+	*count = geom->dg_sectors;
+	for (n = 0; n < *count; n++)
+	{
+		(*results)[n].fmt_cylinder = cylinder;
+		(*results)[n].fmt_head     = dg_x_head(geom, head);
+		(*results)[n].fmt_sector   = dg_x_sector(geom, head,
+						geom->dg_secbase + n);
+		(*results)[n].fmt_secsize  = geom->dg_secsize;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Do two lists of sector IDs match? (DSK_FORMAT may have padding, so 
+ * they can't just be memcmp()ed.) */
+int dsk_same_trackids(const DSK_FORMAT *a, const DSK_FORMAT *b,
+		dsk_psect_t count)
+{
+	dsk_psect_t n;
+
+	for (n = 0; n < count; n++)
+	{
+		if (a[n].fmt_cylinder != b[n].fmt_cylinder ||
+		    a[n].fmt_head     != b[n].fmt_head     ||
+		    a[n].fmt_sector   != b[n].fmt_sector   ||
+		    a[n].fmt_secsize  != b[n].fmt_secsize) return 0;
+	}
+	return 1;
+}
+
+
 LDPUBLIC32 dsk_err_t  LDPUBLIC16 dsk_ltrackids(DSK_PDRIVER self,
 				const DSK_GEOMETRY *geom,
 				dsk_ltrack_t track,
@@ -30,6 +30,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 	DRV_CLASS *dc;
 	dsk_err_t e = DSK_ERR_UNKNOWN;
 	unsigned n, m;
+	unsigned long t0;
 	unsigned char *inv_buf = NULL;
 
 	if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
@@ -45,7 +46,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 	/* If we are storing the complement, generate complemented sector */
 	if (geom->dg_fm & RECMODE_COMPLEMENT)
 	{
-		inv_buf = dsk_malloc(geom->dg_secsize);
+		inv_buf = dsk_pool_alloc(self, geom->dg_secsize);
 	
 		if (!inv_buf) return DSK_ERR_NOMEM;
 		for (m = 0; m < geom->dg_secsize; m++) 
@@ -53,17 +54,16 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_pwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 		buf = inv_buf;
 	}
 
+	t0 = dsk_stats_begin(self, DSK_OP_WRITE, cylinder, head, sector);
 	for (n = 0; n < self->dr_retry_count; n++)
 	{
 		e = (dc->dc_write)(self,geom,buf,cylinder,head,sector); 
 		if (e == DSK_ERR_OK) self->dr_dirty = 1;
-		if (!DSK_TRANSIENT_ERROR(e)) 
-		{
-			if (inv_buf != NULL) dsk_free(inv_buf);
-			return e;
-		}
+		if (!DSK_TRANSIENT_ERROR(e)) break;
 	}
-	if (inv_buf != NULL) dsk_free(inv_buf);
+	dsk_stats_end(self, DSK_OP_WRITE, t0, cylinder, head, sector, e,
+		(n < self->dr_retry_count) ? n + 1 : n, geom->dg_secsize);
+	if (inv_buf != NULL) dsk_pool_free(self, inv_buf);
 	return e;
 }
 
@@ -96,6 +96,7 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY
         DRV_CLASS *dc;
 	dsk_err_t err = DSK_ERR_UNKNOWN;
 	unsigned n, m;
+	unsigned long t0;
 	unsigned char *inv_buf = NULL;
 
         if (!self || !geom || !buf || !self->dr_class) return DSK_ERR_BADPTR;
@@ -110,25 +111,24 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY
 	/* If we are storing the complement, generate complemented sector */
 	if (geom->dg_fm & RECMODE_COMPLEMENT)
 	{
-		inv_buf = dsk_malloc(sector_len);
+		inv_buf = dsk_pool_alloc(self, sector_len);
 	
 		if (!inv_buf) return DSK_ERR_NOMEM;
 		for (m = 0; m < sector_len; m++) 
 			inv_buf[m] = ~((char *)buf)[m];
 		buf = inv_buf;
 	}
+	t0 = dsk_stats_begin(self, DSK_OP_XWRITE, cylinder, head, sector);
 	for (n = 0; n < self->dr_retry_count; n++)
 	{
 		err = (dc->dc_xwrite)(self,geom,buf,cylinder,head, cyl_expect, 
                 	head_expect, sector, sector_len, deleted);
        		if (err == DSK_ERR_OK) self->dr_dirty = 1;
-		if (!DSK_TRANSIENT_ERROR(err)) 
-		{
-			if (inv_buf != NULL) dsk_free(inv_buf);
-			return err;
-		}
+		if (!DSK_TRANSIENT_ERROR(err)) break;
 	}
-	if (inv_buf != NULL) dsk_free(inv_buf);
+	dsk_stats_end(self, DSK_OP_XWRITE, t0, cylinder, head, sector, err,
+		(n < self->dr_retry_count) ? n + 1 : n, sector_len);
+	if (inv_buf != NULL) dsk_pool_free(self, inv_buf);
 	return err;
 }
                                                                                         
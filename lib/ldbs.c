@@ -21,6 +21,9 @@
  * OTHER DEALINGS IN THE SOFTWARE. */
 
 #define _CRT_SECURE_NO_WARNINGS
+#ifdef __linux__
+#define _GNU_SOURCE	/* for fallocate() */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +51,41 @@
 #define PATH_MAX _MAX_PATH
 #endif
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Block stores opened read-only are mapped into memory, where the system
+ * supports it, so that blocks can be read without going through stdio. */
+#ifndef LDBS_USE_MMAP
+# if defined(__unix__) || defined(__APPLE__)
+#  define LDBS_USE_MMAP 1
+# else
+#  define LDBS_USE_MMAP 0
+# endif
+#endif
+
+#if LDBS_USE_MMAP
+#include <sys/types.h>
+#include <sys/mman.h>
+#endif
+
+/* ldbs_compact() gives the new file the permissions of the old one, where
+ * the system has them */
+#ifndef LDBS_KEEP_MODE
+# if defined(__unix__) || defined(__APPLE__)
+#  define LDBS_KEEP_MODE 1
+# else
+#  define LDBS_KEEP_MODE 0
+# endif
+#endif
+
+#if LDBS_KEEP_MODE
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
 /**/
 #define FSEEK fseek
 #define FREAD fread
@@ -119,6 +157,31 @@ static size_t debug_fwrite(void *buf, size_t size, size_t count, FILE *fp, const
 #define HEADER_LEN 20		/* On-disk length of file header */
 #define BLOCKHEAD_LEN 20	/* On-disk length of block header */
 
+/* A sector block that may be used by more than one sector */
+typedef struct ldbs_shared
+{
+	LDBLOCKID blockid;
+	unsigned long refs;	/* Number of sectors using the block; 0 if  */
+				/* this entry is on the free list */
+	unsigned long hash;	/* Hash of the block contents, if 'hashed' */
+	int hashed;
+	long next_id;		/* Next entry in the same block ID chain */
+	long next_hash;		/* Next entry in the same contents chain */
+} LDBS_SHARED;
+
+/* The figures ldbs_get_stats() needs from one track header */
+typedef struct ldbs_trksum
+{
+	unsigned long key;	/* Cylinder and head, for sorting */
+	dsk_pcyl_t cyl;
+	dsk_phead_t head;
+	LDBLOCKID blockid;	/* Track header this was taken from */
+	unsigned short count;	/* Number of sectors */
+	unsigned short min_size, max_size;
+	unsigned char min_secid, max_secid;
+	int seen;
+} LDBS_TRKSUM;
+
 /* Implementation: This covers all the bits we need to manage an LDBS file
  */
 typedef struct ldbs
@@ -132,16 +195,54 @@ typedef struct ldbs
 			/* headers */
 #if LDBS_TEMP_IN_MEM
 	int ismem;
-	void **idmap;
-	int idmapmax;
+	struct ldbs_memslot **memtab;	/* Block table, in chunks */
+	unsigned long memchunks;	/* Number of chunks in memtab */
+	unsigned long memused;		/* Number of slots ever handed out */
+	LDBLOCKID memfree;		/* First slot in the free-slot list */
 #endif
 	LDBS_TRACKDIR *dir;
+	LDBS_TRACKHEAD *spare_trkh;	/* Released track header for reuse */
+	unsigned spare_cap;		/* Sector entries it has room for */
+	unsigned char *scratch;		/* Buffer for (de)serialising track */
+	size_t scratchlen;		/* headers */
+	int scratch_busy;		/* Scratch buffer is in use */
+	LDBLOCKID *scrub;		/* Blocks with free space to be blanked */
+	unsigned nscrub;		/* by the next ldbs_sync() */
+	unsigned maxscrub;
+	int scrub_all;			/* Blank everything at next sync */
+	int dedup;			/* Store identical sectors once */
+	int shared_ok;			/* Reference counts are up to date */
+	LDBS_SHARED *shared;		/* Reference-counted sector blocks */
+	unsigned long nshared;		/* Entries used in 'shared' */
+	unsigned long maxshared;	/* Entries allocated in 'shared' */
+	long *shared_id;		/* Hash chains by block ID... */
+	long *shared_bkt;		/* ...and by block contents */
+	unsigned long sharedbkt;	/* Length of both chain arrays */
+	long shared_free;		/* First unused entry in 'shared' */
+	LDBS_TRKSUM *trksum;		/* Track summaries, in track order */
+	unsigned ntrksum;		/* Entries used in 'trksum' */
+	unsigned maxtrksum;		/* Entries allocated in 'trksum' */
+	int modified;			/* Blocks have been written */
+	const unsigned char *map;	/* Read-only file mapped into memory, */
+	long maplen;			/* or NULL */
+	int closed;			/* File lost by ldbs_compact() */
 } LDBS;
 
+/* If ldbs_compact() can't reopen the file it has replaced, the store is 
+ * left closed, and all that can be done with it is ldbs_close() */
+#define CHECK_OPEN(s) if ((s)->closed) return DSK_ERR_SYSERR;
+
 static const unsigned char FREEBLOCK[4] = {0,0,0,0};
 static const unsigned char USEDBLOCK[4] = {0,1,0,1};
 
 static dsk_err_t ldbs_get_trackdir(PLDBS self, LDBS_TRACKDIR **pdir, LDBLOCKID blockid);
+static dsk_err_t ldbs_scratch(PLDBS self, size_t len, unsigned char **buf);
+static void ldbs_scratch_done(PLDBS self, unsigned char *buf);
+static dsk_err_t ldbs_getblock_s(PLDBS self, LDBLOCKID blockid, 
+			char type[4], unsigned char **buf, size_t *len);
+static void shared_reset(PLDBS self);
+static void sum_reset(PLDBS self);
+static void sum_remove(PLDBS self, dsk_pcyl_t cyl, dsk_phead_t head);
 static dsk_err_t ldbs_put_trackdir(PLDBS self, LDBS_TRACKDIR *dir, LDBLOCKID *blkid);
 
 
@@ -166,78 +267,104 @@ static dsk_err_t ldbs_put_trackdir(PLDBS self, LDBS_TRACKDIR *dir, LDBLOCKID *bl
  */
 #if LDBS_TEMP_IN_MEM
 
-/* Because a pointer may not fit into 32 bits, for an all-memory object
- * we will need to have a mapping between pointers and 32-bit ints.
- *
- * Map the null pointer to 0.
+/* Because a pointer may not fit into 32 bits, blocks in an all-memory 
+ * object are identified by their position in a block table. ID n is 
+ * slot n-1, and 0 is the null block. The table is allocated in chunks
+ * which never move, so a slot can be found in constant time however 
+ * large the store grows; slots released by ldbs_delblock() go on a 
+ * free-slot list and are handed out again before the table is grown.
  */
-static LDBLOCKID encode_ptr(LDBS *self, void *p)
+#define MEMCHUNK_SHIFT	8
+#define MEMCHUNK_SIZE	(1 << MEMCHUNK_SHIFT)	/* Slots per chunk */
+
+typedef struct ldbs_memslot
 {
-	int n;
-	void **p2;
+	void *ptr;		/* Block header + payload, NULL if free */
+	LDBLOCKID link;		/* Used slot: previous block in used list 
+				 * Free slot: next slot in free-slot list */
+} LDBS_MEMSLOT;
 
-	/* Map NULL to zero */
-	if (p == NULL) return 0;
-	/* If a pointer will fit in 32 bits, shove it in there */
-	if (sizeof(void *) <= 4)
-	{
-		return (long)p;
-	}
-	/* OK, we need to store a (probably 64-bit) pointer in a 32-bit long */
 
-	/* Create the ID map, if it doesn't already exist */
-	if (!self->idmap)
+static LDBS_MEMSLOT *mem_slot(LDBS *self, LDBLOCKID id)
+{
+	unsigned long n = (unsigned long)id - 1;
+
+	return &self->memtab[n >> MEMCHUNK_SHIFT][n & (MEMCHUNK_SIZE - 1)];
+}
+
+
+/* Allocate a block and a slot to hold it */
+static dsk_err_t mem_alloc(LDBS *self, size_t size, LDBLOCKID *result)
+{
+	LDBS_MEMSLOT *slot, **tab;
+	LDBLOCKID id;
+	void *p;
+
+	p = ldbs_malloc(sizeof(LDBS_BLOCKHEAD) + size);
+	if (!p) return DSK_ERR_NOMEM;
+
+	if (self->memfree)
 	{
-		self->idmap = ldbs_malloc(8 * sizeof(void *));
-		if (!self->idmap) return 0;
-		for (n = 0; n < 8; n++)
-		{
-			self->idmap[n] = NULL;	
-		}
-		self->idmapmax = 8;
+		id = self->memfree;
+		slot = mem_slot(self, id);
+		self->memfree = slot->link;
 	}
-
-	/* Is the suggested pointer already in the map? */
-	for (n = 0; n < self->idmapmax; n++)
+	else
 	{
-		if (self->idmap[n] == p) 
+		/* All the chunks are full. Add another one, growing
+		 * the table of chunks if necessary. */
+		if (self->memused == self->memchunks * MEMCHUNK_SIZE)
 		{
-			return n + 1;
-		}
-		if (self->idmap[n] == 0)
-		{
-			self->idmap[n] = p;
-			return n + 1;
+			if ((self->memchunks & (self->memchunks - 1)) == 0)
+			{
+				tab = ldbs_realloc(self->memtab, 
+					(self->memchunks ? 2 * self->memchunks
+					: 1) * sizeof(LDBS_MEMSLOT *));
+				if (!tab)
+				{
+					ldbs_free(p);
+					return DSK_ERR_NOMEM;
+				}
+				self->memtab = tab;
+			}
+			self->memtab[self->memchunks] = 
+				ldbs_malloc(MEMCHUNK_SIZE * sizeof(LDBS_MEMSLOT));
+			if (!self->memtab[self->memchunks])
+			{
+				ldbs_free(p);
+				return DSK_ERR_NOMEM;
+			}
+			++self->memchunks;
 		}
+		id = ++self->memused;
+		slot = mem_slot(self, id);
 	}
-	/* The map must be full. Double it. 
-	 * Note: The map will never decrease in size, because blocks once
-	 * allocated are never freed, only zeroed */
-	p2 = ldbs_realloc(self->idmap, 2 * self->idmapmax * sizeof(void *));
-	if (!p2) return 0;
-	for (n = self->idmapmax; n < self->idmapmax * 2; n++)
-	{
-		p2[n] = NULL;	
-	}
-	self->idmap = p2;
-	self->idmap[self->idmapmax] = p;
-	self->idmapmax *= 2;
-	return (self->idmapmax / 2) + 1;
+	slot->ptr  = p;
+	slot->link = LDBLOCKID_NULL;
+	*result = id;
+	return DSK_ERR_OK;
 }
 
 
-/* Decode an integer ID to a pointer */
-static void *decode_ptr(LDBS *self, long l)
+/* Free a block and put its slot on the free-slot list */
+static void mem_release(LDBS *self, LDBLOCKID id)
 {
-	if (l == 0) return NULL;
-	
-	/* If a pointer will fit in 32 bits, it was encoded thus */
-	if (sizeof(void *) <= 4) 
-	{
-		return (void *)l;
-	}
-	/* Otherwise look it up in the ID map */
-	return self->idmap[l - 1];
+	LDBS_MEMSLOT *slot = mem_slot(self, id);
+
+	ldbs_free(slot->ptr);
+	slot->ptr  = NULL;
+	slot->link = self->memfree;
+	self->memfree = id;
+}
+
+
+/* Decode an integer ID to a pointer. Returns NULL if the ID is not that
+ * of a live block. */
+static void *decode_ptr(LDBS *self, LDBLOCKID l)
+{
+	if (l == 0 || (unsigned long)l > self->memused) return NULL;
+
+	return mem_slot(self, l)->ptr;
 }
 
 
@@ -354,7 +481,7 @@ void ldbs_poke4(unsigned char *dest, unsigned long val)
 }
 
 
-unsigned long ldbs_peek4(unsigned char *src)
+unsigned long ldbs_peek4(const unsigned char *src)
 {
 	unsigned long u = src[3];
 	u = (u << 8) | src[2];
@@ -370,7 +497,7 @@ void ldbs_poke2(unsigned char *dest, unsigned short val)
 }
 
 
-unsigned short ldbs_peek2(unsigned char *src)
+unsigned short ldbs_peek2(const unsigned char *src)
 {
 	unsigned short u = src[1];
 	u = (u << 8) | src[0];
@@ -412,7 +539,8 @@ static dsk_err_t ldbs_read_header(PLDBS self)
 static dsk_err_t ldbs_read_blockhead(PLDBS self, LDBS_BLOCKHEAD *bh, 
 		LDBLOCKID blockid)
 {
-	unsigned char header[BLOCKHEAD_LEN];
+	unsigned char buf[BLOCKHEAD_LEN];
+	const unsigned char *header = buf;
 
 	if (blockid == LDBLOCKID_NULL) return DSK_ERR_BADPARM;
 
@@ -420,18 +548,33 @@ static dsk_err_t ldbs_read_blockhead(PLDBS self, LDBS_BLOCKHEAD *bh,
 	if (self->ismem)
 	{
 		void *ptr = decode_ptr(self, blockid);
+		if (!ptr) return DSK_ERR_CORRUPT;
 		memcpy(bh, ptr, sizeof(LDBS_BLOCKHEAD));
 		return DSK_ERR_OK;
 	}
 #endif
 
-	if (FSEEK(self->fp, blockid, SEEK_SET))
+	if (self->map)
 	{
-		return DSK_ERR_SYSERR;
+		/* Block IDs come from the file itself, so make sure this
+		 * one lies within it before looking */
+		if (blockid < HEADER_LEN || 
+		    blockid > self->maplen - BLOCKHEAD_LEN)
+		{
+			return DSK_ERR_CORRUPT;
+		}
+		header = self->map + blockid;
 	}
-	if (FREAD(header, 1, BLOCKHEAD_LEN, self->fp) < BLOCKHEAD_LEN) 
+	else
 	{
-		return DSK_ERR_SYSERR;
+		if (FSEEK(self->fp, blockid, SEEK_SET))
+		{
+			return DSK_ERR_SYSERR;
+		}
+		if (FREAD(buf, 1, BLOCKHEAD_LEN, self->fp) < BLOCKHEAD_LEN) 
+		{
+			return DSK_ERR_SYSERR;
+		}
 	}
 	if (memcmp(header, LDBS_BLOCKHEAD_MAGIC, 4))
 	{
@@ -446,6 +589,66 @@ static dsk_err_t ldbs_read_blockhead(PLDBS self, LDBS_BLOCKHEAD *bh,
 }
 
 
+/* Find the payload of a block whose header has just been read, if it can
+ * be got at directly. Sets *data to NULL if it has to be read from the
+ * file instead. */
+static dsk_err_t ldbs_direct(PLDBS self, LDBLOCKID blockid, 
+		const LDBS_BLOCKHEAD *bh, const unsigned char **data)
+{
+	*data = NULL;
+#if LDBS_TEMP_IN_MEM
+	if (self->ismem)
+	{
+		*data = (unsigned char *)decode_ptr(self, blockid) + 
+				sizeof(LDBS_BLOCKHEAD);
+		return DSK_ERR_OK;
+	}
+#endif
+	if (self->map)
+	{
+		/* The header has been checked already; now the payload */
+		if (bh->ulen < 0 || bh->ulen > self->maplen - 
+					(blockid + BLOCKHEAD_LEN))
+		{
+			return DSK_ERR_CORRUPT;
+		}
+		*data = self->map + blockid + BLOCKHEAD_LEN;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Map a read-only file into memory. If it can't be done, blocks are 
+ * read through stdio as usual. */
+static void ldbs_map(PLDBS self)
+{
+#if LDBS_USE_MMAP
+	void *p;
+
+	if (self->filesize < HEADER_LEN || 
+	    (unsigned long)self->filesize > (size_t)-1)
+	{
+		return;
+	}
+	p = mmap(NULL, (size_t)self->filesize, PROT_READ, MAP_SHARED,
+			fileno(self->fp), 0);
+	if (p == MAP_FAILED) return;
+	self->map    = p;
+	self->maplen = self->filesize;
+#endif
+}
+
+
+static void ldbs_unmap(PLDBS self)
+{
+#if LDBS_USE_MMAP
+	if (self->map) munmap((void *)self->map, (size_t)self->maplen);
+#endif
+	self->map    = NULL;
+	self->maplen = 0;
+}
+
+
 /* Write the header out */
 static dsk_err_t ldbs_write_header(PLDBS self)
 {
@@ -487,7 +690,10 @@ static dsk_err_t ldbs_write_blockhead(PLDBS self, LDBS_BLOCKHEAD *bh,
 	if (self->ismem)
 	{
 		void *ptr = decode_ptr(self, blockid);
+		if (!ptr) return DSK_ERR_CORRUPT;
 		memcpy(ptr, bh, sizeof(LDBS_BLOCKHEAD));
+		/* Keep the back-link of the next block up to date */
+		if (bh->next) mem_slot(self, bh->next)->link = blockid;
 		return DSK_ERR_OK;
 	}
 #endif
@@ -544,10 +750,7 @@ static dsk_err_t ldbs_newblock(PLDBS self, size_t size, LDBLOCKID *result)
 #if LDBS_TEMP_IN_MEM
 	if (self->ismem)
 	{
-		void *p = malloc(sizeof(LDBS_BLOCKHEAD) + size);
-		if (!p) return DSK_ERR_NOMEM;
-		*result = encode_ptr(self, p);
-		return DSK_ERR_OK;
+		return mem_alloc(self, size, result);
 	}
 #endif
 	*result = self->filesize;
@@ -609,6 +812,7 @@ dsk_err_t ldbs_new(PLDBS *result, const char *filename, const char *type)
 	/* temp.fp and temp.filename successfully populated. Write an empty
 	 * header */
 	temp.filesize = HEADER_LEN;
+	temp.shared_free = -1;
 	memcpy(temp.header.magic, LDBS_HEADER_MAGIC, 4);
 	memcpy(temp.header.subtype, st, 4);
 	temp.header.used = temp.header.trackdir = temp.header.free = LDBLOCKID_NULL;
@@ -622,7 +826,8 @@ dsk_err_t ldbs_new(PLDBS *result, const char *filename, const char *type)
  	 * This is a layering violation: In theory the block layer shouldn't 
 	 * know about the track directory. But it's more covenient to do it 
 	 * here than at the point the directory is accessed. */
-	if (!memcmp(st, LDBS_DSK_TYPE, 4) || !memcmp(st, LDBS_DSK_TYPE_V1, 4))
+	if (!memcmp(st, LDBS_DSK_TYPE, 4) || !memcmp(st, LDBS_DSK_TYPE_V1, 4) ||
+	    !memcmp(st, LDBS_DSK_TYPE_SHARED, 4))
 	{
 		/* Allow 176 entries: a disc with 84 tracks, 2 heads and all
 		 * optional blocks will have 173 directory entries, so this
@@ -663,8 +868,9 @@ dsk_err_t ldbs_new(PLDBS *result, const char *filename, const char *type)
 dsk_err_t ldbs_open(PLDBS *result, const char *filename, char *type, 
 		int *readonly)
 {
-	LDBS temp, *pres;
+	LDBS temp, *pres = NULL;
 	dsk_err_t err;
+	int rdonly = 0;
 
 	if (result == NULL || filename == NULL) return DSK_ERR_BADPTR;
 	*result = 0;
@@ -682,6 +888,7 @@ dsk_err_t ldbs_open(PLDBS *result, const char *filename, char *type,
 	{
 		if (readonly) *readonly = 1;
 		temp.fp = fopen(filename, "rb");
+		rdonly = 1;
 	}
 	if (!temp.fp) return DSK_ERR_SYSERR;
 	temp.filename = ldbs_malloc(1 + strlen(filename));
@@ -710,6 +917,7 @@ dsk_err_t ldbs_open(PLDBS *result, const char *filename, char *type,
 		else
 		{
 			temp.filesize = ftell(temp.fp);
+			if (rdonly) ldbs_map(&temp);
 		}
 	}
 	if (!err)
@@ -722,13 +930,16 @@ dsk_err_t ldbs_open(PLDBS *result, const char *filename, char *type,
  * know about the track directory. But it's more covenient to do it here. */
 	if (!err && temp.header.trackdir != LDBLOCKID_NULL &&
 		(!memcmp(temp.header.subtype, LDBS_DSK_TYPE, 4) ||
-		 !memcmp(temp.header.subtype, LDBS_DSK_TYPE_V1, 4)))
+		 !memcmp(temp.header.subtype, LDBS_DSK_TYPE_V1, 4) ||
+		 !memcmp(temp.header.subtype, LDBS_DSK_TYPE_SHARED, 4)))
 	{
 		temp.version = temp.header.subtype[3];
 		err = ldbs_get_trackdir(&temp, &temp.dir, temp.header.trackdir);
 	}
 	if (err)
 	{
+		if (pres) ldbs_free(pres);
+		ldbs_unmap(&temp);
 		fclose(temp.fp);
 		ldbs_free(temp.filename);
 		return err;
@@ -737,21 +948,98 @@ dsk_err_t ldbs_open(PLDBS *result, const char *filename, char *type,
 	{
 		memcpy(type, temp.header.subtype, 4);
 	}
+	/* We don't know what state the free space was left in, so check 
+	 * all of it at the first sync (unless we can't write to it anyway) */
+	temp.scrub_all = !rdonly;
+	temp.shared_free = -1;
 	memcpy(pres, &temp, sizeof(LDBS));
 	*result = pres;
 	return DSK_ERR_OK;
 }
 
 
+#define MAX_SCRUB 4096	/* Beyond this many, just blank the whole file */
+#define PUNCH_MIN 8192	/* Smallest range worth punching a hole for */
+
+/* Note that a block now has space in it that needs to be blanked. The
+ * block is checked again at the next sync, so it doesn't matter if it is 
+ * reused in the meantime. */
+static void mark_scrub(PLDBS self, LDBLOCKID blockid)
+{
+	LDBLOCKID *p;
+
+	if (self->istemp || self->scrub_all) return;
+	if (self->nscrub && self->scrub[self->nscrub - 1] == blockid) return;
+	if (self->nscrub >= self->maxscrub)
+	{
+		if (self->maxscrub >= MAX_SCRUB)
+		{
+			self->scrub_all = 1;
+			return;
+		}
+		p = ldbs_realloc(self->scrub, (self->maxscrub ? 
+			2 * self->maxscrub : 16) * sizeof(LDBLOCKID));
+		if (!p)
+		{
+			self->scrub_all = 1;
+			return;
+		}
+		self->scrub = p;
+		self->maxscrub = self->maxscrub ? 2 * self->maxscrub : 16;
+	}
+	self->scrub[self->nscrub++] = blockid;
+}
+
+
 /* Blank a range of bytes in a file */
 static dsk_err_t zero_range(PLDBS self, long pos, long len)
 {
+	static const unsigned char zeroes[512] = { 0 };
+	size_t n;
+
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+	/* On a large range, deallocate the space rather than writing to it;
+	 * it reads back as zeroes. Any writes still buffered must go first,
+	 * or they would land on top of the hole. */
+	if (len >= PUNCH_MIN && !fflush(self->fp) &&
+	    !fallocate(fileno(self->fp), 
+			FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len))
+	{
+		return DSK_ERR_OK;
+	}
+#endif
 	/* Seek to the first byte to remove */
 	if (FSEEK(self->fp, pos, SEEK_SET)) return DSK_ERR_SYSERR;
 	while (len)
 	{
-		if (fputc(0, self->fp) == EOF) return DSK_ERR_SYSERR;
-		--len;
+		n = (len > (long)sizeof(zeroes)) ? sizeof(zeroes) : (size_t)len;
+		if (FWRITE((void *)zeroes, 1, n, self->fp) < n) 
+			return DSK_ERR_SYSERR;
+		len -= (long)n;
+	}
+	return DSK_ERR_OK;
+}
+
+
+/* Blank the unused part of a block: all of it if the block is free,
+ * or whatever lies beyond the used length if not */
+static dsk_err_t scrub_block(PLDBS self, LDBLOCKID blockid)
+{
+	LDBS_BLOCKHEAD blockhead;
+	dsk_err_t err;
+
+	err = ldbs_read_blockhead(self, &blockhead, blockid);
+	if (err) return err;
+
+	if (!memcmp(blockhead.type, FREEBLOCK, 4))
+	{
+		return zero_range(self, blockid + BLOCKHEAD_LEN, 
+					blockhead.dlen);
+	}
+	if (blockhead.dlen > blockhead.ulen)
+	{
+		return zero_range(self, blockid + BLOCKHEAD_LEN + blockhead.ulen,
+					blockhead.dlen - blockhead.ulen);
 	}
 	return DSK_ERR_OK;
 }
@@ -763,16 +1051,20 @@ dsk_err_t ldbs_sync(PLDBS self)
 	dsk_err_t result = DSK_ERR_OK;
 
 	if (self == NULL) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
 
-	/* If there is a directory, write it */
-	if (self->dir)
+	/* If there is a directory, write it if it has changed */
+	if (self->dir && (self->dir->dirty || !self->header.trackdir))
 	{
 		result = ldbs_put_trackdir(self, self->dir,
 				&self->header.trackdir);
+		if (!result) self->dir->dirty = 0;
 	}
 
-	/* Scrub any blank areas (but don't bother on a temporary blockstore) */
-	if (!self->istemp)
+	/* Scrub any blank areas (but don't bother on a temporary blockstore).
+	 * Normally only the blocks that have gained free space since the 
+	 * last sync need looking at. */
+	if (!self->istemp && self->scrub_all)
 	{
 		LDBLOCKID blockid = self->header.free;
 
@@ -781,12 +1073,7 @@ dsk_err_t ldbs_sync(PLDBS self)
 			result = ldbs_read_blockhead(self, &blockhead, blockid);
 			if (result) break;
 
-			if (!memcmp(blockhead.type, FREEBLOCK, 4))
-			{
-				zero_range(self, 
-					blockid + BLOCKHEAD_LEN, 
-					blockhead.dlen);
-			}
+			scrub_block(self, blockid);
 			blockid = blockhead.next;
 		}
 		blockid = self->header.used;
@@ -796,16 +1083,21 @@ dsk_err_t ldbs_sync(PLDBS self)
 			result = ldbs_read_blockhead(self, &blockhead, blockid);
 			if (result) break;
 
-			if (blockhead.dlen > blockhead.ulen)
-			{
-				zero_range(self, 
-					blockid + BLOCKHEAD_LEN + blockhead.ulen, 
-					blockhead.dlen - blockhead.ulen);
-			}
+			scrub_block(self, blockid);
 			blockid = blockhead.next;
 		}
+		if (!result) self->scrub_all = 0;
+	}
+	else if (!self->istemp)
+	{
+		unsigned n;
 
+		for (n = 0; n < self->nscrub; n++)
+		{
+			scrub_block(self, self->scrub[n]);
+		}
 	}
+	self->nscrub = 0;
 
 	/* Flush the header if it needs updating */
 	if (self->header.dirty)
@@ -818,40 +1110,35 @@ dsk_err_t ldbs_sync(PLDBS self)
 /* Close block store. If it is temporary the backing file will be deleted. */
 dsk_err_t ldbs_close(PLDBS *self)
 {
-	LDBS_BLOCKHEAD blockhead;
 	dsk_err_t result = DSK_ERR_OK;
 
-	ldbs_sync(self[0]);
+	if (!self[0]->closed) ldbs_sync(self[0]);
 
 #if LDBS_TEMP_IN_MEM
 	/* Free all blocks */
 	if (self[0]->ismem)
 	{
-		LDBLOCKID blockid = self[0]->header.free;
-
-		while (0 != blockid)
-		{	
-			result = ldbs_read_blockhead(self[0], &blockhead, blockid);
-			if (result) break;
+		unsigned long n;
 
-			ldbs_free(decode_ptr(self[0], blockid));
-			blockid = blockhead.next;
+		for (n = 0; n < self[0]->memused; n++)
+		{
+			if (self[0]->memtab[n >> MEMCHUNK_SHIFT]
+				[n & (MEMCHUNK_SIZE - 1)].ptr)
+			{
+				ldbs_free(self[0]->memtab[n >> MEMCHUNK_SHIFT]
+					[n & (MEMCHUNK_SIZE - 1)].ptr);
+			}
 		}
-		blockid = self[0]->header.used;
-
-		while (0 != blockid)
+		for (n = 0; n < self[0]->memchunks; n++)
 		{
-			result = ldbs_read_blockhead(self[0], &blockhead, blockid);
-			if (result) break;
-
-			ldbs_free(decode_ptr(self[0], blockid));
-			blockid = blockhead.next;
+			ldbs_free(self[0]->memtab[n]);
 		}
-
+		if (self[0]->memtab) ldbs_free(self[0]->memtab);
 	}
 #endif
 
 	/* Close the backing file */
+	ldbs_unmap(self[0]);
 	if (self[0]->fp && fclose(self[0]->fp))
 	{
 		result = DSK_ERR_SYSERR;
@@ -867,9 +1154,11 @@ dsk_err_t ldbs_close(PLDBS *self)
 		}
 	}
 	if (self[0]->dir)   ldbs_free(self[0]->dir);
-#if LDBS_TEMP_IN_MEM
-	if (self[0]->idmap) ldbs_free(self[0]->idmap);
-#endif
+	if (self[0]->spare_trkh) ldbs_free(self[0]->spare_trkh);
+	if (self[0]->scrub) ldbs_free(self[0]->scrub);
+	if (self[0]->scratch) ldbs_free(self[0]->scratch);
+	shared_reset(self[0]);
+	sum_reset(self[0]);
 	ldbs_free(self[0]->filename);
 	ldbs_free(self[0]);
 	self[0] = NULL;
@@ -889,6 +1178,7 @@ dsk_err_t ldbs_get_blockinfo(PLDBS self, LDBLOCKID blockid, char type[4],
 	{
 		return DSK_ERR_BADPTR;
 	}
+	CHECK_OPEN(self)
 
 	/* Assume blockid is correct. */
 	err = ldbs_read_blockhead(self, &blockhead, blockid);
@@ -916,11 +1206,13 @@ dsk_err_t ldbs_getblock(PLDBS self, LDBLOCKID blockid, char type[4],
 {
 	dsk_err_t err;
 	LDBS_BLOCKHEAD blockhead;
+	const unsigned char *src;
 
 	if (self == NULL || len == NULL)
 	{
 		return DSK_ERR_BADPTR;
 	}
+	CHECK_OPEN(self)
 
 	/* Assume blockid is correct. */
 	err = ldbs_read_blockhead(self, &blockhead, blockid);
@@ -939,19 +1231,17 @@ dsk_err_t ldbs_getblock(PLDBS self, LDBLOCKID blockid, char type[4],
 		*len = blockhead.ulen;
 		return DSK_ERR_OVERRUN;
 	}
+	err = ldbs_direct(self, blockid, &blockhead, &src);
+	if (err) return err;
+
 	/* The buffer is too small. Read what can be read. */
  	if ((long)(*len) < blockhead.ulen)
 	{
-#if LDBS_TEMP_IN_MEM
-		if (self->ismem)
+		if (src)
 		{
-			unsigned char *src = decode_ptr(self, blockid);
-			memcpy(data, src + sizeof(LDBS_BLOCKHEAD), *len);
-			*len = blockhead.ulen;
-			return DSK_ERR_OVERRUN;
+			memcpy(data, src, *len);
 		}
-#endif
-		if (FREAD(data, 1, *len, self->fp) < *len)
+		else if (FREAD(data, 1, *len, self->fp) < *len)
 		{
 			return DSK_ERR_SYSERR;
 		}
@@ -962,14 +1252,11 @@ dsk_err_t ldbs_getblock(PLDBS self, LDBLOCKID blockid, char type[4],
 
 
 	*len = blockhead.ulen;
-#if LDBS_TEMP_IN_MEM
-	if (self->ismem)
+	if (src)
 	{
-		unsigned char *src = decode_ptr(self, blockid);
-		memcpy(data, src + sizeof(LDBS_BLOCKHEAD), *len);
+		memcpy(data, src, *len);
 		return DSK_ERR_OK;
 	}
-#endif
 	if (FREAD(data, 1, *len, self->fp) < *len)
 	{
 		return DSK_ERR_SYSERR;
@@ -992,11 +1279,13 @@ dsk_err_t ldbs_getblock_a(PLDBS self, LDBLOCKID blockid, char *type,
 {
 	dsk_err_t err;
 	LDBS_BLOCKHEAD blockhead;
+	const unsigned char *src;
 
 	if (self == NULL || len == NULL)
 	{
 		return DSK_ERR_BADPTR;
 	}
+	CHECK_OPEN(self)
 
 	/* Assume blockid is correct. */
 	err = ldbs_read_blockhead(self, &blockhead, blockid);
@@ -1013,26 +1302,61 @@ dsk_err_t ldbs_getblock_a(PLDBS self, LDBLOCKID blockid, char *type,
 	{
 		memcpy(type, blockhead.type, 4);
 	}
+	err = ldbs_direct(self, blockid, &blockhead, &src);
+	if (err) return err;
+
 	*data = malloc(blockhead.ulen);
 	if (!*data) return DSK_ERR_NOMEM;
 
 	*len = blockhead.ulen;
-#if LDBS_TEMP_IN_MEM
-	if (self->ismem)
+	if (src)
 	{
-		unsigned char *src = decode_ptr(self, blockid);
-		memcpy(*data, src + sizeof(LDBS_BLOCKHEAD), *len);
+		memcpy(*data, src, *len);
 		return DSK_ERR_OK;
 	}
-#endif
 	if (FREAD(*data, 1, *len, self->fp) < *len)
 	{
+		ldbs_free(*data);
+		*data = NULL;
 		return DSK_ERR_SYSERR;
 	}
 	return DSK_ERR_OK;
 }
 
 
+/* Get a pointer to a block in the store, without copying it */
+dsk_err_t ldbs_getblock_p(PLDBS self, LDBLOCKID blockid, char *type,
+					const void **data, size_t *len)
+{
+	dsk_err_t err;
+	LDBS_BLOCKHEAD blockhead;
+	const unsigned char *src;
+
+	if (self == NULL || data == NULL || len == NULL)
+	{
+		return DSK_ERR_BADPTR;
+	}
+	CHECK_OPEN(self)
+	err = ldbs_read_blockhead(self, &blockhead, blockid);
+	if (err) return err;
+
+	/* Block not found */
+	if (!memcmp(blockhead.type, FREEBLOCK, 4)) return DSK_ERR_CORRUPT;
+
+	err = ldbs_direct(self, blockid, &blockhead, &src);
+	if (err) return err;
+	if (!src) return DSK_ERR_NOTIMPL;
+
+	if (type != NULL)
+	{
+		memcpy(type, blockhead.type, 4);
+	}
+	*data = src;
+	*len  = blockhead.ulen;
+	return DSK_ERR_OK;
+}
+
+
 
 
 /* Add a new block to the store */
@@ -1192,71 +1516,480 @@ static dsk_err_t ldbs_rewriteblock(PLDBS self, LDBLOCKID blockid,
 	if (err) return err;
 
 	if (blockhead.dlen < (long)len) return DSK_ERR_OVERRUN;
+	if (blockhead.ulen > (long)len) mark_scrub(self, blockid);
 	blockhead.ulen = len;
 	err = ldbs_write_blockhead(self, &blockhead, blockid);
 	if (err) return err;
 	return ldbs_write_payload(self, blockid, data, len);
 }
 
-/* Replace a block -- in-place if possible, allocating a new block if 
- * not. 
- *
- * Parameters as for ldbs_addblock except that 'blockid' needs to be 
- * populated on entry with the ID of the block to replace.
- */
-dsk_err_t ldbs_putblock(PLDBS self, LDBLOCKID *blockid, const char *t,
-				const void *data, size_t len)
-{	
-	dsk_err_t err;
-	size_t cur_len;
-	char cur_type[5];
-	char type[5];
+/***************************************************************************/
+/* Shared sector blocks. When deduplication is on, a sector whose contents */
+/* match an existing sector block is stored by referring to that block    */
+/* rather than writing another copy, so one block may be used by several   */
+/* sectors. Reference counts are not stored in the file; they are rebuilt */
+/* from the track headers the first time a sector block is deleted or     */
+/* rewritten, and a block with no entry here has just the one user.       */
+/***************************************************************************/
 
-	if (t) 
-	{
-		memcpy(type, t, 4);
-	}
-	else
-	{
-		memcpy(type, USEDBLOCK, 4);
-	} 	
+#define SHARED_BUCKETS 256	/* Initial size of the hash tables */
 
-	/* Block does not exist, just add it */
-	if (0 == *blockid)
+/* FNV-1a. Any two blocks with the same hash are compared byte for byte
+ * before one is substituted for the other, so this need not be 
+ * cryptographically strong. */
+static unsigned long shared_hashfn(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	unsigned long h = 0x811C9DC5UL;
+
+	while (len--)
 	{
-		return ldbs_addblock(self, blockid, type, data, len);
+		h = ((h ^ *p++) * 0x01000193UL) & 0xFFFFFFFFUL;
 	}
+	return h;
+}
 
-	/* See if it exists with the correct type */
-	err = ldbs_getblock(self, *blockid, cur_type, NULL, &cur_len);
-	if (err && err != DSK_ERR_OVERRUN) return err;
+static unsigned long shared_idhash(LDBLOCKID id)
+{
+	unsigned long h = (unsigned long)id & 0xFFFFFFFFUL;
 
-	if (!memcmp(cur_type, type, 4) && cur_len >= len && len != 0)
+	h ^= (h >> 16);
+	h = (h * 0x45D9F3BUL) & 0xFFFFFFFFUL;
+	return h ^ (h >> 16);
+}
+
+/* Forget all reference counts; they will be recalculated when needed */
+static void shared_reset(PLDBS self)
+{
+	if (self->shared)     ldbs_free(self->shared);
+	if (self->shared_id)  ldbs_free(self->shared_id);
+	if (self->shared_bkt) ldbs_free(self->shared_bkt);
+	self->shared = NULL;
+	self->shared_id = self->shared_bkt = NULL;
+	self->nshared = self->maxshared = self->sharedbkt = 0;
+	self->shared_free = -1;
+	self->shared_ok = 0;
+}
+
+static LDBS_SHARED *shared_find(PLDBS self, LDBLOCKID blockid)
+{
+	long n;
+
+	if (!self->sharedbkt) return NULL;
+	for (n = self->shared_id[shared_idhash(blockid) & (self->sharedbkt - 1)];
+		n >= 0; n = self->shared[n].next_id)
 	{
-		return ldbs_rewriteblock(self, *blockid, data, len);
+		if (self->shared[n].blockid == blockid) return &self->shared[n];
 	}
+	return NULL;
+}
 
-	/* Oh dear. Type is different, or size doesn't conform. We need to
-	 * delete the old block and create a new one. */
-		
-	err = ldbs_delblock(self, *blockid);
-	*blockid = LDBLOCKID_NULL;
-	if (err) return err;
-	return ldbs_addblock(self, blockid, type, data, len);
+/* Add an entry to the content hash chains */
+static void shared_link_hash(PLDBS self, long n)
+{
+	long *bkt = &self->shared_bkt[self->shared[n].hash & 
+					(self->sharedbkt - 1)];
+
+	self->shared[n].next_hash = *bkt;
+	*bkt = n;
 }
 
+/* Remove an entry from the content hash chains */
+static void shared_unlink_hash(PLDBS self, LDBS_SHARED *e)
+{
+	long *p = &self->shared_bkt[e->hash & (self->sharedbkt - 1)];
 
+	if (!e->hashed) return;
+	while (*p >= 0 && &self->shared[*p] != e) p = &self->shared[*p].next_hash;
+	if (*p >= 0) *p = e->next_hash;
+	e->hashed = 0;
+}
 
-dsk_err_t ldbs_fsck(PLDBS self, FILE *logfile)
+static void shared_sethash(PLDBS self, LDBS_SHARED *e, unsigned long hash)
 {
-	dsk_err_t err;
-	LDBS_BLOCKHEAD blockhead;
-	LDBLOCKID pos = LDBLOCKID_NULL;
-	unsigned char buf[BLOCKHEAD_LEN];
+	shared_unlink_hash(self, e);
+	e->hash = hash;
+	e->hashed = 1;
+	shared_link_hash(self, (long)(e - self->shared));
+}
 
-	if (!self) return DSK_ERR_BADPTR;
+/* Make the bucket arrays big enough for all the entries, and rebuild 
+ * the chains */
+static dsk_err_t shared_rebucket(PLDBS self, unsigned long buckets)
+{
+	long *ids, *bkt;
+	unsigned long n;
 
-	/* Flush any pending changes */
+	ids = ldbs_malloc(buckets * sizeof(long));
+	bkt = ldbs_malloc(buckets * sizeof(long));
+	if (!ids || !bkt)
+	{
+		if (ids) ldbs_free(ids);
+		if (bkt) ldbs_free(bkt);
+		return DSK_ERR_NOMEM;
+	}
+	for (n = 0; n < buckets; n++) ids[n] = bkt[n] = -1;
+	if (self->shared_id)  ldbs_free(self->shared_id);
+	if (self->shared_bkt) ldbs_free(self->shared_bkt);
+	self->shared_id  = ids;
+	self->shared_bkt = bkt;
+	self->sharedbkt  = buckets;
+
+	for (n = 0; n < self->nshared; n++)
+	{
+		LDBS_SHARED *e = &self->shared[n];
+		long *p;
+
+		if (!e->refs) continue;	/* On the free list */
+		p = &ids[shared_idhash(e->blockid) & (buckets - 1)];
+		e->next_id = *p;
+		*p = (long)n;
+		if (e->hashed) shared_link_hash(self, (long)n);
+	}
+	return DSK_ERR_OK;
+}
+
+/* Start counting references to a block */
+static LDBS_SHARED *shared_new(PLDBS self, LDBLOCKID blockid)
+{
+	LDBS_SHARED *e;
+	long n, *p;
+
+	/* Keep the chains short */
+	if (self->shared_free < 0 && self->nshared >= self->sharedbkt &&
+	    shared_rebucket(self, self->sharedbkt ? 2 * self->sharedbkt :
+						SHARED_BUCKETS))
+	{
+		return NULL;
+	}
+	if (self->shared_free >= 0)
+	{
+		n = self->shared_free;
+		self->shared_free = self->shared[n].next_id;
+	}
+	else
+	{
+		if (self->nshared == self->maxshared)
+		{
+			unsigned long max = self->maxshared ? 
+				2 * self->maxshared : SHARED_BUCKETS;
+
+			e = ldbs_realloc(self->shared, max * sizeof(LDBS_SHARED));
+			if (!e) return NULL;
+			self->shared = e;
+			self->maxshared = max;
+		}
+		n = (long)(self->nshared++);
+	}
+	e = &self->shared[n];
+	e->blockid = blockid;
+	e->refs = 1;
+	e->hashed = 0;
+	e->next_hash = -1;
+	p = &self->shared_id[shared_idhash(blockid) & (self->sharedbkt - 1)];
+	e->next_id = *p;
+	*p = n;
+	return e;
+}
+
+/* The last user of a block has gone */
+static void shared_drop(PLDBS self, LDBS_SHARED *e)
+{
+	long n = (long)(e - self->shared);
+	long *p = &self->shared_id[shared_idhash(e->blockid) & 
+					(self->sharedbkt - 1)];
+
+	shared_unlink_hash(self, e);
+	while (*p >= 0 && *p != n) p = &self->shared[*p].next_id;
+	if (*p >= 0) *p = e->next_id;
+	e->refs = 0;
+	e->next_id = self->shared_free;
+	self->shared_free = n;
+}
+
+/* Hash the current contents of a block */
+static dsk_err_t shared_hashblock(PLDBS self, LDBLOCKID blockid, 
+				unsigned long *hash)
+{
+	unsigned char *buf;
+	size_t len;
+	char type[4];
+	dsk_err_t err;
+
+	err = ldbs_getblock_s(self, blockid, type, &buf, &len);
+	if (err) return err;
+	*hash = shared_hashfn(buf, len);
+	ldbs_scratch_done(self, buf);
+	return DSK_ERR_OK;
+}
+
+static dsk_err_t shared_count_track(PLDBS self, dsk_pcyl_t cyl, 
+		dsk_phead_t head, LDBS_TRACKHEAD *th, void *param)
+{
+	dsk_err_t *perr = (dsk_err_t *)param;
+	LDBS_SHARED *e;
+	unsigned long hash;
+	unsigned n;
+
+	for (n = 0; n < th->count; n++)
+	{
+		if (th->sector[n].blockid == LDBLOCKID_NULL) continue;
+		e = shared_find(self, th->sector[n].blockid);
+		if (e)
+		{
+			++e->refs;
+			continue;
+		}
+		e = shared_new(self, th->sector[n].blockid);
+		if (!e) *perr = DSK_ERR_NOMEM;
+		else if (self->dedup)
+		{
+			*perr = shared_hashblock(self, e->blockid, &hash);
+			if (!*perr) shared_sethash(self, e, hash);
+		}
+		if (*perr) return *perr;
+	}
+	return DSK_ERR_OK;
+}
+
+/* A sector block has gained a second user. Change the file type, so that
+ * LDBS implementations that don't know blocks can be shared will refuse
+ * the file rather than overwrite a shared block in place. */
+static void shared_mark(PLDBS self)
+{
+	if (memcmp(self->header.subtype, LDBS_DSK_TYPE, 4)) return;
+	memcpy(self->header.subtype, LDBS_DSK_TYPE_SHARED, 4);
+	self->version = self->header.subtype[3];
+	self->header.dirty = 1;
+}
+
+/* Make sure the reference counts are up to date */
+static dsk_err_t shared_ready(PLDBS self)
+{
+	dsk_err_t err, err2 = DSK_ERR_OK;
+
+	if (self->shared_ok) return DSK_ERR_OK;
+	/* Unless deduplication is on, or the file says it has shared 
+	 * blocks, every sector block has exactly one user and there is 
+	 * nothing to count */
+	if (!self->dedup && 
+	    memcmp(self->header.subtype, LDBS_DSK_TYPE_SHARED, 4))
+	{
+		return DSK_ERR_OK;
+	}
+	shared_reset(self);
+	self->shared_ok = 1;
+	if (!self->dir) return DSK_ERR_OK;
+
+	err = ldbs_all_tracks(self, shared_count_track, SIDES_ALT, &err2);
+	if (!err) err = err2;
+	if (err) shared_reset(self);
+	return err;
+}
+
+/* One fewer sector is using a block. Sets *keep if others still are. */
+static dsk_err_t shared_unref(PLDBS self, LDBLOCKID blockid, int *keep)
+{
+	LDBS_SHARED *e;
+	dsk_err_t err;
+
+	*keep = 0;
+	err = shared_ready(self);
+	if (err) return err;
+	e = shared_find(self, blockid);
+	if (!e) return DSK_ERR_OK;
+	if (e->refs > 1)
+	{
+		--e->refs;
+		*keep = 1;
+	}
+	else shared_drop(self, e);
+	return DSK_ERR_OK;
+}
+
+/* Store a new sector block, or find an identical one to reuse */
+static dsk_err_t shared_put(PLDBS self, LDBLOCKID *blockid, 
+			const char *type, const void *data, size_t len)
+{
+	unsigned long hash = shared_hashfn(data, len);
+	unsigned char *buf;
+	size_t blen;
+	char btype[4];
+	LDBS_SHARED *e;
+	dsk_err_t err;
+	long n;
+
+	err = shared_ready(self);
+	if (err) return err;
+
+	if (self->sharedbkt) 
+	{
+		for (n = self->shared_bkt[hash & (self->sharedbkt - 1)]; 
+			n >= 0; n = e->next_hash)
+		{
+			e = &self->shared[n];
+			if (e->hash != hash) continue;
+
+			err = ldbs_get_blockinfo(self, e->blockid, btype, &blen);
+			if (err) return err;
+			if (blen != len) continue;
+			err = ldbs_scratch(self, len, &buf);
+			if (err) return err;
+			err = ldbs_getblock(self, e->blockid, btype, buf, &blen);
+			if (!err && memcmp(buf, data, len)) err = DSK_ERR_NOTME;
+			ldbs_scratch_done(self, buf);
+			if (err == DSK_ERR_NOTME) continue;
+			if (err) return err;
+
+			++e->refs;
+			*blockid = e->blockid;
+			shared_mark(self);
+			return DSK_ERR_OK;
+		}
+	}
+	err = ldbs_addblock(self, blockid, type, data, len);
+	if (err) return err;
+
+	/* If it can't be indexed it just won't be shared */
+	e = shared_new(self, *blockid);
+	if (e) shared_sethash(self, e, hash);
+	return DSK_ERR_OK;
+}
+
+
+dsk_err_t ldbs_set_dedup(PLDBS self, int enable)
+{
+	unsigned long n, hash;
+	dsk_err_t err;
+
+	if (!self) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
+	if (self->dedup == (enable != 0)) return DSK_ERR_OK;
+	self->dedup = (enable != 0);
+	if (!self->dedup || !self->shared_ok) return DSK_ERR_OK;
+
+	/* Counts are already being kept. Index the contents too. */
+	for (n = 0; n < self->nshared; n++)
+	{
+		if (!self->shared[n].refs || self->shared[n].hashed) continue;
+		err = shared_hashblock(self, self->shared[n].blockid, &hash);
+		if (err) return err;
+		shared_sethash(self, &self->shared[n], hash);
+	}
+	return DSK_ERR_OK;
+}
+
+
+int ldbs_get_dedup(PLDBS self)
+{
+	if (!self) return 0;
+	return self->dedup;
+}
+
+
+/* Replace a block -- in-place if possible, allocating a new block if 
+ * not. 
+ *
+ * Parameters as for ldbs_addblock except that 'blockid' needs to be 
+ * populated on entry with the ID of the block to replace.
+ */
+dsk_err_t ldbs_putblock(PLDBS self, LDBLOCKID *blockid, const char *t,
+				const void *data, size_t len)
+{	
+	dsk_err_t err;
+	size_t cur_len;
+	char cur_type[5];
+	char type[5];
+	LDBS_SHARED *sh;
+
+	if (!self) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
+	if (t) 
+	{
+		memcpy(type, t, 4);
+	}
+	else
+	{
+		memcpy(type, USEDBLOCK, 4);
+	} 	
+	self->modified = 1;
+
+	/* If this is a track header, any summary of it is now out of date. 
+	 * ldbs_put_trackhead() makes a new one once it has been written. */
+	if (t) 
+	{
+		dsk_pcyl_t cyl;
+		dsk_phead_t head;
+
+		if (ldbs_decode_trackid(type, &cyl, &head)) 
+			sum_remove(self, cyl, head);
+	}
+
+	/* Block does not exist, just add it */
+	if (0 == *blockid)
+	{
+		if (self->dedup && type[0] == 'S' && len != 0 &&
+		    self->version >= 2)
+		{
+			return shared_put(self, blockid, type, data, len);
+		}
+		return ldbs_addblock(self, blockid, type, data, len);
+	}
+
+	/* See if it exists with the correct type */
+	err = ldbs_getblock(self, *blockid, cur_type, NULL, &cur_len);
+	if (err && err != DSK_ERR_OVERRUN) return err;
+
+	/* If other sectors are using this block, leave it to them and
+	 * give this one a block of its own */
+	sh = NULL;
+	if (cur_type[0] == 'S')
+	{
+		err = shared_ready(self);
+		if (err) return err;
+		sh = shared_find(self, *blockid);
+		if (sh && sh->refs > 1)
+		{
+			--sh->refs;
+			*blockid = LDBLOCKID_NULL;
+			return ldbs_putblock(self, blockid, t, data, len);
+		}
+	}
+
+	if (!memcmp(cur_type, type, 4) && cur_len >= len && len != 0)
+	{
+		err = ldbs_rewriteblock(self, *blockid, data, len);
+		if (!err && sh && sh->hashed)
+		{
+			if (self->dedup) 
+				shared_sethash(self, sh, shared_hashfn(data, len));
+			else	shared_unlink_hash(self, sh);
+		}
+		return err;
+	}
+
+	/* Oh dear. Type is different, or size doesn't conform. We need to
+	 * delete the old block and create a new one. */
+		
+	err = ldbs_delblock(self, *blockid);
+	*blockid = LDBLOCKID_NULL;
+	if (err) return err;
+	return ldbs_putblock(self, blockid, t, data, len);
+}
+
+
+
+dsk_err_t ldbs_fsck(PLDBS self, FILE *logfile)
+{
+	dsk_err_t err;
+	LDBS_BLOCKHEAD blockhead;
+	LDBLOCKID pos = LDBLOCKID_NULL;
+	unsigned char buf[BLOCKHEAD_LEN];
+
+	if (!self) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
+
+	/* Flush any pending changes */
 	if (self->header.dirty)
 	{
 		err = ldbs_write_header(self);
@@ -1270,6 +2003,8 @@ dsk_err_t ldbs_fsck(PLDBS self, FILE *logfile)
 	self->header.used = LDBLOCKID_NULL;
 	self->header.free = LDBLOCKID_NULL;
 	self->header.dirty = 1;
+	self->scrub_all = 1;
+	shared_reset(self);
 
 	/* See if there's another block header; if so, read it */
 	while (FREAD(buf, 1, BLOCKHEAD_LEN, self->fp) == BLOCKHEAD_LEN)
@@ -1347,12 +2082,53 @@ dsk_err_t ldbs_delblock(PLDBS self, LDBLOCKID blockid)
 	LDBLOCKID pos = LDBLOCKID_NULL;
 
 	if (!self) return DSK_ERR_BADPTR;	
+	CHECK_OPEN(self)
 	if (blockid == LDBLOCKID_NULL) return DSK_ERR_BADPARM;
+	self->modified = 1;
 
 	/* Load the requested block header */
 	err = ldbs_read_blockhead(self, &blockhead, blockid);
 	if (err) return err;
 
+	/* A shared sector block stays until its last user deletes it */
+	if (blockhead.type[0] == 'S')
+	{
+		int keep;
+
+		err = shared_unref(self, blockid, &keep);
+		if (err || keep) return err;
+	}
+
+#if LDBS_TEMP_IN_MEM
+	/* In memory, the used list is doubly linked, so the block can be
+	 * unlinked directly. Its memory is then released rather than 
+	 * being kept on the free list. */
+	if (self->ismem)
+	{
+		pos = mem_slot(self, blockid)->link;
+		if (pos)
+		{
+			err = ldbs_read_blockhead(self, &bh2, pos);
+			if (err) return err;
+			bh2.next = blockhead.next;
+			err = ldbs_write_blockhead(self, &bh2, pos);
+			if (err) return err;
+		}
+		else
+		{
+			self->header.used = blockhead.next;
+			self->header.dirty = 1;
+			if (blockhead.next) 
+			{
+				mem_slot(self, blockhead.next)->link = 
+					LDBLOCKID_NULL;
+			}
+		}
+		mem_release(self, blockid);
+		return DSK_ERR_OK;
+	}
+#endif
+
 	/* Walk the data chain removing any references to the selected 
 	 * block. */
 	pos = self->header.used;
@@ -1381,6 +2157,7 @@ dsk_err_t ldbs_delblock(PLDBS self, LDBLOCKID blockid)
 	blockhead.next = self->header.free;
 	err = ldbs_write_blockhead(self, &blockhead, blockid);
 	if (err) return err;
+	mark_scrub(self, blockid);
 	self->header.free = blockid;	
 	self->header.dirty = 1;
 	return DSK_ERR_OK;
@@ -1390,6 +2167,7 @@ dsk_err_t ldbs_delblock(PLDBS self, LDBLOCKID blockid)
 dsk_err_t ldbs_getroot(PLDBS self, LDBLOCKID *blockid)
 {
 	if (!self || !blockid) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
 
 	*blockid = self->header.trackdir;
 	return DSK_ERR_OK;
@@ -1400,6 +2178,7 @@ dsk_err_t ldbs_getroot(PLDBS self, LDBLOCKID *blockid)
 dsk_err_t ldbs_setroot(PLDBS self, LDBLOCKID blockid)
 {
 	if (!self) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
 
 	if (blockid != self->header.trackdir)
 	{
@@ -1416,6 +2195,13 @@ dsk_err_t ldbs_clear(PLDBS self)
 	LDBLOCKID blockid = self->header.used;
 	dsk_err_t err = DSK_ERR_OK;
 
+	CHECK_OPEN(self)
+	/* Everything is going, shared or not, and afterwards nothing will
+	 * be using anything */
+	shared_reset(self);
+	self->shared_ok = 1;
+	sum_reset(self);
+
 	/* For each block... */
 	while (0 != blockid)
 	{
@@ -1440,25 +2226,100 @@ dsk_err_t ldbs_clear(PLDBS self)
 	return err;
 }
 
-static LDBLOCKID remap(LDBLOCKID *map, unsigned maplen, LDBLOCKID id)
+/* Map of old block IDs to new ones, used when cloning. Open addressing
+ * with linear probing; the table is kept at most half full. */
+typedef struct ldbs_idmap
 {
-	unsigned n;
+	LDBLOCKID *key;		/* Old IDs; LDBLOCKID_NULL for an empty slot */
+	LDBLOCKID *value;	/* Corresponding new IDs */
+	unsigned long size;	/* Number of slots, a power of 2 */
+	unsigned long count;	/* Number of slots in use */
+} LDBS_IDMAP;
 
-	if (id == LDBLOCKID_NULL) 
+static unsigned long idmap_hash(LDBLOCKID id, unsigned long size)
+{
+	unsigned long h = (unsigned long)id & 0xFFFFFFFFUL;
+
+	h ^= (h >> 16);
+	h = (h * 0x45D9F3BUL) & 0xFFFFFFFFUL;
+	h ^= (h >> 16);
+	return h & (size - 1);
+}
+
+static dsk_err_t idmap_init(LDBS_IDMAP *map, unsigned long size)
+{
+	map->key   = ldbs_malloc(size * sizeof(LDBLOCKID));
+	map->value = ldbs_malloc(size * sizeof(LDBLOCKID));
+	if (!map->key || !map->value)
 	{
-/*		printf("remap(NULL)=NULL\n"); */
-		return LDBLOCKID_NULL;
+		if (map->key)   ldbs_free(map->key);
+		if (map->value) ldbs_free(map->value);
+		return DSK_ERR_NOMEM;
 	}
+	memset(map->key, 0, size * sizeof(LDBLOCKID));
+	map->size  = size;
+	map->count = 0;
+	return DSK_ERR_OK;
+}
 
-	for (n = 0; n < maplen; n += 2)
+static void idmap_free(LDBS_IDMAP *map)
+{
+	ldbs_free(map->key);
+	ldbs_free(map->value);
+}
+
+/* Find the slot that holds 'id', or the empty slot where it would go */
+static unsigned long idmap_slot(LDBS_IDMAP *map, LDBLOCKID id)
+{
+	unsigned long n = idmap_hash(id, map->size);
+
+	while (map->key[n] != LDBLOCKID_NULL && map->key[n] != id)
+	{
+		n = (n + 1) & (map->size - 1);
+	}
+	return n;
+}
+
+static dsk_err_t idmap_put(LDBS_IDMAP *map, LDBLOCKID oldid, LDBLOCKID newid)
+{
+	unsigned long n;
+
+	if (2 * (map->count + 1) > map->size)
 	{
-/*		printf("{%ld:%ld}", map[n], map[n+1]); */
-		if (map[n] == id) 
+		LDBS_IDMAP bigger;
+		dsk_err_t err = idmap_init(&bigger, 2 * map->size);
+
+		if (err) return err;
+		for (n = 0; n < map->size; n++)
 		{
-/*			printf("remap(%ld)=%ld\n", map[n], map[n+1]); */
-			return map[n+1];
+			if (map->key[n] != LDBLOCKID_NULL)
+			{
+				unsigned long m = idmap_slot(&bigger, map->key[n]);
+				bigger.key[m]   = map->key[n];
+				bigger.value[m] = map->value[n];
+			}
 		}
+		bigger.count = map->count;
+		idmap_free(map);
+		*map = bigger;
+	}
+	n = idmap_slot(map, oldid);
+	if (map->key[n] == LDBLOCKID_NULL) ++map->count;
+	map->key[n]   = oldid;
+	map->value[n] = newid;
+	return DSK_ERR_OK;
+}
+
+static LDBLOCKID remap(LDBS_IDMAP *map, LDBLOCKID id)
+{
+	unsigned long n;
+
+	if (id == LDBLOCKID_NULL) 
+	{
+		return LDBLOCKID_NULL;
 	}
+	n = idmap_slot(map, id);
+	if (map->key[n] == id) return map->value[n];
 #ifndef WIN16
 	fprintf(stderr, "Internal error: remap(%lx)=NULL\n", id); 
 #endif
@@ -1467,8 +2328,8 @@ static LDBLOCKID remap(LDBLOCKID *map, unsigned maplen, LDBLOCKID id)
 	return LDBLOCKID_NULL;
 }
 
-dsk_err_t remap_track_header(PLDBS self, unsigned char *th, unsigned thlen,
-				LDBLOCKID *mapping, unsigned maplen)
+static dsk_err_t remap_track_header(PLDBS self, unsigned char *th, 
+				unsigned thlen, LDBS_IDMAP *map)
 {
 	unsigned se_offset, se_len;
 	unsigned ns;
@@ -1497,107 +2358,138 @@ dsk_err_t remap_track_header(PLDBS self, unsigned char *th, unsigned thlen,
 		}	
 		id = ldbs_peek4(th + se_offset + 8 + ns * se_len);
 		if (id == LDBLOCKID_NULL) continue;
-		id = remap(mapping, maplen, id);
+		id = remap(map, id);
 		ldbs_poke4(th + se_offset + 8 + ns * se_len, id);
 	}
 	return DSK_ERR_OK;
 }
 
+/* Copy one block across, unless it has been copied already */
+static dsk_err_t clone_block(PLDBS source, PLDBS dest, LDBS_IDMAP *map,
+				LDBLOCKID blockid)
+{
+	LDBLOCKID newid = LDBLOCKID_NULL;
+	dsk_err_t err;
+	void *buf;
+	char type[4];
+	size_t len;
+
+	if (blockid == LDBLOCKID_NULL) return DSK_ERR_OK;
+	if (map->key[idmap_slot(map, blockid)] == blockid) return DSK_ERR_OK;
+
+	err = ldbs_getblock_a(source, blockid, type, &buf, &len);
+	if (err) return err;
+	err = ldbs_putblock(dest, &newid, type, buf, len);
+	ldbs_free(buf);
+	if (err) return err;
+	return idmap_put(map, blockid, newid);
+}
+
+typedef struct clone_param
+{
+	PLDBS dest;
+	LDBS_IDMAP *map;
+	dsk_err_t err;
+} CLONE_PARAM;
+
+/* Copy a track header and then its sectors */
+static dsk_err_t clone_track(PLDBS self, dsk_pcyl_t cyl, dsk_phead_t head,
+				LDBS_TRACKHEAD *th, void *param)
+{
+	CLONE_PARAM *cp = (CLONE_PARAM *)param;
+	LDBLOCKID blockid;
+	char type[4];
+	unsigned n;
+	dsk_err_t err;
+
+	ldbs_encode_trackid(type, cyl, head);
+	err = ldbs_trackdir_find(self->dir, type, &blockid);
+	if (!err) err = clone_block(self, cp->dest, cp->map, blockid);
+	for (n = 0; !err && n < th->count; n++)
+	{
+		err = clone_block(self, cp->dest, cp->map, 
+					th->sector[n].blockid);
+	}
+	if (err) cp->err = err;
+	return err;
+}
+
 /* Copy all blocks from one blockstore to another. 
  * The cloning process isn't just a matter of copying blocks from one file
  * to the other, because the track directory and track headers contain 
  * block IDs. So we do two passes: the first to migrate the blocks 
- * themselves, the second to fix up the block IDs. */
+ * themselves, the second to fix up the block IDs. 
+ *
+ * Blocks are written in the order a disc image is read: each track header
+ * followed by its sectors, in cylinder and head order; then any other 
+ * blocks that the track directory refers to; then whatever is left. */
 dsk_err_t ldbs_clone(PLDBS source, PLDBS dest)
 {
-	LDBLOCKID *mapping;
-	unsigned maplen, mapmax;
+	LDBS_IDMAP map;
 	LDBS_BLOCKHEAD blockhead;
 	LDBLOCKID blockid = source->header.used;
-	LDBLOCKID newid = LDBLOCKID_NULL;
 	dsk_err_t err = DSK_ERR_OK;
-	void *buf;
-	char type[4];
-	size_t len;
+	CLONE_PARAM cp;
 
-	/* Build a mapping of block IDs: old, new, old, new... */
-	mapmax = 400;	/* So 400 entries can map 200 IDs */
-	mapping = ldbs_malloc(mapmax * sizeof(LDBLOCKID));
-	if (!mapping) return DSK_ERR_NOMEM;
-	maplen = 0;
+	CHECK_OPEN(source)
+	CHECK_OPEN(dest)
+	err = idmap_init(&map, 512);
+	if (err) return err;
 
 	/* Delete everything out of the destination file. */
 	err = ldbs_clear(dest);
 	if (err) 
 	{
-		ldbs_free(mapping);
+		idmap_free(&map);
 		return err;
 	}
-	/* First, move the data blocks across. This happens to reverse 
-	 * their order, just to be fun. */
-	while (LDBLOCKID_NULL != blockid)
+	/* It gets the same type as the source, unless it ends up sharing
+	 * blocks where the source didn't */
+	memcpy(dest->header.subtype, source->header.subtype, 4);
+	dest->version = source->version;
+	dest->header.dirty = 1;
+	/* First, move the data blocks across, tracks first */
+	if (source->dir)
+	{
+		unsigned n;
+
+		cp.dest = dest;
+		cp.map  = &map;
+		cp.err  = DSK_ERR_OK;
+		err = ldbs_all_tracks(source, clone_track, SIDES_ALT, &cp);
+		if (!err) err = cp.err;
+		for (n = 0; !err && n < source->dir->count; n++)
+		{
+			err = clone_block(source, dest, &map, 
+					source->dir->entry[n].blockid);
+		}
+	}
+	while (!err && LDBLOCKID_NULL != blockid)
 	{
 	/* Load the block header so we know the next entry in the list */
 		err = ldbs_read_blockhead(source, &blockhead, blockid);
-		if (err) 
-		{
-			break;
-		}
-	/* Load the block proper */
-		err = ldbs_getblock_a(source, blockid, type, &buf, &len);
-		if (err) 
-		{
-			break;
-		}
-
-	/* Write it out to the destination file */	
-		newid = LDBLOCKID_NULL;	
-		err = ldbs_putblock(dest, &newid, type, buf, len);
-		ldbs_free(buf);
-		if (err) 
-		{
-			break;
-		}
-	/* Add (blockid, newid) to the mapping array */	
-		if (maplen == mapmax)
-		{
-			mapmax *= 2;
-			mapping = ldbs_realloc(mapping, 
-				mapmax * sizeof(LDBLOCKID));
-			if (!mapping) return DSK_ERR_NOMEM;
-		}
-/*
-fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid, 
-			isprint(type[0]) ? type[0] : '.',
-			isprint(type[1]) ? type[1] : '.',
-			isprint(type[2]) ? type[2] : '.',
-			isprint(type[3]) ? type[3] : '.', maplen);
-*/
-		mapping[maplen++] = blockid;
-		mapping[maplen++] = newid;
+		if (!err) err = clone_block(source, dest, &map, blockid);
 	/* And go to the next block */
 		blockid = blockhead.next;
 	}
 	if (err) 
 	{
-		ldbs_free(mapping);
+		idmap_free(&map);
 		return err;
 	}
 /* Remap the block IDs. The first one is the ID of the track directory. */
 	if (source->header.trackdir)
 	{
-		dest->header.trackdir = remap(mapping, maplen, 
-						source->header.trackdir);
+		dest->header.trackdir = remap(&map, source->header.trackdir);
 
 	}
 /* Up to now, ldbs_clone() has been working at blockstore level. If the 
  * file it is processing is a disc image, it now needs to remap the IDs 
  * in its directory and track headers */
 	if (!memcmp(source->header.subtype, LDBS_DSK_TYPE, 4) ||
-	    !memcmp(source->header.subtype, LDBS_DSK_TYPE_V1, 4))
+	    !memcmp(source->header.subtype, LDBS_DSK_TYPE_V1, 4) ||
+	    !memcmp(source->header.subtype, LDBS_DSK_TYPE_SHARED, 4))
 	{
-		dest->version = source->version;
-		memcpy(dest->header.subtype, source->header.subtype, 4);
 		if (dest->dir)
 		{
 			ldbs_free(dest->dir);
@@ -1613,8 +2505,7 @@ fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid,
 			for (n = 0; n < dest->dir->count; n++)
 			{
 				dest->dir->entry[n].blockid = 
-					remap(mapping, maplen, 
-						dest->dir->entry[n].blockid);	
+					remap(&map, dest->dir->entry[n].blockid);	
 /* If it's a track, we need to redo that track's header too */
 				if (dest->dir->entry[n].id[0] == 'T')
 				{
@@ -1629,13 +2520,13 @@ fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid,
 /* Remap the sector references within it... */
 					if (!err)
 					{
-						err = remap_track_header(dest, th, thlen, mapping, maplen);
+						err = remap_track_header(dest, th, thlen, &map);
 /* ... and save it */
 						if (!err) err = ldbs_rewriteblock(dest, 
 						  dest->dir->entry[n].blockid,
 						  th, thlen); 
+						ldbs_free(th);
 					}
-					ldbs_free(th);
 				}
 				if (err) break;
 			}
@@ -1647,8 +2538,169 @@ fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid,
 	{
 		err = ldbs_sync(dest);
 	}
-	memcpy(dest->header.subtype, source->header.subtype, 4);
-	ldbs_free(mapping);
+	idmap_free(&map);
+	/* Sectors that shared a block still do, but the counts built up
+	 * while copying don't know that */
+	shared_reset(dest);
+	return err;
+}
+
+/* Choose a name for a file alongside 'filename' that is not in use, by
+ * changing its last character (so it still fits in 8.3). If 'create' is 
+ * set, the file is created too, so that nothing else can take the name.
+ * 'buf' must have room for a copy of 'filename'. */
+static dsk_err_t ldbs_sidename(const char *filename, char *buf, int create)
+{
+	static const char subst[] = "$~0123456789";
+	size_t len = strlen(filename);
+	const char *s;
+	FILE *fp;
+#ifdef __linux__
+	int fd;
+#endif
+
+	if (!len) return DSK_ERR_BADPARM;
+	strcpy(buf, filename);
+	for (s = subst; *s; s++)
+	{
+		if (*s == filename[len - 1]) continue;
+		buf[len - 1] = *s;
+#ifdef __linux__
+		if (create)
+		{
+			fd = open(buf, O_WRONLY | O_CREAT | O_EXCL, 0666);
+			if (fd == -1) continue;
+			close(fd);
+			return DSK_ERR_OK;
+		}
+#endif
+		fp = fopen(buf, "rb");
+		if (fp)		/* Already exists */
+		{
+			fclose(fp);
+			continue;
+		}
+		if (create)
+		{
+			fp = fopen(buf, "wb");
+			if (!fp) return DSK_ERR_SYSERR;
+			fclose(fp);
+		}
+		return DSK_ERR_OK;
+	}
+	return DSK_ERR_SYSERR;
+}
+
+
+/* Rewrite a blockstore file without its free space. The compacted copy 
+ * goes into a new file alongside the original and is then renamed over 
+ * it. */
+dsk_err_t ldbs_compact(PLDBS self)
+{
+	PLDBS tmp;
+	char *tmpname, *bakname;
+	FILE *fp;
+	size_t len;
+	dsk_err_t err, err2;
+#if LDBS_KEEP_MODE
+	struct stat st;
+#endif
+
+	if (!self) return DSK_ERR_BADPTR;
+	CHECK_OPEN(self)
+#if LDBS_TEMP_IN_MEM
+	if (self->ismem) return DSK_ERR_OK;
+#endif
+	/* Don't go to all this trouble only to find we can't replace the
+	 * original (or when it's been opened read-only) */
+	if (self->map) return DSK_ERR_RDONLY;
+	fp = fopen(self->filename, "r+b");
+	if (!fp) return DSK_ERR_RDONLY;
+	fclose(fp);
+
+	err = ldbs_sync(self);
+	if (err) return err;
+
+	len = strlen(self->filename);
+	tmpname = ldbs_malloc(2 * (len + 1));
+	if (!tmpname) return DSK_ERR_NOMEM;
+	bakname = tmpname + len + 1;
+	err = ldbs_sidename(self->filename, tmpname, 1);
+	if (err)
+	{
+		ldbs_free(tmpname);
+		return err;
+	}
+
+	err = ldbs_new(&tmp, tmpname, self->header.subtype);
+	if (err)
+	{
+		remove(tmpname);
+		ldbs_free(tmpname);
+		return err;
+	}
+	err  = ldbs_clone(self, tmp);
+#if LDBS_KEEP_MODE
+	if (!err && (fstat(fileno(self->fp), &st) ||
+		     fchmod(fileno(tmp->fp), st.st_mode & 07777)))
+	{
+		err = DSK_ERR_SYSERR;
+	}
+#endif
+	err2 = ldbs_close(&tmp);
+	if (!err) err = err2;
+	if (err)
+	{
+		remove(tmpname);
+		ldbs_free(tmpname);
+		return err;
+	}
+	/* Swap the compacted copy in. Not every rename() will replace an
+	 * existing file; if this one won't, move the original aside first,
+	 * and put it back if the copy can't then take its place. The
+	 * original is not deleted until the copy is in. */
+	fclose(self->fp);
+	if (rename(tmpname, self->filename))
+	{
+		err = ldbs_sidename(self->filename, bakname, 0);
+		if (!err && rename(self->filename, bakname)) 
+		{
+			err = DSK_ERR_SYSERR;
+		}
+		if (err) remove(tmpname);
+		else if (rename(tmpname, self->filename))
+		{
+			err = DSK_ERR_SYSERR;
+			/* If the original can't be put back, leave both 
+			 * files in place */
+			if (!rename(bakname, self->filename)) remove(tmpname);
+		}
+		else remove(bakname);
+	}
+	ldbs_free(tmpname);
+	self->fp = fopen(self->filename, "r+b");
+	if (!self->fp)
+	{
+		self->closed = 1;
+		return DSK_ERR_SYSERR;
+	}
+	if (err) return err;
+
+	/* And pick up the new layout */
+	err = ldbs_read_header(self);
+	if (err) return err;
+	if (FSEEK(self->fp, 0, SEEK_END)) return DSK_ERR_SYSERR;
+	self->filesize = ftell(self->fp);
+	self->nscrub = 0;
+	shared_reset(self);
+	sum_reset(self);
+	if (self->dir)
+	{
+		ldbs_free(self->dir);
+		self->dir = NULL;
+		err = ldbs_get_trackdir(self, &self->dir, 
+				self->header.trackdir);
+	}
 	return err;
 }
 
@@ -1656,6 +2708,7 @@ fprintf(stderr, "%08lx -> %08lx %c%c%c%c maplen=%d\n", blockid, newid,
 
 
 
+
 /***************************************************************************/
 /************************* DISK IMAGE FUNCTIONS ****************************/
 /***************************************************************************/
@@ -1739,25 +2792,36 @@ static dsk_err_t ldbs_get_trackdir(PLDBS self, LDBS_TRACKDIR **pdir, LDBLOCKID b
 {
 	char dirtype[4];
 	size_t len = 0;
-	unsigned char *buf, *ptr;
+	const unsigned char *buf, *ptr;
+	void *copy = NULL;
 	LDBS_TRACKDIR *dir;
 	short ec, n;
 	dsk_err_t err;
 
-	/* Get size of root dir */
-	err = ldbs_getblock_a(self, blockid, dirtype, (void **)&buf, &len);
+	/* Use the root dir where it lies if possible, otherwise load it */
+	err = ldbs_getblock_p(self, blockid, dirtype, (const void **)&buf, &len);
+	if (err == DSK_ERR_NOTIMPL)
+	{
+		err = ldbs_getblock_a(self, blockid, dirtype, &copy, &len);
+		buf = copy;
+	}
 	if (err) return err;
 	/* Root dir not of type DIR1? Then bail */
 	if (memcmp(dirtype, LDBS_DIR_TYPE, 4)) 
 	{
-		ldbs_free(buf);
+		if (copy) ldbs_free(copy);
 		return DSK_ERR_NOTME;
 	}
+	if (len < 2)
+	{
+		if (copy) ldbs_free(copy);
+		return DSK_ERR_CORRUPT;
+	}
 	/* Length of disk structure = 2 + 8 * count of entries */
 	dir = ldbs_trackdir_alloc( (len - 2) / 8);	
 	if (!dir) 
 	{
-		ldbs_free(buf);
+		if (copy) ldbs_free(copy);
 		return DSK_ERR_NOMEM;
 	}
 	/* Get entry count */
@@ -1772,7 +2836,7 @@ static dsk_err_t ldbs_get_trackdir(PLDBS self, LDBS_TRACKDIR **pdir, LDBLOCKID b
 		memcpy(dir->entry[n].id, ptr, 4);
 		dir->entry[n].blockid = ldbs_peek4(ptr + 4);
 	}
-	ldbs_free(buf);
+	if (copy) ldbs_free(copy);
 	*pdir = dir;
 	return DSK_ERR_OK;
 }
@@ -1817,11 +2881,78 @@ static dsk_err_t ldbs_put_trackdir(PLDBS self, LDBS_TRACKDIR *dir, LDBLOCKID *bl
 }
 
 
+/* Get a buffer of at least 'len' bytes, and give it back with 
+ * ldbs_scratch_done(). The buffer belongs to the blockstore and is reused 
+ * from call to call. If it is already in use (for instance, by a caller
+ * further up that ended up back in the blockstore through a callback) 
+ * then a separate buffer is allocated instead. */
+static dsk_err_t ldbs_scratch(PLDBS self, size_t len, unsigned char **buf)
+{
+	unsigned char *p;
+
+	if (self->scratch_busy)
+	{
+		*buf = ldbs_malloc(len ? len : 1);
+		return (*buf) ? DSK_ERR_OK : DSK_ERR_NOMEM;
+	}
+	if (len > self->scratchlen || !self->scratch)
+	{
+		p = ldbs_realloc(self->scratch, len ? len : 1);
+		if (!p) return DSK_ERR_NOMEM;
+		self->scratch = p;
+		if (len > self->scratchlen) self->scratchlen = len;
+	}
+	self->scratch_busy = 1;
+	*buf = self->scratch;
+	return DSK_ERR_OK;
+}
+
+
+static void ldbs_scratch_done(PLDBS self, unsigned char *buf)
+{
+	if (!buf) return;
+	if (buf == self->scratch) self->scratch_busy = 0;
+	else ldbs_free(buf);
+}
+
+
+/* Load a block into a scratch buffer, which the caller must release with
+ * ldbs_scratch_done() if this succeeds */
+static dsk_err_t ldbs_getblock_s(PLDBS self, LDBLOCKID blockid, 
+			char type[4], unsigned char **buf, size_t *len)
+{
+	size_t bufsize = self->scratch_busy ? 0 : self->scratchlen;
+	dsk_err_t err;
+
+	err = ldbs_scratch(self, bufsize, buf);
+	if (err) return err;
+	err = ldbs_getblock(self, blockid, type, *buf, &bufsize);
+	/* The buffer was too small, or the block is empty */
+	if (err == DSK_ERR_OVERRUN && bufsize == 0) err = DSK_ERR_OK;
+	else if (err == DSK_ERR_OVERRUN)
+	{
+		ldbs_scratch_done(self, *buf);
+		err = ldbs_scratch(self, bufsize, buf);
+		if (err) return err;
+		err = ldbs_getblock(self, blockid, type, *buf, &bufsize);
+	}
+	if (err)
+	{
+		ldbs_scratch_done(self, *buf);
+		*buf = NULL;
+		return err;
+	}
+	*len = bufsize;
+	return DSK_ERR_OK;
+}
+
+
 dsk_err_t ldbs_get_trackhead(PLDBS self, LDBS_TRACKHEAD **trkh, 
 	dsk_pcyl_t cylinder, dsk_phead_t head)
 {
 	size_t n;
-	unsigned char *buf;
+	const unsigned char *buf;
+	unsigned char *sbuf = NULL;
 	size_t bufsize;
 	LDBLOCKID blkid;
 	dsk_err_t err;
@@ -1846,29 +2977,35 @@ dsk_err_t ldbs_get_trackhead(PLDBS self, LDBS_TRACKHEAD **trkh,
 		*trkh = 0;
 		return DSK_ERR_OK;
 	}
-	bufsize = 0;
-	err = ldbs_getblock_a(self, blkid, tbuf, (void **)&buf, &bufsize);
+	/* Parse the block where it lies if possible. Otherwise load it into
+	 * the scratch buffer, enlarging that if it isn't big enough */
+	err = ldbs_getblock_p(self, blkid, tbuf, (const void **)&buf, &bufsize);
+	if (err == DSK_ERR_NOTIMPL)
+	{
+		err = ldbs_getblock_s(self, blkid, tbuf, &sbuf, &bufsize);
+		buf = sbuf;
+	}
 	if (err) return err;
 
-	/* Track header must be at least 6 bytes */
-	if (bufsize < 6)
+	/* Track header must be at least 6 bytes (10 in V2) */
+	if (bufsize < 6 || (self->version >= 2 && bufsize < 10))
 	{
-		ldbs_free(buf);
+		ldbs_scratch_done(self, sbuf);
 		return DSK_ERR_CORRUPT;
 	}
 
 	/* Disk structure is loaded in buf */
 	if (self->version < 2)	/* Sector count is in different places */
 	{			/* in v1 and v2 files */
-		result = ldbs_trackhead_alloc(ldbs_peek2(buf));
+		result = ldbs_trackhead_reuse(self, ldbs_peek2(buf));
 	}
 	else
 	{
-		result = ldbs_trackhead_alloc(ldbs_peek2(buf + 4));
+		result = ldbs_trackhead_reuse(self, ldbs_peek2(buf + 4));
 	}
 	if (!result) 
 	{
-		ldbs_free(buf);
+		ldbs_scratch_done(self, sbuf);
 		return DSK_ERR_NOMEM;
 	}
 	if (self->version < 2)	/* V1 has fixed size track & sector headers */
@@ -1890,15 +3027,18 @@ dsk_err_t ldbs_get_trackhead(PLDBS self, LDBS_TRACKHEAD **trkh,
 		result->recmode  = buf[7];
 		result->gap3     = buf[8];
 		result->filler   = buf[9];
-		if (se_offset >= 12)
+		if (se_offset >= 12 && bufsize >= 12)
 		{
 			result->total_len = ldbs_peek2(buf + 10);
 		}
 	}
-	/* Indicated size exceeds actual size */
-	if (se_offset + result->count * se_size > bufsize)
+	/* Indicated size exceeds actual size, or is too small to hold the
+	 * fields we read */
+	if (se_offset + result->count * se_size > bufsize ||
+	    (result->count && se_size < 12))
 	{
-		ldbs_free(buf);
+		ldbs_scratch_done(self, sbuf);
+		ldbs_trackhead_release(self, result);
 		return DSK_ERR_CORRUPT;
 	}
 
@@ -1933,12 +3073,178 @@ dsk_err_t ldbs_get_trackhead(PLDBS self, LDBS_TRACKHEAD **trkh,
 			result->sector[n].datalen = (128 << result->sector[n].id_psh);
 		}
 	}
-	ldbs_free(buf);
+	ldbs_scratch_done(self, sbuf);
 	*trkh = result;
 	return DSK_ERR_OK;
 }
 
 
+/* Track summaries.
+ *
+ * ldbs_get_stats() needs only a few figures from each track header. 
+ * Rather than load every header each time it is called, a summary of 
+ * each track is kept in memory. The summaries are never saved: they are
+ * made from the track headers the first time they are wanted, and kept 
+ * up to date by ldbs_put_trackhead(). Writing a track header block any 
+ * other way throws its summary away, so it is made again next time.
+ *
+ * Each summary also records the block ID of the track header it came 
+ * from, so that if the directory is changed to point at another block
+ * the summary is made again.
+ */
+#define TRKSUM_KEY(c, h) (((unsigned long)(c) << 8) | ((h) & 0xFF))
+
+static void sum_reset(PLDBS self)
+{
+	if (self->trksum) ldbs_free(self->trksum);
+	self->trksum = NULL;
+	self->ntrksum = self->maxtrksum = 0;
+}
+
+
+/* Find the summary for a track, or where it would go if there isn't one */
+static int sum_find(PLDBS self, unsigned long key, unsigned *pos)
+{
+	unsigned lo = 0, hi = self->ntrksum, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (self->trksum[mid].key < key) lo = mid + 1;
+		else				 hi = mid;
+	}
+	*pos = lo;
+	return (lo < self->ntrksum && self->trksum[lo].key == key);
+}
+
+
+/* Get the summary for a track, adding an empty one if need be */
+static LDBS_TRKSUM *sum_get(PLDBS self, dsk_pcyl_t cyl, dsk_phead_t head)
+{
+	unsigned long key = TRKSUM_KEY(cyl, head);
+	unsigned pos, newmax;
+	LDBS_TRKSUM *ts;
+
+	if (sum_find(self, key, &pos)) return &self->trksum[pos];
+
+	if (self->ntrksum >= self->maxtrksum)
+	{
+		newmax = self->maxtrksum ? 2 * self->maxtrksum : 64;
+		ts = ldbs_realloc(self->trksum, newmax * sizeof(LDBS_TRKSUM));
+		if (!ts) return NULL;
+		self->trksum = ts;
+		self->maxtrksum = newmax;
+	}
+	ts = &self->trksum[pos];
+	memmove(ts + 1, ts, (self->ntrksum - pos) * sizeof(LDBS_TRKSUM));
+	++self->ntrksum;
+	memset(ts, 0, sizeof(*ts));
+	ts->key  = key;
+	ts->cyl  = cyl;
+	ts->head = head;
+	return ts;
+}
+
+
+static void sum_remove(PLDBS self, dsk_pcyl_t cyl, dsk_phead_t head)
+{
+	unsigned pos;
+
+	if (!sum_find(self, TRKSUM_KEY(cyl, head), &pos)) return;
+	--self->ntrksum;
+	memmove(&self->trksum[pos], &self->trksum[pos + 1], 
+		(self->ntrksum - pos) * sizeof(LDBS_TRKSUM));
+}
+
+
+/* Summarise a track header */
+static void sum_make(PLDBS self, LDBS_TRKSUM *ts, LDBLOCKID blockid,
+			const LDBS_TRACKHEAD *trkh)
+{
+	const LDBS_SECTOR_ENTRY *se;
+	unsigned short size;
+	unsigned n;
+
+	ts->blockid   = blockid;
+	ts->count     = trkh->count;
+	ts->min_size  = ts->max_size  = 0;
+	ts->min_secid = ts->max_secid = 0;
+	for (n = 0; n < trkh->count; n++)
+	{
+		se = &trkh->sector[n];
+		/* The length that ldbs_get_trackhead() would give. Version 1
+		 * headers don't store it. */
+		size = se->datalen;
+		if (self->version < 2 || !size) size = 128 << se->id_psh;
+
+		if (!n || size < ts->min_size) ts->min_size = size;
+		if (!n || size > ts->max_size) ts->max_size = size;
+		if (!n || se->id_sec < ts->min_secid) ts->min_secid = se->id_sec;
+		if (!n || se->id_sec > ts->max_secid) ts->max_secid = se->id_sec;
+	}
+}
+
+
+/* Bring the summaries into line with the track directory, rereading any 
+ * track header that doesn't have an up-to-date summary and dropping 
+ * summaries of tracks that have gone. */
+static dsk_err_t sum_check(PLDBS self)
+{
+	LDBS_TRACKDIR_ENTRY *de;
+	LDBS_TRACKHEAD *trkh;
+	LDBS_TRKSUM *ts;
+	dsk_pcyl_t cyl;
+	dsk_phead_t head;
+	unsigned n, m;
+	dsk_err_t err;
+
+	for (n = 0; n < self->ntrksum; n++) self->trksum[n].seen = 0;
+
+	for (n = 0; n < self->dir->count; n++)
+	{
+		de = &self->dir->entry[n];
+		if (de->blockid == LDBLOCKID_NULL ||
+		    !ldbs_decode_trackid(de->id, &cyl, &head))
+		{
+			continue;
+		}
+		ts = sum_get(self, cyl, head);
+		if (!ts) return DSK_ERR_NOMEM;
+		if (ts->blockid != de->blockid)
+		{
+			err = ldbs_get_trackhead(self, &trkh, cyl, head);
+			if (err) return err;
+			/* ldbs_get_trackhead() doesn't move anything, so ts
+			 * is still good */
+			if (!trkh) continue;
+			sum_make(self, ts, de->blockid, trkh);
+			ldbs_trackhead_release(self, trkh);
+		}
+		ts->seen = 1;
+	}
+	for (n = m = 0; n < self->ntrksum; n++)
+	{
+		if (self->trksum[n].seen) self->trksum[m++] = self->trksum[n];
+	}
+	self->ntrksum = m;
+	return DSK_ERR_OK;
+}
+
+
+/* A track header has been written; bring its summary up to date */
+static void sum_update(PLDBS self, const char *type, dsk_pcyl_t cyl, 
+			dsk_phead_t head, const LDBS_TRACKHEAD *trkh)
+{
+	LDBLOCKID blockid;
+	LDBS_TRKSUM *ts;
+
+	if (ldbs_trackdir_find(self->dir, type, &blockid)) return;
+	ts = sum_get(self, cyl, head);
+	/* If there's no room, there is no summary to be out of date */
+	if (ts) sum_make(self, ts, blockid, trkh);
+}
+
+
 dsk_err_t ldbs_put_trackhead(PLDBS self, const LDBS_TRACKHEAD *trkh, 
 				dsk_pcyl_t cylinder, dsk_phead_t head)
 {
@@ -1952,7 +3258,12 @@ dsk_err_t ldbs_put_trackhead(PLDBS self, const LDBS_TRACKHEAD *trkh,
 
 	ldbs_encode_trackid(type, cylinder, head);
 
-	if (trkh == NULL) return ldbs_putblock_d(self, type, NULL, 0);
+	if (trkh == NULL) 
+	{
+		err = ldbs_putblock_d(self, type, NULL, 0);
+		if (!err) sum_remove(self, cylinder, head);
+		return err;
+	}
 
 	if (self->version < 2)
 	{
@@ -1965,8 +3276,8 @@ dsk_err_t ldbs_put_trackhead(PLDBS self, const LDBS_TRACKHEAD *trkh,
 		se_size = 18;
 	}
 	bufsize = (trkh->count * se_size) + se_offset;	
-	buf = ldbs_malloc(bufsize);
-	if (!buf) return DSK_ERR_NOMEM;
+	err = ldbs_scratch(self, bufsize, &buf);
+	if (err) return err;
 
 	if (self->version < 2)
 	{
@@ -2019,8 +3330,8 @@ dsk_err_t ldbs_put_trackhead(PLDBS self, const LDBS_TRACKHEAD *trkh,
 		}
 	}
 	err = ldbs_putblock_d(self, type, buf, bufsize);
-
-	ldbs_free(buf);
+	ldbs_scratch_done(self, buf);
+	if (!err) sum_update(self, type, cylinder, head, trkh);
 	return err;
 }
 
@@ -2204,6 +3515,43 @@ LDBS_TRACKHEAD *ldbs_trackhead_alloc(unsigned entries)
 }
 
 
+/* Drivers that walk a disc track by track would otherwise allocate and 
+ * free a track header for each track. Instead, the blockstore keeps the 
+ * last header released and hands it out again if it is big enough. */
+LDBS_TRACKHEAD *ldbs_trackhead_reuse(PLDBS self, unsigned entries)
+{
+	LDBS_TRACKHEAD *result = self->spare_trkh;
+
+	if (!result || self->spare_cap < entries)
+	{
+		return ldbs_trackhead_alloc(entries);
+	}
+	self->spare_trkh = NULL;
+	self->spare_cap = 0;
+	memset(result, 0, sizeof(LDBS_TRACKHEAD) + 
+			entries * sizeof(LDBS_SECTOR_ENTRY));
+	result->count = entries;
+	return result;
+}
+
+
+void ldbs_trackhead_release(PLDBS self, LDBS_TRACKHEAD *trkh)
+{
+	if (!trkh) return;
+	/* Keep whichever of the two has room for more sectors. Once a header
+	 * has been handed out, all that is known of its size is that it 
+	 * holds 'count' entries. */
+	if (self->spare_trkh && self->spare_cap >= trkh->count)
+	{
+		ldbs_free(trkh);
+		return;
+	}
+	if (self->spare_trkh) ldbs_free(self->spare_trkh);
+	self->spare_trkh = trkh;
+	self->spare_cap = trkh->count;
+}
+
+
 LDBS_TRACKHEAD *ldbs_trackhead_realloc(LDBS_TRACKHEAD *t, unsigned short entries)
 {
 	size_t newsize = sizeof(LDBS_TRACKHEAD) + entries * sizeof(LDBS_SECTOR_ENTRY);
@@ -2569,54 +3917,62 @@ dsk_err_t ldbs_all_sectors(PLDBS self, LDBS_SECTOR_CALLBACK cbk,
 	return ldbs_all_tracks(self, sector_callback_wrap, sides, &p[0]);
 }
 
-static dsk_err_t track_stat_callback(PLDBS self, 
-		dsk_pcyl_t cyl, dsk_phead_t head, LDBS_TRACKHEAD *th,
-		void *param)
+/* Add one track to the statistics. Tracks are added in cylinder / head
+ * order. */
+static void track_stat(LDBS_STATS *stats, const LDBS_TRKSUM *ts)
 {
-	LDBS_STATS *stats = param;
-	unsigned n;
-
-	if (stats->drive_empty && th->count)
+	if (stats->drive_empty && ts->count)
 	{
 		stats->drive_empty = 0;
-		stats->min_cylinder = stats->max_cylinder = cyl;
-		stats->min_head     = stats->max_head     = head;
-		stats->min_spt      = stats->max_spt      = th->count;
-		stats->min_secid    = stats->max_secid = th->sector[0].id_sec;
-		stats->min_sector_size = stats->max_sector_size = 
-			th->sector[0].datalen;
-	}
-	if (cyl < stats->min_cylinder) stats->min_cylinder = cyl;
-	if (cyl > stats->max_cylinder) stats->max_cylinder = cyl;
-	if (head < stats->min_head) stats->min_head = head;
-	if (head > stats->max_head) stats->max_head = head;
-	if (th->count < stats->min_spt) stats->min_spt = th->count;
-	if (th->count > stats->max_spt) stats->max_spt = th->count;
-
-	for (n = 0; n < th->count; n++)
-	{
-		LDBS_SECTOR_ENTRY *se = &th->sector[n];
-		size_t secsize = se->datalen;
-
-		if (se->id_sec < stats->min_secid) stats->min_secid = se->id_sec;
-		if (se->id_sec > stats->max_secid) stats->max_secid = se->id_sec;
-		if (secsize < stats->min_sector_size) stats->min_sector_size = secsize;	
-		if (secsize > stats->max_sector_size) stats->max_sector_size = secsize;	
+		stats->min_cylinder = stats->max_cylinder = ts->cyl;
+		stats->min_head     = stats->max_head     = ts->head;
+		stats->min_spt      = stats->max_spt      = ts->count;
+		stats->min_secid    = ts->min_secid;
+		stats->max_secid    = ts->max_secid;
+		stats->min_sector_size = ts->min_size;
+		stats->max_sector_size = ts->max_size;
+	}
+	if (ts->cyl < stats->min_cylinder) stats->min_cylinder = ts->cyl;
+	if (ts->cyl > stats->max_cylinder) stats->max_cylinder = ts->cyl;
+	if (ts->head < stats->min_head) stats->min_head = ts->head;
+	if (ts->head > stats->max_head) stats->max_head = ts->head;
+	if (ts->count < stats->min_spt) stats->min_spt = ts->count;
+	if (ts->count > stats->max_spt) stats->max_spt = ts->count;
+
+	if (ts->count)
+	{
+		if (ts->min_secid < stats->min_secid) 
+			stats->min_secid = ts->min_secid;
+		if (ts->max_secid > stats->max_secid) 
+			stats->max_secid = ts->max_secid;
+		if (ts->min_size < stats->min_sector_size) 
+			stats->min_sector_size = ts->min_size;	
+		if (ts->max_size > stats->max_sector_size) 
+			stats->max_sector_size = ts->max_size;	
 	}
-
-
-	return DSK_ERR_OK;
 }
 
 
 dsk_err_t ldbs_get_stats(PLDBS self, LDBS_STATS *stats)
 {
+	dsk_err_t err;
+	unsigned n;
+
 	if (!self || !stats) return DSK_ERR_BADPTR;
 
 	memset(stats, 0, sizeof(*stats));
 	stats->drive_empty = 1;
 
-	return ldbs_all_tracks(self, track_stat_callback, SIDES_ALT, stats);
+	if (!self->dir) return DSK_ERR_NOTME;
+
+	err = sum_check(self);
+	if (err) return err;
+
+	for (n = 0; n < self->ntrksum; n++)
+	{
+		track_stat(stats, &self->trksum[n]);
+	}
+	return DSK_ERR_OK;
 }
 
 
@@ -52,7 +52,11 @@ DRV_CLASS dc_remote =
 	remote_option_set,
 	remote_option_get,
 	remote_trackids,
-	remote_rtread
+	remote_rtread,
+	NULL,		/* to_ldbs */
+	NULL,		/* from_ldbs */
+	NULL,		/* to_stream */
+	NULL		/* from_stream */
 };
 
 /* All classes of remote driver */
@@ -81,6 +85,14 @@ int implements(DSK_DRIVER *self, int function)
 	return 0;
 }
 
+/* Should sector data be sent compressed? Only if the server implements the 
+ * compressed version of the call, and hasn't already refused one. */
+static int use_zip(DSK_DRIVER *self, int function)
+{
+	if (self->dr_remote->rd_nozip) return 0;
+	return implements(self, function);
+}
+
 static dsk_err_t remote_lookup(DSK_DRIVER *self, const char *filename, 
 		char **fileout, char **outtype, char **outcomp)
 {
@@ -147,6 +159,21 @@ static dsk_err_t remote_lookup(DSK_DRIVER *self, const char *filename,
 	return DSK_ERR_NOTME;
 }
 
+/* Pass a packet to the transport, counting and timing it */
+static dsk_err_t remote_call(DSK_PDRIVER self, unsigned char *input,
+		int inp_len, unsigned char *output, int *out_len)
+{
+	dsk_err_t err;
+	unsigned long t0 = dsk_stats_begin(self, DSK_OP_RPC, -1, -1, -1);
+
+	err = (self->dr_remote->rd_class->rc_call)(self, input, inp_len,
+			output, out_len);
+	dsk_stats_end(self, DSK_OP_RPC, t0, -1, -1, -1, err, 1,
+			(unsigned long)inp_len + (err ? 0 : *out_len));
+	return err;
+}
+
+
 dsk_err_t remote_open(DSK_DRIVER *self, const char *filename)
 {
 	RPCFUNC function;
@@ -155,7 +182,7 @@ dsk_err_t remote_open(DSK_DRIVER *self, const char *filename)
 	dsk_err_t err = remote_lookup(self, filename, &outname, &outtype, &outcomp);
 
 	if (err) return err;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 	err = dsk_r_open(self, function, &self->dr_remote->rd_handle, 
 			 	outname, outtype, outcomp);
 	dsk_free(outname);
@@ -180,7 +207,7 @@ dsk_err_t remote_creat(DSK_DRIVER *self, const char *filename)
 	dsk_err_t err = remote_lookup(self, filename, &outname, &outtype, &outcomp);
 
 	if (err) return err;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 	err = dsk_r_creat(self, function, &self->dr_remote->rd_handle, 
 			 	outname, outtype, outcomp);
 	dsk_free(outname);
@@ -203,7 +230,7 @@ dsk_err_t remote_close(DSK_DRIVER *self)
 	dsk_err_t err;
 	RPCFUNC function;
 	if (self == NULL || self->dr_remote == NULL) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	/* Update the comment (if any) */
 	if (implements(self, RPC_DSK_SETCOMMENT))
@@ -231,11 +258,20 @@ dsk_err_t remote_read(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
                               dsk_phead_t head, dsk_psect_t sector)
 {
 	RPCFUNC function;
+	dsk_err_t err;
 	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_PREAD)) return DSK_ERR_NOTIMPL;
 
+	if (use_zip(self, RPC_DSK_ZPREAD))
+	{
+		err = dsk_r_zread(self, function, self->dr_remote->rd_handle,
+				geom, buf, cylinder, head, sector);
+		if (err != DSK_ERR_UNKRPC) return err;
+		/* The server doesn't do compression; don't ask it again */
+		self->dr_remote->rd_nozip = 1;
+	}
 	return dsk_r_read(self, function, self->dr_remote->rd_handle,
 			geom, buf, cylinder, head, sector);
 }
@@ -245,11 +281,19 @@ dsk_err_t remote_write(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
                               dsk_phead_t head, dsk_psect_t sector)
 {
 	RPCFUNC function;
+	dsk_err_t err;
 	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_PWRITE)) return DSK_ERR_NOTIMPL;
 
+	if (use_zip(self, RPC_DSK_ZPWRITE))
+	{
+		err = dsk_r_zwrite(self, function, self->dr_remote->rd_handle,
+				geom, buf, cylinder, head, sector);
+		if (err != DSK_ERR_UNKRPC) return err;
+		self->dr_remote->rd_nozip = 1;
+	}
 	return dsk_r_write(self, function, self->dr_remote->rd_handle,
 			geom, buf, cylinder, head, sector);
 }
@@ -262,7 +306,7 @@ dsk_err_t remote_format(DSK_DRIVER *self, DSK_GEOMETRY *geom,
 {
 	RPCFUNC function;
 	if (!self || !geom || !format || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_PFORMAT)) return DSK_ERR_NOTIMPL;
 	return dsk_r_format(self, function, self->dr_remote->rd_handle,
@@ -276,7 +320,7 @@ dsk_err_t remote_secid(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 {
 	RPCFUNC function;
 	if (!self || !geom || !result || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_PSECID)) return DSK_ERR_NOTIMPL;
 	return dsk_r_secid(self, function, self->dr_remote->rd_handle,
@@ -288,7 +332,7 @@ dsk_err_t remote_getgeom(DSK_DRIVER *self, DSK_GEOMETRY *geom)
 {
 	RPCFUNC function;
 	if (!self || !geom || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_GETGEOM)) return DSK_ERR_NOTIMPL;
 	return dsk_r_getgeom(self, function, self->dr_remote->rd_handle,
@@ -300,7 +344,7 @@ dsk_err_t remote_xseek(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 {
 	RPCFUNC function;
 	if (!self || !geom || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_PSEEK)) return DSK_ERR_NOTIMPL;
 	return dsk_r_pseek(self, function, self->dr_remote->rd_handle,
@@ -314,7 +358,7 @@ dsk_err_t remote_status(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 {
 	RPCFUNC function;
 	if (!self || !geom || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_DRIVE_STATUS)) return DSK_ERR_NOTIMPL;
 	return dsk_r_drive_status(self, function, self->dr_remote->rd_handle,
@@ -328,10 +372,19 @@ dsk_err_t remote_xread(DSK_DRIVER *self, const DSK_GEOMETRY *geom, void *buf,
 		      dsk_psect_t sector, size_t sector_size, int *deleted)
 {
 	RPCFUNC function;
+	dsk_err_t err;
 	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_XREAD)) return DSK_ERR_NOTIMPL;
+	if (use_zip(self, RPC_DSK_ZXREAD))
+	{
+		err = dsk_r_zxread(self, function, self->dr_remote->rd_handle,
+				geom, buf, cylinder, head, cyl_expected, 
+				head_expected, sector, sector_size, deleted);
+		if (err != DSK_ERR_UNKRPC) return err;
+		self->dr_remote->rd_nozip = 1;
+	}
 	return dsk_r_xread(self, function, self->dr_remote->rd_handle,
 			geom, buf, cylinder, head, cyl_expected, head_expected,
 			sector, sector_size, deleted);
@@ -347,10 +400,19 @@ dsk_err_t remote_xwrite(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 			dsk_psect_t sector, size_t sector_size, int deleted)
 {
 	RPCFUNC function;
+	dsk_err_t err;
 	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_XWRITE)) return DSK_ERR_NOTIMPL;
+	if (use_zip(self, RPC_DSK_ZXWRITE))
+	{
+		err = dsk_r_zxwrite(self, function, self->dr_remote->rd_handle,
+				geom, buf, cylinder, head, cyl_expected, 
+				head_expected, sector, sector_size, deleted);
+		if (err != DSK_ERR_UNKRPC) return err;
+		self->dr_remote->rd_nozip = 1;
+	}
 	return dsk_r_xwrite(self, function, self->dr_remote->rd_handle,
 			geom, buf, cylinder, head, cyl_expected, head_expected,
 			sector, sector_size, deleted);
@@ -362,10 +424,18 @@ dsk_err_t remote_tread(DSK_DRIVER *self, const DSK_GEOMETRY *geom, void *buf,
 		                     dsk_pcyl_t cylinder, dsk_phead_t head)
 {
 	RPCFUNC function;
+	dsk_err_t err;
 	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_PTREAD)) return DSK_ERR_NOTIMPL;
+	if (use_zip(self, RPC_DSK_ZPTREAD))
+	{
+		err = dsk_r_ztread(self, function, self->dr_remote->rd_handle,
+				geom, buf, cylinder, head);
+		if (err != DSK_ERR_UNKRPC) return err;
+		self->dr_remote->rd_nozip = 1;
+	}
 	return dsk_r_tread(self, function, self->dr_remote->rd_handle,
 			geom, buf, cylinder, head);
 	
@@ -376,10 +446,19 @@ dsk_err_t remote_xtread(DSK_DRIVER *self, const DSK_GEOMETRY *geom, void *buf,
 		        dsk_pcyl_t cyl_expected, dsk_phead_t head_expected)
 {
 	RPCFUNC function;
+	dsk_err_t err;
 	if (!self || !geom || !buf || !self->dr_remote) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_XTREAD)) return DSK_ERR_NOTIMPL;
+	if (use_zip(self, RPC_DSK_ZXTREAD))
+	{
+		err = dsk_r_zxtread(self, function, self->dr_remote->rd_handle,
+				geom, buf, cylinder, head, cyl_expected, 
+				head_expected);
+		if (err != DSK_ERR_UNKRPC) return err;
+		self->dr_remote->rd_nozip = 1;
+	}
 	return dsk_r_xtread(self, function, self->dr_remote->rd_handle,
 			geom, buf, cylinder, head, cyl_expected, 
 			head_expected);
@@ -390,7 +469,7 @@ dsk_err_t remote_option_enum(DSK_DRIVER *self, int idx, char **optname)
 {
 	RPCFUNC function;
 	if (!self || !optname) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_OPTION_ENUM)) return DSK_ERR_NOTIMPL;
 	return dsk_r_option_enum(self, function, self->dr_remote->rd_handle,
@@ -402,15 +481,20 @@ dsk_err_t remote_option_set(DSK_DRIVER *self, const char *optname, int value)
 {
 	RPCFUNC function;
 	if (!self || !optname) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
-/* We also support this option, which does not show up in dsk_option_enum
+/* We also support these options, which do not show up in dsk_option_enum
  * (because it would be quite tricky to get right) */
 	if (!strcmp(optname, "REMOTE:TESTING"))
 	{
 		self->dr_remote->rd_testing = value;
 		return DSK_ERR_OK;
 	}
+	if (!strcmp(optname, "REMOTE:COMPRESS"))
+	{
+		self->dr_remote->rd_nozip = !value;
+		return DSK_ERR_OK;
+	}
 
 	if (!implements(self, RPC_DSK_OPTION_SET)) return DSK_ERR_NOTIMPL;
 	return dsk_r_option_set(self, function, self->dr_remote->rd_handle,
@@ -421,13 +505,18 @@ dsk_err_t remote_option_get(DSK_DRIVER *self, const char *optname, int *value)
 {
 	RPCFUNC function;
 	if (!self || !optname || !value) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!strcmp(optname, "REMOTE:TESTING"))
 	{
 		*value = self->dr_remote->rd_testing;
 		return DSK_ERR_OK;
 	}
+	if (!strcmp(optname, "REMOTE:COMPRESS"))
+	{
+		*value = !self->dr_remote->rd_nozip;
+		return DSK_ERR_OK;
+	}
 
 	if (!implements(self, RPC_DSK_OPTION_GET)) return DSK_ERR_NOTIMPL;
 	return dsk_r_option_get(self, function, self->dr_remote->rd_handle,
@@ -440,7 +529,7 @@ dsk_err_t remote_trackids(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 {
 	RPCFUNC function;
 	if (!self || !geom || !count || !result) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_TRACKIDS)) return DSK_ERR_NOTIMPL;
 	return dsk_r_trackids(self, function, self->dr_remote->rd_handle,
@@ -454,7 +543,7 @@ dsk_err_t remote_rtread(DSK_DRIVER *self, const DSK_GEOMETRY *geom,
 {
 	RPCFUNC function;
 	if (!self || !geom || !buf) return DSK_ERR_BADPTR;
-	function = self->dr_remote->rd_class->rc_call;
+	function = remote_call;
 
 	if (!implements(self, RPC_DSK_RTREAD)) return DSK_ERR_NOTIMPL;
 	return dsk_r_rtread(self, function, self->dr_remote->rd_handle,
@@ -34,6 +34,7 @@ typedef struct remote_data
 	unsigned *rd_functions;	/* Implemented functions */
 	char *rd_name;		/* Remote system name */
 	unsigned rd_testing;	/* Disable optimisations for testing? */
+	unsigned rd_nozip;	/* Send sector data uncompressed? */
 } REMOTE_DATA;
 
 typedef struct remote_class
@@ -390,6 +390,178 @@ dsk_err_t dsk_r_xtread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
 }
 
 
+/* Compressed-payload equivalents of the functions above. The sector data
+ * go over the wire as a ZBUFFER (see rpcfuncs.h) */
+dsk_err_t dsk_r_zread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder,
+                              dsk_phead_t head, dsk_psect_t sector)
+{
+	unsigned char ibuf[SMALLBUF], *iptr = ibuf;
+	unsigned char obuf[LARGEBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+	size_t len = geom->dg_secsize;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_ZPREAD);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);      if (err) return err;
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_ENC_ALL);  if (err) return err;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);	   if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, sector);       if (err) return err;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
+	if (err2 == DSK_ERR_UNKRPC) return err2;
+	err = dsk_unpack_zbytes(&optr, &olen, buf, &len);  if (err) return err;
+	return err2;
+}
+
+
+dsk_err_t dsk_r_zwrite(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
+					  dsk_phead_t head, dsk_psect_t sector)
+{
+	unsigned char ibuf[LARGEBUF], *iptr = ibuf;
+	unsigned char obuf[SMALLBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_ZPWRITE);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);	   if (err) return err;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);		   if (err) return err;
+	err = dsk_pack_zbytes(&iptr, &ilen, buf, geom->dg_secsize, RPC_ENC_ALL); if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, sector);      if (err) return err;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
+	return err2;
+}
+
+
+dsk_err_t dsk_r_zxread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_pcyl_t cyl_expected, 
+		dsk_phead_t head_expected, dsk_psect_t sector, 
+		size_t sector_size, int *deleted)
+{
+	unsigned char ibuf[SMALLBUF], *iptr = ibuf;
+	unsigned char obuf[LARGEBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+	int32 del = deleted ? *deleted : 0;
+	size_t len = sector_size;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_ZXREAD);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);      if (err) return err;
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_ENC_ALL);  if (err) return err;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);	   if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cyl_expected); if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head_expected);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, sector);       if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, sector_size);  if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, del);          if (err) return err;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
+	if (err2 == DSK_ERR_UNKRPC) return err2;
+	err = dsk_unpack_zbytes(&optr, &olen, buf, &len);  if (err) return err;
+	err = dsk_unpack_i32  (&optr, &olen, &del);        if (err) return err;
+	if (deleted) *deleted = del;
+	return err2;
+}
+
+
+dsk_err_t dsk_r_zxwrite(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_pcyl_t cyl_expected, 
+		dsk_phead_t head_expected, dsk_psect_t sector, 
+		size_t sector_size, int deleted)
+{
+	unsigned char ibuf[LARGEBUF], *iptr = ibuf;
+	unsigned char obuf[SMALLBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_ZXWRITE);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);  if (err) return err;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);	   if (err) return err;
+	err = dsk_pack_zbytes(&iptr, &ilen, buf, sector_size, RPC_ENC_ALL); if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cyl_expected); if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head_expected);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, sector);       if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, sector_size);  if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, deleted);      if (err) return err;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
+	return err2;
+}
+
+
+dsk_err_t dsk_r_ztread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder, 
+		dsk_phead_t head)
+{
+	unsigned char ibuf[SMALLBUF], *iptr = ibuf;
+	unsigned char obuf[LARGEBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+	size_t len = geom->dg_secsize * geom->dg_sectors;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_ZPTREAD);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);	   if (err) return err;
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_ENC_ALL);  if (err) return err;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);	   if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) return err;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
+	if (err2 == DSK_ERR_UNKRPC) return err2;
+	err = dsk_unpack_zbytes(&optr, &olen, buf, &len);  if (err) return err;
+	return err2;
+}
+
+
+dsk_err_t dsk_r_zxtread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder, 
+		dsk_phead_t head, dsk_pcyl_t cyl_expected, 
+		dsk_phead_t head_expected)
+{
+	unsigned char ibuf[SMALLBUF], *iptr = ibuf;
+	unsigned char obuf[LARGEBUF], *optr = obuf;
+	dsk_err_t err;
+	int ilen = sizeof ibuf;
+	int olen = sizeof obuf;
+	dsk_err_t err2;
+	size_t len = geom->dg_secsize * geom->dg_sectors;
+
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_DSK_ZXTREAD);if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, nDriver);	   if (err) return err;
+	err = dsk_pack_i16   (&iptr, &ilen, RPC_ENC_ALL);  if (err) return err;
+	err = dsk_pack_geom  (&iptr, &ilen, geom);	   if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cylinder);     if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head);         if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, cyl_expected); if (err) return err;
+	err = dsk_pack_i32   (&iptr, &ilen, head_expected);if (err) return err;
+	err = (*func)(self, ibuf, iptr - ibuf, obuf, &olen);	   if (err) return err;
+	err = dsk_unpack_err  (&optr, &olen, &err2);	   if (err) return err;
+	if (err2 == DSK_ERR_UNKRPC) return err2;
+	err = dsk_unpack_zbytes(&optr, &olen, buf, &len);  if (err) return err;
+	return err2;
+}
+
+
 dsk_err_t dsk_r_option_enum(DSK_DRIVER *self, RPCFUNC func, unsigned nDriver,
 		int idx, char **optname)
 {
@@ -77,6 +77,36 @@ typedef unsigned long  int32;
 #define RPC_DSK_PROPERTIES      139
 #define RPC_DSK_GETCOMMENT	140
 #define RPC_DSK_SETCOMMENT	141
+/* Variants of PREAD, XREAD, PWRITE, XWRITE, PTREAD and XTREAD in which the
+ * sector data are sent as a ZBUFFER (see below) rather than a BUFFER */
+#define RPC_DSK_ZPREAD		142
+#define RPC_DSK_ZXREAD		143
+#define RPC_DSK_ZPWRITE		144
+#define RPC_DSK_ZXWRITE		145
+#define RPC_DSK_ZPTREAD		146
+#define RPC_DSK_ZXTREAD		147
+
+/* Payload encodings used in a ZBUFFER. A ZBUFFER is packed as:
+ *
+ *	INT16	encoding
+ *	INT32	length of the decoded data
+ *	BUFFER	encoded data
+ *
+ * RAW:  The data, unchanged.
+ * FILL: A single byte, repeated to fill the decoded length.
+ * RLE:  A sequence of blocks, each starting with an INT16. If the top bit
+ *       is set, the bottom 15 bits are a repeat count and one byte follows.
+ *       Otherwise it is a count of literal bytes, which follow it.
+ *
+ * Whoever requests the data passes an INT16 bitmap of the encodings it 
+ * will accept (bit n set => encoding n accepted). RAW is always acceptable.
+ */
+#define RPC_ENC_RAW		0
+#define RPC_ENC_FILL		1
+#define RPC_ENC_RLE		2
+
+#define RPC_ENC_ALL		((1 << RPC_ENC_RAW) | (1 << RPC_ENC_FILL) | \
+				 (1 << RPC_ENC_RLE))
 
 typedef dsk_err_t (*RPCFUNC)(DSK_PDRIVER pDriver,
 			unsigned char *input,  int inp_len,
@@ -94,6 +124,9 @@ dsk_err_t dsk_pack_geom  (unsigned char **output, int *out_len,
 				const DSK_GEOMETRY *g);
 dsk_err_t dsk_pack_format(unsigned char **output, int *out_len, 
 				const DSK_FORMAT *f);
+dsk_err_t dsk_pack_zbytes(unsigned char **output, int *out_len, 
+				const unsigned char *buf, size_t len, 
+				int16 accept);
 
 /* RPC unpack functions */
 dsk_err_t dsk_unpack_err   (unsigned char **input, int *inp_len, dsk_err_t *e);
@@ -107,6 +140,9 @@ dsk_err_t dsk_unpack_string(unsigned char **input, int *inp_len, char **buf);
 dsk_err_t dsk_unpack_geom  (unsigned char **input, int *inp_len, 
 				DSK_GEOMETRY *g);
 dsk_err_t dsk_unpack_format(unsigned char **input, int *inp_len, DSK_FORMAT *f);
+/* On entry *len is the size of buf; on return it is the decoded length */
+dsk_err_t dsk_unpack_zbytes(unsigned char **input, int *inp_len, 
+				unsigned char *buf, size_t *len);
 
 /* RPC client functions */
 dsk_err_t dsk_r_open (DSK_PDRIVER self, RPCFUNC func, unsigned int *nDriver, 
@@ -171,6 +207,32 @@ dsk_err_t dsk_r_get_comment(DSK_DRIVER *self, RPCFUNC func, unsigned nDriver,
 dsk_err_t dsk_r_set_comment(DSK_DRIVER *self, RPCFUNC func, unsigned nDriver,
 		const char *optname);
 
+/* Compressed-payload versions of the above. These return DSK_ERR_UNKRPC
+ * if the server does not understand them. */
+dsk_err_t dsk_r_zread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t dsk_r_zwrite(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_psect_t sector);
+dsk_err_t dsk_r_zxread (DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_pcyl_t cyl_expected, 
+		dsk_phead_t head_expected, dsk_psect_t sector, 
+		size_t sector_size, int *deleted);
+dsk_err_t dsk_r_zxwrite(DSK_PDRIVER self, RPCFUNC func, unsigned int nDriver, 
+		const DSK_GEOMETRY *geom, const void *buf, dsk_pcyl_t cylinder,
+		dsk_phead_t head, dsk_pcyl_t cyl_expected, 
+		dsk_phead_t head_expected, dsk_psect_t sector, 
+		size_t sector_size, int deleted);
+dsk_err_t dsk_r_ztread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder, 
+		dsk_phead_t head);
+dsk_err_t dsk_r_zxtread(DSK_DRIVER *self, RPCFUNC func, unsigned int nDriver,
+		const DSK_GEOMETRY *geom, void *buf, dsk_pcyl_t cylinder, 
+		dsk_phead_t head, dsk_pcyl_t cyl_expected, 
+		dsk_phead_t head_expected);
+
 /* These functions are remote-only for now */
 dsk_err_t dsk_r_properties(DSK_PDRIVER self, RPCFUNC func, 
 		unsigned int nDriver);
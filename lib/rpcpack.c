@@ -131,6 +131,73 @@ dsk_err_t dsk_unpack_format(unsigned char **input, int *inp_len, DSK_FORMAT *f)
 	return DSK_ERR_OK;
 	}
 
+
+/* Compressed memory blocks are stored as encoding, decoded length, and 
+ * then the encoded data as a memory block. */
+dsk_err_t dsk_unpack_zbytes(unsigned char **input, int *inp_len, 
+		unsigned char *buf, size_t *len)
+	{
+	dsk_err_t err;
+	int16 enc, hdr, count;
+	int32 dlen;
+	unsigned char *src;
+	int slen;
+	size_t n = 0;
+
+	err = dsk_unpack_i16(input, inp_len, &enc);  if (err) return err;
+	err = dsk_unpack_i32(input, inp_len, &dlen); if (err) return err;
+	slen = *inp_len - 2;
+	err = dsk_unpack_bytes(input, inp_len, &src); if (err) return err;
+	slen -= *inp_len;
+
+	if (dlen > *len) return DSK_ERR_RPC;
+	switch(enc)
+		{
+		case RPC_ENC_RAW:
+			if (slen != (int)dlen) return DSK_ERR_RPC;
+			if (slen) memcpy(buf, src, slen);
+			break;
+
+		case RPC_ENC_FILL:
+			if (slen != 1) return DSK_ERR_RPC;
+			memset(buf, src[0], dlen);
+			break;
+
+		case RPC_ENC_RLE:
+			while (slen > 0)
+				{
+				if (slen < 2) return DSK_ERR_RPC;
+				hdr = (((int16)src[0]) << 8) | src[1];
+				src  += 2;
+				slen -= 2;
+				count = hdr & 0x7FFF;
+				if (n + count > dlen) return DSK_ERR_RPC;
+				if (hdr & 0x8000)
+					{
+					if (slen < 1) return DSK_ERR_RPC;
+					memset(buf + n, src[0], count);
+					++src;
+					--slen;
+					}
+				else
+					{
+					if (slen < (int)count) return DSK_ERR_RPC;
+					memcpy(buf + n, src, count);
+					src  += count;
+					slen -= count;
+					}
+				n += count;
+				}
+			if (n != dlen) return DSK_ERR_RPC;
+			break;
+
+		default:
+			return DSK_ERR_RPC;
+		}
+	*len = dlen;
+	return DSK_ERR_OK;
+	}
+
 /* ///////////////////////////////////////////////////////////////////////// */
 
 
@@ -226,3 +293,94 @@ dsk_err_t dsk_pack_format(unsigned char **output, int *out_len, const DSK_FORMAT
 	err = dsk_pack_i16(output, out_len, (int16)f->fmt_secsize);   if (err) return err;
 	return DSK_ERR_OK;
 	}
+
+
+/* Append a literal block to an RLE-encoded buffer. Returns 0 if it would
+ * overflow. */
+static int rle_literal(unsigned char *dst, size_t *out, size_t max,
+		const unsigned char *src, size_t count)
+	{
+	if (!count) return 1;
+	if (*out + 2 + count > max) return 0;
+	dst[(*out)++] = (unsigned char)(count >> 8);
+	dst[(*out)++] = (unsigned char)(count & 0xFF);
+	memcpy(dst + *out, src, count);
+	(*out) += count;
+	return 1;
+	}
+
+/* RLE-encode a buffer. Runs of 5 or more identical bytes are compressed; 
+ * everything else is stored literally. Returns the encoded length, or 0 
+ * if the result would not fit in 'max' bytes. */
+static size_t rle_encode(unsigned char *dst, size_t max, 
+		const unsigned char *src, size_t len)
+	{
+	size_t n = 0, lit = 0, out = 0, run;
+
+	while (n < len)
+		{
+		for (run = 1; n + run < len && run < 0x7FFF && 
+				src[n + run] == src[n]; run++);
+		if (run < 5)
+			{
+			if (n - lit + run > 0x7FFF)
+				{
+				if (!rle_literal(dst, &out, max, src + lit, n - lit)) return 0;
+				lit = n;
+				}
+			n += run;
+			continue;
+			}
+		if (!rle_literal(dst, &out, max, src + lit, n - lit)) return 0;
+		if (out + 3 > max) return 0;
+		dst[out++] = (unsigned char)((run >> 8) | 0x80);
+		dst[out++] = (unsigned char)(run & 0xFF);
+		dst[out++] = src[n];
+		n += run;
+		lit = n;
+		}
+	if (!rle_literal(dst, &out, max, src + lit, n - lit)) return 0;
+	return out;
+	}
+
+
+/* Pack a memory block using the most compact encoding that the other end 
+ * accepts. The encoded data must be smaller than the original, or it is 
+ * sent raw. */
+dsk_err_t dsk_pack_zbytes(unsigned char **output, int *out_len,  
+		const unsigned char *buf, size_t len, int16 accept)
+	{
+	dsk_err_t err;
+	size_t n, zlen;
+
+	if (len && (accept & (1 << RPC_ENC_FILL)))
+		{
+		for (n = 1; n < len; n++) if (buf[n] != buf[0]) break;
+		if (n == len)
+			{
+			err = dsk_pack_i16  (output, out_len, RPC_ENC_FILL); if (err) return err;
+			err = dsk_pack_i32  (output, out_len, (int32)len);   if (err) return err;
+			return dsk_pack_bytes(output, out_len, buf, 1);
+			}
+		}
+	/* Encode directly into the output buffer, after the 8 bytes of 
+	 * headers. */
+	if (len && (accept & (1 << RPC_ENC_RLE)) && *out_len > 8)
+		{
+		zlen = rle_encode((*output) + 8, 
+			((size_t)(*out_len - 8) < len - 1) ? 
+				(size_t)(*out_len - 8) : len - 1, buf, len);
+		if (zlen)
+			{
+			err = dsk_pack_i16(output, out_len, RPC_ENC_RLE); if (err) return err;
+			err = dsk_pack_i32(output, out_len, (int32)len);  if (err) return err;
+			err = dsk_pack_i16(output, out_len, (int16)zlen); if (err) return err;
+			(*output)  += zlen;
+			(*out_len) -= (int)zlen;
+			return DSK_ERR_OK;
+			}
+		}
+	err = dsk_pack_i16(output, out_len, RPC_ENC_RAW); if (err) return err;
+	err = dsk_pack_i32(output, out_len, (int32)len);  if (err) return err;
+	return dsk_pack_bytes(output, out_len, buf, len);
+	}
@@ -51,6 +51,8 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_rpc_server(unsigned char *input,  int inp_le
 	unsigned char status;
 	int deleted, value;
 	int16 props[sizeof(DRV_CLASS)];
+	int16 accept;
+	size_t zlen;
 
 	err = dsk_unpack_i16(&input, &inp_len, &function); if (err) return err;
 	switch(function)
@@ -248,6 +250,111 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_rpc_server(unsigned char *input,  int inp_le
 				err = dsk_pack_bytes(&output, out_len, secbuf, geom.dg_secsize * geom.dg_sectors); if (err) return err;
 				return DSK_ERR_OK;
 
+/* Compressed-payload versions of PREAD, PWRITE, XREAD, XWRITE, PTREAD and
+ * XTREAD */
+		case RPC_DSK_ZPREAD:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_i16 (&input, &inp_len, &accept); if (err) return err;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (geom.dg_secsize > sizeof(secbuf)) return DSK_ERR_RPC;
+				err2= dsk_pread(pDriver, &geom, secbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2, (dsk_psect_t)int3);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				err = dsk_pack_zbytes(&output, out_len, secbuf, geom.dg_secsize, accept); if (err) return err;
+				return DSK_ERR_OK;
+		case RPC_DSK_ZPWRITE:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				zlen = sizeof(secbuf);
+				err = dsk_unpack_zbytes(&input, &inp_len, secbuf, &zlen); if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (zlen < geom.dg_secsize) return DSK_ERR_RPC;
+				err2= dsk_pwrite(pDriver, &geom, secbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2, (dsk_psect_t)int3);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				return DSK_ERR_OK;
+		case RPC_DSK_ZXREAD:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_i16 (&input, &inp_len, &accept); if (err) return err;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int4);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int5);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int6);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int7);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (int6 > sizeof(secbuf)) return DSK_ERR_RPC;
+				deleted = int7;
+				err2= dsk_xread(pDriver, &geom, secbuf, 
+						(dsk_pcyl_t)int1, 
+						(dsk_phead_t)int2, 
+						(dsk_pcyl_t)int3, 
+						(dsk_phead_t)int4, 
+						(dsk_psect_t)int5,
+						(size_t)int6,
+						&deleted);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				err = dsk_pack_zbytes(&output, out_len, secbuf, int6, accept); if (err) return err;
+				err = dsk_pack_i32(&output, out_len, deleted);
+				return DSK_ERR_OK;
+		case RPC_DSK_ZXWRITE:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				zlen = sizeof(secbuf);
+				err = dsk_unpack_zbytes(&input, &inp_len, secbuf, &zlen); if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int4);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int5);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int6);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int7);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (zlen < int6) return DSK_ERR_RPC;
+				err2= dsk_xwrite(pDriver, &geom, secbuf, 
+						(dsk_pcyl_t)int1, 
+						(dsk_phead_t)int2, 
+						(dsk_pcyl_t)int3, 
+						(dsk_phead_t)int4, 
+						(dsk_psect_t)int5,
+						(size_t)int6,
+						(int)int7);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				return DSK_ERR_OK;
+		case RPC_DSK_ZPTREAD:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_i16 (&input, &inp_len, &accept); if (err) return err;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (geom.dg_secsize * geom.dg_sectors > sizeof(secbuf)) return DSK_ERR_RPC;
+				err2= dsk_ptread(pDriver, &geom, secbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				err = dsk_pack_zbytes(&output, out_len, secbuf, geom.dg_secsize * geom.dg_sectors, accept); if (err) return err;
+				return DSK_ERR_OK;
+		case RPC_DSK_ZXTREAD:
+				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
+				err = dsk_unpack_i16 (&input, &inp_len, &accept); if (err) return err;
+				err = dsk_unpack_geom(&input, &inp_len, &geom);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int2);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int3);	  if (err) return err;
+				err = dsk_unpack_i32 (&input, &inp_len, &int4);	  if (err) return err;
+				err = dsk_map_itod(nDriver, &pDriver);			  if (err) return err;
+				if (geom.dg_secsize * geom.dg_sectors > sizeof(secbuf)) return DSK_ERR_RPC;
+				err2= dsk_xtread(pDriver, &geom, secbuf, (dsk_pcyl_t)int1, (dsk_phead_t)int2, (dsk_pcyl_t)int3, (dsk_phead_t)int4);
+				err = dsk_pack_err(&output, out_len, err2);	  if (err) return err;
+				err = dsk_pack_zbytes(&output, out_len, secbuf, geom.dg_secsize * geom.dg_sectors, accept); if (err) return err;
+				return DSK_ERR_OK;
+
 		case RPC_DSK_OPTION_ENUM:
 				err = dsk_unpack_i32 (&input, &inp_len, &nd);	  if (err) return err;	nDriver = (unsigned int)nd;
 				err = dsk_unpack_i32 (&input, &inp_len, &int1);	  if (err) return err;
@@ -328,6 +435,12 @@ LDPUBLIC32 dsk_err_t LDPUBLIC16 dsk_rpc_server(unsigned char *input,  int inp_le
 				PROPCHECK(dc_option_set, RPC_DSK_OPTION_SET)
 				PROPCHECK(dc_trackids, RPC_DSK_TRACKIDS)
 				PROPCHECK(dc_rtread, RPC_DSK_RTREAD)
+				PROPCHECK(dc_read,    RPC_DSK_ZPREAD)
+				PROPCHECK(dc_write,   RPC_DSK_ZPWRITE)
+				PROPCHECK(dc_xread,   RPC_DSK_ZXREAD)
+				PROPCHECK(dc_xwrite,  RPC_DSK_ZXWRITE)
+				PROPCHECK(dc_tread,   RPC_DSK_ZPTREAD)
+				PROPCHECK(dc_xtread,  RPC_DSK_ZXTREAD)
 #undef PROPCHECK
 				props[int1++] = RPC_DSK_PROPERTIES;
 				err = dsk_pack_err(&output, out_len, DSK_ERR_OK);	  if (err) return err;
@@ -24,6 +24,7 @@
 
 package uk.co.demon.seasip.libdsk;
 
+import java.nio.ByteBuffer;
 
 /** The Drive class represents an open LibDsk drive. */
 public class Drive
@@ -289,6 +290,223 @@ public class Drive
   */
 	public native void readTrack(Geometry g, byte buf[], int cylinder, int head, int cylExpected, int headExpected) throws DskException;
 
+/* Transfers of several sectors in one call, and transfers to and from 
+ * direct ByteBuffers. The byte[] methods above cross from Java to C once
+ * per sector, and the array may be copied on the way in and again on the 
+ * way out; these avoid both. A direct ByteBuffer is used in place, starting 
+ * at its position, and the position is moved on past the data 
+ * transferred. */
+
+/** Read several consecutive sectors from one track.
+  * @param g The drive geometry to use.
+  * @param buf The buffer to be filled with data. It must hold at least 
+  *           count * g.secsize bytes.
+  * @param cyl The physical cylinder containing the sectors. 
+  * @param head The physical head to use.
+  * @param sector The number of the first sector.
+  * @param count The number of sectors to read.
+  * @exception DskException If any read failed, or the buffer is too small.
+  *                     Sectors before the one that failed will have been 
+  *                     read into the buffer.
+  */
+	public native void readSectors(Geometry g, byte[] buf, int cyl, int head, int sector, int count) throws DskException;
+
+/** Read several consecutive sectors using logical sector addresses.
+  * @param g The drive geometry to use. This will be used to translate the
+  *         sector numbers to physical cylinder/head/sector.
+  * @param buf The buffer to be filled with data. It must hold at least 
+  *           count * g.secsize bytes.
+  * @param logsect The number of the first sector (0 is the first sector 
+  *               on the disc).
+  * @param count The number of sectors to read.
+  * @exception DskException If any read failed, or the buffer is too small.
+  */
+	public native void readSectors(Geometry g, byte[] buf, int logsect, int count) throws DskException;
+
+/** Write several consecutive sectors on one track.
+  * @param g The drive geometry to use.
+  * @param buf The data to be written, count * g.secsize bytes.
+  * @param cyl The physical cylinder containing the sectors. 
+  * @param head The physical head to use.
+  * @param sector The number of the first sector.
+  * @param count The number of sectors to write.
+  * @exception DskException If any write failed, or the buffer is too small.
+  */
+	public native void writeSectors(Geometry g, byte[] buf, int cyl, int head, int sector, int count) throws DskException;
+
+/** Write several consecutive sectors using logical sector addresses.
+  * @param g The drive geometry to use. This will be used to translate the
+  *         sector numbers to physical cylinder/head/sector.
+  * @param buf The data to be written, count * g.secsize bytes.
+  * @param logsect The number of the first sector (0 is the first sector 
+  *               on the disc).
+  * @param count The number of sectors to write.
+  * @exception DskException If any write failed, or the buffer is too small.
+  */
+	public native void writeSectors(Geometry g, byte[] buf, int logsect, int count) throws DskException;
+
+/** Write a whole track using a physical head/cylinder number. This 
+  * writes sectors g.secbase to g.secbase + g.sectors - 1, the same 
+  * sectors that readTrack() reads.
+  * @param g The drive geometry to use.
+  * @param buf The data to be written, g.sectors * g.secsize bytes.
+  * @param cylinder The physical cylinder to use.
+  * @param head The physical head to use.
+  * @exception DskException If any write failed, or the buffer is too small.
+  */
+	public void writeTrack(Geometry g, byte buf[], int cylinder, int head) throws DskException
+	{
+		writeSectors(g, buf, cylinder, head, g.secbase, g.sectors);
+	}
+
+/** Read a disc sector into a direct ByteBuffer, using a physical sector 
+  * address.
+  * @param g The drive geometry to use.
+  * @param buf A direct buffer with at least g.secsize bytes remaining.
+  * @param cyl The physical cylinder containing the sector. 
+  * @param head The physical head to use.
+  * @param sector The number of the sector.
+  * @exception DskException If the read failed for any reason, or the 
+  *                     buffer is not direct or too small.
+  */
+	public void read(Geometry g, ByteBuffer buf, int cyl, int head, int sector) throws DskException
+	{
+		readSectors(g, buf, cyl, head, sector, 1);
+	}
+
+/** Read a disc sector into a direct ByteBuffer, using a logical sector 
+  * address.
+  * @param g The drive geometry to use. This will be used to translate the
+  *         sector number to a physical cylinder/head/sector.
+  * @param buf A direct buffer with at least g.secsize bytes remaining.
+  * @param logsect The number of the sector (0 is the first sector on the disc).
+  * @exception DskException If the read failed for any reason, or the 
+  *                     buffer is not direct or too small.
+  */
+	public void read(Geometry g, ByteBuffer buf, int logsect) throws DskException
+	{
+		readSectors(g, buf, logsect, 1);
+	}
+
+/** Write a disc sector from a direct ByteBuffer, using a physical sector 
+  * address.
+  * @param g The drive geometry to use.
+  * @param buf A direct buffer with at least g.secsize bytes remaining.
+  * @param cyl The physical cylinder containing the sector. 
+  * @param head The physical head to use.
+  * @param sector The number of the sector.
+  * @exception DskException If the write failed for any reason, or the 
+  *                     buffer is not direct or too small.
+  */
+	public void write(Geometry g, ByteBuffer buf, int cyl, int head, int sector) throws DskException
+	{
+		writeSectors(g, buf, cyl, head, sector, 1);
+	}
+
+/** Write a disc sector from a direct ByteBuffer, using a logical sector 
+  * address.
+  * @param g The drive geometry to use. This will be used to translate the
+  *         sector number to a physical cylinder/head/sector.
+  * @param buf A direct buffer with at least g.secsize bytes remaining.
+  * @param logsect The number of the sector (0 is the first sector on the disc).
+  * @exception DskException If the write failed for any reason, or the 
+  *                     buffer is not direct or too small.
+  */
+	public void write(Geometry g, ByteBuffer buf, int logsect) throws DskException
+	{
+		writeSectors(g, buf, logsect, 1);
+	}
+
+/** Read several consecutive sectors from one track into a direct 
+  * ByteBuffer.
+  * @see #readSectors(Geometry, byte[], int, int, int, int) 
+  * @exception DskException If any read failed, or the buffer is not direct
+  *                     or has fewer than count * g.secsize bytes 
+  *                     remaining. */
+	public void readSectors(Geometry g, ByteBuffer buf, int cyl, int head, int sector, int count) throws DskException
+	{
+		nioTransfer(g, buf, NIO_READ, cyl, head, sector, count);
+	}
+
+/** Read several consecutive sectors into a direct ByteBuffer, using 
+  * logical sector addresses.
+  * @see #readSectors(Geometry, byte[], int, int) 
+  * @exception DskException If any read failed, or the buffer is not direct
+  *                     or has fewer than count * g.secsize bytes 
+  *                     remaining. */
+	public void readSectors(Geometry g, ByteBuffer buf, int logsect, int count) throws DskException
+	{
+		nioTransfer(g, buf, NIO_LREAD, logsect, 0, 0, count);
+	}
+
+/** Write several consecutive sectors on one track from a direct 
+  * ByteBuffer.
+  * @see #writeSectors(Geometry, byte[], int, int, int, int) 
+  * @exception DskException If any write failed, or the buffer is not direct
+  *                     or has fewer than count * g.secsize bytes 
+  *                     remaining. */
+	public void writeSectors(Geometry g, ByteBuffer buf, int cyl, int head, int sector, int count) throws DskException
+	{
+		nioTransfer(g, buf, NIO_WRITE, cyl, head, sector, count);
+	}
+
+/** Write several consecutive sectors from a direct ByteBuffer, using 
+  * logical sector addresses.
+  * @see #writeSectors(Geometry, byte[], int, int) 
+  * @exception DskException If any write failed, or the buffer is not direct
+  *                     or has fewer than count * g.secsize bytes 
+  *                     remaining. */
+	public void writeSectors(Geometry g, ByteBuffer buf, int logsect, int count) throws DskException
+	{
+		nioTransfer(g, buf, NIO_LWRITE, logsect, 0, 0, count);
+	}
+
+/** Read a track into a direct ByteBuffer, using a physical head/cylinder 
+  * number.
+  * @see #readTrack(Geometry, byte[], int, int) 
+  * @exception DskException If the read failed for any reason, or the 
+  *                     buffer is not direct or has fewer than 
+  *                     g.sectors * g.secsize bytes remaining. */
+	public void readTrack(Geometry g, ByteBuffer buf, int cylinder, int head) throws DskException
+	{
+		nioTransfer(g, buf, NIO_TREAD, cylinder, head, 0, g.sectors);
+	}
+
+/** Write a track from a direct ByteBuffer, using a physical head/cylinder 
+  * number.
+  * @see #writeTrack(Geometry, byte[], int, int) 
+  * @exception DskException If any write failed, or the buffer is not direct
+  *                     or has fewer than g.sectors * g.secsize bytes 
+  *                     remaining. */
+	public void writeTrack(Geometry g, ByteBuffer buf, int cylinder, int head) throws DskException
+	{
+		nioTransfer(g, buf, NIO_WRITE, cylinder, head, g.secbase, g.sectors);
+	}
+
+	/* Operations for nioTransfer() */
+	private static final int NIO_READ   = 0;	/* dsk_pread */
+	private static final int NIO_LREAD  = 1;	/* dsk_lread */
+	private static final int NIO_WRITE  = 2;	/* dsk_pwrite */
+	private static final int NIO_LWRITE = 3;	/* dsk_lwrite */
+	private static final int NIO_TREAD  = 4;	/* dsk_ptread */
+
+	/* Transfer 'count' sectors between the disc and buf, starting at 
+	 * buf.position(), then advance the position over them. For NIO_LREAD
+	 * and NIO_LWRITE, 'a' is the logical sector; otherwise a, b and c
+	 * are cylinder, head and sector. */
+	private void nioTransfer(Geometry g, ByteBuffer buf, int op, 
+			int a, int b, int c, int count) throws DskException
+	{
+		int pos = buf.position();
+
+		nio(g, buf, pos, buf.limit() - pos, op, a, b, c, count);
+		buf.position(pos + count * g.secsize);
+	}
+
+	private native void nio(Geometry g, ByteBuffer buf, int offset, 
+			int length, int op, int a, int b, int c, 
+			int count) throws DskException;
+
 /** Format a track, generating the sector headers automatically.
  * The resulting track headers will be correct for standard DOS, PCW or 
  * Linux floppies.
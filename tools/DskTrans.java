@@ -22,6 +22,7 @@
  ***************************************************************************/
 
 /* Portable equivalent of PCWTRANS */
+import java.nio.ByteBuffer;
 import uk.co.demon.seasip.libdsk.*;
 
 class DskTrans
@@ -91,6 +92,7 @@ class DskTrans
 		Drive indr = null, outdr = null;
 		int cyl, head, sec;
 		byte[] buf = null;
+		ByteBuffer track = null;
 		Geometry dg = new Geometry();
 		String op = "Opening";
 
@@ -108,6 +110,8 @@ class DskTrans
 			}
 			else FormatType.stdFormat(format, dg, null);
 			buf = new byte[dg.secsize];
+			// Whole tracks are copied through native memory
+			track = ByteBuffer.allocateDirect(dg.sectors * dg.secsize);
 	
 			System.out.println("Input driver: " + indr.getDriverDesc());
 			System.out.println("Output driver:" + outdr.getDriverDesc());
@@ -127,6 +131,36 @@ class DskTrans
 				// Format track
        				outdr.autoFormat(dg, cyl, head, (byte)0xE5);
 
+				// Unless individual sectors may fail, copy 
+				// the track in one go
+				if (!md3)
+				{
+					System.out.print("Cyl " +
+						Integer.toString(cyl + 1)      + "/" +
+						Integer.toString(dg.cylinders) + " Head " +
+						Integer.toString(head + 1)     + "/" +
+						Integer.toString(dg.heads)     + 
+						"                \r");
+					System.out.flush();
+
+					op = "Reading";
+					track.clear();
+					if (logical)
+					{
+						int ls, si;
+
+						si = dg.sidedness;
+						dg.sidedness = Geometry.SIDES_ALT;
+						ls = dg.ps2ls(cyl, head, dg.secbase);
+						dg.sidedness = si;
+						indr.readSectors(dg, track, ls, dg.sectors);
+					}
+					else indr.readSectors(dg, track, cyl, head, dg.secbase, dg.sectors);
+					op = "Writing";
+					track.clear();
+					outdr.writeTrack(dg, track, cyl, head);
+					continue;
+				}
 				for (sec = 0; sec < dg.sectors; ++sec)
 				{
 				System.out.print("Cyl " +
@@ -151,7 +185,7 @@ class DskTrans
 	 * order. */
 						si = dg.sidedness;
 						dg.sidedness = Geometry.SIDES_ALT;
-						ls = dg.ps2ls(cyl, head, sec);
+						ls = dg.ps2ls(cyl, head, sec + dg.secbase);
 						dg.sidedness = si;
 						indr.read(dg, buf, ls);
 					}
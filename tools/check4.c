@@ -0,0 +1,407 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Round-trip tests for the Squeeze and QRST (PKWARE DCL) decompressors.
+ * A 720k image is filled with a mixture of runs, text, repeats and noise,
+ * compressed, and then opened again and read back sector by sector.
+ *
+ * Squeezed images are written by LibDsk itself. LibDsk has no compressor
+ * for QRST v5, so there's a small PKWARE DCL implode below to write one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdsk.h"
+
+#define CHECKFILE "check4.tmp"
+
+static DSK_GEOMETRY dg;
+static unsigned char *image;
+static unsigned long imagelen;
+
+int do_test(const char *what, const char *type, const char *comp);
+int sq_write(void);
+int qrst5_write(int lit, int dict);
+void make_image(unsigned long seed);
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+
+	dg_stdformat(&dg, FMT_720K, NULL, NULL);
+	imagelen = (unsigned long)dg.dg_cylinders * dg.dg_heads *
+			dg.dg_sectors * dg.dg_secsize;
+	image = malloc(imagelen);
+	if (!image)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	make_image(1);
+	if (!err) err = sq_write();
+	if (!err) err = do_test("Squeeze", "raw", "sq");
+	if (!err) err = qrst5_write(0, 6);
+	if (!err) err = do_test("QRST (uncoded literals)", "qrst", NULL);
+	make_image(2);
+	if (!err) err = qrst5_write(1, 4);
+	if (!err) err = do_test("QRST (coded literals)", "qrst", NULL);
+	remove(CHECKFILE);
+	free(image);
+	return err;
+}
+
+/* Fill the image. Each track gets one kind of content, so the compressors
+ * see short and long codes, and short, long and overlapping matches */
+static unsigned long rnd;
+
+static unsigned char next_rnd(void)
+{
+	rnd = rnd * 1103515245UL + 12345UL;
+	return (unsigned char)(rnd >> 16);
+}
+
+void make_image(unsigned long seed)
+{
+	static const char *words[] = { "LIBDSK ", "floppy ", "disc ",
+		"image ", "sector ", "track ", "\r\n", "A>DIR ", "COM " };
+	unsigned long tracklen = (unsigned long)dg.dg_sectors * dg.dg_secsize;
+	unsigned long n, t, m;
+	unsigned char *trk;
+
+	rnd = seed;
+	for (t = 0; t * tracklen < imagelen; t++)
+	{
+		trk = image + t * tracklen;
+		switch ((t + seed) % 6)
+		{
+			case 0:	/* Noise */
+				for (n = 0; n < tracklen; n++)
+					trk[n] = next_rnd();
+				break;
+			case 1: /* Blank, or the RLE marker repeated */
+				memset(trk, (t & 8) ? 0x90 : 0xE5, tracklen);
+				break;
+			case 2: /* Text */
+				for (n = 0; n < tracklen; )
+				{
+					const char *w = words[next_rnd() % 9];
+					while (*w && n < tracklen) trk[n++] = *w++;
+				}
+				break;
+			case 3:	/* Short runs, with some 0x90 bytes */
+				for (n = 0; n < tracklen; )
+				{
+					unsigned char c = next_rnd();
+					m = next_rnd() % 8 + 1;
+					if (c < 0x20) c = 0x90;
+					while (m-- && n < tracklen) trk[n++] = c;
+				}
+				break;
+			case 4:	/* Skewed values */
+				for (n = 0; n < tracklen; n++)
+				{
+					m = next_rnd();
+					trk[n] = (unsigned char)((m * m * m) >> 16);
+				}
+				break;
+			case 5:	/* An earlier track, slightly changed */
+				memcpy(trk, image + (next_rnd() % (t + 1)) * tracklen, tracklen);
+				for (n = 0; n < 16; n++)
+					trk[(next_rnd() * 256UL + next_rnd()) % tracklen] ^= 0x55;
+				break;
+		}
+	}
+	/* Sector 0 holds a 720k BPB, so the geometry is unambiguous */
+	memset(image, 0, dg.dg_secsize);
+	image[0] = 0xEB; image[1] = 0x34; image[2] = 0x90;
+	image[0x0B] = 0x00; image[0x0C] = 0x02;	/* Sector size */
+	image[0x0D] = 2;			/* Sectors / cluster */
+	image[0x0E] = 1;			/* Reserved sectors */
+	image[0x10] = 2;			/* FATs */
+	image[0x11] = 0x70;			/* Root directory */
+	image[0x13] = 0xA0; image[0x14] = 0x05; /* Sectors */
+	image[0x15] = 0xF9;			/* Media */
+	image[0x16] = 3;			/* Sectors / FAT */
+	image[0x18] = 9;			/* Sectors / track */
+	image[0x1A] = 2;			/* Heads */
+	image[0x1FE] = 0x55; image[0x1FF] = 0xAA;
+}
+
+/* Open the compressed image and check every sector */
+int do_test(const char *what, const char *type, const char *comp)
+{
+	DSK_PDRIVER dr = NULL;
+	dsk_lsect_t ls, lsmax;
+	dsk_err_t e;
+	unsigned char *buf;
+
+	buf = malloc(dg.dg_secsize);
+	if (!buf) return 1;
+	lsmax = imagelen / dg.dg_secsize;
+	e = dsk_open(&dr, CHECKFILE, type, comp);
+	for (ls = 0; !e && ls < lsmax; ls++)
+	{
+		e = dsk_lread(dr, &dg, buf, ls);
+		if (!e && memcmp(buf, image + ls * dg.dg_secsize, dg.dg_secsize))
+		{
+			fprintf(stderr, "%s: sector %ld differs\n", what, ls);
+			free(buf);
+			dsk_close(&dr);
+			return 1;
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	free(buf);
+	if (e)
+	{
+		fprintf(stderr, "%s: %s\n", what, dsk_strerror(e));
+		return 1;
+	}
+	return 0;
+}
+
+
+int sq_write(void)
+{
+	DSK_PDRIVER dr = NULL;
+	dsk_lsect_t ls, lsmax;
+	dsk_err_t e;
+
+	lsmax = imagelen / dg.dg_secsize;
+	e = dsk_creat(&dr, CHECKFILE, "raw", "sq");
+	for (ls = 0; !e && ls < lsmax; ls++)
+	{
+		e = dsk_lwrite(dr, &dg, image + ls * dg.dg_secsize, ls);
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e)
+	{
+		fprintf(stderr, "Squeeze: %s\n", dsk_strerror(e));
+		return 1;
+	}
+	return 0;
+}
+
+/************************* PKWARE DCL implode ******************************/
+
+/* The code tables, in the same compact form blast.c uses: each byte is
+ * a count (high four bits + 1) and a code length (low four bits) */
+static const unsigned char litlen[] = {
+	11, 124, 8, 7, 28, 7, 188, 13, 76, 4, 10, 8, 12, 10, 12, 10, 8, 23, 8,
+	9, 7, 6, 7, 8, 7, 6, 55, 8, 23, 24, 12, 11, 7, 9, 11, 12, 6, 7, 22, 5,
+	7, 24, 6, 11, 9, 6, 7, 22, 7, 11, 38, 7, 9, 8, 25, 11, 8, 11, 9, 12,
+	8, 12, 5, 38, 5, 38, 5, 11, 7, 5, 6, 21, 6, 10, 53, 8, 7, 24, 10, 27,
+	44, 253, 253, 253, 252, 252, 252, 13, 12, 45, 12, 45, 12, 61, 12, 45,
+	44, 173};
+static const unsigned char lenlen[] = {2, 35, 36, 53, 38, 23};
+static const unsigned char distlen[] = {2, 20, 53, 230, 247, 151, 248};
+static const short base[16] = {
+	3, 2, 4, 5, 6, 7, 8, 9, 10, 12, 16, 24, 40, 72, 136, 264};
+static const char extra[16] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8};
+
+typedef struct
+{
+	unsigned short code[256];
+	unsigned char len[256];
+} IMP_CODES;
+
+static IMP_CODES litcode, lencode, distcode;
+
+static FILE *imp_fp;
+static unsigned long imp_bitbuf;
+static int imp_bitcnt;
+
+/* Work out the codes for each symbol, as blast.c will decode them. Codes
+ * are canonical, with the bits inverted. */
+static void imp_construct(IMP_CODES *c, const unsigned char *rep, int n)
+{
+	int sym = 0, len, left, s, first;
+
+	do
+	{
+		len = *rep++;
+		left = (len >> 4) + 1;
+		do
+		{
+			c->len[sym++] = len & 15;
+		} while (--left);
+	} while (--n);
+	first = 0;
+	for (len = 1; len <= 13; len++)
+	{
+		for (s = 0; s < sym; s++) if (c->len[s] == len)
+		{
+			c->code[s] = first++;
+		}
+		first <<= 1;
+	}
+}
+
+static int imp_bits(unsigned long value, int count)
+{
+	imp_bitbuf |= (value & ((1UL << count) - 1)) << imp_bitcnt;
+	imp_bitcnt += count;
+	while (imp_bitcnt >= 8)
+	{
+		if (fputc((int)(imp_bitbuf & 0xFF), imp_fp) == EOF) return 1;
+		imp_bitbuf >>= 8;
+		imp_bitcnt -= 8;
+	}
+	return 0;
+}
+
+/* Huffman codes are written most significant bit first, inverted */
+static int imp_code(const IMP_CODES *c, int sym)
+{
+	int n, err = 0;
+
+	for (n = c->len[sym] - 1; n >= 0 && !err; n--)
+	{
+		err = imp_bits(1 ^ ((c->code[sym] >> n) & 1), 1);
+	}
+	return err;
+}
+
+static int imp_match(int len, unsigned dist, int dict)
+{
+	int sym, shift, err;
+
+	for (sym = 15; base[sym] > len; sym--);
+	if (len == 3) sym = 0;	/* base[] isn't in order */
+	err = imp_bits(1, 1);
+	if (!err) err = imp_code(&lencode, sym);
+	if (!err) err = imp_bits(len - base[sym], extra[sym]);
+	if (len == 519) return err;
+	shift = (len == 2) ? 2 : dict;
+	--dist;
+	if (!err) err = imp_code(&distcode, dist >> shift);
+	if (!err) err = imp_bits(dist, shift);
+	return err;
+}
+
+#define HASHSIZE 4096
+#define HASH(p) ((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & (HASHSIZE - 1))
+
+/* Greedy implode, using a hash of the next three bytes to find matches */
+static int implode(int lit, int dict)
+{
+	long *head, *prev;
+	unsigned long pos, window = 64UL << dict;
+	long cand;
+	int err, len, best, chain;
+	unsigned dist = 0;
+
+	head = malloc(HASHSIZE * sizeof(long));
+	prev = malloc(imagelen * sizeof(long));
+	if (!head || !prev)
+	{
+		if (head) free(head);
+		return 1;
+	}
+	for (pos = 0; pos < HASHSIZE; pos++) head[pos] = -1;
+
+	imp_construct(&litcode, litlen, sizeof(litlen));
+	imp_construct(&lencode, lenlen, sizeof(lenlen));
+	imp_construct(&distcode, distlen, sizeof(distlen));
+	imp_bitbuf = 0;
+	imp_bitcnt = 0;
+	err = imp_bits(lit, 8);
+	if (!err) err = imp_bits(dict, 8);
+	for (pos = 0; pos < imagelen && !err; )
+	{
+		best = 0;
+		if (pos + 3 <= imagelen)
+		{
+			cand = head[HASH(image + pos)];
+			for (chain = 0; chain < 32 && cand >= 0 &&
+				pos - cand <= window; chain++)
+			{
+				for (len = 0; len < 518 && pos + len < imagelen &&
+					image[cand + len] == image[pos + len]; len++);
+				if (len > best)
+				{
+					best = len;
+					dist = (unsigned)(pos - cand);
+				}
+				cand = prev[cand];
+			}
+		}
+		if (best == 2 && dist > 256) best = 0;
+		if (best >= 2)
+		{
+			err = imp_match(best, dist, dict);
+		}
+		else
+		{
+			best = 1;
+			err = imp_bits(0, 1);
+			if (!err && lit) err = imp_code(&litcode, image[pos]);
+			else if (!err)   err = imp_bits(image[pos], 8);
+		}
+		while (best--)
+		{
+			if (pos + 3 <= imagelen)
+			{
+				prev[pos] = head[HASH(image + pos)];
+				head[HASH(image + pos)] = pos;
+			}
+			++pos;
+		}
+	}
+	if (!err) err = imp_match(519, 0, dict);
+	if (!err && imp_bitcnt) err = imp_bits(0, 8 - imp_bitcnt);
+	free(prev);
+	free(head);
+	return err;
+}
+
+int qrst5_write(int lit, int dict)
+{
+	unsigned char header[821];
+	int err;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, "QRST", 4);
+	header[12]  = 3;		/* 720k */
+	header[795] = 2;		/* Compressed */
+	header[797] = sizeof(header) & 0xFF;	/* Offset of data */
+	header[798] = sizeof(header) >> 8;
+
+	imp_fp = fopen(CHECKFILE, "wb");
+	if (!imp_fp)
+	{
+		perror(CHECKFILE);
+		return 1;
+	}
+	err = (fwrite(header, 1, sizeof(header), imp_fp) < sizeof(header));
+	if (!err) err = implode(lit, dict);
+	if (fclose(imp_fp)) err = 1;
+	if (err) fprintf(stderr, "QRST: Failed to write %s\n", CHECKFILE);
+	return err;
+}
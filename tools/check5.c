@@ -0,0 +1,302 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Tests for LDBS sector deduplication. Identical sectors written with
+ * LDBS:DEDUP on must share one block, and the file must be marked as
+ * having shared blocks. Once it has been closed and reopened, rewriting
+ * one of the sectors must leave the others alone, deleting a shared
+ * block must only drop a reference, and deleting its last user must free
+ * it for ldbs_compact() to reclaim. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdsk.h"
+#include "ldbs.h"
+
+#define CHECKFILE "check5.tmp"
+
+static DSK_GEOMETRY dg;
+static unsigned char data_a[512], data_b[512], data_c[512], blank[512];
+
+int dedup_write(void);
+int overwrite(void);
+int check_shared(int first_shared);
+int check_sectors(const unsigned char *first, const unsigned char *mid);
+int delete_compact(void);
+
+int main(int argc, char **argv)
+{
+	int err = 0;
+	int n;
+
+	dg_stdformat(&dg, FMT_720K, NULL, NULL);
+	/* Sectors filled with one byte are stored without a block, so
+	 * these must vary */
+	for (n = 0; n < (int)sizeof(data_a); n++)
+	{
+		data_a[n] = 'A' + n % 26;
+		data_b[n] = 'B' + n % 24;
+		data_c[n] = 'C' + n % 22;
+	}
+	memset(blank, 0xE5, sizeof(blank));
+
+	/* Sectors 1-3 hold A, and 4 holds B */
+	err = dedup_write();
+	if (!err) err = check_shared(1);
+	if (!err) err = check_sectors(data_a, data_a);
+	/* Sector 1 is rewritten, with deduplication off */
+	if (!err) err = overwrite();
+	if (!err) err = check_shared(0);
+	if (!err) err = check_sectors(data_c, data_a);
+	/* Sectors 2 and 3 are deleted */
+	if (!err) err = delete_compact();
+	if (!err) err = check_sectors(data_c, blank);
+	remove(CHECKFILE);
+	return err;
+}
+
+
+static int fail(const char *what, dsk_err_t e)
+{
+	fprintf(stderr, "%s: %s\n", what, dsk_strerror(e));
+	return 1;
+}
+
+
+static LDBS_SECTOR_ENTRY *find_sector(LDBS_TRACKHEAD *th, int sec)
+{
+	int n;
+
+	for (n = 0; n < th->count; n++)
+	{
+		if (th->sector[n].id_sec == sec) return &th->sector[n];
+	}
+	return NULL;
+}
+
+
+static long file_size(void)
+{
+	FILE *fp = fopen(CHECKFILE, "rb");
+	long size = -1;
+
+	if (!fp) return -1;
+	if (!fseek(fp, 0, SEEK_END)) size = ftell(fp);
+	fclose(fp);
+	return size;
+}
+
+
+int dedup_write(void)
+{
+	DSK_PDRIVER dr = NULL;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	remove(CHECKFILE);
+	e = dsk_creat(&dr, CHECKFILE, "ldbs", NULL);
+	if (!e) e = dsk_set_option(dr, "LDBS:DEDUP", 1);
+	if (!e) e = dsk_apform(dr, &dg, 0, 0, 0xE5);
+	for (s = 1; !e && s <= 3; s++)
+	{
+		e = dsk_pwrite(dr, &dg, data_a, 0, 0, s);
+	}
+	if (!e) e = dsk_pwrite(dr, &dg, data_b, 0, 0, 4);
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Writing with deduplication", e);
+	return 0;
+}
+
+
+int overwrite(void)
+{
+	DSK_PDRIVER dr = NULL;
+	dsk_err_t e;
+
+	e = dsk_open(&dr, CHECKFILE, "ldbs", NULL);
+	if (!e) e = dsk_pwrite(dr, &dg, data_c, 0, 0, 1);
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Rewriting a shared sector", e);
+	return 0;
+}
+
+
+/* Check the file type, and which sectors share a block */
+int check_shared(int first_shared)
+{
+	PLDBS store = NULL;
+	LDBS_TRACKHEAD *th = NULL;
+	LDBS_SECTOR_ENTRY *s1, *s2, *s3, *s4;
+	char type[4];
+	int readonly = 0;
+	int err = 0;
+	dsk_err_t e;
+
+	e = ldbs_open(&store, CHECKFILE, type, &readonly);
+	if (!e) e = ldbs_get_trackhead(store, &th, 0, 0);
+	if (e)
+	{
+		if (store) ldbs_close(&store);
+		return fail("Reading the track header", e);
+	}
+	if (memcmp(type, LDBS_DSK_TYPE_SHARED, 4))
+	{
+		fprintf(stderr, "File type is %-4.4s, not %-4.4s\n", type,
+				LDBS_DSK_TYPE_SHARED);
+		err = 1;
+	}
+	s1 = th ? find_sector(th, 1) : NULL;
+	s2 = th ? find_sector(th, 2) : NULL;
+	s3 = th ? find_sector(th, 3) : NULL;
+	s4 = th ? find_sector(th, 4) : NULL;
+	if (!s1 || !s2 || !s3 || !s4)
+	{
+		fprintf(stderr, "Sectors missing from track header\n");
+		err = 1;
+	}
+	else if (s2->blockid != s3->blockid ||
+		 (s1->blockid == s2->blockid) != first_shared ||
+		 s4->blockid == s2->blockid)
+	{
+		fprintf(stderr, "Sector blocks are %ld %ld %ld %ld\n",
+			s1->blockid, s2->blockid, s3->blockid, s4->blockid);
+		err = 1;
+	}
+	if (th) ldbs_free(th);
+	ldbs_close(&store);
+	return err;
+}
+
+
+/* Read back sectors 1-4 of the image */
+int check_sectors(const unsigned char *first, const unsigned char *mid)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512];
+	const unsigned char *expect;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	e = dsk_open(&dr, CHECKFILE, "ldbs", NULL);
+	for (s = 1; !e && s <= 4; s++)
+	{
+		e = dsk_pread(dr, &dg, buf, 0, 0, s);
+		expect = (s == 1) ? first : (s == 4) ? data_b : mid;
+		if (!e && memcmp(buf, expect, sizeof(buf)))
+		{
+			fprintf(stderr, "Sector %d differs\n", s);
+			dsk_close(&dr);
+			return 1;
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Reading back", e);
+	return 0;
+}
+
+
+/* Delete sector 'sec' from track 0 head 0, blanking it */
+static dsk_err_t delete_sector(PLDBS store, int sec)
+{
+	LDBS_TRACKHEAD *th = NULL;
+	LDBS_SECTOR_ENTRY *se;
+	dsk_err_t e;
+
+	e = ldbs_get_trackhead(store, &th, 0, 0);
+	if (e) return e;
+	se = th ? find_sector(th, sec) : NULL;
+	if (!se) e = DSK_ERR_NOADDR;
+	if (!e) e = ldbs_delblock(store, se->blockid);
+	if (!e)
+	{
+		se->blockid = LDBLOCKID_NULL;
+		se->copies  = 0;
+		se->filler  = 0xE5;
+		e = ldbs_put_trackhead(store, th, 0, 0);
+	}
+	if (th) ldbs_free(th);
+	return e;
+}
+
+
+int delete_compact(void)
+{
+	PLDBS store = NULL;
+	LDBS_TRACKHEAD *th = NULL;
+	LDBS_SECTOR_ENTRY *se;
+	unsigned char buf[512];
+	size_t len = sizeof(buf);
+	char type[4];
+	int readonly = 0;
+	long before, after;
+	dsk_err_t e;
+
+	/* Sector 3 still uses the block, so it must survive */
+	e = ldbs_open(&store, CHECKFILE, type, &readonly);
+	if (!e) e = delete_sector(store, 2);
+	if (!e) e = ldbs_get_trackhead(store, &th, 0, 0);
+	se = th ? find_sector(th, 3) : NULL;
+	if (!e && !se) e = DSK_ERR_NOADDR;
+	if (!e) e = ldbs_getblock(store, se->blockid, NULL, buf, &len);
+	if (th) ldbs_free(th);
+	if (!e && (len != sizeof(buf) || memcmp(buf, data_a, len)))
+	{
+		fprintf(stderr, "Shared block lost when one user deleted\n");
+		ldbs_close(&store);
+		return 1;
+	}
+	if (!e) e = ldbs_compact(store);
+	if (store)
+	{
+		if (!e) e = ldbs_close(&store); else ldbs_close(&store);
+	}
+	if (e) return fail("Deleting a shared sector", e);
+	before = file_size();
+
+	/* Now it has no users, and compacting the file must drop it */
+	e = ldbs_open(&store, CHECKFILE, type, &readonly);
+	if (!e) e = delete_sector(store, 3);
+	if (!e) e = ldbs_compact(store);
+	if (store)
+	{
+		if (!e) e = ldbs_close(&store); else ldbs_close(&store);
+	}
+	if (e) return fail("Deleting the last user of a block", e);
+	after = file_size();
+	if (before < 0 || after < 0 || before - after < (long)sizeof(buf))
+	{
+		fprintf(stderr, "Compacting reclaimed %ld bytes of %ld\n",
+				before - after, before);
+		return 1;
+	}
+	return 0;
+}
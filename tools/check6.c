@@ -0,0 +1,263 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Round trip through ldbs_compact(). An LDBS image has the sectors of one
+ * track deleted, leaving free space in the file; it is then compacted.
+ * The file must shrink, keep its permissions, still be usable through
+ * the open handle, and read back sector for sector as it did before. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdsk.h"
+#include "ldbs.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+# define CHECK_MODE 1
+# include <sys/types.h>
+# include <sys/stat.h>
+#else
+# define CHECK_MODE 0
+#endif
+
+#define CHECKFILE "check6.tmp"
+
+/* Cylinders written, and the track whose sectors are deleted */
+#define CYLS	3
+#define DEL_CYL	1
+#define DEL_HEAD 0
+
+static DSK_GEOMETRY dg;
+
+int write_image(void);
+int delete_track(void);
+int compact(long *before, long *after);
+int check_image(int deleted);
+
+int main(int argc, char **argv)
+{
+	long before = -1, after = -1;
+	int err;
+
+	dg_stdformat(&dg, FMT_720K, NULL, NULL);
+
+	err = write_image();
+	if (!err) err = check_image(0);
+	if (!err) err = delete_track();
+	if (!err) err = check_image(1);
+	if (!err) err = compact(&before, &after);
+	if (!err && (before < 0 || after < 0 ||
+		before - after < (long)(dg.dg_sectors * dg.dg_secsize)))
+	{
+		fprintf(stderr, "Compacting reclaimed %ld bytes of %ld\n",
+				before - after, before);
+		err = 1;
+	}
+	if (!err) err = check_image(1);
+	remove(CHECKFILE);
+	return err;
+}
+
+
+static int fail(const char *what, dsk_err_t e)
+{
+	fprintf(stderr, "%s: %s\n", what, dsk_strerror(e));
+	return 1;
+}
+
+
+static long file_size(void)
+{
+	FILE *fp = fopen(CHECKFILE, "rb");
+	long size = -1;
+
+	if (!fp) return -1;
+	if (!fseek(fp, 0, SEEK_END)) size = ftell(fp);
+	fclose(fp);
+	return size;
+}
+
+
+/* What is written to a sector. Sectors filled with one byte are stored
+ * without a block, so the pattern must vary within each one */
+static void pattern(unsigned char *buf, dsk_pcyl_t c, dsk_phead_t h,
+		dsk_psect_t s)
+{
+	size_t n;
+
+	for (n = 0; n < dg.dg_secsize; n++)
+	{
+		buf[n] = (unsigned char)(n + 31 * c + 7 * h + 3 * s);
+	}
+}
+
+
+/* What a sector should read back as, once its track may be deleted */
+static void expected(unsigned char *buf, dsk_pcyl_t c, dsk_phead_t h,
+		dsk_psect_t s, int deleted)
+{
+	if (deleted && c == DEL_CYL && h == DEL_HEAD)
+		memset(buf, 0xE5, dg.dg_secsize);
+	else	pattern(buf, c, h, s);
+}
+
+
+int write_image(void)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512];
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	remove(CHECKFILE);
+	e = dsk_creat(&dr, CHECKFILE, "ldbs", NULL);
+	for (c = 0; !e && c < CYLS; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+	{
+		e = dsk_apform(dr, &dg, c, h, 0xE5);
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+		{
+			pattern(buf, c, h, s);
+			e = dsk_pwrite(dr, &dg, buf, c, h, s);
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Writing the image", e);
+	return 0;
+}
+
+
+/* Drop the blocks of one track's sectors, blanking them */
+int delete_track(void)
+{
+	PLDBS store = NULL;
+	LDBS_TRACKHEAD *th = NULL;
+	char type[4];
+	int readonly = 0;
+	int n;
+	dsk_err_t e;
+
+	e = ldbs_open(&store, CHECKFILE, type, &readonly);
+	if (!e) e = ldbs_get_trackhead(store, &th, DEL_CYL, DEL_HEAD);
+	if (!e && !th) e = DSK_ERR_NOADDR;
+	for (n = 0; !e && n < th->count; n++)
+	{
+		e = ldbs_delblock(store, th->sector[n].blockid);
+		th->sector[n].blockid = LDBLOCKID_NULL;
+		th->sector[n].copies  = 0;
+		th->sector[n].filler  = 0xE5;
+	}
+	if (!e) e = ldbs_put_trackhead(store, th, DEL_CYL, DEL_HEAD);
+	if (th) ldbs_free(th);
+	if (store)
+	{
+		if (!e) e = ldbs_close(&store); else ldbs_close(&store);
+	}
+	if (e) return fail("Deleting a track", e);
+	return 0;
+}
+
+
+int compact(long *before, long *after)
+{
+	PLDBS store = NULL;
+	LDBS_TRACKHEAD *th = NULL;
+	char type[4];
+	int readonly = 0;
+	dsk_err_t e;
+#if CHECK_MODE
+	struct stat st;
+
+	if (chmod(CHECKFILE, 0640))
+	{
+		perror(CHECKFILE);
+		return 1;
+	}
+#endif
+	*before = file_size();
+	e = ldbs_open(&store, CHECKFILE, type, &readonly);
+	if (!e) e = ldbs_compact(store);
+	/* The handle must have followed the file to its new layout */
+	if (!e) e = ldbs_get_trackhead(store, &th, CYLS - 1, 1);
+	if (!e && (!th || th->count != dg.dg_sectors)) e = DSK_ERR_BADFMT;
+	if (th) ldbs_free(th);
+	if (!e) e = ldbs_fsck(store, NULL);
+	if (store)
+	{
+		if (!e) e = ldbs_close(&store); else ldbs_close(&store);
+	}
+	if (e) return fail("Compacting", e);
+	*after = file_size();
+#if CHECK_MODE
+	if (stat(CHECKFILE, &st))
+	{
+		perror(CHECKFILE);
+		return 1;
+	}
+	if ((st.st_mode & 07777) != 0640)
+	{
+		fprintf(stderr, "Compacted file has mode %04o, not 0640\n",
+				(unsigned)(st.st_mode & 07777));
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+
+/* Read back every sector written */
+int check_image(int deleted)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512], expect[512];
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	e = dsk_open(&dr, CHECKFILE, "ldbs", NULL);
+	for (c = 0; !e && c < CYLS; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+	{
+		e = dsk_pread(dr, &dg, buf, c, h, s);
+		expected(expect, c, h, s, deleted);
+		if (!e && memcmp(buf, expect, sizeof(buf)))
+		{
+			fprintf(stderr, "Cylinder %d head %d sector %d differs\n",
+					c, h, s);
+			dsk_close(&dr);
+			return 1;
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Reading back", e);
+	return 0;
+}
@@ -0,0 +1,295 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Tests for dsk_diff() and dsk_diff_apply(). Two images that differ in a
+ * few sectors are compared, once as raw files and once as LDBS files (so
+ * that the LDBS fast path is used), and the delta is applied to a copy of
+ * the first. The copy must then match the second byte for byte, and the
+ * delta must be refused by an image that is not the one it was made
+ * against. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdsk.h"
+
+#define BASEFILE   "check7a.tmp"
+#define TARGETFILE "check7b.tmp"
+#define COPYFILE   "check7c.tmp"
+#define DELTAFILE  "check7d.tmp"
+
+/* Only a few cylinders are needed */
+#define CYLS 4
+
+static DSK_GEOMETRY dg;
+
+int run_diff(const char *type);
+
+int main(int argc, char **argv)
+{
+	int err;
+
+	dg_stdformat(&dg, FMT_720K, NULL, NULL);
+	dg.dg_cylinders = CYLS;
+
+	err = run_diff("raw");
+	if (!err) err = run_diff("ldbs");
+	remove(BASEFILE);
+	remove(TARGETFILE);
+	remove(COPYFILE);
+	remove(DELTAFILE);
+	return err;
+}
+
+
+static int fail(const char *what, const char *type, dsk_err_t e)
+{
+	fprintf(stderr, "%s (%s): %s\n", what, type, dsk_strerror(e));
+	return 1;
+}
+
+
+/* Is this one of the sectors changed in the second image? */
+static int changed(dsk_pcyl_t c, dsk_phead_t h, dsk_psect_t s)
+{
+	return (c == 1 && h == 0 && s == 3) ||
+	       (c == 3 && h == 1 && s == 9);
+}
+
+
+/* What is written to a sector. Sectors filled with one byte are stored
+ * without a block in LDBS, so the pattern must vary within each one */
+static void pattern(unsigned char *buf, dsk_pcyl_t c, dsk_phead_t h,
+		dsk_psect_t s, int target)
+{
+	size_t n;
+	int alt = (target && changed(c, h, s));
+
+	for (n = 0; n < dg.dg_secsize; n++)
+	{
+		buf[n] = (unsigned char)(n + 31 * c + 7 * h + 3 * s + alt);
+	}
+}
+
+
+static dsk_err_t make_image(const char *name, const char *type, int target)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512];
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	remove(name);
+	e = dsk_creat(&dr, name, type, NULL);
+	for (c = 0; !e && c < dg.dg_cylinders; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+	{
+		e = dsk_apform(dr, &dg, c, h, 0xE5);
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+		{
+			pattern(buf, c, h, s, target);
+			e = dsk_pwrite(dr, &dg, buf, c, h, s);
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	return e;
+}
+
+
+/* Load a whole file */
+static unsigned char *load_file(const char *name, long *len)
+{
+	FILE *fp = fopen(name, "rb");
+	unsigned char *buf = NULL;
+
+	*len = -1;
+	if (!fp) return NULL;
+	if (!fseek(fp, 0, SEEK_END)) *len = ftell(fp);
+	if (*len >= 0 && !fseek(fp, 0, SEEK_SET)) buf = malloc(*len + 1);
+	if (buf && fread(buf, 1, *len, fp) != (size_t)*len)
+	{
+		free(buf);
+		buf = NULL;
+	}
+	fclose(fp);
+	return buf;
+}
+
+
+static int copy_file(const char *src, const char *dest)
+{
+	unsigned char *buf;
+	long len;
+	FILE *fp;
+	int ok = 0;
+
+	buf = load_file(src, &len);
+	if (!buf) return 0;
+	fp = fopen(dest, "wb");
+	if (fp)
+	{
+		ok = (fwrite(buf, 1, len, fp) == (size_t)len);
+		if (fclose(fp)) ok = 0;
+	}
+	free(buf);
+	return ok;
+}
+
+
+/* Byte for byte comparison of two files */
+static int same_file(const char *name1, const char *name2)
+{
+	unsigned char *buf1, *buf2;
+	long len1, len2;
+	int same;
+
+	buf1 = load_file(name1, &len1);
+	buf2 = load_file(name2, &len2);
+	same = (buf1 && buf2 && len1 == len2 && !memcmp(buf1, buf2, len1));
+	if (buf1) free(buf1);
+	if (buf2) free(buf2);
+	return same;
+}
+
+
+/* Sector for sector comparison of an image with what was written to the
+ * first or second one */
+static int check_image(const char *name, const char *type, int target)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512], expect[512];
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	e = dsk_open(&dr, name, type, NULL);
+	for (c = 0; !e && c < dg.dg_cylinders; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+	{
+		e = dsk_pread(dr, &dg, buf, c, h, s);
+		pattern(expect, c, h, s, target);
+		if (!e && memcmp(buf, expect, sizeof(buf)))
+		{
+			fprintf(stderr, "%s (%s): cylinder %d head %d "
+				"sector %d differs\n", name, type, c, h, s);
+			dsk_close(&dr);
+			return 1;
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Reading back", type, e);
+	return 0;
+}
+
+
+static dsk_err_t apply(const char *name, const char *type)
+{
+	DSK_PDRIVER dr = NULL;
+	dsk_err_t e;
+
+	e = dsk_open(&dr, name, type, NULL);
+	if (!e) e = dsk_diff_apply(dr, &dg, DELTAFILE);
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	return e;
+}
+
+
+int run_diff(const char *type)
+{
+	DSK_PDRIVER dr1 = NULL, dr2 = NULL;
+	DSK_DIFF_STATS dd;
+	dsk_err_t e;
+
+	e = make_image(BASEFILE, type, 0);
+	if (!e) e = make_image(TARGETFILE, type, 1);
+	if (e) return fail("Creating images", type, e);
+
+	remove(DELTAFILE);
+	e = dsk_open(&dr1, BASEFILE, type, NULL);
+	if (!e) e = dsk_open(&dr2, TARGETFILE, type, NULL);
+	if (!e) e = dsk_diff(dr1, dr2, &dg, DELTAFILE, &dd, NULL, NULL);
+	if (dr2) dsk_close(&dr2);
+	if (dr1) dsk_close(&dr1);
+	if (e) return fail("Comparing", type, e);
+	if (dd.dd_tracks != (unsigned long)(CYLS * dg.dg_heads) ||
+	    dd.dd_tracks_differ != 2 || dd.dd_sectors_differ != 2)
+	{
+		fprintf(stderr, "Comparing (%s): %lu of %lu tracks, "
+			"%lu of %lu sectors differ\n", type,
+			dd.dd_tracks_differ, dd.dd_tracks,
+			dd.dd_sectors_differ, dd.dd_sectors);
+		return 1;
+	}
+
+	/* The delta turns a copy of the first image into the second */
+	if (!copy_file(BASEFILE, COPYFILE))
+	{
+		perror(COPYFILE);
+		return 1;
+	}
+	e = apply(COPYFILE, type);
+	if (e) return fail("Applying the delta", type, e);
+	if (check_image(COPYFILE, type, 1)) return 1;
+	/* A raw file has nowhere to lay its sectors out differently, so the
+	 * files themselves must match */
+	if (!strcmp(type, "raw") && !same_file(COPYFILE, TARGETFILE))
+	{
+		fprintf(stderr, "Applying the delta (%s): files differ\n",
+				type);
+		return 1;
+	}
+
+	/* The copy is no longer the image the delta was made against, so
+	 * applying it again must fail, and leave the copy alone */
+	if (!copy_file(TARGETFILE, COPYFILE))
+	{
+		perror(COPYFILE);
+		return 1;
+	}
+	e = apply(COPYFILE, type);
+	if (e != DSK_ERR_MISMATCH)
+	{
+		fprintf(stderr, "Applying to the wrong image (%s) gave: %s\n",
+				type, dsk_strerror(e));
+		return 1;
+	}
+	if (check_image(COPYFILE, type, 1)) return 1;
+	if (!strcmp(type, "raw") && !same_file(COPYFILE, TARGETFILE))
+	{
+		fprintf(stderr, "Refused delta (%s) changed the image\n", type);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,294 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Tests for dsk_overlay_commit(). Sectors are written through an overlay,
+ * and one track is formatted with no sectors; the overlay is committed,
+ * more is written and it is committed again. Once it is closed, the base
+ * must hold all of it, and must not have been touched before the first
+ * commit. A raw base can't hold an empty track, so committing one to it
+ * must fail. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdsk.h"
+
+#define BASEFILE  "check8a.tmp"
+#define DELTAFILE "check8b.tmp"
+
+/* Only a few cylinders are needed */
+#define CYLS 3
+
+/* The track emptied through the overlay */
+#define EMPTY_CYL  1
+#define EMPTY_HEAD 1
+
+static DSK_GEOMETRY dg;
+
+int overlay_commit(void);
+int empty_raw(void);
+int check_image(int stage);
+
+int main(int argc, char **argv)
+{
+	int err;
+
+	dg_stdformat(&dg, FMT_720K, NULL, NULL);
+	dg.dg_cylinders = CYLS;
+
+	err = overlay_commit();
+	if (!err) err = check_image(2);
+	if (!err) err = empty_raw();
+	remove(BASEFILE);
+	remove(DELTAFILE);
+	return err;
+}
+
+
+static int fail(const char *what, dsk_err_t e)
+{
+	fprintf(stderr, "%s: %s\n", what, dsk_strerror(e));
+	return 1;
+}
+
+
+/* Which commit, if any, changed a sector */
+static int written_at(dsk_pcyl_t c, dsk_phead_t h, dsk_psect_t s)
+{
+	if ((c == 0 && h == 0 && s == 2) || (c == 2 && h == 1 && s == 5))
+		return 1;
+	/* The second commit rewrites a track the first one did */
+	if ((c == 0 && h == 1 && s == 7) || (c == 2 && h == 1 && s == 6))
+		return 2;
+	return 0;
+}
+
+
+/* What a sector holds once 'stage' commits have been made. Sectors filled
+ * with one byte are stored without a block in LDBS, so the pattern must
+ * vary within each one */
+static void pattern(unsigned char *buf, dsk_pcyl_t c, dsk_phead_t h,
+		dsk_psect_t s, int stage)
+{
+	size_t n;
+	int w = written_at(c, h, s);
+	int alt = (w && w <= stage) ? 0x80 : 0;
+
+	for (n = 0; n < dg.dg_secsize; n++)
+	{
+		buf[n] = (unsigned char)((n + 31 * c + 7 * h + 3 * s) ^ alt);
+	}
+}
+
+
+static dsk_err_t make_base(const char *type)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512];
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s;
+	dsk_err_t e;
+
+	remove(BASEFILE);
+	remove(DELTAFILE);
+	e = dsk_creat(&dr, BASEFILE, type, NULL);
+	for (c = 0; !e && c < dg.dg_cylinders; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+	{
+		e = dsk_apform(dr, &dg, c, h, 0xE5);
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+		{
+			pattern(buf, c, h, s, 0);
+			e = dsk_pwrite(dr, &dg, buf, c, h, s);
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	return e;
+}
+
+
+/* Write the sectors changed by commit 'stage' */
+static dsk_err_t write_stage(DSK_PDRIVER dr, int stage)
+{
+	unsigned char buf[512];
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s;
+	dsk_err_t e = DSK_ERR_OK;
+
+	for (c = 0; !e && c < dg.dg_cylinders; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+	{
+		if (written_at(c, h, s) != stage) continue;
+		pattern(buf, c, h, s, stage);
+		e = dsk_pwrite(dr, &dg, buf, c, h, s);
+	}
+	return e;
+}
+
+
+/* Format a track with no sectors on it */
+static dsk_err_t empty_track(DSK_PDRIVER dr)
+{
+	DSK_GEOMETRY dg0;
+	DSK_FORMAT blank;
+
+	memcpy(&dg0, &dg, sizeof(dg0));
+	dg0.dg_sectors = 0;
+	memset(&blank, 0, sizeof(blank));
+	return dsk_pformat(dr, &dg0, EMPTY_CYL, EMPTY_HEAD, &blank, 0xE5);
+}
+
+
+int overlay_commit(void)
+{
+	DSK_PDRIVER base = NULL, ov = NULL;
+	dsk_err_t e;
+	const char *op = "Creating the base";
+
+	e = make_base("ldbs");
+	if (e) return fail(op, e);
+
+	op = "Opening the overlay";
+	e = dsk_open(&base, BASEFILE, "ldbs", NULL);
+	if (!e) e = dsk_overlay(&ov, base, DELTAFILE);
+	if (e)
+	{
+		if (base) dsk_close(&base);
+		return fail(op, e);
+	}
+	op = "Writing through the overlay";
+	e = write_stage(ov, 1);
+	if (!e) e = empty_track(ov);
+	/* Nothing reaches the base until the overlay is committed */
+	if (!e) e = dsk_close(&ov);
+	if (e)
+	{
+		if (ov) dsk_close(&ov);
+		return fail(op, e);
+	}
+	if (check_image(0)) return 1;
+
+	op = "Reopening the overlay";
+	e = dsk_open(&ov, "overlay:" BASEFILE "," DELTAFILE, NULL, NULL);
+	if (!e) op = "First commit";
+	if (!e) e = dsk_overlay_commit(ov, &dg);
+	if (!e) op = "Writing after the first commit";
+	if (!e) e = write_stage(ov, 2);
+	if (!e) op = "Second commit";
+	if (!e) e = dsk_overlay_commit(ov, &dg);
+	if (ov)
+	{
+		if (!e) e = dsk_close(&ov); else dsk_close(&ov);
+	}
+	if (e) return fail(op, e);
+	return 0;
+}
+
+
+/* Check the base, once 'stage' commits have been made */
+int check_image(int stage)
+{
+	DSK_PDRIVER dr = NULL;
+	unsigned char buf[512], expect[512];
+	DSK_FORMAT *ids = NULL;
+	dsk_pcyl_t c;
+	dsk_phead_t h;
+	dsk_psect_t s, count = 0;
+	dsk_err_t e;
+
+	e = dsk_open(&dr, BASEFILE, "ldbs", NULL);
+	for (c = 0; !e && c < dg.dg_cylinders; c++)
+	    for (h = 0; !e && h < dg.dg_heads; h++)
+	{
+		if (stage && c == EMPTY_CYL && h == EMPTY_HEAD)
+		{
+			e = dsk_ptrackids(dr, &dg, c, h, &count, &ids);
+			if (e == DSK_ERR_NOADDR)
+			{
+				count = 0;
+				e = DSK_ERR_OK;
+			}
+			if (ids) dsk_free(ids);
+			ids = NULL;
+			if (!e && count)
+			{
+				fprintf(stderr, "Emptied track has %d sectors\n",
+						count);
+				dsk_close(&dr);
+				return 1;
+			}
+			continue;
+		}
+		for (s = dg.dg_secbase; !e && s < dg.dg_secbase + dg.dg_sectors; s++)
+		{
+			e = dsk_pread(dr, &dg, buf, c, h, s);
+			pattern(expect, c, h, s, stage);
+			if (!e && memcmp(buf, expect, sizeof(buf)))
+			{
+				fprintf(stderr, "After %d commits, cylinder %d "
+					"head %d sector %d differs\n",
+					stage, c, h, s);
+				dsk_close(&dr);
+				return 1;
+			}
+		}
+	}
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e) return fail("Reading back the base", e);
+	return 0;
+}
+
+
+/* A raw file can't hold a track with no sectors */
+int empty_raw(void)
+{
+	DSK_PDRIVER base = NULL, ov = NULL;
+	dsk_err_t e;
+
+	e = make_base("raw");
+	if (!e) e = dsk_open(&base, BASEFILE, "raw", NULL);
+	if (!e) e = dsk_overlay(&ov, base, NULL);
+	if (e)
+	{
+		if (base) dsk_close(&base);
+		return fail("Opening an overlay on a raw file", e);
+	}
+	e = empty_track(ov);
+	if (!e) e = dsk_overlay_commit(ov, &dg);
+	dsk_close(&ov);
+	if (e != DSK_ERR_BADFMT)
+	{
+		fprintf(stderr, "Committing an empty track to a raw file "
+				"gave: %s\n", dsk_strerror(e));
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,684 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Benchmark for LibDsk drivers and compression methods. For each driver
+ * and compression method, a synthetic disc image is created and the time
+ * taken by the common operations on it is measured. The results go to
+ * stdout as JSON or CSV, so that runs against different versions of
+ * LibDsk can be compared. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#ifdef HAVE_LIBGEN_H
+# include <libgen.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+# include <sys/time.h>
+# define BENCH_GETTIMEOFDAY
+#endif
+#include "libdsk.h"
+#include "utilopts.h"
+#include "formname.h"
+
+#ifdef __PACIFIC__
+# define AV0 "DSKBENCH"
+#else
+# ifdef HAVE_BASENAME
+#  define AV0 (basename(argv[0]))
+# else
+#  define AV0 argv[0]
+# endif
+#endif
+
+/* The operations timed for each image */
+enum
+{
+	OP_CREATE,	/* dsk_creat() */
+	OP_FORMAT,	/* dsk_apform() every track */
+	OP_WRITE_SEQ,	/* dsk_pwrite() every sector, in order */
+	OP_COMMIT,	/* dsk_close() the new image */
+	OP_OPEN,	/* dsk_open() it again */
+	OP_GETGEOM,	/* dsk_getgeom() */
+	OP_READ_SEQ,	/* dsk_pread() every sector, in order */
+	OP_READ_RAND,	/* dsk_pread() as many sectors, at random */
+	OP_READ_TRACK,	/* dsk_ptread() every track */
+	OP_WRITE_RAND,	/* dsk_pwrite() as many sectors, at random */
+	OP_CLOSE,	/* dsk_close() the modified image */
+	OP_COPY,	/* dsk_copy() it to another format */
+	OP_MAX
+};
+
+static const char *op_names[OP_MAX] =
+{
+	"create", "format", "write_seq", "commit", "open", "getgeom",
+	"read_seq", "read_rand", "read_track", "write_rand", "close", "copy"
+};
+
+typedef struct
+{
+	int done;		/* Operation was attempted */
+	dsk_err_t err;		/* First error it returned */
+	unsigned long count;	/* Calls made */
+	unsigned long bytes;	/* Data transferred */
+	double secs;		/* Best time over all repeats */
+} BENCH_RESULT;
+
+/* Not image files, so they can't be benchmarked this way */
+static const char *skip_types[] =
+{
+	"floppy", "ntwdm", "int25", "remote", "rcpmfs", "overlay", NULL
+};
+
+/* Compression methods that can only decompress */
+static const char *skip_comps[] =
+{
+	"bz2", "tdlzh", "qrst5", NULL
+};
+
+/* Drivers that can only hold discs of a particular shape. -1 means any
+ * value will do. Gotek collections also need the image within the 
+ * collection to be named, as "<type>:<file>,<number>". */
+static const struct
+{
+	const char *names;	/* As in the driver class */
+	int gotek;		/* Image is part of a Gotek collection */
+	int cylinders, heads, sectors, secbase, secsize;
+	const char *why;
+} fixed_types[] =
+{
+	{ "gotek\0gotek144\0gotek1440\0", 1, 80, 2, 18, 1, 512,
+		"only holds 80 x 2 x 18 x 512-byte discs" },
+	{ "gotek72\0gotek720\0", 1, 80, 2, 9, 1, 512,
+		"only holds 80 x 2 x 9 x 512-byte discs" },
+	{ "sap\0SAP\0", 0, -1, -1, 16, -1, -1,
+		"always stores 16 sectors per track" },
+	{ "myz80\0MYZ80\0", 0, 64, 1, 128, 0, 1024,
+		"only holds 64 x 1 x 128 x 1024-byte discs" },
+	{ "simh\0SIMH\0", 0, 127, 2, 32, 0, 128,
+		"only holds 127 x 2 x 32 x 128-byte discs" },
+	{ "nanowasp\0nwasp\0", 0, 40, 2, 10, 1, 512,
+		"only holds 40 x 2 x 10 x 512-byte discs" },
+	{ "ydsk\0YDSK\0", 0, -1, 1, -1, 0, -1,
+		"only holds single-sided discs with sectors numbered from 0" },
+	{ NULL }
+};
+
+static DSK_GEOMETRY geom;
+static const char *fmtname;
+static char *copytype = "ldbs";
+static unsigned repeat = 3;
+static int csv = 0;
+static int nresults = 0;
+static int failed = 0;
+static const char *progname;
+static char *imgfile, *cpyfile;	/* The scratch files */
+static char *imgname, *cpyname;	/* ...as passed to LibDsk */
+static unsigned char *secbuf, *trkbuf;
+
+int help(int argc, char **argv)
+{
+	fprintf(stderr, "Syntax: \n"
+		"      %s { options } { directory }\n\n"
+		"Benchmarks LibDsk drivers and compression methods, using\n"
+		"scratch files in the directory given (default is the\n"
+		"current directory).\n\n", AV0);
+
+	fprintf(stderr, "Options:\n"
+                        "-type <type>     Benchmark only this driver\n"
+                        "                 %s -types lists all drivers\n"
+                        "-comp <comp>     Benchmark only this compression\n"
+                        "                 ('none' for no compression)\n"
+                        "-format <fmt>    Geometry of the test image\n"
+                        "                 %s -formats lists formats\n"
+                        "-ctype <type>    Driver to use as the destination\n"
+                        "                 of dsk_copy() (default ldbs)\n"
+                        "-repeat <count>  Times to run each benchmark; the\n"
+                        "                 best time is reported (default 3)\n"
+                        "-json            Output results as JSON (default)\n"
+                        "-csv             Output results as CSV\n",
+			AV0, AV0);
+	fprintf(stderr,"\nDefault is every driver with every compression "
+			"method.\nDrivers that can't hold the chosen format "
+			"are skipped. If any\noperation fails, it is reported "
+			"here rather than in the results.\n\n");
+
+	fprintf(stderr, "eg: %s -csv /tmp > bench.csv\n"
+                        "    %s -type edsk -comp none\n", AV0, AV0);
+	return 1;
+}
+
+
+static double now(void)
+{
+#ifdef BENCH_GETTIMEOFDAY
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+/* Fixed sequence of pseudo-random numbers, so that every run does the
+ * same work */
+static unsigned long rand_seed;
+
+static unsigned long next_rand(void)
+{
+	rand_seed = (rand_seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+	return rand_seed >> 8;
+}
+
+
+static void poke2(unsigned char *p, unsigned v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+
+/* A DOS boot sector describing the test geometry, so that drivers which
+ * don't store the geometry can find it with dsk_getgeom() */
+static void boot_sector(void)
+{
+	unsigned long total = (unsigned long)geom.dg_cylinders *
+				geom.dg_heads * geom.dg_sectors;
+
+	memset(secbuf, 0, geom.dg_secsize);
+	memcpy(secbuf, "\xEB\x3C\x90" "DSKBENCH", 11);
+	poke2(secbuf + 11, (unsigned)geom.dg_secsize);
+	secbuf[13] = 2;				/* Sectors per cluster */
+	poke2(secbuf + 14, 1);			/* Reserved sectors */
+	secbuf[16] = 2;				/* FATs */
+	poke2(secbuf + 17, 112);		/* Root directory entries */
+	poke2(secbuf + 19, (unsigned)(total > 0xFFFF ? 0 : total));
+	secbuf[21] = 0xF9;			/* Media byte */
+	poke2(secbuf + 22, 3);			/* Sectors per FAT */
+	poke2(secbuf + 24, geom.dg_sectors);
+	poke2(secbuf + 26, geom.dg_heads);
+	if (geom.dg_secsize >= 512)
+	{
+		secbuf[510] = 0x55;
+		secbuf[511] = 0xAA;
+	}
+}
+
+
+/* Contents of a sector. The first is a boot sector; after that, every 
+ * other one is left blank, as unused space on a real disc would be, and
+ * the rest are filled with data that doesn't compress too well. */
+static void fill_sector(unsigned long lsect, unsigned char pass)
+{
+	size_t n;
+
+	if (lsect == 0)
+	{
+		boot_sector();
+		return;
+	}
+	if (lsect & 1)
+	{
+		memset(secbuf, 0xE5, geom.dg_secsize);
+		return;
+	}
+	rand_seed = lsect * 2 + pass;
+	for (n = 0; n < geom.dg_secsize; n++)
+	{
+		secbuf[n] = (unsigned char)next_rand();
+	}
+}
+
+
+static void json_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\') printf("\\%c", *s);
+		else if ((unsigned char)*s < ' ') printf("\\u%04x", *s);
+		else putchar(*s);
+	}
+	putchar('"');
+}
+
+
+static void put_header(void)
+{
+	if (csv)
+	{
+		printf("type,comp,op,status,count,bytes,seconds,"
+			"ops_per_sec,mb_per_sec\n");
+		return;
+	}
+	printf("{\n  \"libdsk\": ");
+	json_string(LIBDSK_VERSION);
+	printf(",\n  \"format\": ");
+	json_string(fmtname);
+	printf(",\n  \"cylinders\": %d,\n  \"heads\": %d,\n"
+		"  \"sectors\": %d,\n  \"secsize\": %lu,\n"
+		"  \"repeat\": %u,\n  \"copy_type\": ",
+		geom.dg_cylinders, geom.dg_heads, geom.dg_sectors,
+		(unsigned long)geom.dg_secsize, repeat);
+	json_string(copytype);
+	printf(",\n  \"results\": [");
+}
+
+
+static void put_footer(void)
+{
+	if (!csv) printf("\n  ]\n}\n");
+}
+
+
+static void put_result(const char *type, const char *comp, int op,
+			const BENCH_RESULT *r)
+{
+	const char *status = r->err ? dsk_strerror(r->err) : "ok";
+	double ops = 0, mbs = 0;
+
+	if (r->secs > 0 && !r->err)
+	{
+		ops = r->count / r->secs;
+		mbs = r->bytes / 1048576.0 / r->secs;
+	}
+	if (csv)
+	{
+		printf("%s,%s,%s,\"%s\",%lu,%lu,%.6f,%.1f,%.3f\n",
+			type, comp, op_names[op], status,
+			r->count, r->bytes, r->secs, ops, mbs);
+		return;
+	}
+	printf("%s\n    { \"type\": ", nresults ? "," : "");
+	json_string(type);
+	printf(", \"comp\": ");
+	json_string(comp);
+	printf(", \"op\": \"%s\", \"status\": ", op_names[op]);
+	json_string(status);
+	printf(", \"count\": %lu, \"bytes\": %lu, \"seconds\": %.6f, "
+		"\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f }",
+		r->count, r->bytes, r->secs, ops, mbs);
+	++nresults;
+}
+
+
+/* Record one timed operation. The first error, and the best time of the
+ * runs that succeeded, are kept. */
+static void record(BENCH_RESULT *r, dsk_err_t err, double t0,
+		unsigned long count, unsigned long bytes)
+{
+	double secs = now() - t0;
+
+	if (err)
+	{
+		if (!r->err) r->err = err;
+	}
+	else if (!r->done || r->err || secs < r->secs)
+	{
+		r->secs = secs;
+	}
+	r->done  = 1;
+	r->count = count;
+	r->bytes = bytes;
+}
+
+
+/* Time an operation on every sector, in order or at random */
+static dsk_err_t all_sectors(DSK_PDRIVER dr, int write, int random,
+			unsigned char pass, unsigned long *count)
+{
+	unsigned long total = (unsigned long)geom.dg_cylinders *
+				geom.dg_heads * geom.dg_sectors;
+	unsigned long n, lsect;
+	dsk_pcyl_t cyl;
+	dsk_phead_t head;
+	dsk_psect_t sec;
+	dsk_err_t err;
+
+	for (n = 0; n < total; n++)
+	{
+		if (random)
+		{
+			rand_seed = n * 7 + pass;
+			lsect = next_rand() % total;
+		}
+		else lsect = n;
+		sec  = (dsk_psect_t)(lsect % geom.dg_sectors);
+		head = (dsk_phead_t)((lsect / geom.dg_sectors) % geom.dg_heads);
+		cyl  = (dsk_pcyl_t)(lsect / geom.dg_sectors / geom.dg_heads);
+		if (write)
+		{
+			fill_sector(lsect, pass);
+			err = dsk_pwrite(dr, &geom, secbuf, cyl, head,
+					sec + geom.dg_secbase);
+		}
+		else	err = dsk_pread(dr, &geom, secbuf, cyl, head,
+					sec + geom.dg_secbase);
+		if (err)
+		{
+			*count = n;
+			return err;
+		}
+	}
+	*count = total;
+	return DSK_ERR_OK;
+}
+
+
+/* One pass over a single driver / compression pair */
+static void bench_pass(char *type, char *comp, BENCH_RESULT *res)
+{
+	DSK_PDRIVER dr = NULL, dest = NULL;
+	DSK_GEOMETRY g2;
+	dsk_err_t err;
+	dsk_pcyl_t cyl;
+	dsk_phead_t head;
+	unsigned long count;
+	unsigned long tracks = (unsigned long)geom.dg_cylinders * geom.dg_heads;
+	unsigned long total  = tracks * geom.dg_sectors;
+	unsigned long bytes  = total * geom.dg_secsize;
+	size_t tracklen = geom.dg_sectors * geom.dg_secsize;
+	double t0;
+
+	remove(imgfile);
+	remove(cpyfile);
+
+	t0 = now();
+	err = dsk_creat(&dr, imgname, type, comp);
+	record(&res[OP_CREATE], err, t0, 1, 0);
+	if (err) return;
+
+	t0 = now();
+	err = DSK_ERR_OK;
+	count = 0;
+	for (cyl = 0; cyl < geom.dg_cylinders && !err; cyl++)
+	    for (head = 0; head < geom.dg_heads && !err; head++)
+	{
+		err = dsk_apform(dr, &geom, cyl, head, 0xE5);
+		if (!err) ++count;
+	}
+	record(&res[OP_FORMAT], err, t0, count, count * tracklen);
+
+	t0 = now();
+	err = all_sectors(dr, 1, 0, 0, &count);
+	record(&res[OP_WRITE_SEQ], err, t0, count, count * geom.dg_secsize);
+
+	t0 = now();
+	err = dsk_close(&dr);
+	record(&res[OP_COMMIT], err, t0, 1, bytes);
+
+	t0 = now();
+	err = dsk_open(&dr, imgname, type, comp);
+	record(&res[OP_OPEN], err, t0, 1, bytes);
+	if (err) return;
+
+	t0 = now();
+	err = dsk_getgeom(dr, &g2);
+	if (!err && (g2.dg_cylinders != geom.dg_cylinders ||
+		     g2.dg_heads     != geom.dg_heads     ||
+		     g2.dg_sectors   != geom.dg_sectors   ||
+		     g2.dg_secsize   != geom.dg_secsize   ||
+		     g2.dg_secbase   != geom.dg_secbase)) err = DSK_ERR_BADFMT;
+	record(&res[OP_GETGEOM], err, t0, 1, 0);
+
+	t0 = now();
+	err = all_sectors(dr, 0, 0, 0, &count);
+	record(&res[OP_READ_SEQ], err, t0, count, count * geom.dg_secsize);
+
+	t0 = now();
+	err = all_sectors(dr, 0, 1, 0, &count);
+	record(&res[OP_READ_RAND], err, t0, count, count * geom.dg_secsize);
+
+	t0 = now();
+	err = DSK_ERR_OK;
+	count = 0;
+	for (cyl = 0; cyl < geom.dg_cylinders && !err; cyl++)
+	    for (head = 0; head < geom.dg_heads && !err; head++)
+	{
+		err = dsk_ptread(dr, &geom, trkbuf, cyl, head);
+		if (!err) ++count;
+	}
+	record(&res[OP_READ_TRACK], err, t0, count, count * tracklen);
+
+	t0 = now();
+	err = all_sectors(dr, 1, 1, 1, &count);
+	record(&res[OP_WRITE_RAND], err, t0, count, count * geom.dg_secsize);
+
+	t0 = now();
+	err = dsk_close(&dr);
+	record(&res[OP_CLOSE], err, t0, 1, bytes);
+	if (err) return;
+
+	/* Conversion to another format, as dskconv would do it */
+	t0 = now();
+	err = dsk_open(&dr, imgname, type, comp);
+	if (!err) err = dsk_creat(&dest, cpyname, copytype, NULL);
+	if (!err) err = dsk_copy(&geom, dr, dest);
+	if (dest)
+	{
+		dsk_err_t e2 = dsk_close(&dest);
+		if (!err) err = e2;
+	}
+	if (dr) dsk_close(&dr);
+	record(&res[OP_COPY], err, t0, 1, bytes);
+}
+
+
+static int fixed_type(const char *type)
+{
+	const char *s;
+	int n;
+
+	for (n = 0; fixed_types[n].names; n++)
+	{
+		for (s = fixed_types[n].names; *s; s += 1 + strlen(s))
+		{
+			if (!strcmp(s, type)) return n;
+		}
+	}
+	return -1;
+}
+
+
+static int fits(int want, unsigned long have)
+{
+	return want < 0 || (unsigned long)want == have;
+}
+
+
+/* Name to pass to LibDsk for a scratch file. Returns NULL if the driver
+ * can't hold the test geometry, with the reason in *why. */
+static char *set_name(char *name, const char *file, const char *type,
+			const char **why)
+{
+	int n = fixed_type(type);
+
+	strcpy(name, file);
+	if (n < 0) return name;
+	if (!fits(fixed_types[n].cylinders, geom.dg_cylinders) ||
+	    !fits(fixed_types[n].heads,     geom.dg_heads)     ||
+	    !fits(fixed_types[n].sectors,   geom.dg_sectors)   ||
+	    !fits(fixed_types[n].secbase,   geom.dg_secbase)   ||
+	    !fits(fixed_types[n].secsize,   geom.dg_secsize))
+	{
+		*why = fixed_types[n].why;
+		return NULL;
+	}
+	if (fixed_types[n].gotek) sprintf(name, "%s:%s,0", type, file);
+	return name;
+}
+
+
+static void bench(char *type, char *comp)
+{
+	BENCH_RESULT res[OP_MAX];
+	const char *why;
+	unsigned n;
+	int op;
+
+	if (!set_name(imgname, imgfile, type, &why))
+	{
+		fprintf(stderr, "%s: Skipping %s: %s\n", progname, type, why);
+		return;
+	}
+	if (comp && strcmp(imgname, imgfile))
+	{
+		fprintf(stderr, "%s: Skipping %s (%s): a Gotek collection "
+			"can't be compressed\n", progname, type, comp);
+		return;
+	}
+	fprintf(stderr, "%-79.79s\r", type);
+	memset(res, 0, sizeof(res));
+	for (n = 0; n < repeat; n++)
+	{
+		bench_pass(type, comp, res);
+		/* Don't bother repeating something that can't be done */
+		if (res[OP_CREATE].err || res[OP_OPEN].err) break;
+	}
+	remove(imgfile);
+	remove(cpyfile);
+	/* Only successful operations are worth timing */
+	for (op = 0; op < OP_MAX; op++)
+	{
+		if (!res[op].done) continue;
+		if (res[op].err)
+		{
+			fprintf(stderr, "%s: %s (%s): %s failed: %s\n", 
+				progname, type, comp ? comp : "none", 
+				op_names[op], dsk_strerror(res[op].err));
+			failed = 1;
+		}
+		else put_result(type, comp ? comp : "none", op, &res[op]);
+	}
+	fflush(stdout);
+}
+
+
+static void bench_types(char *type, char *comp)
+{
+	int n, m;
+	char *name;
+
+	if (type)
+	{
+		bench(type, comp);
+		return;
+	}
+	for (n = 0; !dsk_type_enum(n, &name); n++)
+	{
+		for (m = 0; skip_types[m]; m++)
+		{
+			if (!strcmp(name, skip_types[m])) break;
+		}
+		if (!skip_types[m]) bench(name, comp);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	char *type, *comp, *dir = ".";
+	dsk_format_t format;
+	const char *fmtwhy;
+	int n, m;
+	char *name;
+        int stdret;
+
+        stdret = standard_args(argc, argv); if (!stdret) return 0;
+
+	type     = check_type("-type", &argc, argv);
+	comp     = check_type("-comp", &argc, argv);
+	copytype = check_type("-ctype", &argc, argv);
+	format   = check_format("-format", &argc, argv);
+	if (find_arg("-repeat", argc, argv) > 0)
+		repeat = check_retry("-repeat", &argc, argv);
+	csv = present_arg("-csv", &argc, argv);
+	present_arg("-json", &argc, argv);
+
+        if (find_arg("--help",    argc, argv) > 0) return help(argc, argv);
+	args_complete(&argc, argv);
+	if (argc > 2) return help(argc, argv);
+	if (argc == 2) dir = argv[1];
+	if (!copytype) copytype = "ldbs";
+	if (format == -1) format = FMT_720K;
+	progname = AV0;
+	if (dg_stdformat(&geom, format, &fmtname, NULL))
+	{
+		fprintf(stderr, "%s: Unknown format\n", AV0);
+		return 1;
+	}
+	imgfile = malloc(strlen(dir) + 20);
+	cpyfile = malloc(strlen(dir) + 20);
+	imgname = malloc(strlen(dir) + 40);
+	cpyname = malloc(strlen(dir) + 40);
+	secbuf  = malloc(geom.dg_secsize);
+	trkbuf  = malloc(geom.dg_secsize * geom.dg_sectors);
+	if (!imgfile || !cpyfile || !imgname || !cpyname || 
+	    !secbuf || !trkbuf)
+	{
+		fprintf(stderr, "%s: Out of memory\n", AV0);
+		return 1;
+	}
+	sprintf(imgfile, "%s/dskbench.img", dir);
+	sprintf(cpyfile, "%s/dskbench.cpy", dir);
+	if (!set_name(cpyname, cpyfile, copytype, &fmtwhy))
+	{
+		fprintf(stderr, "%s: Can't copy to %s: %s\n", AV0, 
+				copytype, fmtwhy);
+		return 1;
+	}
+
+	/* Progress messages would get mixed up with the results */
+	dsk_reportfunc_set(NULL, NULL);
+
+	put_header();
+	if (comp)
+	{
+		bench_types(type, strcmp(comp, "none") ? comp : NULL);
+	}
+	else
+	{
+		bench_types(type, NULL);
+		for (n = 0; !dsk_comp_enum(n, &name); n++)
+		{
+			for (m = 0; skip_comps[m]; m++)
+			{
+				if (!strcmp(name, skip_comps[m])) break;
+			}
+			if (!skip_comps[m]) bench_types(type, name);
+		}
+	}
+	put_footer();
+	fprintf(stderr, "%-79.79s\r", "");
+
+	free(trkbuf);
+	free(secbuf);
+	free(cpyname);
+	free(imgname);
+	free(cpyfile);
+	free(imgfile);
+	return failed;
+}
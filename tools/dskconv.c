@@ -51,6 +51,8 @@ int do_copy(char *infile, char *outfile);
 static dsk_format_t format = -1;
 static char *intyp = NULL, *outtyp = NULL;
 static char *incomp = NULL, *outcomp = NULL;
+static int stats = 0;
+static int sparse = 0;
 
 static void report(const char *s)
 {
@@ -75,7 +77,10 @@ int help(int argc, char **argv)
                        "-otype <type>   type of output disc image\n"
                        "                '%s -types' lists valid types.\n"
 		       "-format         Force a specified format name\n"
-                       "                '%s -formats' lists valid formats.\n",
+                       "                '%s -formats' lists valid formats.\n"
+                       "-sparse         Leave zero-filled sectors as holes (raw output)\n"
+                       "-stats          Print operation counts and timings when done\n"
+                       "-trace <file>   Write a trace of all disc operations to a file\n",
 			AV0, AV0);
 
 	fprintf(stderr,"\nDefault in-image type is autodetect."
@@ -106,6 +111,9 @@ int main(int argc, char **argv)
         outcomp   = check_type("-ocomp", &argc, argv);
 	if (!outtyp) outtyp = "ldbs";
         format    = check_format("-format", &argc, argv);
+	if (present_arg("-sparse", &argc, argv)) sparse = 1;
+	if (present_arg("-stats", &argc, argv)) stats = 1;
+	check_trace("-trace", &argc, argv);
 	args_complete(&argc, argv);
 	return do_copy(argv[1], argv[2]);
 }
@@ -124,6 +132,11 @@ int do_copy(char *infile, char *outfile)
 
 	        e = dsk_open (&indr,  infile,  intyp, incomp);
 	if (!e) e = dsk_creat(&outdr, outfile, outtyp, outcomp);
+	if (!e && sparse && dsk_set_option(outdr, "RAW:SPARSE", 1))
+	{
+		fprintf(stderr, "Warning: %s files cannot be made sparse\n", 
+				dsk_drvname(outdr));
+	}
 
 	printf("Input driver: %s\nOutput driver:%s\n",
                         dsk_drvdesc(indr), dsk_drvdesc(outdr));
@@ -167,6 +180,8 @@ int do_copy(char *infile, char *outfile)
 	if (!e) op = "Finalizing";
 	
 	printf("\r                                     \r");
+	if (stats && indr)  dump_stats(indr,  infile);
+	if (stats && outdr) dump_stats(outdr, outfile);
 	if (outdr) 
 	{
 		if (!e) e = dsk_close(&outdr); else dsk_close(&outdr);
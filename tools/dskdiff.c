@@ -0,0 +1,229 @@
+/***************************************************************************
+ *                                                                         *
+ *    LIBDSK: General floppy and diskimage access library                  *
+ *    Copyright (C) 2019  John Elliott <seasip.webmaster@gmail.com>        *
+ *                                                                         *
+ *    This library is free software; you can redistribute it and/or        *
+ *    modify it under the terms of the GNU Library General Public          *
+ *    License as published by the Free Software Foundation; either         *
+ *    version 2 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *    This library is distributed in the hope that it will be useful,      *
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+ *    Library General Public License for more details.                     *
+ *                                                                         *
+ *    You should have received a copy of the GNU Library General Public    *
+ *    License along with this library; if not, write to the Free           *
+ *    Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,      *
+ *    MA 02111-1307, USA                                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/* Compare two disc images, and optionally save or apply the differences */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#ifdef HAVE_LIBGEN_H
+# include <libgen.h>
+#endif
+#include "libdsk.h"
+#include "utilopts.h"
+#include "formname.h"
+
+#ifdef __PACIFIC__
+# define AV0 "DSKDIFF"
+#else
+# ifdef HAVE_BASENAME
+#  define AV0 (basename(argv[0]))
+# else
+#  define AV0 argv[0]
+# endif
+#endif
+
+int do_diff(char *file1, char *file2);
+int do_apply(char *deltafile, char *file);
+
+static dsk_format_t format = -1;
+static char *intyp = NULL, *outtyp = NULL;
+static char *incomp = NULL, *outcomp = NULL;
+static char *deltafile = NULL;
+static int verbose = 0;
+static int quiet = 0;
+static int stats = 0;
+
+static void report(const char *s)
+{
+        fprintf(stderr, "%-79.79s\r", s);
+        fflush(stderr);
+}
+
+static void report_end(void)
+{
+        fprintf(stderr, "\r%-79.79s\r", "");
+        fflush(stderr);
+}
+
+
+int help(int argc, char **argv)
+{
+	fprintf(stderr, "Syntax: \n"
+                       "      %s {options} image1 image2\n"
+                       "      %s {options} -apply delta image\n",
+			AV0, AV0);
+	fprintf(stderr,"\nOptions are:\n"
+		       "-itype <type>   type of first disc image\n"
+                       "-otype <type>   type of second disc image\n"
+                       "                '%s -types' lists valid types.\n"
+		       "-icomp <comp>   compression of first disc image\n"
+		       "-ocomp <comp>   compression of second disc image\n"
+		       "-format         Force a specified format name\n"
+                       "                '%s -formats' lists valid formats.\n"
+                       "-delta <file>   Save the tracks of image2 that differ\n"
+                       "                from image1 in an LDBS file\n"
+                       "-apply          Write the tracks in 'delta' to 'image'\n"
+                       "-v              List the tracks that differ\n"
+                       "-q              Print nothing; just set the exit status\n"
+                       "-stats          Print operation counts and timings when done\n"
+                       "-trace <file>   Write a trace of all disc operations to a file\n",
+			AV0, AV0);
+
+	fprintf(stderr,"\nDefault image types are autodetect.\n"
+		       "Exit status is 0 if the images are the same, 1 if they\n"
+		       "differ and 2 if there was an error.\n\n");
+
+	fprintf(stderr, "eg: %s original.dsk converted.ldbs\n"
+                        "    %s -delta changes.ldbs old.dsk new.dsk\n"
+                        "    %s -apply changes.ldbs old.dsk\n",
+			AV0, AV0, AV0);
+	return 2;
+}
+
+
+int main(int argc, char **argv)
+{
+	int stdret, apply = 0;
+
+        stdret = standard_args(argc, argv); if (!stdret) return 0;
+	if (argc < 3) return help(argc, argv);
+	if (find_arg("--help",    argc, argv) > 0) return help(argc, argv);
+
+	ignore_arg("-type", 2, &argc, argv);
+	ignore_arg("-comp", 2, &argc, argv);
+
+	intyp     = check_type("-itype", &argc, argv);
+        outtyp    = check_type("-otype", &argc, argv);
+	incomp    = check_type("-icomp", &argc, argv);
+        outcomp   = check_type("-ocomp", &argc, argv);
+	deltafile = check_type("-delta", &argc, argv);
+        format    = check_format("-format", &argc, argv);
+	if (present_arg("-apply", &argc, argv)) apply = 1;
+	if (present_arg("-v", &argc, argv)) verbose = 1;
+	if (present_arg("-q", &argc, argv)) quiet = 1;
+	if (present_arg("-stats", &argc, argv)) stats = 1;
+	check_trace("-trace", &argc, argv);
+	args_complete(&argc, argv);
+	if (argc < 3) return help(argc, argv);
+
+	if (!quiet) dsk_reportfunc_set(report, report_end);
+	if (apply) return do_apply(argv[1], argv[2]);
+	return do_diff(argv[1], argv[2]);
+}
+
+
+static void list_track(dsk_pcyl_t cylinder, dsk_phead_t head,
+		dsk_psect_t differ, void *param)
+{
+	printf("Cylinder %2d head %d: %d sector%s differ%s\n", cylinder, head,
+		differ, differ == 1 ? "" : "s", differ == 1 ? "s" : "");
+}
+
+
+int do_diff(char *file1, char *file2)
+{
+	DSK_PDRIVER dr1 = NULL, dr2 = NULL;
+	DSK_GEOMETRY dg, dg2;
+	DSK_DIFF_STATS dd;
+	dsk_err_t e;
+	char *op = "Opening first image";
+
+	        e = dsk_open(&dr1, file1, intyp, incomp);
+	if (!e) op = "Opening second image";
+	if (!e) e = dsk_open(&dr2, file2, outtyp, outcomp);
+	if (!e && format == -1)
+	{
+		/* Compare all the tracks that either image has */
+		op = "Identifying disc";
+		e = dsk_getgeom(dr1, &dg);
+		if (!e && dsk_getgeom(dr2, &dg2) == DSK_ERR_OK)
+		{
+			if (dg2.dg_cylinders > dg.dg_cylinders)
+				dg.dg_cylinders = dg2.dg_cylinders;
+			if (dg2.dg_heads > dg.dg_heads)
+				dg.dg_heads = dg2.dg_heads;
+		}
+	}
+	else if (!e) e = dg_stdformat(&dg, format, NULL, NULL);
+	if (!e)
+	{
+		op = "Comparing";
+		e = dsk_diff(dr1, dr2, &dg, deltafile, &dd,
+			(verbose && !quiet) ? list_track : NULL, NULL);
+	}
+	if (stats && dr1) dump_stats(dr1, file1);
+	if (stats && dr2) dump_stats(dr2, file2);
+	if (dr2) dsk_close(&dr2);
+	if (dr1) dsk_close(&dr1);
+	if (e)
+	{
+		if (!quiet) fprintf(stderr, "%s: %s\n", op, dsk_strerror(e));
+		return 2;
+	}
+	if (!quiet)
+	{
+		if (dd.dd_tracks_differ)
+			printf("%s and %s differ: %lu of %lu tracks, "
+				"%lu of %lu sectors\n", file1, file2,
+				dd.dd_tracks_differ, dd.dd_tracks,
+				dd.dd_sectors_differ, dd.dd_sectors);
+		else	printf("%s and %s are the same (%lu tracks, "
+				"%lu sectors)\n", file1, file2,
+				dd.dd_tracks, dd.dd_sectors);
+	}
+	return dd.dd_tracks_differ ? 1 : 0;
+}
+
+
+int do_apply(char *delta, char *file)
+{
+	DSK_PDRIVER dr = NULL;
+	DSK_GEOMETRY dg;
+	dsk_err_t e;
+	char *op = "Opening image";
+
+	        e = dsk_open(&dr, file, intyp, incomp);
+	if (!e && format == -1)
+	{
+		op = "Identifying disc";
+		e = dsk_getgeom(dr, &dg);
+	}
+	else if (!e) e = dg_stdformat(&dg, format, NULL, NULL);
+	if (!e)
+	{
+		op = "Applying delta";
+		e = dsk_diff_apply(dr, &dg, delta);
+	}
+	if (stats && dr) dump_stats(dr, file);
+	if (dr)
+	{
+		if (!e) e = dsk_close(&dr); else dsk_close(&dr);
+	}
+	if (e)
+	{
+		if (!quiet) fprintf(stderr, "%s: %s\n", op, dsk_strerror(e));
+		return 2;
+	}
+	return 0;
+}
@@ -51,6 +51,9 @@
 static int retries = 1;
 static int pcdos = 0;
 static int apricot = 0;
+static int stats = 0;
+static int sparse = 0;
+static unsigned char filler = 0xE5;
 
 int do_format(const char *outfile, const char *outtyp, const char *outcomp, 
 		int forcehead, dsk_format_t format);
@@ -68,6 +71,10 @@ int help(int argc, char **argv)
                 "  -side <side>       Force format on head 0 or 1.\n"
 		"  -pcdos             Create an empty PCDOS filesystem.\n"
 		"  -apricot           Create an empty Apricot MSDOS filesystem.\n" 
+		"  -filler <byte>     Fill formatted sectors with this byte (default 0xE5).\n"
+		"  -sparse            Leave the file sparse where sectors are zero-filled.\n"
+		"  -stats             Print operation counts and timings when done.\n"
+		"  -trace <file>      Write a trace of all disc operations to a file.\n"
 		, AV0, AV0, AV0);
 	fprintf(stderr,"\nDefault type is DSK.\nDefault format is PCW 180k.\n\n");
 		
@@ -78,6 +85,26 @@ int help(int argc, char **argv)
 }
 
 
+static unsigned char check_filler(char *arg, int *argc, char **argv)
+{
+	int n = find_arg(arg, *argc, argv);
+	char *end;
+	long nr;
+
+	if (n < 0) return 0xE5;	
+	excise_arg(n, argc, argv);
+	if (n < *argc) nr = strtol(argv[n], &end, 0);
+	if (n >= *argc || end == argv[n] || *end || nr < 0 || nr > 255)
+	{
+		fprintf(stderr, "Syntax error: use '%s nnn' where nnn is 0-255\n", arg);
+		exit(1);
+	}
+	excise_arg(n, argc, argv);
+
+	return (unsigned char)nr;
+}
+
+
 static void report(const char *s)
 {
         printf("%-79.79s\r", s);
@@ -116,6 +143,10 @@ int main(int argc, char **argv)
         retries   = check_retry("-retry", &argc, argv);
 	pcdos = present_arg("-pcdos", &argc, argv);
 	apricot = present_arg("-apricot", &argc, argv);
+	stats = present_arg("-stats", &argc, argv);
+	sparse = present_arg("-sparse", &argc, argv);
+	filler = check_filler("-filler", &argc, argv);
+	check_trace("-trace", &argc, argv);
 
 	if (format == -1) format = FMT_180K;
 	args_complete(&argc, argv);
@@ -412,6 +443,11 @@ int do_format(const char *outfile, const char *outtyp, const char *outcomp,
 	e = dsk_creat(&outdr, outfile, outtyp, outcomp);
 	if (!e) e = dsk_set_retry(outdr, retries);
 	if (!e && forcehead >= 0) e = dsk_set_forcehead(outdr, forcehead);
+	if (!e && sparse && dsk_set_option(outdr, "RAW:SPARSE", 1))
+	{
+		fprintf(stderr, "Warning: %s files cannot be made sparse\n", 
+				dsk_drvname(outdr));
+	}
 	if (!e) e = dg_stdformat(&dg, format, NULL, &fdesc);
 	if (!e)
 	{
@@ -425,7 +461,7 @@ int do_format(const char *outfile, const char *outtyp, const char *outcomp,
 			 	head+1, dg.dg_heads);
 			fflush(stdout);
 
-			if (!e) e = dsk_apform(outdr, &dg, cyl, head, 0xE5);
+			if (!e) e = dsk_apform(outdr, &dg, cyl, head, filler);
 			if (e) break;	
 		    }
 		}
@@ -481,6 +517,7 @@ int do_format(const char *outfile, const char *outtyp, const char *outcomp,
 		}
 	}
 	printf("\r                                     \r");
+	if (stats && outdr) dump_stats(outdr, outfile);
 	if (outdr) 
 	{
 		if (!e) e = dsk_close(&outdr); else dsk_close(&outdr);
@@ -490,6 +527,14 @@ int do_format(const char *outfile, const char *outtyp, const char *outcomp,
 		fprintf(stderr, "%s\n", dsk_strerror(e));
 		return 1;
 	}
+	if (sparse)
+	{
+		unsigned long logical, allocated;
+
+		if (!dsk_get_filesize(outfile, &logical, &allocated))
+			printf("%s: %lu bytes, %lu allocated\n", outfile,
+				logical, allocated);
+	}
 	return 0;
 }
 
@@ -42,6 +42,7 @@
 #endif
 
 static unsigned retries = 1;
+static int hash = 0;
 
 int do_login(int argc, char *outfile, char *outtyp, char *outcomp, int forcehead);
 
@@ -53,7 +54,8 @@ int help(int argc, char **argv)
                 "  -type <type>       Type of disk image file to read.\n"
                 "                     '%s -types' lists valid types.\n"
                 "  -retry <count>     Set number of retries.\n"
-                "  -side <side>       Force read of head 0 or 1.\n",
+                "  -side <side>       Force read of head 0 or 1.\n"
+                "  -hash              Print a fingerprint of the disc contents.\n",
 		AV0, AV0);
 
 	fprintf(stderr,"\nDefault type is autodetect.\n\n");
@@ -96,6 +98,7 @@ int main(int argc, char **argv)
 	outcomp   = check_type("-comp", &argc, argv);
 	forcehead = check_forcehead("-side", &argc, argv);	
 	retries   = check_retry("-retry", &argc, argv);
+	hash      = present_arg("-hash", &argc, argv);
 
         if (find_arg("--help",    argc, argv) > 0) return help(argc, argv);
 	args_complete(&argc, argv);
@@ -167,6 +170,7 @@ int do_login(int argc, char *outfile, char *outtyp, char *outcomp, int forcehead
 	char *comment;
 	int indent = 0;
 	int opt, any;
+	dsk_err_t he = DSK_ERR_OK;
 
 	dsk_reportfunc_set(report, report_end);	
 	e = dsk_open(&outdr, outfile, outtyp, outcomp);
@@ -217,6 +221,21 @@ int do_login(int argc, char *outfile, char *outtyp, char *outcomp, int forcehead
 			indent, indent, "", (dg.dg_fm & RECMODE_COMPLEMENT) ? "Yes" : "No",
 			indent, indent, "", dg.dg_rwgap,   
 			indent, indent, "", dg.dg_fmtgap);
+		if (hash)
+		{
+			unsigned char fp[DSK_HASH_LEN];
+			int n;
+
+			he = dsk_hash(outdr, &dg, fp, NULL, NULL);
+			if (!he)
+			{
+				printf("%-*.*sFingerprint:   ",
+					indent, indent, "");
+				for (n = 0; n < DSK_HASH_LEN; n++)
+					printf("%02x", fp[n]);
+				putchar('\n');
+			}
+		}
 		e = dsk_drive_status(outdr, &dg, 0, &drv_status);
 		if (!e)
 		{	
@@ -262,6 +281,7 @@ int do_login(int argc, char *outfile, char *outtyp, char *outcomp, int forcehead
 			}			
 			++opt;
 		}
+		if (!e) e = he;
 	}
 	if (outdr) 
 	{
@@ -103,6 +103,7 @@ int help(int argc, char **argv)
 		       "-last <cyl>    Scan up to specified cylinder\n"
 		       "-dstep         Double-step\n"
 		       "-xml           Output as XML\n"
+		       "-trace <file>  Write a trace of all disc operations to a file\n"
 		       "-format        Force a specified format name\n"
                        "               '%s -formats' lists valid formats.\n",
 			AV0, AV0);
@@ -137,6 +138,7 @@ int main(int argc, char **argv)
 	retries   = check_retry("-retry", &argc, argv);
 	if (present_arg("-dstep", &argc, argv)) idstep = 1;
 	if (present_arg("-xml", &argc, argv)) xml = 1;
+	check_trace("-trace", &argc, argv);
         format    = check_format("-format", &argc, argv);
 	first     = check_numeric("-first", &argc, argv);
 	last      = check_numeric("-last", &argc, argv);
@@ -54,6 +54,8 @@ static int pcdos = 0;
 static int stubborn = 0;
 static int logical = 0;
 static int noformat = 0;
+static int dedup = 0;
+static int stats = 0;
 static dsk_format_t format = -1;
 static const char *intyp = NULL;
 static const char *outtyp = NULL;
@@ -115,6 +117,9 @@ int help(int argc, char **argv)
 		       "-idstep         Double-step when reading\n"
 		       "-odstep         Double-step when writing\n"
                        "-noformat       Do not format destination disc\n"
+                       "-dedup          Store identical sectors only once (LDBS output)\n"
+                       "-stats          Print operation counts and timings when done\n"
+                       "-trace <file>   Write a trace of all disc operations to a file\n"
                        "-md3            Defeat MicroDesign 3 copy protection\n"
                        "-apricot        Convert Apricot superblock to PC-DOS format\n"
                        "-pcdos          Convert PC-DOS superblock to Apricot format\n"
@@ -190,6 +195,9 @@ int main(int argc, char **argv)
 	if (present_arg("-pcdos", &argc, argv)) pcdos = 1;
 	if (present_arg("-stubborn", &argc, argv)) stubborn = 1;
 	if (present_arg("-noformat", &argc, argv)) noformat = 1;
+	if (present_arg("-dedup", &argc, argv)) dedup = 1;
+	if (present_arg("-stats", &argc, argv)) stats = 1;
+	check_trace("-trace", &argc, argv);
 	if (present_arg("-logical", &argc, argv)) 
 	{
 		logical = 1;
@@ -225,6 +233,7 @@ int do_copy(char *infile, char *outfile)
 	if (!e && outside >= 0) e = dsk_set_option(outdr, "HEAD", outside);
 	if (!e && idstep) e = dsk_set_option(indr, "DOUBLESTEP", 1);
 	if (!e && odstep) e = dsk_set_option(outdr, "DOUBLESTEP", 1);
+	if (!e && dedup) e = dsk_set_option(outdr, "LDBS:DEDUP", 1);
 	if (!e) e = dsk_set_retry(outdr, retries);
 	if (!e && format == -1)
 	{
@@ -361,6 +370,8 @@ int do_copy(char *infile, char *outfile)
 	}
 abort:
 	printf("\r                                     \r");
+	if (stats && indr)  dump_stats(indr,  infile);
+	if (stats && outdr) dump_stats(outdr, outfile);
 	if (outdr) 
 	{
 		if (!e) e = dsk_close(&outdr); else dsk_close(&outdr);
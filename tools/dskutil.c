@@ -710,25 +710,15 @@ dsk_err_t new_secsize(size_t newsize)
 
 dsk_err_t new_geometry(const char *cmd)
 {
-	int fmt = FMT_180K;
-	dsk_cchar_t fname;
+	dsk_format_t fmt;
 	dsk_err_t err;
-	int found = 0;
 	DSK_GEOMETRY newdg;
 
 	while (cmd[0] == ' ' || cmd[0] == '\t') ++cmd;
 	if (cmd[0]) 
 	{
-		while (dg_stdformat(&newdg, fmt, &fname, NULL) == DSK_ERR_OK)
-		{
-			if (!strcmpi(cmd, fname))
-			{
-				found = 1;
-				break;
-			}
-			++fmt;
-		}
-		if (!found)
+		if (dg_namedformat(cmd, &fmt) != DSK_ERR_OK ||
+		    dg_stdformat(&newdg, fmt, NULL, NULL) != DSK_ERR_OK)
 		{
 			printf("Unknown format name: '%s'\n", cmd);
 			return DSK_ERR_OK;
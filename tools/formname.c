@@ -32,10 +32,9 @@
 
 dsk_format_t check_format(char *arg, int *argc, char **argv)
 {
-	int fmt;
 	int n = find_arg(arg, *argc, argv);
-	dsk_cchar_t fname;
 	char *argname;
+	dsk_format_t fmt;
 
 	if (n < 0) return -1;
 	excise_arg(n, argc, argv);
@@ -46,12 +45,7 @@ dsk_format_t check_format(char *arg, int *argc, char **argv)
 	}
 	argname = argv[n];
 	excise_arg(n, argc, argv);
-	fmt = FMT_180K;
-	while (dg_stdformat(NULL, fmt, &fname, NULL) == DSK_ERR_OK)
-	{
-		if (!strcmpi(argname, fname)) return fmt;
-		++fmt;
-	}
+	if (dg_namedformat(argname, &fmt) == DSK_ERR_OK) return fmt;
 	fprintf(stderr, "Format name %s not recognised.\n", argname);
 	exit(1);
 	return FMT_180K;
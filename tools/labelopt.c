@@ -27,8 +27,8 @@
 #ifdef HAVE_TIME_H
 #include <time.h>
 #endif
-#include "utilopts.h"
 #include "libdsk.h"
+#include "utilopts.h"
 #include "labelopt.h"
 
 
@@ -24,8 +24,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "config.h"
-#include "utilopts.h"
 #include "libdsk.h"
+#include "utilopts.h"
 #ifdef HAVE_WINDOWS_H
 #include <windows.h>
 # ifdef HAVE_WINIOCTL_H
@@ -323,6 +323,72 @@ static const char *known_exts[] =
 };
 
 
+static void trace_finish(void)
+{
+	dsk_trace_chrome(NULL);
+}
+
+
+/* -trace <file>: Write a Chrome trace of all LibDsk calls to <file> */
+void check_trace(char *arg, int *argc, char **argv)
+{
+	int n = find_arg(arg, *argc, argv);
+	char *v;
+
+	if (n < 0) return;
+	excise_arg(n, argc, argv);
+	if (n >= *argc)
+	{
+		fprintf(stderr, "Syntax error: use '%s <filename>'\n", arg);
+		exit(1);
+	}
+	v = argv[n];
+	excise_arg(n, argc, argv);
+
+	if (dsk_trace_chrome(v))
+	{
+		perror(v);
+		exit(1);
+	}
+	atexit(trace_finish);
+}
+
+
+/* Print the operation counters for a drive, for the -stats option */
+void dump_stats(DSK_PDRIVER dsk, const char *label)
+{
+	DSK_STATS st;
+	DSK_OPSTATS *op;
+	int n, b;
+
+	if (dsk_get_stats(dsk, &st)) return;
+	fprintf(stderr, "Statistics for %s (%s):\n", label, dsk_drvname(dsk));
+	fprintf(stderr, "%-9s %8s %7s %7s %10s %10s %8s %8s\n", "Operation",
+		"Calls", "Errors", "Retries", "Bytes", "Total ms", "Mean us",
+		"Max us");
+	for (n = 0; n < DSK_OP_MAX; n++)
+	{
+		op = &st.st_op[n];
+		if (!op->ds_calls) continue;
+		fprintf(stderr, "%-9s %8lu %7lu %7lu %10lu %10.1f %8lu %8lu\n",
+			dsk_op_name(n), op->ds_calls, op->ds_errors,
+			op->ds_retries, op->ds_bytes, op->ds_total_us / 1000.0,
+			op->ds_total_us / op->ds_calls, op->ds_max_us);
+		fprintf(stderr, "%9s", "");
+		for (b = 0; b < DSK_STATS_BUCKETS; b++)
+		{
+			if (!op->ds_hist[b]) continue;
+			if (b == DSK_STATS_BUCKETS - 1)
+				fprintf(stderr, " >=%luus:%lu", 1UL << b, 
+					op->ds_hist[b]);
+			else	fprintf(stderr, " <%luus:%lu", 2UL << b,
+					op->ds_hist[b]);
+		}
+		fputc('\n', stderr);
+	}
+}
+
+
 const char *guess_type(const char *arg)
 {
 	const char *ext;
@@ -368,6 +434,7 @@ const char *guess_type(const char *arg)
 
 	if (!strncmp(arg, "fork:", 5) || !strncmp(arg, "serial:", 7))
 		return "remote";
+	if (!strncmp(arg, "overlay:", 8)) return "overlay";
 
 	/* Check for known file extensions */
 	ext = strrchr(arg, '.');
@@ -25,3 +25,5 @@ int ignore_arg(char *arg, int count, int *argc, char **argv);
 void args_complete(int *argc, char **argv);
 int version(void);
 const char *guess_type(const char *arg);
+void dump_stats(DSK_PDRIVER dsk, const char *label);
+void check_trace(char *arg, int *argc, char **argv);
@@ -330,6 +330,10 @@ SOURCE=..\lib\drvnwasp.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\lib\drvovly.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\lib\drvposix.c
 
 !IF  "$(CFG)" == "libdsk - Win32 Release"
@@ -454,6 +458,14 @@ SOURCE=..\lib\dskcopy.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\lib\dskdiff.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dskhash.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\lib\dskerror.c
 
 !IF  "$(CFG)" == "libdsk - Win32 Release"
@@ -497,6 +509,34 @@ SOURCE=..\lib\dskiconv.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\lib\dskgcach.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dskpool.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dskfbuf.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dskperf.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dsktrace.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dskfill.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\lib\dskrun.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\lib\dskjni.c
 
 !IF  "$(CFG)" == "libdsk - Win32 Release"
@@ -878,6 +918,10 @@ SOURCE=..\lib\drvmyz80.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\lib\drvovly.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\lib\drvposix.h
 # End Source File
 # Begin Source File